@@ -1,10 +1,13 @@
 #ifndef LIBRARYSCANNER_HPP
 #define LIBRARYSCANNER_HPP
 
+#include <atomic>
 #include "db/SyncDatabase.hpp"
+#include "meta/Metadata.hpp"
 #include <mutex>
 #include <string>
 #include "Types.hpp"
+#include <unordered_map>
 #include <vector>
 
 // The LibraryScanner class searches for audio files in the given path and updates
@@ -47,8 +50,17 @@ class LibraryScanner {
         // Vector of files to remove
         std::vector<FileTuple> removeFiles;
 
+        // Album ReplayGain values found in tags (album name -> values)
+        std::unordered_map<std::string, Metadata::ReplayGain> albumGains;
+        std::mutex albumMutex;
+
+        // Loudness analysis statistics
+        std::atomic<size_t> analysedFiles;
+        std::atomic<unsigned long long> analysisMicros;
+
         // Functions to actually process files on another thread
         std::string parseAlbumArt(const Metadata::Song &);
+        void parseReplayGain(Metadata::Song &, const Metadata::ReplayGain &);
         Status parseFileAdd(const FileTuple &);
         Status parseFileUpdate(const FileTuple &);
 
@@ -60,12 +72,13 @@ class LibraryScanner {
         // Prepare lists of files to add/edit/remove from database
         Status processFiles();
 
-        // Process metadata for each required file
+        // Process metadata for each required file (using multiple threads), which
+        // also measures the loudness of each file without ReplayGain tags
         // Accepts references to variables to update status
         // (current file, total files, estimated remaining time (secs))
         Status processMetadata(std::atomic<size_t> &, std::atomic<size_t> &, std::atomic<size_t> &);
 
-        // Update the database with new data
+        // Update the database with new data (including affected albums' ReplayGain)
         // !! Assumes that the database is locked for writing before calling !!
         Status updateDatabase();
 
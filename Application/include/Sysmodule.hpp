@@ -6,9 +6,17 @@
 #include <functional>
 #include <mutex>
 #include <queue>
+#include <switch.h>
 #include "Types.hpp"
 #include <vector>
 
+namespace TriPlayer {
+    struct MemoryUsage;
+    struct QueueChange;
+    struct QueueEdit;
+    struct Stats;
+};
+
 // The sysmodule class communicates with the sysmodule via IPC calls.
 // All values are cached, allowing for fast access and no race conditions!
 class Sysmodule {
@@ -27,6 +35,8 @@ class Sysmodule {
         std::atomic<bool> exit_;
         std::atomic<int> limit_;
         std::chrono::steady_clock::time_point lastUpdateTime;
+        std::atomic<bool> subscribed;           // Set true once stateEvent has been received from the sysmodule
+        Event stateEvent;                       // Signalled by the sysmodule whenever the state changes
 
         // === Status vars ===
         std::atomic<SongID> currentSong_;
@@ -37,7 +47,10 @@ class Sysmodule {
         std::atomic<double> position_;
         std::atomic<bool> queueChanged_;        // Set true when the whole queue has been updated (not just a single song)
         std::vector<SongID> queue_;
-        std::mutex queueMutex;
+        std::mutex queueMutex;                  // Protects queue_ and the edits below (lock before subQueueMutex)
+        std::vector<TriPlayer::QueueChange> queueChanges_;  // Edits applied to both queues since queueChanges() was last called
+        bool queueChangesValid;                 // Set false when the edits above are incomplete (e.g. the queues were fetched in full)
+        std::atomic<uint64_t> queueVersion;     // Version of the sysmodule's queues that queue_ and subQueue_ match
         std::atomic<size_t> queueSize_;
         std::atomic<RepeatMode> repeatMode_;
         std::atomic<ShuffleMode> shuffleMode_;
@@ -46,6 +59,7 @@ class Sysmodule {
         std::mutex subQueueMutex;
         std::atomic<size_t> subQueueSize_;
         std::atomic<size_t> songIdx_;
+        std::atomic<uint64_t> stateGeneration; // Generation of the last state snapshot applied
         std::atomic<PlaybackStatus> status_;
         std::atomic<double> volume_;
         // ======
@@ -53,10 +67,17 @@ class Sysmodule {
         // Queue of IPC commands
         std::queue< std::function<bool()> > ipcQueue;
         std::mutex ipcMutex;
+        UEvent ipcEvent;                        // Signalled when a command is added to the queue
 
         // Returns if the message was added to the queue
         bool addToIpcQueue(std::function<bool()>);
 
+        // Fetch both queues in full (run on the IPC thread)
+        bool fetchQueues();
+        // Apply the edits made to the sysmodule's queues since they were last fetched, or fetch
+        // them in full if the sysmodule no longer has them (run on the IPC thread)
+        bool syncQueues();
+
     public:
         // Constructor creates a socket and attempts connection to sysmodule
         Sysmodule();
@@ -81,6 +102,10 @@ class Sysmodule {
         double position();
         bool queueChanged();
         std::vector<SongID> queue();
+        // Moves the edits made to both queues since the last call into the first vector, and copies the
+        // queues they result in into the others. Returns false if the edits are incomplete, in which case
+        // they should be ignored and the queues compared in full
+        bool queueChanges(std::vector<TriPlayer::QueueChange> &, std::vector<SongID> &, std::vector<SongID> &);
         size_t queueSize();
         RepeatMode repeatMode();
         ShuffleMode shuffleMode();
@@ -95,6 +120,8 @@ class Sysmodule {
         bool waitRequestDBLock();
         bool waitReset();
         size_t waitSongIdx();
+        bool waitGetStats(TriPlayer::Stats &);
+        bool waitGetMemoryUsage(std::vector<TriPlayer::MemoryUsage> &);
 
         // === Send command to sysmodule ===
         // Updates relevant variable when reply received or sets error() true
@@ -122,11 +149,18 @@ class Sysmodule {
 
         void sendGetQueue();
         void sendGetQueueSize();
+        void sendSyncQueues();
         void sendSetQueue(const std::vector<SongID> &);
 
         void sendGetSongIdx();
         void sendSetSongIdx(const size_t);
         void sendRemoveFromQueue(const size_t);
+        // Edits to a range of songs in the main queue, each sent in one call
+        void sendInsertIntoQueue(const size_t, const std::vector<SongID> &);
+        void sendRemoveFromQueue(const size_t, const size_t);
+        void sendMoveInQueue(const size_t, const size_t, const size_t);
+        // Apply the edits in order as one call (none are applied if any are invalid)
+        void sendEditQueue(const std::vector<TriPlayer::QueueEdit> &);
 
         // Shuffle/repeat
         void sendGetRepeat();
@@ -136,6 +170,7 @@ class Sysmodule {
         void sendSetShuffle(const ShuffleMode);
 
         // Status
+        void sendGetState();
         void sendGetSong();
         void sendGetStatus();
 
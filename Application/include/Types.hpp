@@ -78,6 +78,8 @@ namespace Metadata {
         std::string path;           // Path of associated file
         AudioFormat format;         // Audio format song is stored in
         unsigned int modified;      // Timestamp file was last modified
+        float gain;                 // ReplayGain of track in dB
+        float peak;                 // Peak of track (linear, 0 if not measured)
     };
 
     struct PlaylistSong {
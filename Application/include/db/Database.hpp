@@ -76,6 +76,8 @@ class Database {
         // ===== Album Metadata ===== //
         // Update an album's metadata (grabs ID from struct)
         bool updateAlbum(Metadata::Album);
+        // Set an album's ReplayGain (gain in dB, peak as linear)
+        bool updateAlbumGain(AlbumID, float, float);
         // Returns metadata for all stored albums
         // Empty if no albums or an error occurred
         std::vector<Metadata::Album> getAllAlbumMetadata(SortBy);
@@ -0,0 +1,13 @@
+#ifndef MIGRATION_8_HPP
+#define MIGRATION_8_HPP
+
+#include "SQLite.hpp"
+#include <string>
+
+// Migration 8
+// Adds ReplayGain columns to the Songs and Albums tables
+namespace Migration {
+    std::string migrateTo8(SQLite *);
+};
+
+#endif
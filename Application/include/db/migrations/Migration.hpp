@@ -9,5 +9,6 @@
 #include "db/migrations/5_UpdateSearch.hpp"
 #include "db/migrations/6_RemoveImages.hpp"
 #include "db/migrations/7_AddAudioFormat.hpp"
+#include "db/migrations/8_AddLoudness.hpp"
 
 #endif
\ No newline at end of file
@@ -0,0 +1,74 @@
+#ifndef METADATA_LOUDNESS_HPP
+#define METADATA_LOUDNESS_HPP
+
+#include <array>
+#include <string>
+#include "Types.hpp"
+#include <vector>
+
+// Loudness measurement used to calculate ReplayGain values when scanning.
+// Integrated loudness follows ITU-R BS.1770 / EBU R128 (K-weighting, 400ms blocks
+// with 75% overlap, absolute and relative gating) and peaks are measured after
+// oversampling by four (true peak). Gains are relative to ReplayGain 2.0's -18 LUFS.
+namespace Metadata::Loudness {
+    // Loudness tracks are normalized to (in LUFS)
+    constexpr float referenceLoudness = -18.0f;
+
+    // Result of a measurement
+    struct Result {
+        float gain;                 // Gain to reach the reference loudness (dB)
+        float peak;                 // True peak (linear, 0 on error/silence)
+    };
+
+    // The Meter class measures a stream of interleaved float samples. Any number of
+    // samples can be passed to process() at once, with the result available at any time.
+    // This class is not thread-safe!
+    class Meter {
+        private:
+            // State of a single biquad
+            struct Biquad {
+                double b0, b1, b2, a1, a2;
+                double z1, z2;
+            };
+
+            int channels;                               // Number of channels
+            std::vector<Biquad> shelf;                  // K-weighting high shelf for each channel
+            std::vector<Biquad> highpass;               // K-weighting high pass for each channel
+
+            size_t hopSize;                             // Number of frames in 100ms
+            size_t hopFrames;                           // Frames in the current hop
+            double hopEnergy;                           // Energy of the current hop
+            std::array<double, 4> hops;                 // Energy of the last four hops (one block)
+            size_t hopCount;                            // Total number of hops completed
+            std::vector<double> blocks;                 // Mean energy of each block above the absolute gate
+
+            bool oversample;                            // Whether the rate is low enough to oversample
+            std::vector<float> history;                 // Previous samples of each channel used for interpolation
+            size_t historyPos;                          // Position to write the next sample into history
+            float peak_;                                // Highest (absolute) value seen
+
+        public:
+            // Constructor takes sample rate and number of channels
+            Meter(long, int);
+
+            // Measure the given number of frames
+            void process(const float *, size_t);
+
+            // Returns the integrated loudness of everything processed so far (LUFS)
+            // Returns a value below -70 if there's nothing loud enough to measure
+            double loudness();
+            // Returns the true peak of everything processed so far (linear)
+            float peak();
+    };
+
+    // Decodes and measures the given file
+    // Returns a peak of zero if the file couldn't be decoded or is silent
+    Result measureFile(const std::string &, const AudioFormat);
+
+    // Calculates an album's gain and peak from its songs' values, as the duration weighted mean energy of the
+    // songs' loudness (an approximation: the album's blocks aren't gated together, see the definition)
+    // Songs which haven't been measured are ignored, returning a peak of zero if there are none
+    Result combine(const std::vector<Song> &);
+};
+
+#endif
@@ -14,6 +14,16 @@ namespace Metadata {
         Success     // Artist and image found/downloaded
     };
 
+    // ReplayGain values found in a file's tags
+    struct ReplayGain {
+        bool hasTrack;              // Whether track values were found
+        float trackGain;            // Track gain (dB)
+        float trackPeak;            // Track peak (linear, 1.0 if only the gain was found)
+        bool hasAlbum;              // Whether album values were found
+        float albumGain;            // Album gain (dB)
+        float albumPeak;            // Album peak (linear, 1.0 if only the gain was found)
+    };
+
     // Searches for an album image given the album's name
     // Accepts name, buffer to fill with image, int to fill with ID
     DownloadResult downloadAlbumImage(const std::string &, std::vector<unsigned char> &, int &);
@@ -26,9 +36,9 @@ namespace Metadata {
     // Returns an empty vector if no art is found
     std::vector<unsigned char> readArtFromFile(const std::string &, const AudioFormat);
 
-    // Extracts metadata from the specified file
+    // Extracts metadata from the specified file, filling the given struct with any ReplayGain tags
     // Returned ID is -1 on success, -2 on success but not enough tags, -3 on fatal error
-    Song readFromFile(const std::string &, const AudioFormat);
+    Song readFromFile(const std::string &, const AudioFormat, ReplayGain &);
 };
 
 #endif
\ No newline at end of file
@@ -11,6 +11,9 @@ namespace CustomElm::ListItem {
 namespace CustomOvl {
     class ItemMenu;
 }
+namespace TriPlayer {
+    struct QueueChange;
+};
 
 namespace Frame {
     class Queue : public Frame {
@@ -43,6 +46,7 @@ namespace Frame {
             // "Cached" variables for updating
             size_t cachedSongIdx;
             SongID cachedSongID;
+            std::vector<SongID> cachedFullQueue;    // Whole main queue (cachedQueue is the part after the playing song)
             std::vector<SongID> cachedQueue;
             std::vector<SongID> cachedSubQueue;
 
@@ -59,6 +63,22 @@ namespace Frame {
             // Update list elements
             void updateList();
 
+            // Show or hide the sub-queue's heading
+            void setQueueHeading(const bool);
+            // Create an element for the song and insert it before the given one in the section
+            void insertListSong(const SongID, const Section, std::list<CustomElm::ListItem::Song *>::iterator);
+            // Remove the element from the section, returning the one after it
+            std::list<CustomElm::ListItem::Song *>::iterator eraseListSong(const Section, std::list<CustomElm::ListItem::Song *>::iterator);
+            // Remove every song element
+            void clearListSongs();
+
+            // Apply the edit to the IDs and the section's elements, which show the IDs from the given
+            // position onwards (moved along with the songs shown). Returns false if it doesn't fit the IDs
+            bool applyChange(const TriPlayer::QueueChange &, const Section, std::vector<SongID> &, size_t &);
+            // Apply the edits to the cached queues and elements, then move 'Up Next' to follow the
+            // given song index. Returns false if the result doesn't match the given queues
+            bool applyChanges(const std::vector<TriPlayer::QueueChange> &, const size_t, const std::vector<SongID> &, const std::vector<SongID> &);
+
             // Create a ListItem::Song for given id
             CustomElm::ListItem::Song * getListSong(size_t, Section);
 
@@ -0,0 +1,33 @@
+#ifndef FRAME_SETTINGS_SYSDIAGNOSTICS
+#define FRAME_SETTINGS_SYSDIAGNOSTICS
+
+#include "ui/frame/settings/Frame.hpp"
+
+namespace TriPlayer {
+    struct MemoryUsage;
+    struct Stats;
+};
+
+namespace Frame::Settings {
+    // Shows the sysmodule's performance counters
+    class SysDiagnostics : public Frame {
+        private:
+            // Shown when the sysmodule doesn't respond
+            Aether::ListComment * error;
+            // Memory used by each subsystem (as of the last refresh)
+            std::vector<TriPlayer::MemoryUsage> memory;
+            // Each row and the function which returns it's value
+            std::vector< std::pair<Aether::ListOption *, std::function<std::string(const TriPlayer::Stats &)> > > rows;
+
+            // Add a row to the list
+            void addRow(const std::string &, std::function<std::string(const TriPlayer::Stats &)>);
+            // Query the sysmodule and update each row
+            void refresh();
+
+        public:
+            // Constructor creates all elements
+            SysDiagnostics(Main::Application *);
+    };
+};
+
+#endif
@@ -35,6 +35,7 @@ namespace Screen {
             CustomElm::SideButton * buttonAppAdvanced;
             CustomElm::SideButton * buttonSysGeneral;
             CustomElm::SideButton * buttonSysMP3;
+            CustomElm::SideButton * buttonSysDiagnostics;
             CustomElm::SideButton * buttonAbout;
             Aether::Ellipse * updateDot;
 
@@ -49,6 +50,7 @@ namespace Screen {
 
             void setupSysGeneral();
             void setupSysMP3();
+            void setupSysDiagnostics();
 
             void setupAbout();
 
@@ -3,14 +3,20 @@
 #include <future>
 #include "LibraryScanner.hpp"
 #include "Log.hpp"
+#include "meta/Loudness.hpp"
 #include "meta/Metadata.hpp"
 #include "Paths.hpp"
+#include <thread>
+#include <unordered_set>
 #include "utils/FS.hpp"
 #include "utils/Image.hpp"
 #include "utils/NX.hpp"
 #include "utils/Timer.hpp"
 #include "utils/Utils.hpp"
 
+// Maximum number of threads used to process metadata (the application is given three cores)
+static constexpr size_t maxThreads = 3;
+
 // List of accepted extensions (case insensitive, but these must be lowercase)
 static const std::vector< std::pair<std::string, AudioFormat> > allowedTypes = {
     {".flac", AudioFormat::FLAC},
@@ -26,7 +32,8 @@ bool LibraryScanner::FileTupleComparator(const FileTuple & lhs, const FileTuple
 }
 
 LibraryScanner::LibraryScanner(const SyncDatabase & db, const std::string & path) : database(db), searchPath(path) {
-
+    this->analysedFiles = 0;
+    this->analysisMicros = 0;
 }
 
 std::string LibraryScanner::parseAlbumArt(const Metadata::Song & meta) {
@@ -59,15 +66,41 @@ std::string LibraryScanner::parseAlbumArt(const Metadata::Song & meta) {
     return filename;
 }
 
+void LibraryScanner::parseReplayGain(Metadata::Song & meta, const Metadata::ReplayGain & rg) {
+    // Use the track's tags if present, otherwise measure the file
+    if (rg.hasTrack) {
+        meta.gain = rg.trackGain;
+        meta.peak = rg.trackPeak;
+
+    } else {
+        Utils::Timer timer = Utils::Timer();
+        timer.start();
+        Metadata::Loudness::Result result = Metadata::Loudness::measureFile(meta.path, meta.format);
+        meta.gain = result.gain;
+        meta.peak = result.peak;
+        this->analysisMicros += static_cast<unsigned long long>(timer.elapsedMillis() * 1000.0);
+        this->analysedFiles++;
+    }
+
+    // Album values are only taken from tags, which should be the same for every song of the album, so the
+    // first song found with them is used. Otherwise they're combined from the songs' values in updateDatabase()
+    if (rg.hasAlbum) {
+        std::scoped_lock<std::mutex> mtx(this->albumMutex);
+        this->albumGains.emplace(meta.album, rg);
+    }
+}
+
 LibraryScanner::Status LibraryScanner::parseFileAdd(const FileTuple & file) {
     // Read tags and data from file
-    Metadata::Song meta = Metadata::readFromFile(file.path, file.format);
+    Metadata::ReplayGain rg;
+    Metadata::Song meta = Metadata::readFromFile(file.path, file.format, rg);
     if (meta.ID == -3) {
         Log::writeError("[SCAN] [ADD] Failed to parse file: " + file.path);
         return Status::ErrUnknown;
     }
     meta.path = file.path;
     meta.modified = file.modifiedTime;
+    this->parseReplayGain(meta, rg);
 
     // Append to metadata vector
     std::scoped_lock<std::mutex> mtx(this->addMutex);
@@ -77,11 +110,13 @@ LibraryScanner::Status LibraryScanner::parseFileAdd(const FileTuple & file) {
 
 LibraryScanner::Status LibraryScanner::parseFileUpdate(const FileTuple & file) {
     // Read new tags and data from file
-    Metadata::Song newMeta = Metadata::readFromFile(file.path, file.format);
+    Metadata::ReplayGain rg;
+    Metadata::Song newMeta = Metadata::readFromFile(file.path, file.format, rg);
     if (newMeta.ID == -3) {
         Log::writeError("[SCAN] [UPDATE] Failed to parse file: " + file.path);
         return Status::ErrUnknown;
     }
+    this->parseReplayGain(newMeta, rg);
 
     // Read old data from database (also thread-safe due to wrapper) and merge
     std::string tmp = file.path;
@@ -98,6 +133,8 @@ LibraryScanner::Status LibraryScanner::parseFileUpdate(const FileTuple & file) {
     meta.trackNumber = newMeta.trackNumber;
     meta.discNumber = newMeta.discNumber;
     meta.modified = file.modifiedTime;
+    meta.gain = newMeta.gain;
+    meta.peak = newMeta.peak;
 
     // Append to metadata vector
     std::scoped_lock<std::mutex> mtx(this->updateMutex);
@@ -212,53 +249,77 @@ LibraryScanner::Status LibraryScanner::processMetadata(std::atomic<size_t> & cur
     estRemaining = 0;
     currentFile = 1;
     totalFiles = this->addFiles.size() + this->updateFiles.size();
-    Status status = Status::Ok;
 
     // Timer used to estimate remaining time
     Utils::Timer timer = Utils::Timer();
     timer.start();
 
-    // Parse files that need to be added first, then updated
-    std::vector<FileTuple> dummy;
-    std::vector<FileTuple> & vec = dummy;
-    for (size_t v = 0; v < 2; v++) {
-        // Get reference to appropriate vector
-        switch (v) {
-            case 0:
-                vec = this->addFiles;
-                break;
-
-            case 1:
-                vec = this->updateFiles;
-                break;
-
-            default:
-                return Status::ErrUnknown;
-                break;
-        }
-
-        // Iterate over each vector
-        for (size_t i = 0; i < vec.size(); i++) {
-            status = (v == 0 ? this->parseFileAdd(vec[i]) : this->parseFileUpdate(vec[i]));
+    // Files are handed out to each thread in order (added first, then updated), as decoding
+    // to measure loudness takes far longer than reading tags
+    std::atomic<size_t> nextFile = 0;
+    std::atomic<bool> error = false;
+    Status status = Status::Ok;
+    std::mutex statusMutex;
+    auto worker = [&]() {
+        size_t i;
+        while (!error && (i = nextFile++) < totalFiles) {
+            Status result;
+            if (i < this->addFiles.size()) {
+                result = this->parseFileAdd(this->addFiles[i]);
+            } else {
+                result = this->parseFileUpdate(this->updateFiles[i - this->addFiles.size()]);
+            }
 
             // Increment counter and adjust remaining time
-            estRemaining = (timer.elapsedSeconds() / (double)currentFile) * (totalFiles - currentFile);
-            currentFile++;
-
-            // Return if an error occurred
-            if (status != Status::Ok) {
-                Log::writeError("[SCAN] Error occurred during metadata scan");
-                return status;
+            size_t done = currentFile++;
+            size_t total = totalFiles;
+            estRemaining = (timer.elapsedSeconds() / (double)done) * (total - (done < total ? done : total));
+
+            // Stop all threads if an error occurred
+            if (result != Status::Ok) {
+                std::scoped_lock<std::mutex> mtx(statusMutex);
+                status = result;
+                error = true;
             }
         }
+    };
+
+    size_t threads = std::thread::hardware_concurrency();
+    threads = (threads == 0 ? 1 : (threads > maxThreads ? maxThreads : threads));
+    std::vector<std::future<void> > workers;
+    for (size_t t = 1; t < threads; t++) {
+        workers.push_back(std::async(std::launch::async, worker));
+    }
+    worker();
+    for (std::future<void> & f : workers) {
+        f.get();
     }
+    timer.stop();
 
-    // We get here once all are completed and no error occurred
+    if (status != Status::Ok) {
+        Log::writeError("[SCAN] Error occurred during metadata scan");
+        return status;
+    }
+
+    // Keep the same order as the files were found in
+    auto comparator = [](const Metadata::Song & lhs, const Metadata::Song & rhs) {
+        return lhs.path < rhs.path;
+    };
+    std::sort(this->addMeta.begin(), this->addMeta.end(), comparator);
+    std::sort(this->updateMeta.begin(), this->updateMeta.end(), comparator);
+
+    // Log how much of the time was spent measuring loudness (which is summed across threads)
+    const double analysisSecs = this->analysisMicros / 1000000.0;
+    Log::writeInfo("[SCAN] Processed " + std::to_string(totalFiles) + " files in " + std::to_string(timer.elapsedSeconds()) + "s using " + std::to_string(threads) + " threads");
+    Log::writeInfo("[SCAN] Measured loudness of " + std::to_string(this->analysedFiles) + " files in " + std::to_string(analysisSecs) + "s (thread time)");
     Log::writeSuccess("[SCAN] Song metadata processed successfully");
     return Status::Ok;
 }
 
 LibraryScanner::Status LibraryScanner::updateDatabase() {
+    // Albums which need their ReplayGain recalculated
+    std::unordered_set<AlbumID> albums;
+
     // Add songs first
     for (size_t i = 0; i < this->addMeta.size(); i++) {
         bool ok = this->database->addSong(this->addMeta[i]);
@@ -277,11 +338,25 @@ LibraryScanner::Status LibraryScanner::updateDatabase() {
         }
     }
 
-    // And finally remove songs
+    // Mark the albums of added/updated songs
+    for (size_t v = 0; v < 2; v++) {
+        std::vector<Metadata::Song> & vec = (v == 0 ? this->addMeta : this->updateMeta);
+        for (size_t i = 0; i < vec.size(); i++) {
+            AlbumID id = this->database->getAlbumIDForSong(this->database->getSongIDForPath(vec[i].path));
+            if (id >= 0) {
+                albums.insert(id);
+            }
+        }
+    }
+
+    // And finally remove songs (noting their albums beforehand)
     bool ok = true;
     for (size_t i = 0; i < this->removeFiles.size(); i++) {
         std::string tmp = this->removeFiles[i].path;
         SongID id = this->database->getSongIDForPath(tmp);
+        if (id >= 0) {
+            albums.insert(this->database->getAlbumIDForSong(id));
+        }
         (id >= 0 ? ok = this->database->removeSong(id) : ok = false);
         if (!ok) {
             Log::writeError("[SCAN] Error removing song: " + this->removeFiles[i].path);
@@ -289,6 +364,28 @@ LibraryScanner::Status LibraryScanner::updateDatabase() {
         }
     }
 
+    // Update each affected album's ReplayGain, preferring values found in tags. Otherwise it's the duration weighted
+    // energy average of the songs' results, not a gated measurement of the whole album (see Loudness::combine())
+    // (albums which were deleted along with their songs won't have any songs left)
+    for (AlbumID id : albums) {
+        std::vector<Metadata::Song> songs = this->database->getSongMetadataForAlbum(id);
+        if (songs.empty()) {
+            continue;
+        }
+
+        Metadata::Loudness::Result result = Metadata::Loudness::combine(songs);
+        std::unordered_map<std::string, Metadata::ReplayGain>::iterator it = this->albumGains.find(songs[0].album);
+        if (it != this->albumGains.end()) {
+            result.gain = it->second.albumGain;
+            result.peak = it->second.albumPeak;
+        }
+
+        if (!this->database->updateAlbumGain(id, result.gain, result.peak)) {
+            Log::writeError("[SCAN] Error updating gain of album: " + songs[0].album);
+            return Status::ErrDatabase;
+        }
+    }
+
     Log::writeSuccess("[SCAN] Database successfully updated");
     return Status::Ok;
 }
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include "ipc/TriPlayer.hpp"
 #include <limits>
 #include "Log.hpp"
@@ -9,6 +10,65 @@
 
 // Number of seconds between updating state (automatically)
 #define UPDATE_DELAY 0.1
+// Number of seconds between updating state while the sysmodule tells us about changes
+// and nothing is playing (only a fallback in case one is missed)
+#define IDLE_UPDATE_DELAY 1.0
+// Maximum number of queue edits kept for queueChanges() (any more and the queues are compared instead)
+#define MAX_QUEUE_CHANGES 500
+
+// Convert the sysmodule's repeat mode to the app's
+static RepeatMode toRepeatMode(const TriPlayer::Repeat r) {
+    switch (r) {
+        case TriPlayer::Repeat::One:
+            return RepeatMode::One;
+
+        case TriPlayer::Repeat::All:
+            return RepeatMode::All;
+
+        default:
+            return RepeatMode::Off;
+    }
+}
+
+// Apply an edit received from the sysmodule to a copy of a queue
+static void applyQueueChange(std::vector<SongID> & ids, const TriPlayer::QueueChange & change) {
+    switch (change.type) {
+        case TriPlayer::Change::Insert:
+            ids.insert(ids.begin() + std::min<size_t>(change.pos, ids.size()), change.id);
+            break;
+
+        case TriPlayer::Change::Remove:
+            if (change.pos < ids.size()) {
+                ids.erase(ids.begin() + change.pos, ids.begin() + std::min<size_t>(change.pos + change.value, ids.size()));
+            }
+            break;
+
+        case TriPlayer::Change::Move:
+            if (change.pos < ids.size()) {
+                SongID id = ids[change.pos];
+                ids.erase(ids.begin() + change.pos);
+                ids.insert(ids.begin() + std::min<size_t>(change.value, ids.size()), id);
+            }
+            break;
+    }
+}
+
+// Convert the sysmodule's playback status to the app's
+static PlaybackStatus toPlaybackStatus(const TriPlayer::Status s) {
+    switch (s) {
+        case TriPlayer::Status::Playing:
+            return PlaybackStatus::Playing;
+
+        case TriPlayer::Status::Paused:
+            return PlaybackStatus::Paused;
+
+        case TriPlayer::Status::Stopped:
+            return PlaybackStatus::Stopped;
+
+        default:
+            return PlaybackStatus::Error;
+    }
+}
 
 bool Sysmodule::addToIpcQueue(std::function<bool()> f) {
     if (this->error_ != Error::None) {
@@ -17,6 +77,7 @@ bool Sysmodule::addToIpcQueue(std::function<bool()> f) {
 
     std::scoped_lock<std::mutex> mtx(this->ipcMutex);
     this->ipcQueue.push(f);
+    ueventSignal(&this->ipcEvent);
     return true;
 }
 
@@ -25,6 +86,9 @@ Sysmodule::Sysmodule() {
     this->connected_ = false;
     this->error_ = Error::Unknown;
     this->limit_ = -1;
+    this->queueVersion = 0;
+    this->subscribed = false;
+    ueventCreate(&this->ipcEvent, true);
     this->reconnect();
 
     // Initialize all variables
@@ -36,17 +100,18 @@ Sysmodule::Sysmodule() {
     this->playingFrom_ = "";
     this->position_ = 0.0;
     this->queueChanged_ = false;
+    this->queueChangesValid = false;
     this->queueSize_ = 0;
     this->repeatMode_ = RepeatMode::Off;
     this->shuffleMode_ = ShuffleMode::Off;
     this->songIdx_ = 0;
+    this->stateGeneration = 0;
     this->subQueueChanged_ = false;
     this->status_ = PlaybackStatus::Stopped;
     this->volume_ = 100.0;
 
     // Fetch queue at launch
-    this->sendGetQueue();
-    this->sendGetSubQueue();
+    this->sendSyncQueues();
 }
 
 Sysmodule::Error Sysmodule::error() {
@@ -87,9 +152,31 @@ void Sysmodule::reconnect() {
         return;
     }
 
-    // If we reach here we're connected successfully!
+    // If we reach here we're connected successfully! Force the next snapshot to be applied
+    // as the sysmodule may have restarted
+    this->stateGeneration = 0;
+    this->queueVersion = 0;
     Log::writeSuccess("[SYSMODULE] Connection established!");
     this->error_ = Error::None;
+
+    // Ask to be told about state changes (replacing the event on the processing thread, as
+    // it may be waiting on the old one). Polling still works if this fails
+    this->ipcQueue.push([this]() -> bool {
+        if (this->subscribed) {
+            eventClose(&this->stateEvent);
+            this->subscribed = false;
+        }
+
+        uint32_t handle;
+        if (TriPlayer::subscribe(handle)) {
+            eventLoadRemote(&this->stateEvent, handle, true);
+            this->subscribed = true;
+        } else {
+            Log::writeWarning("[SYSMODULE] Couldn't subscribe to state changes, polling instead");
+        }
+        return true;
+    });
+    ueventSignal(&this->ipcEvent);
 }
 
 bool Sysmodule::terminate() {
@@ -112,6 +199,7 @@ bool Sysmodule::terminate() {
         done = true;
         return ok;
     });
+    ueventSignal(&this->ipcEvent);
 
     // Now wait for function to run and return result!
     mtx.unlock();
@@ -163,23 +251,29 @@ void Sysmodule::process() {
         }
         mtx.unlock();
 
-        // Check if variables need to be updated
+        // Check if variables need to be updated (the position needs polling while playing, but
+        // otherwise the sysmodule signals us when something changes)
         now = std::chrono::steady_clock::now();
-        if (std::chrono::duration_cast< std::chrono::duration<double> >(now - this->lastUpdateTime).count() > UPDATE_DELAY) {
-            this->sendGetPlayingFrom();
-            this->sendGetPosition();
-            this->sendGetQueueSize();
-            this->sendGetRepeat();
-            this->sendGetShuffle();
-            this->sendGetSong();
-            this->sendGetSongIdx();
-            this->sendGetSubQueueSize();
-            this->sendGetStatus();
-            this->sendGetVolume();
+        double elapsed = std::chrono::duration_cast< std::chrono::duration<double> >(now - this->lastUpdateTime).count();
+        double delay = (this->subscribed && this->status_ != PlaybackStatus::Playing ? IDLE_UPDATE_DELAY : UPDATE_DELAY);
+        if (elapsed > delay) {
+            this->sendGetState();
             this->lastUpdateTime = now;
+            continue;
+        }
 
+        // Otherwise block until a command is queued, the state changes or the next update is due
+        s32 idx = -1;
+        uint64_t timeout = (delay - elapsed) * 1000000000;
+        ::Result rc;
+        if (this->subscribed) {
+            rc = waitMulti(&idx, timeout, waiterForUEvent(&this->ipcEvent), waiterForEvent(&this->stateEvent));
         } else {
-            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            rc = waitMulti(&idx, timeout, waiterForUEvent(&this->ipcEvent));
+        }
+        if (R_SUCCEEDED(rc) && idx == 1) {
+            this->sendGetState();
+            this->lastUpdateTime = std::chrono::steady_clock::now();
         }
     }
 }
@@ -212,6 +306,17 @@ std::vector<SongID> Sysmodule::queue() {
     return this->queue_;
 }
 
+bool Sysmodule::queueChanges(std::vector<TriPlayer::QueueChange> & changes, std::vector<SongID> & queue, std::vector<SongID> & subQueue) {
+    std::scoped_lock<std::mutex, std::mutex> mtx(this->queueMutex, this->subQueueMutex);
+    bool valid = this->queueChangesValid;
+    changes.swap(this->queueChanges_);
+    this->queueChanges_.clear();
+    this->queueChangesValid = true;
+    queue = this->queue_;
+    subQueue = this->subQueue_;
+    return valid;
+}
+
 size_t Sysmodule::queueSize() {
     return this->queueSize_;
 }
@@ -317,6 +422,50 @@ size_t Sysmodule::waitSongIdx() {
     return this->songIdx_;
 }
 
+bool Sysmodule::waitGetStats(TriPlayer::Stats & stats) {
+    std::atomic<bool> done = false;
+    std::atomic<bool> ok = false;
+
+    // Query performance counters
+    this->addToIpcQueue([&stats, &done, &ok]() -> bool {
+        ok = TriPlayer::getStats(stats);
+        done = true;
+        return ok;
+    });
+
+    // Block until done
+    while (!done) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        if (this->error_ != Error::None) {
+            return false;
+        }
+    }
+
+    return ok;
+}
+
+bool Sysmodule::waitGetMemoryUsage(std::vector<TriPlayer::MemoryUsage> & usage) {
+    std::atomic<bool> done = false;
+    std::atomic<bool> ok = false;
+
+    // Query memory usage
+    this->addToIpcQueue([&usage, &done, &ok]() -> bool {
+        ok = TriPlayer::getMemoryUsage(usage);
+        done = true;
+        return ok;
+    });
+
+    // Block until done
+    while (!done) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        if (this->error_ != Error::None) {
+            return false;
+        }
+    }
+
+    return ok;
+}
+
 void Sysmodule::sendResume() {
     this->addToIpcQueue([]() -> bool {
         return TriPlayer::resume();
@@ -384,9 +533,10 @@ void Sysmodule::sendGetSubQueue() {
         std::vector<SongID> ids;
         bool b = TriPlayer::getSubQueue(ids);
         if (b) {
-            std::scoped_lock<std::mutex> mtx(this->subQueueMutex);
+            std::scoped_lock<std::mutex, std::mutex> mtx(this->queueMutex, this->subQueueMutex);
             this->subQueue_ = ids;
             this->subQueueChanged_ = true;
+            this->queueChangesValid = false;
         }
         return b;
     });
@@ -433,6 +583,7 @@ void Sysmodule::sendGetQueue() {
             std::scoped_lock<std::mutex> mtx(this->queueMutex);
             this->queue_ = ids;
             this->queueChanged_ = true;
+            this->queueChangesValid = false;
         }
         return b;
     });
@@ -453,6 +604,74 @@ void Sysmodule::sendGetQueueSize() {
     });
 }
 
+void Sysmodule::sendSyncQueues() {
+    this->addToIpcQueue([this]() -> bool {
+        return this->syncQueues();
+    });
+}
+
+bool Sysmodule::fetchQueues() {
+    // Fetch again if the queues were edited part way through (if they keep being edited give up,
+    // leaving the version unset so they're fetched again next time)
+    std::vector<SongID> queue;
+    std::vector<SongID> subQueue;
+    uint64_t version = 0;
+    for (size_t i = 0; i < 3 && version == 0; i++) {
+        TriPlayer::State before;
+        TriPlayer::State after;
+        if (!TriPlayer::getState(before) || !TriPlayer::getQueue(queue) || !TriPlayer::getSubQueue(subQueue) || !TriPlayer::getState(after)) {
+            return false;
+        }
+        if (before.queueVersion == after.queueVersion) {
+            version = after.queueVersion;
+        }
+    }
+
+    std::scoped_lock<std::mutex, std::mutex> mtx(this->queueMutex, this->subQueueMutex);
+    this->queue_ = queue;
+    this->subQueue_ = subQueue;
+    this->queueChanged_ = true;
+    this->subQueueChanged_ = true;
+    this->queueChanges_.clear();
+    this->queueChangesValid = false;
+    this->queueVersion = version;
+    return true;
+}
+
+bool Sysmodule::syncQueues() {
+    std::vector<TriPlayer::QueueChange> changes;
+    uint64_t version;
+    bool truncated;
+    if (!TriPlayer::getQueueChanges(this->queueVersion, changes, version, truncated)) {
+        return false;
+    }
+    if (truncated) {
+        return this->fetchQueues();
+    }
+    if (changes.empty()) {
+        return true;
+    }
+
+    // Apply the edits to our copies, keeping them for queueChanges() unless there's too many
+    std::scoped_lock<std::mutex, std::mutex> mtx(this->queueMutex, this->subQueueMutex);
+    for (const TriPlayer::QueueChange & change : changes) {
+        applyQueueChange((change.subQueue ? this->subQueue_ : this->queue_), change);
+        if (change.subQueue) {
+            this->subQueueChanged_ = true;
+        } else {
+            this->queueChanged_ = true;
+        }
+    }
+    if (this->queueChangesValid && this->queueChanges_.size() + changes.size() <= MAX_QUEUE_CHANGES) {
+        this->queueChanges_.insert(this->queueChanges_.end(), changes.begin(), changes.end());
+    } else {
+        this->queueChanges_.clear();
+        this->queueChangesValid = false;
+    }
+    this->queueVersion = version;
+    return true;
+}
+
 void Sysmodule::sendSetQueue(const std::vector<SongID> & q) {
     // Don't send empty queues
     if (q.size() == 0 || this->limit_ == 0) {
@@ -496,24 +715,40 @@ void Sysmodule::sendRemoveFromQueue(const size_t pos) {
     });
 }
 
+void Sysmodule::sendInsertIntoQueue(const size_t pos, const std::vector<SongID> & ids) {
+    if (ids.empty()) {
+        return;
+    }
+
+    this->addToIpcQueue([pos, ids]() -> bool {
+        return TriPlayer::insertIntoQueue(pos, ids);
+    });
+}
+
+void Sysmodule::sendRemoveFromQueue(const size_t pos, const size_t count) {
+    this->addToIpcQueue([pos, count]() -> bool {
+        return TriPlayer::removeFromQueue(pos, count);
+    });
+}
+
+void Sysmodule::sendMoveInQueue(const size_t pos, const size_t count, const size_t to) {
+    this->addToIpcQueue([pos, count, to]() -> bool {
+        return TriPlayer::moveInQueue(pos, count, to);
+    });
+}
+
+void Sysmodule::sendEditQueue(const std::vector<TriPlayer::QueueEdit> & edits) {
+    this->addToIpcQueue([edits]() -> bool {
+        return TriPlayer::editQueue(edits);
+    });
+}
+
 void Sysmodule::sendGetRepeat() {
     this->addToIpcQueue([this]() -> bool {
         TriPlayer::Repeat r;
         bool b = TriPlayer::getRepeatMode(r);
         if (b) {
-            switch (r) {
-                case TriPlayer::Repeat::Off:
-                    this->repeatMode_ = RepeatMode::Off;
-                    break;
-
-                case TriPlayer::Repeat::One:
-                    this->repeatMode_ = RepeatMode::One;
-                    break;
-
-                case TriPlayer::Repeat::All:
-                    this->repeatMode_ = RepeatMode::All;
-                    break;
-            }
+            this->repeatMode_ = toRepeatMode(r);
         }
         return b;
     });
@@ -560,13 +795,54 @@ void Sysmodule::sendSetShuffle(const ShuffleMode m) {
         bool b = TriPlayer::setShuffleMode(s);
         if (b) {
             // Get queue on change
-            this->sendGetQueue();
+            this->sendSyncQueues();
             this->shuffleMode_ = m;
         }
         return b;
     });
 }
 
+void Sysmodule::sendGetState() {
+    this->addToIpcQueue([this]() -> bool {
+        TriPlayer::State state;
+        bool b = TriPlayer::getState(state);
+        if (!b) {
+            return b;
+        }
+
+        // The position is always updated, everything else only when the sysmodule
+        // reports that something has changed
+        if (!this->keepPosition) {
+            this->position_ = state.position;
+        }
+        if (state.generation == this->stateGeneration) {
+            return b;
+        }
+        this->stateGeneration = state.generation;
+
+        this->currentSong_ = state.song;
+        this->status_ = toPlaybackStatus(state.status);
+        this->repeatMode_ = toRepeatMode(state.repeat);
+        this->shuffleMode_ = (state.shuffle == TriPlayer::Shuffle::Off ? ShuffleMode::Off : ShuffleMode::On);
+        if (!this->keepVolume) {
+            this->volume_ = state.volume;
+        }
+        {
+            std::scoped_lock<std::mutex> mtx(this->playingFromMutex);
+            this->playingFrom_ = std::string(state.playingFrom);
+        }
+
+        // Catch up with any edits to the queues
+        if (this->queueVersion != state.queueVersion) {
+            this->sendSyncQueues();
+        }
+        this->queueSize_ = state.queueSize;
+        this->songIdx_ = state.queueIdx;
+        this->subQueueSize_ = state.subQueueSize;
+        return b;
+    });
+}
+
 void Sysmodule::sendGetSong() {
     this->addToIpcQueue([this]() -> bool {
         SongID id;
@@ -583,23 +859,7 @@ void Sysmodule::sendGetStatus() {
         TriPlayer::Status s;
         bool b = TriPlayer::getStatus(s);
         if (b) {
-            switch (s) {
-                case TriPlayer::Status::Error:
-                    this->status_ = PlaybackStatus::Error;
-                    break;
-
-                case TriPlayer::Status::Playing:
-                    this->status_ = PlaybackStatus::Playing;
-                    break;
-
-                case TriPlayer::Status::Paused:
-                    this->status_ = PlaybackStatus::Paused;
-                    break;
-
-                case TriPlayer::Status::Stopped:
-                    this->status_ = PlaybackStatus::Stopped;
-                    break;
-            }
+            this->status_ = toPlaybackStatus(s);
         }
         return b;
     });
@@ -663,9 +923,13 @@ void Sysmodule::sendReloadConfig() {
 
 void Sysmodule::exit() {
     this->exit_ = true;
+    ueventSignal(&this->ipcEvent);
 }
 
 Sysmodule::~Sysmodule() {
+    if (this->subscribed) {
+        eventClose(&this->stateEvent);
+    }
     if (this->connected_) {
         TriPlayer::exit();
     }
@@ -10,7 +10,7 @@
 #include "utils/Utils.hpp"
 
 // Version of the database (database begins with zero from 'template', so this started at 1)
-#define DB_VERSION 7
+#define DB_VERSION 8
 // Maximum number of spellfixed words to allow per word (i.e. pick the top x words)
 #define SPELLFIX_LIMIT 6
 // Location of template file
@@ -167,6 +167,14 @@ bool Database::migrate() {
                     break;
                 }
                 Log::writeSuccess("[DB] Migrated to version 7");
+
+            case 7:
+                err = Migration::migrateTo8(this->db);
+                if (!err.empty()) {
+                    err = "Migration 8: " + err;
+                    break;
+                }
+                Log::writeSuccess("[DB] Migrated to version 8");
         }
     }
 
@@ -389,6 +397,29 @@ bool Database::updateAlbum(Metadata::Album m) {
     return ok;
 }
 
+bool Database::updateAlbumGain(AlbumID id, float gain, float peak) {
+    // First check we have write permission
+    if (this->db->connectionType() != SQLite::Connection::ReadWrite) {
+        this->setErrorMsg("[updateAlbumGain] Can't update album as the database is unwritable");
+        return false;
+    }
+
+    bool ok = this->db->prepareQuery("UPDATE Albums SET gain = ?, peak = ? WHERE id = ?;");
+    ok = keepFalse(ok, this->db->bindDouble(0, gain));
+    ok = keepFalse(ok, this->db->bindDouble(1, peak));
+    ok = keepFalse(ok, this->db->bindInt(2, id));
+    if (!ok) {
+        this->setErrorMsg("[updateAlbumGain] An error occurred while preparing the statement");
+        return false;
+    }
+
+    ok = this->db->executeQuery();
+    if (!ok) {
+        this->setErrorMsg("[updateAlbumGain] An error occurred while updating the entry");
+    }
+    return ok;
+}
+
 std::vector<Metadata::Album> Database::getAllAlbumMetadata(Database::SortBy sort) {
     std::vector<Metadata::Album> v;
     // Check we can read
@@ -953,7 +984,7 @@ std::vector<Metadata::PlaylistSong> Database::getSongMetadataForPlaylist(Playlis
     }
 
     // Create a Metadata::Song for each entry given the playlist
-    bool ok = this->db->prepareQuery("SELECT Songs.ID, Songs.title, Artists.name, Albums.name, Songs.track, Songs.disc, Songs.duration, Songs.plays, Songs.favourite, Songs.path, Songs.format, Songs.modified, PlaylistSongs.rowid FROM PlaylistSongs JOIN Songs ON Songs.id = PlaylistSongs.song_id JOIN Albums ON Albums.id = Songs.album_id JOIN Artists ON Artists.id = Songs.artist_id WHERE PlaylistSongs.playlist_id = ? ORDER BY " + orderBy + ";");
+    bool ok = this->db->prepareQuery("SELECT Songs.ID, Songs.title, Artists.name, Albums.name, Songs.track, Songs.disc, Songs.duration, Songs.plays, Songs.favourite, Songs.path, Songs.format, Songs.modified, Songs.gain, Songs.peak, PlaylistSongs.rowid FROM PlaylistSongs JOIN Songs ON Songs.id = PlaylistSongs.song_id JOIN Albums ON Albums.id = Songs.album_id JOIN Artists ON Artists.id = Songs.artist_id WHERE PlaylistSongs.playlist_id = ? ORDER BY " + orderBy + ";");
     ok = keepFalse(ok, this->db->bindInt(0, id));
     ok = keepFalse(ok, this->db->executeQuery());
     if (!ok) {
@@ -963,6 +994,7 @@ std::vector<Metadata::PlaylistSong> Database::getSongMetadataForPlaylist(Playlis
     while (ok && this->db->hasRow()) {
         Metadata::Song m;
         int tmp;
+        double tmpDbl;
         std::string tmpStr;
         ok = this->db->getInt(0, m.ID);
         ok = keepFalse(ok, this->db->getString(1, m.title));
@@ -982,7 +1014,11 @@ std::vector<Metadata::PlaylistSong> Database::getSongMetadataForPlaylist(Playlis
         m.format = audioFormatFromString(tmpStr);
         ok = keepFalse(ok, this->db->getInt(11, tmp));
         m.modified = tmp;
-        ok = keepFalse(ok, this->db->getInt(12, tmp));
+        ok = keepFalse(ok, this->db->getDouble(12, tmpDbl));
+        m.gain = tmpDbl;
+        ok = keepFalse(ok, this->db->getDouble(13, tmpDbl));
+        m.peak = tmpDbl;
+        ok = keepFalse(ok, this->db->getInt(14, tmp));
 
         // Push back PlaylistSong struct if all successful
         if (ok) {
@@ -1060,7 +1096,7 @@ bool Database::addSong(Metadata::Song m) {
     }
 
     // Finally add song
-    ok = this->db->prepareQuery("INSERT INTO Songs (path, format, modified, artist_id, album_id, title, duration, track, disc) VALUES (?, ?, ?, (SELECT id FROM Artists WHERE name = ?), (SELECT id FROM Albums WHERE name = ?), ?, ?, ?, ?);");
+    ok = this->db->prepareQuery("INSERT INTO Songs (path, format, modified, artist_id, album_id, title, duration, track, disc, gain, peak) VALUES (?, ?, ?, (SELECT id FROM Artists WHERE name = ?), (SELECT id FROM Albums WHERE name = ?), ?, ?, ?, ?, ?, ?);");
     ok = keepFalse(ok, this->db->bindString(0, m.path));
     ok = keepFalse(ok, this->db->bindString(1, audioFormatToString(m.format)));
     ok = keepFalse(ok, this->db->bindInt(2, m.modified));
@@ -1070,6 +1106,8 @@ bool Database::addSong(Metadata::Song m) {
     ok = keepFalse(ok, this->db->bindInt(6, m.duration));
     ok = keepFalse(ok, this->db->bindInt(7, m.trackNumber));
     ok = keepFalse(ok, this->db->bindInt(8, m.discNumber));
+    ok = keepFalse(ok, this->db->bindDouble(9, m.gain));
+    ok = keepFalse(ok, this->db->bindDouble(10, m.peak));
     if (!ok) {
         this->setErrorMsg("[addSong] An error occurred while preparing the statement");
         return false;
@@ -1107,7 +1145,7 @@ bool Database::updateSong(Metadata::Song m) {
     }
 
     // Now update relevant fields
-    ok = this->db->prepareQuery("UPDATE Songs SET modified = ?, artist_id = (SELECT id FROM Artists WHERE name = ?), album_id = (SELECT id FROM Albums WHERE name = ?), title = ?, track = ?, disc = ?, duration = ?, plays = ?, favourite = ?, path = ?, format = ? WHERE id = ?;");
+    ok = this->db->prepareQuery("UPDATE Songs SET modified = ?, artist_id = (SELECT id FROM Artists WHERE name = ?), album_id = (SELECT id FROM Albums WHERE name = ?), title = ?, track = ?, disc = ?, duration = ?, plays = ?, favourite = ?, path = ?, format = ?, gain = ?, peak = ? WHERE id = ?;");
     ok = keepFalse(ok, this->db->bindInt(0, m.modified));
     ok = keepFalse(ok, this->db->bindString(1, m.artist));
     ok = keepFalse(ok, this->db->bindString(2, m.album));
@@ -1119,7 +1157,9 @@ bool Database::updateSong(Metadata::Song m) {
     ok = keepFalse(ok, this->db->bindBool(8, m.favourite));
     ok = keepFalse(ok, this->db->bindString(9, m.path));
     ok = keepFalse(ok, this->db->bindString(10, audioFormatToString(m.format)));
-    ok = keepFalse(ok, this->db->bindInt(11, m.ID));
+    ok = keepFalse(ok, this->db->bindDouble(11, m.gain));
+    ok = keepFalse(ok, this->db->bindDouble(12, m.peak));
+    ok = keepFalse(ok, this->db->bindInt(13, m.ID));
     if (!ok) {
         this->setErrorMsg("[updateSong] An error occurred while preparing the statement");
         return false;
@@ -1219,7 +1259,7 @@ std::vector<Metadata::Song> Database::getAllSongMetadata(Database::SortBy sort)
     }
 
     // Create a Metadata::Song for each entry
-    bool ok = this->db->prepareQuery("SELECT Songs.ID, Songs.title, Artists.name, Albums.name, Songs.track, Songs.disc, Songs.duration, Songs.plays, Songs.favourite, Songs.path, Songs.format, Songs.modified FROM Songs JOIN Albums ON Albums.id = Songs.album_id JOIN Artists ON Artists.id = Songs.artist_id ORDER BY " + orderBy + ";");
+    bool ok = this->db->prepareQuery("SELECT Songs.ID, Songs.title, Artists.name, Albums.name, Songs.track, Songs.disc, Songs.duration, Songs.plays, Songs.favourite, Songs.path, Songs.format, Songs.modified, Songs.gain, Songs.peak FROM Songs JOIN Albums ON Albums.id = Songs.album_id JOIN Artists ON Artists.id = Songs.artist_id ORDER BY " + orderBy + ";");
     ok = keepFalse(ok, this->db->executeQuery());
     if (!ok) {
         this->setErrorMsg("[getAllSongInfo] Unable to query for all songs");
@@ -1228,6 +1268,7 @@ std::vector<Metadata::Song> Database::getAllSongMetadata(Database::SortBy sort)
     while (ok && this->db->hasRow()) {
         Metadata::Song m;
         int tmp;
+        double tmpDbl;
         std::string tmpStr;
         ok = this->db->getInt(0, m.ID);
         ok = keepFalse(ok, this->db->getString(1, m.title));
@@ -1247,6 +1288,10 @@ std::vector<Metadata::Song> Database::getAllSongMetadata(Database::SortBy sort)
         m.format = audioFormatFromString(tmpStr);
         ok = keepFalse(ok, this->db->getInt(11, tmp));
         m.modified = tmp;
+        ok = keepFalse(ok, this->db->getDouble(12, tmpDbl));
+        m.gain = tmpDbl;
+        ok = keepFalse(ok, this->db->getDouble(13, tmpDbl));
+        m.peak = tmpDbl;
 
         if (ok) {
             v.push_back(m);
@@ -1268,7 +1313,7 @@ std::vector<Metadata::Song> Database::getSongMetadataForAlbum(AlbumID id) {
 
     // Create a Metadata::Song for each entry given the album (sorted)
     // Note that 0's are treated as 9999's so they are at the end (yes this means it won't always be at the end but no album has 9999 discs or 9999 tracks)
-    bool ok = this->db->prepareQuery("SELECT Songs.ID, Songs.title, Artists.name, Albums.name, Songs.track, Songs.disc, Songs.duration, Songs.plays, Songs.favourite, Songs.path, Songs.format, Songs.modified FROM Songs JOIN Albums ON Albums.id = Songs.album_id JOIN Artists ON Artists.id = Songs.artist_id WHERE Songs.album_id = ? ORDER BY CASE disc WHEN 0 THEN 9999 ELSE disc END, CASE track WHEN 0 THEN 9999 ELSE track END, title;");
+    bool ok = this->db->prepareQuery("SELECT Songs.ID, Songs.title, Artists.name, Albums.name, Songs.track, Songs.disc, Songs.duration, Songs.plays, Songs.favourite, Songs.path, Songs.format, Songs.modified, Songs.gain, Songs.peak FROM Songs JOIN Albums ON Albums.id = Songs.album_id JOIN Artists ON Artists.id = Songs.artist_id WHERE Songs.album_id = ? ORDER BY CASE disc WHEN 0 THEN 9999 ELSE disc END, CASE track WHEN 0 THEN 9999 ELSE track END, title;");
     ok = keepFalse(ok, this->db->bindInt(0, id));
     ok = keepFalse(ok, this->db->executeQuery());
     if (!ok) {
@@ -1278,6 +1323,7 @@ std::vector<Metadata::Song> Database::getSongMetadataForAlbum(AlbumID id) {
     while (ok && this->db->hasRow()) {
         Metadata::Song m;
         int tmp;
+        double tmpDbl;
         std::string tmpStr;
         ok = this->db->getInt(0, m.ID);
         ok = keepFalse(ok, this->db->getString(1, m.title));
@@ -1297,6 +1343,10 @@ std::vector<Metadata::Song> Database::getSongMetadataForAlbum(AlbumID id) {
         m.format = audioFormatFromString(tmpStr);
         ok = keepFalse(ok, this->db->getInt(11, tmp));
         m.modified = tmp;
+        ok = keepFalse(ok, this->db->getDouble(12, tmpDbl));
+        m.gain = tmpDbl;
+        ok = keepFalse(ok, this->db->getDouble(13, tmpDbl));
+        m.peak = tmpDbl;
 
         if (ok) {
             v.push_back(m);
@@ -1317,7 +1367,7 @@ std::vector<Metadata::Song> Database::getSongMetadataForArtist(ArtistID id) {
     }
 
     // Create a Metadata::Song for each entry given the artist
-    bool ok = this->db->prepareQuery("SELECT Songs.ID, Songs.title, Artists.name, Albums.name, Songs.track, Songs.disc, Songs.duration, Songs.plays, Songs.favourite, Songs.path, Songs.format, Songs.modified FROM Songs JOIN Albums ON Albums.id = Songs.album_id JOIN Artists ON Artists.id = Songs.artist_id WHERE Songs.artist_id = ? ORDER BY Songs.title;");
+    bool ok = this->db->prepareQuery("SELECT Songs.ID, Songs.title, Artists.name, Albums.name, Songs.track, Songs.disc, Songs.duration, Songs.plays, Songs.favourite, Songs.path, Songs.format, Songs.modified, Songs.gain, Songs.peak FROM Songs JOIN Albums ON Albums.id = Songs.album_id JOIN Artists ON Artists.id = Songs.artist_id WHERE Songs.artist_id = ? ORDER BY Songs.title;");
     ok = keepFalse(ok, this->db->bindInt(0, id));
     ok = keepFalse(ok, this->db->executeQuery());
     if (!ok) {
@@ -1327,6 +1377,7 @@ std::vector<Metadata::Song> Database::getSongMetadataForArtist(ArtistID id) {
     while (ok && this->db->hasRow()) {
         Metadata::Song m;
         int tmp;
+        double tmpDbl;
         std::string tmpStr;
         ok = this->db->getInt(0, m.ID);
         ok = keepFalse(ok, this->db->getString(1, m.title));
@@ -1346,6 +1397,10 @@ std::vector<Metadata::Song> Database::getSongMetadataForArtist(ArtistID id) {
         m.format = audioFormatFromString(tmpStr);
         ok = keepFalse(ok, this->db->getInt(11, tmp));
         m.modified = tmp;
+        ok = keepFalse(ok, this->db->getDouble(12, tmpDbl));
+        m.gain = tmpDbl;
+        ok = keepFalse(ok, this->db->getDouble(13, tmpDbl));
+        m.peak = tmpDbl;
 
         if (ok) {
             v.push_back(m);
@@ -1367,7 +1422,7 @@ Metadata::Song Database::getSongMetadataForID(SongID id) {
     }
 
     // Query for song info
-    bool ok = this->db->prepareQuery("SELECT Songs.ID, Songs.title, Artists.name, Albums.name, Songs.track, Songs.disc, Songs.duration, Songs.plays, Songs.favourite, Songs.path, Songs.format, Songs.modified FROM Songs JOIN Albums ON Albums.id = Songs.album_id JOIN Artists ON Artists.id = Songs.artist_id WHERE Songs.ID = ?;");
+    bool ok = this->db->prepareQuery("SELECT Songs.ID, Songs.title, Artists.name, Albums.name, Songs.track, Songs.disc, Songs.duration, Songs.plays, Songs.favourite, Songs.path, Songs.format, Songs.modified, Songs.gain, Songs.peak FROM Songs JOIN Albums ON Albums.id = Songs.album_id JOIN Artists ON Artists.id = Songs.artist_id WHERE Songs.ID = ?;");
     ok = keepFalse(ok, this->db->bindInt(0, id));
     ok = keepFalse(ok, this->db->executeQuery());
     if (!ok) {
@@ -1375,6 +1430,7 @@ Metadata::Song Database::getSongMetadataForID(SongID id) {
         return m;
     }
     int tmp;
+    double tmpDbl;
     std::string tmpStr;
     ok = this->db->getInt(0, m.ID);
     ok = keepFalse(ok, this->db->getString(1, m.title));
@@ -1394,6 +1450,10 @@ Metadata::Song Database::getSongMetadataForID(SongID id) {
     m.format = audioFormatFromString(tmpStr);
     ok = keepFalse(ok, this->db->getInt(11, tmp));
     m.modified = tmp;
+    ok = keepFalse(ok, this->db->getDouble(12, tmpDbl));
+    m.gain = tmpDbl;
+    ok = keepFalse(ok, this->db->getDouble(13, tmpDbl));
+    m.peak = tmpDbl;
 
     if (!ok) {
         this->setErrorMsg("[getSongInfoForID] An error occurred reading from the query results");
@@ -1774,7 +1834,7 @@ std::vector<Metadata::Song> Database::searchSongs(std::string str, int limit) {
     // Iterate over each phrase and store results
     for (size_t i = 0; i < phrases.size(); i++) {
         // Create query and optionally append LIMIT
-        std::string query = "SELECT Songs.id, Songs.title, Artists.name, Albums.name, Songs.track, Songs.disc, Songs.duration, Songs.plays, Songs.favourite, Songs.path, Songs.format, Songs.modified FROM Songs JOIN FtsSongs ON Songs.title = FtsSongs.title JOIN Artists ON artist_id = Artists.id JOIN Albums ON album_id = Albums.id WHERE FtsSongs MATCH ? ORDER BY okapi_bm25(matchinfo(FtsSongs, 'pcxnal'), 0) DESC, Songs.title";
+        std::string query = "SELECT Songs.id, Songs.title, Artists.name, Albums.name, Songs.track, Songs.disc, Songs.duration, Songs.plays, Songs.favourite, Songs.path, Songs.format, Songs.modified, Songs.gain, Songs.peak FROM Songs JOIN FtsSongs ON Songs.title = FtsSongs.title JOIN Artists ON artist_id = Artists.id JOIN Albums ON album_id = Albums.id WHERE FtsSongs MATCH ? ORDER BY okapi_bm25(matchinfo(FtsSongs, 'pcxnal'), 0) DESC, Songs.title";
         query += (limit >= 0 ? " LIMIT ?;" : ";");
         bool ok = this->db->prepareQuery(query);
         std::string str = phrases[i];
@@ -1790,6 +1850,7 @@ std::vector<Metadata::Song> Database::searchSongs(std::string str, int limit) {
 
         // Iterate over returned rows
         int tmp;
+        double tmpDbl;
         std::string tmpStr;
         while (ok && this->db->hasRow()) {
             Metadata::Song m;
@@ -1821,6 +1882,10 @@ std::vector<Metadata::Song> Database::searchSongs(std::string str, int limit) {
             m.format = audioFormatFromString(tmpStr);
             ok = keepFalse(ok, this->db->getInt(11, tmp));
             m.modified = tmp;
+            ok = keepFalse(ok, this->db->getDouble(12, tmpDbl));
+            m.gain = tmpDbl;
+            ok = keepFalse(ok, this->db->getDouble(13, tmpDbl));
+            m.peak = tmpDbl;
 
             if (ok) {
                 v.push_back(m);
@@ -0,0 +1,39 @@
+#include "db/migrations/8_AddLoudness.hpp"
+
+namespace Migration {
+    std::string migrateTo8(SQLite * db) {
+        // Add gain (dB) and peak (linear) columns to Songs (a peak of zero indicates it's not set)
+        bool ok = db->prepareAndExecuteQuery("ALTER TABLE Songs ADD COLUMN gain REAL NOT NULL DEFAULT 0;");
+        if (!ok) {
+            return "Unable to add gain column to Songs";
+        }
+        ok = db->prepareAndExecuteQuery("ALTER TABLE Songs ADD COLUMN peak REAL NOT NULL DEFAULT 0;");
+        if (!ok) {
+            return "Unable to add peak column to Songs";
+        }
+
+        // Add the same columns to Albums
+        ok = db->prepareAndExecuteQuery("ALTER TABLE Albums ADD COLUMN gain REAL NOT NULL DEFAULT 0;");
+        if (!ok) {
+            return "Unable to add gain column to Albums";
+        }
+        ok = db->prepareAndExecuteQuery("ALTER TABLE Albums ADD COLUMN peak REAL NOT NULL DEFAULT 0;");
+        if (!ok) {
+            return "Unable to add peak column to Albums";
+        }
+
+        // Reset every song's modified time so the next scan measures them all
+        ok = db->prepareAndExecuteQuery("UPDATE Songs SET modified = 0;");
+        if (!ok) {
+            return "Unable to reset all rows' modified time";
+        }
+
+        // Bump up version number
+        ok = db->prepareAndExecuteQuery("UPDATE Variables SET value = 8 WHERE name = 'version';");
+        if (!ok) {
+            return "Unable to set version to 8";
+        }
+
+        return "";
+    };
+}
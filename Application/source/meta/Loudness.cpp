@@ -0,0 +1,326 @@
+#include <cmath>
+#include "Log.hpp"
+#include "meta/Loudness.hpp"
+#include <mpg123.h>
+#include <mutex>
+
+// The decoders are only needed by the application to measure loudness
+#define DR_FLAC_IMPLEMENTATION
+#include "decoders/dr_flac.h"
+#define DR_WAV_IMPLEMENTATION
+#include "decoders/dr_wav.h"
+
+constexpr double absoluteGate = -70.0;          // Blocks quieter than this are ignored (LUFS)
+constexpr double relativeGate = -10.0;          // Blocks this much quieter than the ungated loudness are ignored (LU)
+constexpr size_t chunkFrames = 4096;            // Number of frames decoded at once
+constexpr long maxOversampleRate = 96000;       // Rates at or above this don't need oversampling
+constexpr size_t phases = 4;                    // Oversampling factor for true peak
+constexpr size_t taps = 12;                     // Number of taps per phase
+
+// Convert a mean square energy to LUFS and back
+static inline double energyToLoudness(double energy) {
+    return -0.691 + 10.0 * std::log10(energy);
+}
+
+static inline double loudnessToEnergy(double loudness) {
+    return std::pow(10.0, (loudness + 0.691) / 10.0);
+}
+
+// Returns the coefficients of the interpolation filter, split into phases with the
+// taps of each phase reversed so they line up with the history (oldest sample first).
+// The filter is a windowed sinc so phase 0 passes the original samples through.
+static const std::array<std::array<float, taps>, phases> & interpolationFilter() {
+    static std::array<std::array<float, taps>, phases> filter = []() {
+        std::array<std::array<float, taps>, phases> f;
+        const double centre = (phases * taps)/2.0;
+        for (size_t p = 0; p < phases; p++) {
+            double sum = 0.0;
+            for (size_t k = 0; k < taps; k++) {
+                // Blackman windowed sinc
+                const double n = k * phases + p;
+                const double x = (n - centre)/phases;
+                const double sinc = (x == 0.0 ? 1.0 : std::sin(M_PI * x) / (M_PI * x));
+                const double window = 0.42 - 0.5 * std::cos(2.0 * M_PI * n / (2.0 * centre)) + 0.08 * std::cos(4.0 * M_PI * n / (2.0 * centre));
+                f[p][taps - 1 - k] = sinc * window;
+                sum += sinc * window;
+            }
+
+            // Normalize each phase to unity gain
+            for (size_t k = 0; k < taps; k++) {
+                f[p][k] /= sum;
+            }
+        }
+        return f;
+    }();
+    return filter;
+}
+
+namespace Metadata::Loudness {
+    Meter::Meter(long rate, int channels) {
+        this->channels = (channels > 0 ? channels : 1);
+        this->hopSize = (rate > 10 ? rate/10 : 1);
+        this->hopFrames = 0;
+        this->hopEnergy = 0.0;
+        this->hops.fill(0.0);
+        this->hopCount = 0;
+        this->oversample = (rate < maxOversampleRate);
+        this->history.assign(this->channels * taps * 2, 0.0f);
+        this->historyPos = 0;
+        this->peak_ = 0.0f;
+
+        // K-weighting stage 1: high shelf modelling the head (BS.1770 coefficients recalculated for the rate)
+        Biquad shelf;
+        double k = std::tan(M_PI * 1681.974450955533 / rate);
+        const double vh = std::pow(10.0, 3.999843853973347 / 20.0);
+        const double vb = std::pow(vh, 0.4996667741545416);
+        double q = 0.7071752369554196;
+        double a0 = 1.0 + k/q + k*k;
+        shelf.b0 = (vh + vb * k/q + k*k) / a0;
+        shelf.b1 = 2.0 * (k*k - vh) / a0;
+        shelf.b2 = (vh - vb * k/q + k*k) / a0;
+        shelf.a1 = 2.0 * (k*k - 1.0) / a0;
+        shelf.a2 = (1.0 - k/q + k*k) / a0;
+        shelf.z1 = shelf.z2 = 0.0;
+
+        // K-weighting stage 2: 'RLB' high pass
+        Biquad highpass;
+        k = std::tan(M_PI * 38.13547087602444 / rate);
+        q = 0.5003270373238773;
+        a0 = 1.0 + k/q + k*k;
+        highpass.b0 = 1.0;
+        highpass.b1 = -2.0;
+        highpass.b2 = 1.0;
+        highpass.a1 = 2.0 * (k*k - 1.0) / a0;
+        highpass.a2 = (1.0 - k/q + k*k) / a0;
+        highpass.z1 = highpass.z2 = 0.0;
+
+        this->shelf.assign(this->channels, shelf);
+        this->highpass.assign(this->channels, highpass);
+    }
+
+    void Meter::process(const float * buf, size_t frames) {
+        const std::array<std::array<float, taps>, phases> & filter = interpolationFilter();
+        const double gate = loudnessToEnergy(absoluteGate);
+
+        for (size_t i = 0; i < frames; i++) {
+            for (int ch = 0; ch < this->channels; ch++) {
+                const float sample = buf[i * this->channels + ch];
+
+                // Sum the K-weighted energy (all channels are weighted equally as only mono/stereo is expected)
+                Biquad & s = this->shelf[ch];
+                double y = s.b0 * sample + s.z1;
+                s.z1 = s.b1 * sample - s.a1 * y + s.z2;
+                s.z2 = s.b2 * sample - s.a2 * y;
+
+                Biquad & h = this->highpass[ch];
+                const double x = y;
+                y = h.b0 * x + h.z1;
+                h.z1 = h.b1 * x - h.a1 * y + h.z2;
+                h.z2 = h.b2 * x - h.a2 * y;
+                this->hopEnergy += y * y;
+
+                // Interpolate between this and the previous samples to find the true peak
+                float peak = std::fabs(sample);
+                if (this->oversample) {
+                    float * hist = &this->history[ch * taps * 2];
+                    hist[this->historyPos] = sample;
+                    hist[this->historyPos + taps] = sample;
+                    const float * window = hist + this->historyPos + 1;
+                    for (size_t p = 1; p < phases; p++) {
+                        float v = 0.0f;
+                        for (size_t k = 0; k < taps; k++) {
+                            v += filter[p][k] * window[k];
+                        }
+                        peak = std::fmax(peak, std::fabs(v));
+                    }
+                }
+                this->peak_ = std::fmax(this->peak_, peak);
+            }
+            this->historyPos = (this->historyPos + 1) % taps;
+
+            // Each 100ms completes a 400ms block (which overlap by 75%)
+            this->hopFrames++;
+            if (this->hopFrames == this->hopSize) {
+                this->hops[this->hopCount % this->hops.size()] = this->hopEnergy / this->hopSize;
+                this->hopCount++;
+                this->hopFrames = 0;
+                this->hopEnergy = 0.0;
+
+                if (this->hopCount >= this->hops.size()) {
+                    const double block = (this->hops[0] + this->hops[1] + this->hops[2] + this->hops[3]) / this->hops.size();
+                    if (block > gate) {
+                        this->blocks.push_back(block);
+                    }
+                }
+            }
+        }
+    }
+
+    double Meter::loudness() {
+        if (this->blocks.empty()) {
+            return absoluteGate - 1.0;
+        }
+
+        // Find the loudness of all blocks above the absolute gate first
+        double sum = 0.0;
+        for (double block : this->blocks) {
+            sum += block;
+        }
+        const double gate = loudnessToEnergy(energyToLoudness(sum / this->blocks.size()) + relativeGate);
+
+        // Then only include those above the relative gate
+        sum = 0.0;
+        size_t count = 0;
+        for (double block : this->blocks) {
+            if (block > gate) {
+                sum += block;
+                count++;
+            }
+        }
+        return (count > 0 ? energyToLoudness(sum / count) : absoluteGate - 1.0);
+    }
+
+    float Meter::peak() {
+        return this->peak_;
+    }
+
+    // Decoders for each format, which decode the whole file through the meter
+    // Each returns false if the file couldn't be opened
+    static bool measureFLAC(const std::string & path, Meter * & meter) {
+        drflac * flac = drflac_open_file(path.c_str(), nullptr);
+        if (flac == nullptr) {
+            return false;
+        }
+
+        meter = new Meter(flac->sampleRate, flac->channels);
+        std::vector<float> buf(chunkFrames * flac->channels);
+        size_t decoded;
+        while ((decoded = drflac_read_pcm_frames_f32(flac, chunkFrames, buf.data())) > 0) {
+            meter->process(buf.data(), decoded);
+        }
+
+        drflac_close(flac);
+        return true;
+    }
+
+    static bool measureMP3(const std::string & path, Meter * & meter) {
+        // Older versions of mpg123 require this to be called once before use
+        static std::once_flag initFlag;
+        std::call_once(initFlag, []() {
+            mpg123_init();
+        });
+
+        int result;
+        mpg123_handle * mpg = mpg123_new(nullptr, &result);
+        if (mpg == nullptr) {
+            return false;
+        }
+        mpg123_param(mpg, MPG123_FLAGS, MPG123_QUIET | MPG123_GAPLESS, 0.0f);
+
+        // Get format (mpg123 outputs 16 bit samples, as in the sysmodule)
+        long rate;
+        int channels, encoding;
+        bool ok = (mpg123_open(mpg, path.c_str()) == MPG123_OK);
+        ok = ok && (mpg123_getformat(mpg, &rate, &channels, &encoding) == MPG123_OK);
+
+        if (ok) {
+            meter = new Meter(rate, channels);
+            std::vector<int16_t> samples(chunkFrames * channels);
+            std::vector<float> buf(chunkFrames * channels);
+            size_t decoded = 0;
+            do {
+                mpg123_read(mpg, reinterpret_cast<unsigned char *>(samples.data()), samples.size() * sizeof(int16_t), &decoded);
+                size_t count = decoded/sizeof(int16_t);
+                for (size_t i = 0; i < count; i++) {
+                    buf[i] = samples[i] / 32768.0f;
+                }
+                meter->process(buf.data(), count/channels);
+            } while (decoded > 0);
+        }
+
+        mpg123_close(mpg);
+        mpg123_delete(mpg);
+        return ok;
+    }
+
+    static bool measureWAV(const std::string & path, Meter * & meter) {
+        drwav wav;
+        if (!drwav_init_file(&wav, path.c_str(), nullptr)) {
+            return false;
+        }
+
+        meter = new Meter(wav.sampleRate, wav.channels);
+        std::vector<float> buf(chunkFrames * wav.channels);
+        size_t decoded;
+        while ((decoded = drwav_read_pcm_frames_f32(&wav, chunkFrames, buf.data())) > 0) {
+            meter->process(buf.data(), decoded);
+        }
+
+        drwav_uninit(&wav);
+        return true;
+    }
+
+    Result measureFile(const std::string & path, const AudioFormat format) {
+        Meter * meter = nullptr;
+        bool ok = false;
+        switch (format) {
+            case AudioFormat::FLAC:
+                ok = measureFLAC(path, meter);
+                break;
+
+            case AudioFormat::MP3:
+                ok = measureMP3(path, meter);
+                break;
+
+            case AudioFormat::WAV:
+                ok = measureWAV(path, meter);
+                break;
+
+            default:
+                break;
+        }
+
+        // Silent files are treated as unmeasured, as any gain would be meaningless
+        Result result = {0.0f, 0.0f};
+        if (!ok || meter == nullptr) {
+            Log::writeError("[META] [LOUDNESS] Unable to decode file: " + path);
+
+        } else if (meter->loudness() < absoluteGate) {
+            Log::writeWarning("[META] [LOUDNESS] File is too quiet to measure: " + path);
+
+        } else {
+            result.gain = referenceLoudness - meter->loudness();
+            result.peak = meter->peak();
+        }
+
+        delete meter;
+        return result;
+    }
+
+    Result combine(const std::vector<Song> & songs) {
+        // The album's loudness is the mean energy of it's songs' (gated) loudness, weighted by their
+        // length. This isn't BS.1770's integrated loudness of the album as one stream, as each song
+        // was gated on it's own (a quiet song among loud ones keeps blocks the album's relative gate
+        // would drop), so it differs most for albums mixing quiet and loud songs. Only each song's
+        // result is stored, and gating the album as a whole would mean decoding every song again
+        // whenever one of them changes
+        double energy = 0.0;
+        double duration = 0.0;
+        Result result = {0.0f, 0.0f};
+        for (const Song & song : songs) {
+            if (song.peak <= 0.0f) {
+                continue;
+            }
+
+            const double length = (song.duration > 0 ? song.duration : 1);
+            energy += loudnessToEnergy(referenceLoudness - song.gain) * length;
+            duration += length;
+            result.peak = std::fmax(result.peak, song.peak);
+        }
+
+        if (duration > 0.0) {
+            result.gain = referenceLoudness - energyToLoudness(energy / duration);
+        }
+        return result;
+    }
+};
@@ -1,3 +1,4 @@
+#include <cstdlib>
 #include "Log.hpp"
 #include "meta/AudioDB.hpp"
 #include "meta/Metadata.hpp"
@@ -9,6 +10,7 @@
 #include <id3v1tag.h>
 #include <id3v2tag.h>
 #include <mpegfile.h>
+#include <textidentificationframe.h>
 #include <xiphcomment.h>
 #include <wavfile.h>
 
@@ -106,9 +108,32 @@ namespace Metadata {
         m.duration = -1;
         m.plays = 0;
         m.favourite = false;
+        m.gain = 0.0f;
+        m.peak = 0.0f;
         return m;
     }
 
+    // Parse a single ReplayGain field, only replacing values which haven't been found
+    static void parseReplayGain(const TagLib::String & key, const TagLib::String & value, ReplayGain & rg) {
+        const std::string field = key.upper().to8Bit(true);
+        const float num = std::strtof(value.to8Bit(true).c_str(), nullptr);
+
+        if (field == "REPLAYGAIN_TRACK_GAIN" && !rg.hasTrack) {
+            rg.hasTrack = true;
+            rg.trackGain = num;
+
+        } else if (field == "REPLAYGAIN_TRACK_PEAK" && num > 0.0f) {
+            rg.trackPeak = num;
+
+        } else if (field == "REPLAYGAIN_ALBUM_GAIN" && !rg.hasAlbum) {
+            rg.hasAlbum = true;
+            rg.albumGain = num;
+
+        } else if (field == "REPLAYGAIN_ALBUM_PEAK" && num > 0.0f) {
+            rg.albumPeak = num;
+        }
+    }
+
     // Return whether mime type is supported
     static inline bool mimeTypeSupported(const TagLib::String & mime) {
         const std::string str = mime.to8Bit(true);
@@ -169,7 +194,16 @@ namespace Metadata {
     }
 
     // Parse metadata stored in ID3v2 tags, only replacing empty values
-    static void parseID3v2Tags(TagLib::ID3v2::Tag * tag, Song & m) {
+    static void parseID3v2Tags(TagLib::ID3v2::Tag * tag, Song & m, ReplayGain & rg) {
+        // ReplayGain is stored in TXXX frames
+        TagLib::ID3v2::FrameList userList = tag->frameListMap()["TXXX"];
+        for (TagLib::ID3v2::Frame * frame : userList) {
+            TagLib::ID3v2::UserTextIdentificationFrame * user = static_cast<TagLib::ID3v2::UserTextIdentificationFrame *>(frame);
+            if (user != nullptr && user->fieldList().size() > 1) {
+                parseReplayGain(user->description(), user->fieldList().back(), rg);
+            }
+        }
+
         if (m.title.empty() && !tag->title().isEmpty()) {
             m.title = tag->title().to8Bit(true);
         }
@@ -224,7 +258,13 @@ namespace Metadata {
     }
 
     // Parse metadata stored in a XiphComment, only replacing empty values
-    static void parseXiphComment(TagLib::Ogg::XiphComment * xiph, Song & m) {
+    static void parseXiphComment(TagLib::Ogg::XiphComment * xiph, Song & m, ReplayGain & rg) {
+        for (const std::pair<const TagLib::String, TagLib::StringList> & field : xiph->fieldListMap()) {
+            if (!field.second.isEmpty()) {
+                parseReplayGain(field.first, field.second.front(), rg);
+            }
+        }
+
         if (m.title.empty() && !xiph->title().isEmpty()) {
             m.title = xiph->title().to8Bit(true);
         }
@@ -366,7 +406,7 @@ namespace Metadata {
     }
 
     // Treats given file as FLAC and extracts relevant metadata
-    static Song readFromFLAC(const std::string & path) {
+    static Song readFromFLAC(const std::string & path, ReplayGain & rg) {
         // Initialize blank object first
         Song m = getBlankMetadata();
         m.format = AudioFormat::FLAC;
@@ -392,7 +432,7 @@ namespace Metadata {
         if (file.hasXiphComment()) {
             TagLib::Ogg::XiphComment * xiph = file.xiphComment();
             if (xiph != nullptr) {
-                parseXiphComment(xiph, m);
+                parseXiphComment(xiph, m, rg);
             }
 
         } else {
@@ -403,7 +443,7 @@ namespace Metadata {
         if (file.hasID3v2Tag()) {
             TagLib::ID3v2::Tag * tag = file.ID3v2Tag();
             if (tag != nullptr) {
-                parseID3v2Tags(tag, m);
+                parseID3v2Tags(tag, m, rg);
             }
 
         } else {
@@ -428,7 +468,7 @@ namespace Metadata {
     }
 
     // Treats given file as MP3 and extracts relevant metadata
-    static Song readFromMP3(const std::string & path) {
+    static Song readFromMP3(const std::string & path, ReplayGain & rg) {
         // Initialize blank object first
         Song m = getBlankMetadata();
         m.format = AudioFormat::MP3;
@@ -454,7 +494,7 @@ namespace Metadata {
         if (file.hasID3v2Tag()) {
             TagLib::ID3v2::Tag * tag = file.ID3v2Tag();
             if (tag != nullptr) {
-                parseID3v2Tags(tag, m);
+                parseID3v2Tags(tag, m, rg);
             }
 
         } else {
@@ -479,7 +519,7 @@ namespace Metadata {
     }
 
     // Treats given file as WAV and extracts relevant metadata
-    static Song readFromWAV(const std::string & path) {
+    static Song readFromWAV(const std::string & path, ReplayGain & rg) {
         // Initialize blank object first
         Song m = getBlankMetadata();
         m.format = AudioFormat::WAV;
@@ -516,7 +556,7 @@ namespace Metadata {
         if (file.hasID3v2Tag()) {
             TagLib::ID3v2::Tag * tag = file.ID3v2Tag();
             if (tag != nullptr) {
-                parseID3v2Tags(tag, m);
+                parseID3v2Tags(tag, m, rg);
             }
 
         } else {
@@ -529,19 +569,22 @@ namespace Metadata {
         return m;
     }
 
-    Song readFromFile(const std::string & path, const AudioFormat format) {
+    Song readFromFile(const std::string & path, const AudioFormat format, ReplayGain & rg) {
+        // Peaks default to full scale as they're not always stored alongside the gain
+        rg = ReplayGain{false, 0.0f, 1.0f, false, 0.0f, 1.0f};
+
         // Call relevant function
         switch (format) {
             case AudioFormat::FLAC:
-                return readFromFLAC(path);
+                return readFromFLAC(path, rg);
                 break;
 
             case AudioFormat::MP3:
-                return readFromMP3(path);
+                return readFromMP3(path, rg);
                 break;
 
             case AudioFormat::WAV:
-                return readFromWAV(path);
+                return readFromWAV(path, rg);
                 break;
 
             default:
@@ -1,6 +1,7 @@
 #include <sstream>
 #include "Application.hpp"
 #include "dtl.hpp"
+#include "ipc/TriPlayer.hpp"
 #include "lang/Lang.hpp"
 #include "Paths.hpp"
 #include "ui/element/listitem/Song.hpp"
@@ -41,6 +42,7 @@ namespace Frame {
             return lhs.ID < rhs.ID;
         });
 
+        this->cachedSongIdx = 0;
         this->cachedSongID = -1;
         this->emptyMsg = nullptr;
         this->heading->setString("Queue.Heading"_lang);
@@ -86,19 +88,20 @@ namespace Frame {
     }
 
     void Queue::updateList() {
-        // Get queues
+        // Get queues, along with the edits made since they were last fetched
         std::string playingFrom = this->app->sysmodule()->playingFrom();
-        std::vector<SongID> queue = this->app->sysmodule()->queue();
-        std::vector<SongID> subQueue = this->app->sysmodule()->subQueue();
+        std::vector<TriPlayer::QueueChange> changes;
+        std::vector<SongID> fullQueue;
+        std::vector<SongID> subQueue;
+        bool haveChanges = this->app->sysmodule()->queueChanges(changes, fullQueue, subQueue);
         size_t songIdx = this->app->sysmodule()->waitSongIdx();
         SongID currentID = -1;
 
         // Safety check before 'slicing' queue (if there's an error leave it empty)
-        if (songIdx >= queue.size()) {
-            queue.clear();
-        } else {
-            currentID = queue[songIdx];
-            queue = std::vector<SongID>(queue.begin() + songIdx + 1, queue.end()); // Note we don't include the current song in the queue!
+        std::vector<SongID> queue;
+        if (songIdx < fullQueue.size()) {
+            currentID = fullQueue[songIdx];
+            queue = std::vector<SongID>(fullQueue.begin() + songIdx + 1, fullQueue.end()); // Note we don't include the current song in the queue!
         }
 
         // Set empty if so
@@ -120,65 +123,69 @@ namespace Frame {
             this->songPressed = true;
         }
 
-        // Diff each type of queue
-        dtl::Diff<SongID> queueDiff(cachedQueue, queue);
-        queueDiff.compose();
-        dtl::Diff<SongID> subQueueDiff(cachedSubQueue, subQueue);
-        subQueueDiff.compose();
-
-        // Remove/add queue heading if needed
-        if (subQueue.empty() && this->queue != nullptr) {
-            this->list->removeElement(this->queue);
-            this->queue = nullptr;
-        } else if (!subQueue.empty() && this->queue == nullptr) {
-            this->queue = new Aether::Element(0, 0, 100, 80);
-            Aether::Text * tmp = new Aether::Text(this->queue->x(), this->queue->y(), "Queue.NextInQueue"_lang, 28);
-            tmp->setY(tmp->y() + (this->queue->h() - tmp->h())/2 + 10);
-            tmp->setColour(this->app->theme()->FG());
-            this->queue->addElement(tmp);
-            this->list->addElementBefore(this->queue, this->upnext);
+        // Apply the edits straight to the lists if we have them, starting over if they don't add up
+        bool applied = false;
+        if (haveChanges) {
+            applied = this->applyChanges(changes, songIdx, fullQueue, subQueue);
+            if (!applied) {
+                this->clearListSongs();
+            }
         }
 
-        // Update sub queue
-        std::list<CustomElm::ListItem::Song *>::iterator it = this->queueEls.begin();
-        std::stringstream ss;
-        subQueueDiff.printSES(ss);
-        for (std::string line; std::getline(ss, line);) {
-            // Take action based on first char
-            switch (line[0]) {
-                // Remove element
-                case '-': {
-                    std::list<CustomElm::ListItem::Song *>::iterator prev = std::prev(it);
-                    this->list->removeElement(*it);
-                    this->queueEls.erase(it);
-                    it = prev;
-                    std::advance(it, 1);
-                    break;
+        // Otherwise diff each type of queue
+        if (!applied) {
+            dtl::Diff<SongID> queueDiff(this->cachedQueue, queue);
+            queueDiff.compose();
+            dtl::Diff<SongID> subQueueDiff(this->cachedSubQueue, subQueue);
+            subQueueDiff.compose();
+
+            // Update sub queue
+            this->setQueueHeading(!subQueue.empty());
+            std::list<CustomElm::ListItem::Song *>::iterator it = this->queueEls.begin();
+            std::stringstream ss;
+            subQueueDiff.printSES(ss);
+            for (std::string line; std::getline(ss, line);) {
+                // Take action based on first char
+                switch (line[0]) {
+                    // Remove element
+                    case '-':
+                        it = this->eraseListSong(Section::Queue, it);
+                        break;
+
+                    // Add element
+                    case '+':
+                        this->insertListSong(std::stoi(line.substr(1, line.length() - 1)), Section::Queue, it);
+                        break;
+
+                    // Don't alter if the same
+                    case ' ':
+                        std::advance(it, 1);
+                        break;
                 }
+            }
 
-                // Add element
-                case '+': {
-                    SongID id = std::stoi(line.substr(1, line.length() - 1));
-                    CustomElm::ListItem::Song * l = this->getListSong(id, Section::Queue);
-                    l->setMoreCallback([this, id, l]() {
-                        // Need to find current position
-                        std::list<CustomElm::ListItem::Song *>::iterator it = std::find(this->queueEls.begin(), this->queueEls.end(), l);
-                        size_t pos = std::distance(this->queueEls.begin(), it);
-                        this->createMenu(id, pos, Section::Queue);
-                    });
-                    if (it == this->queueEls.begin()) {
-                        this->list->addElementAfter(l, this->queue);
-                    } else {
-                        this->list->addElementAfter(l, *std::prev(it));
-                    }
-                    this->queueEls.insert(it, l);
-                    break;
+            // Update normal queue (including current song)
+            it = this->upnextEls.begin();
+            std::stringstream ss2;
+            queueDiff.printSES(ss2);
+            for (std::string line; std::getline(ss2, line);) {
+                // Take action based on first char
+                switch (line[0]) {
+                    // Remove element
+                    case '-':
+                        it = this->eraseListSong(Section::UpNext, it);
+                        break;
+
+                    // Add element
+                    case '+':
+                        this->insertListSong(std::stoi(line.substr(1, line.length() - 1)), Section::UpNext, it);
+                        break;
+
+                    // Don't alter if the same
+                    case ' ':
+                        std::advance(it, 1);
+                        break;
                 }
-
-                // Don't alter if the same
-                case ' ':
-                    std::advance(it, 1);
-                    break;
             }
         }
 
@@ -190,52 +197,10 @@ namespace Frame {
             this->upnext->setHidden(false);
         }
 
-        // Update normal queue (including current song)
-        it = this->upnextEls.begin();
-        std::stringstream ss2;
-        queueDiff.printSES(ss2);
-        for (std::string line; std::getline(ss2, line);) {
-            // Take action based on first char
-            switch (line[0]) {
-                // Remove element
-                case '-': {
-                    std::list<CustomElm::ListItem::Song *>::iterator prev = std::prev(it);
-                    this->list->removeElement(*it);
-                    this->upnextEls.erase(it);
-                    it = prev;
-                    std::advance(it, 1);
-                    break;
-                }
-
-                // Add element
-                case '+': {
-                    SongID id = std::stoi(line.substr(1, line.length() - 1));
-                    CustomElm::ListItem::Song * l = this->getListSong(id, Section::UpNext);
-                    l->setMoreCallback([this, id, l]() {
-                        // Need to find current position
-                        std::list<CustomElm::ListItem::Song *>::iterator it = std::find(this->upnextEls.begin(), this->upnextEls.end(), l);
-                        size_t pos = std::distance(this->upnextEls.begin(), it) + this->cachedSongIdx + 1;
-                        this->createMenu(id, pos, Section::UpNext);
-                    });
-                    if (it == this->upnextEls.begin()) {
-                        this->list->addElementAfter(l, this->upnext);
-                    } else {
-                        this->list->addElementAfter(l, *std::prev(it));
-                    }
-                    this->upnextEls.insert(it, l);
-                    break;
-                }
-
-                // Don't alter if the same
-                case ' ':
-                    std::advance(it, 1);
-                    break;
-            }
-        }
-
         // Update cached variables
         this->cachedSongIdx = songIdx;
         this->cachedSongID = currentID;
+        this->cachedFullQueue = fullQueue;
         this->cachedQueue = queue;
         this->cachedSubQueue = subQueue;
 
@@ -250,6 +215,142 @@ namespace Frame {
         }
     }
 
+    void Queue::setQueueHeading(const bool show) {
+        if (!show && this->queue != nullptr) {
+            this->list->removeElement(this->queue);
+            this->queue = nullptr;
+
+        } else if (show && this->queue == nullptr) {
+            this->queue = new Aether::Element(0, 0, 100, 80);
+            Aether::Text * tmp = new Aether::Text(this->queue->x(), this->queue->y(), "Queue.NextInQueue"_lang, 28);
+            tmp->setY(tmp->y() + (this->queue->h() - tmp->h())/2 + 10);
+            tmp->setColour(this->app->theme()->FG());
+            this->queue->addElement(tmp);
+            this->list->addElementBefore(this->queue, this->upnext);
+        }
+    }
+
+    void Queue::insertListSong(const SongID id, const Section sec, std::list<CustomElm::ListItem::Song *>::iterator it) {
+        std::list<CustomElm::ListItem::Song *> & els = (sec == Section::Queue ? this->queueEls : this->upnextEls);
+        CustomElm::ListItem::Song * l = this->getListSong(id, sec);
+        if (sec == Section::Queue) {
+            l->setMoreCallback([this, id, l]() {
+                // Need to find current position
+                std::list<CustomElm::ListItem::Song *>::iterator it = std::find(this->queueEls.begin(), this->queueEls.end(), l);
+                size_t pos = std::distance(this->queueEls.begin(), it);
+                this->createMenu(id, pos, Section::Queue);
+            });
+
+        } else {
+            l->setMoreCallback([this, id, l]() {
+                // Need to find current position
+                std::list<CustomElm::ListItem::Song *>::iterator it = std::find(this->upnextEls.begin(), this->upnextEls.end(), l);
+                size_t pos = std::distance(this->upnextEls.begin(), it) + this->cachedSongIdx + 1;
+                this->createMenu(id, pos, Section::UpNext);
+            });
+        }
+
+        // Place after the previous song, or the section's heading if it's the first
+        if (it == els.begin()) {
+            this->list->addElementAfter(l, (sec == Section::Queue ? this->queue : this->upnext));
+        } else {
+            this->list->addElementAfter(l, *std::prev(it));
+        }
+        els.insert(it, l);
+    }
+
+    std::list<CustomElm::ListItem::Song *>::iterator Queue::eraseListSong(const Section sec, std::list<CustomElm::ListItem::Song *>::iterator it) {
+        std::list<CustomElm::ListItem::Song *> & els = (sec == Section::Queue ? this->queueEls : this->upnextEls);
+        this->list->removeElement(*it);
+        return els.erase(it);
+    }
+
+    void Queue::clearListSongs() {
+        while (!this->queueEls.empty()) {
+            this->eraseListSong(Section::Queue, this->queueEls.begin());
+        }
+        while (!this->upnextEls.empty()) {
+            this->eraseListSong(Section::UpNext, this->upnextEls.begin());
+        }
+        this->cachedQueue.clear();
+        this->cachedSubQueue.clear();
+    }
+
+    bool Queue::applyChange(const TriPlayer::QueueChange & change, const Section sec, std::vector<SongID> & ids, size_t & start) {
+        std::list<CustomElm::ListItem::Song *> & els = (sec == Section::Queue ? this->queueEls : this->upnextEls);
+        switch (change.type) {
+            case TriPlayer::Change::Insert:
+                if (change.pos > ids.size()) {
+                    return false;
+                }
+                ids.insert(ids.begin() + change.pos, change.id);
+
+                // Songs inserted before those shown just push them along
+                if (change.pos < start) {
+                    start++;
+                } else {
+                    this->insertListSong(change.id, sec, std::next(els.begin(), change.pos - start));
+                }
+                break;
+
+            case TriPlayer::Change::Remove: {
+                if (change.pos + change.value > ids.size()) {
+                    return false;
+                }
+                ids.erase(ids.begin() + change.pos, ids.begin() + change.pos + change.value);
+
+                // Only remove the elements for songs which were shown
+                size_t hidden = (start > change.pos ? std::min<size_t>(start - change.pos, change.value) : 0);
+                std::list<CustomElm::ListItem::Song *>::iterator it = std::next(els.begin(), std::max<size_t>(change.pos, start) - start);
+                for (size_t i = hidden; i < change.value; i++) {
+                    it = this->eraseListSong(sec, it);
+                }
+                start -= hidden;
+                break;
+            }
+
+            case TriPlayer::Change::Move: {
+                // Same as removing then inserting the song
+                if (change.pos >= ids.size() || change.value >= ids.size()) {
+                    return false;
+                }
+                const TriPlayer::QueueChange remove = {TriPlayer::Change::Remove, change.subQueue, change.pos, 1, -1};
+                const TriPlayer::QueueChange insert = {TriPlayer::Change::Insert, change.subQueue, change.value, 0, ids[change.pos]};
+                return (this->applyChange(remove, sec, ids, start) && this->applyChange(insert, sec, ids, start));
+            }
+        }
+        return true;
+    }
+
+    bool Queue::applyChanges(const std::vector<TriPlayer::QueueChange> & changes, const size_t songIdx, const std::vector<SongID> & queue, const std::vector<SongID> & subQueue) {
+        // The heading needs to be present while adding sub-queue songs
+        this->setQueueHeading(true);
+
+        // 'Up Next' shows the main queue after the previously playing song
+        size_t start = std::min(this->cachedSongIdx + 1, this->cachedFullQueue.size());
+        size_t subStart = 0;
+        for (const TriPlayer::QueueChange & change : changes) {
+            bool ok = (change.subQueue ? this->applyChange(change, Section::Queue, this->cachedSubQueue, subStart) : this->applyChange(change, Section::UpNext, this->cachedFullQueue, start));
+            if (!ok) {
+                return false;
+            }
+        }
+        this->setQueueHeading(!this->cachedSubQueue.empty());
+
+        // Now move it along to follow the song playing now
+        size_t newStart = std::min(songIdx + 1, this->cachedFullQueue.size());
+        while (start < newStart) {
+            this->eraseListSong(Section::UpNext, this->upnextEls.begin());
+            start++;
+        }
+        while (start > newStart) {
+            start--;
+            this->insertListSong(this->cachedFullQueue[start], Section::UpNext, this->upnextEls.begin());
+        }
+
+        return (this->cachedFullQueue == queue && this->cachedSubQueue == subQueue && this->upnextEls.size() == queue.size() - newStart);
+    }
+
     CustomElm::ListItem::Song * Queue::getListSong(size_t id, Section sec) {
         // Get info for song (will be blank if not found)
         Metadata::Song m;
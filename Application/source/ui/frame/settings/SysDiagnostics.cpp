@@ -0,0 +1,118 @@
+#include "Application.hpp"
+#include "ipc/TriPlayer.hpp"
+#include "lang/Lang.hpp"
+#include "ui/frame/settings/SysDiagnostics.hpp"
+#include "utils/Utils.hpp"
+
+// Format a time in milliseconds to two decimal places
+static std::string formatMs(const float ms) {
+    return Utils::truncateToDecimalPlace(std::to_string(ms), 2);
+}
+
+namespace Frame::Settings {
+    SysDiagnostics::SysDiagnostics(Main::Application * a) : Frame(a) {
+        this->error = new Aether::ListComment("Settings.SysDiagnostics.Unavailable"_lang);
+        this->error->setTextColour(this->app->theme()->muted());
+        this->error->setHidden(true);
+        this->list->addElement(this->error);
+
+        // Decoding
+        this->addRow("Settings.SysDiagnostics.BuffersDecoded"_lang, [](const TriPlayer::Stats & s) {
+            return std::to_string(s.buffersDecoded);
+        });
+        this->addRow("Settings.SysDiagnostics.DecodeTime"_lang, [](const TriPlayer::Stats & s) {
+            return formatMs(s.decodeMin) + " / " + formatMs(s.decodeAvg) + " / " + formatMs(s.decodeP99);
+        });
+        this->addRow("Settings.SysDiagnostics.RealTime"_lang, [](const TriPlayer::Stats & s) {
+            return Utils::truncateToDecimalPlace(std::to_string(s.realTimeFactor), 1) + "x";
+        });
+        this->addRow("Settings.SysDiagnostics.Underruns"_lang, [](const TriPlayer::Stats & s) {
+            return std::to_string(s.underruns);
+        });
+        this->addRow("Settings.SysDiagnostics.BuffersUsed"_lang, [](const TriPlayer::Stats & s) {
+            return std::to_string(s.buffersUsed) + " / " + std::to_string(s.buffersMax);
+        });
+        this->list->addElement(new Aether::ListSeparator());
+
+        // File access
+        this->addRow("Settings.SysDiagnostics.BytesRead"_lang, [](const TriPlayer::Stats & s) {
+            return Utils::formatBytes(s.bytesRead);
+        });
+        this->addRow("Settings.SysDiagnostics.ReadLatency"_lang, [](const TriPlayer::Stats & s) {
+            return formatMs(s.readLatency);
+        });
+        this->addRow("Settings.SysDiagnostics.SeekHits"_lang, [](const TriPlayer::Stats & s) {
+            return std::to_string(s.seekHits) + " / " + std::to_string(s.seekHits + s.seekPurges);
+        });
+        this->addRow("Settings.SysDiagnostics.LockWait"_lang, [](const TriPlayer::Stats & s) {
+            return formatMs(s.queueWait) + " / " + formatMs(s.sourceWait) + " / " + formatMs(s.databaseWait);
+        });
+        this->addRow("Settings.SysDiagnostics.Heap"_lang, [](const TriPlayer::Stats & s) {
+            return Utils::formatBytes(s.heapUsed) + " / " + Utils::formatBytes(s.heapPeak) + " / " + Utils::formatBytes(s.heapSize);
+        });
+        this->list->addElement(new Aether::ListSeparator());
+
+        // Song changes
+        this->addRow("Settings.SysDiagnostics.SongChanges"_lang, [](const TriPlayer::Stats & s) {
+            return std::to_string(s.songChanges);
+        });
+        this->addRow("Settings.SysDiagnostics.SongChangeTime"_lang, [](const TriPlayer::Stats & s) {
+            return formatMs(s.songChangeLast) + " / " + formatMs(s.songChangeAvg) + " / " + formatMs(s.songChangeMax);
+        });
+        this->addRow("Settings.SysDiagnostics.CacheHits"_lang, [](const TriPlayer::Stats & s) {
+            return std::to_string(s.cacheHits) + " / " + std::to_string(s.cacheLookups);
+        });
+        this->addRow("Settings.SysDiagnostics.CacheMemory"_lang, [](const TriPlayer::Stats & s) {
+            return Utils::formatBytes(s.cacheMemory);
+        });
+        this->list->addElement(new Aether::ListSeparator());
+
+        // Memory used by each subsystem (the list of subsystems comes from the sysmodule)
+        this->app->sysmodule()->waitGetMemoryUsage(this->memory);
+        for (size_t i = 0; i < this->memory.size(); i++) {
+            this->addRow(Utils::substituteTokens("Settings.SysDiagnostics.Memory"_lang, std::string(this->memory[i].name)), [this, i](const TriPlayer::Stats &) {
+                if (i >= this->memory.size()) {
+                    return std::string("-");
+                }
+                const TriPlayer::MemoryUsage & use = this->memory[i];
+                std::string str = Utils::formatBytes(use.used) + " / " + (use.budget > 0 ? Utils::formatBytes(use.budget) : "-");
+                return (use.overruns > 0 ? str + " (!)" : str);
+            });
+        }
+        if (!this->memory.empty()) {
+            this->addComment("Settings.SysDiagnostics.MemoryText"_lang);
+            this->list->addElement(new Aether::ListSeparator());
+        }
+
+        // Refresh button
+        this->addButton("Settings.SysDiagnostics.Refresh"_lang, [this]() {
+            this->refresh();
+        });
+        this->addComment("Settings.SysDiagnostics.RefreshText"_lang);
+
+        this->refresh();
+    }
+
+    void SysDiagnostics::addRow(const std::string & str, std::function<std::string(const TriPlayer::Stats &)> f) {
+        Aether::ListOption * opt = new Aether::ListOption(str, "-", nullptr);
+        opt->setSelectable(false);
+        opt->setHintColour(this->app->theme()->FG());
+        opt->setLineColour(this->app->theme()->muted2());
+        opt->setValueColour(this->app->theme()->accent());
+        this->list->addElement(opt);
+        this->rows.push_back(std::make_pair(opt, f));
+    }
+
+    void SysDiagnostics::refresh() {
+        TriPlayer::Stats stats;
+        bool ok = this->app->sysmodule()->waitGetStats(stats) && this->app->sysmodule()->waitGetMemoryUsage(this->memory);
+        this->error->setHidden(ok);
+        if (!ok) {
+            return;
+        }
+
+        for (std::pair<Aether::ListOption *, std::function<std::string(const TriPlayer::Stats &)> > & row : this->rows) {
+            row.first->setValue(row.second(stats));
+        }
+    }
+};
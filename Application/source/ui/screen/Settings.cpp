@@ -7,6 +7,7 @@
 #include "ui/frame/settings/AppGeneral.hpp"
 #include "ui/frame/settings/AppMetadata.hpp"
 #include "ui/frame/settings/AppSearch.hpp"
+#include "ui/frame/settings/SysDiagnostics.hpp"
 #include "ui/frame/settings/SysGeneral.hpp"
 #include "ui/frame/settings/SysMP3.hpp"
 #include "ui/screen/Settings.hpp"
@@ -36,6 +37,7 @@ namespace Screen {
         this->buttonAppAdvanced->setActivated(false);
         this->buttonSysGeneral->setActivated(false);
         this->buttonSysMP3->setActivated(false);
+        this->buttonSysDiagnostics->setActivated(false);
         this->buttonAbout->setActivated(false);
         this->removeElement(this->frame);
     }
@@ -82,6 +84,12 @@ namespace Screen {
         this->addElement(this->frame);
     }
 
+    void Settings::setupSysDiagnostics() {
+        this->buttonSysDiagnostics->setActivated(true);
+        this->frame = new Frame::Settings::SysDiagnostics(this->app);
+        this->addElement(this->frame);
+    }
+
     void Settings::setupAbout() {
         this->buttonAbout->setActivated(true);
         this->frame = new Frame::Settings::About(this->app);
@@ -98,6 +106,7 @@ namespace Screen {
             this->buttonAppAdvanced->setActiveColour(this->app->theme()->accent());
             this->buttonSysGeneral->setActiveColour(this->app->theme()->accent());
             this->buttonSysMP3->setActiveColour(this->app->theme()->accent());
+            this->buttonSysDiagnostics->setActiveColour(this->app->theme()->accent());
             this->buttonAbout->setActiveColour(this->app->theme()->accent());
             this->updateDot->setColour(this->app->theme()->accent());
         }
@@ -240,6 +249,18 @@ namespace Screen {
         this->sidebarList->addElement(this->buttonSysMP3);
         this->sidebarList->addElement(new Aether::ListSeparator(SIDEBAR_SEP));
 
+        // Sysmodule (diagnostics)
+        this->buttonSysDiagnostics = new CustomElm::SideButton(0, 0, 100);
+        this->buttonSysDiagnostics->setText("Settings.Diagnostics"_lang);
+        this->buttonSysDiagnostics->onPress([this]() {
+            this->setupNew();
+            this->setupSysDiagnostics();
+        });
+        this->buttonSysDiagnostics->setActiveColour(this->app->theme()->accent());
+        this->buttonSysDiagnostics->setInactiveColour(this->app->theme()->FG());
+        this->sidebarList->addElement(this->buttonSysDiagnostics);
+        this->sidebarList->addElement(new Aether::ListSeparator(SIDEBAR_SEP));
+
         // About
         this->addHeading("Settings.Miscellaneous"_lang);
         this->buttonAbout = new CustomElm::SideButton(0, 0, 100);
@@ -38,6 +38,8 @@ namespace Path {
     namespace Sys {
         extern const std::string ConfigFile;
         extern const std::string LogFile;
+
+        extern const std::string SeekIndexFolder;
     };
 };
 
@@ -54,7 +54,14 @@ namespace Ipc {
 
         ReloadConfig,       // Get the sysmodule to update it's config          // Nothing                                          // Nothing
         Reset,              // Reinitialize sysmodule (except ipc service)      // Nothing                                          // Version of sysmodule (string)
-        Quit                // Properly terminate the sysmodule                 // Nothing                                          // Nothing
+        Quit,               // Properly terminate the sysmodule                 // Nothing                                          // Nothing
+
+        GetStats,           // Get playback performance counters                // Nothing                                          // TriPlayer::Stats (versioned, see TriPlayer.hpp)
+        GetMemory,          // Get (and log) memory used by each subsystem      // Nothing                                          // Number of subsystems + TriPlayer::MemoryUsage for each
+        GetState,           // Get a snapshot of the playback state             // Nothing                                          // TriPlayer::State (versioned, see TriPlayer.hpp)
+        Subscribe,          // Get an event signalled when the state changes    // Nothing                                          // Event handle (copied)
+        GetQueueChanges,    // Get edits made to the queues since a version     // Version [uint64_t]                               // Version reached [uint64_t] + number returned [uint32_t] + truncated [uint32_t] + TriPlayer::QueueChange for each
+        EditQueue           // Apply a list of edits to the queue (all or none) // Type, position, count, to [uint32_t] + IDs [int] for each   // Size of queue [size_t]
     };
 };
 
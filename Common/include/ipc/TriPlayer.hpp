@@ -1,6 +1,7 @@
 #ifndef IPC_TRIPLAYER_HPP
 #define IPC_TRIPLAYER_HPP
 
+#include <cstdint>
 #include <string>
 #include <vector>
 
@@ -32,6 +33,119 @@ namespace TriPlayer {
         Error       // A fatal error occurred
     };
 
+    // Version of the State layout below (follows the same rules as Stats)
+    constexpr uint32_t stateVersion = 2;
+
+    // Snapshot of everything a client shows about playback, fetched in one call
+    struct State {
+        uint32_t version;           // Version of the layout filled in by the sysmodule
+        uint32_t size;              // Number of bytes filled in by the sysmodule
+        uint64_t generation;        // Increases whenever any field other than position changes
+
+        int32_t song;               // ID of the playing song (-1 if nothing is playing)
+        Status status;              // Playback status
+        Repeat repeat;              // Repeat mode
+        Shuffle shuffle;            // Shuffle mode
+        double position;            // Position in the song (0.0 to 100.0)
+        double volume;              // Volume (0.0 to 100.0)
+        uint32_t queueIdx;          // Index of the playing song in the main queue
+        uint32_t queueSize;         // Number of songs in the main queue
+        uint32_t subQueueSize;      // Number of songs in the sub-queue
+        char playingFrom[104];      // 'Playing from' text (null terminated)
+
+        // Added in version 2
+        uint64_t queueVersion;      // Increases with each edit to the queue or sub-queue (see getQueueChanges)
+    };
+
+    // Type of edit made to a queue
+    enum class Change {
+        Insert,     // A song was inserted
+        Remove,     // One or more songs were removed
+        Move        // A song was moved
+    };
+
+    // A single edit made to the queue or sub-queue
+    struct QueueChange {
+        Change type;                // Type of edit
+        uint32_t subQueue;          // Non-zero if made to the sub-queue, zero for the main queue
+        uint32_t pos;               // Position of the (first) song inserted/removed/moved
+        uint32_t value;             // Remove: number of songs removed, Move: position moved to (after removal)
+        int32_t id;                 // Insert: ID of the song inserted
+    };
+
+    // Type of edit to make to the queue (see editQueue)
+    enum class Edit {
+        Insert,     // Insert IDs at pos
+        Remove,     // Remove count songs starting at pos
+        Move        // Move count songs starting at pos to position to (counted after removing them)
+    };
+
+    // A single edit to make to the queue
+    struct QueueEdit {
+        Edit type;                  // Type of edit
+        uint32_t pos;               // Position of the first song
+        uint32_t count;             // Remove/Move: number of songs (ignored for Insert)
+        uint32_t to;                // Move: position the first song ends up at
+        std::vector<int> IDs;       // Insert: IDs to insert
+    };
+
+    // Version of the Stats layout below. Fields are only ever added to the end (bumping
+    // the version), so check version and size before reading anything added after version 1
+    constexpr uint32_t statsVersion = 1;
+
+    // Performance counters kept by the sysmodule since it started
+    // Times are in milliseconds unless stated otherwise
+    struct Stats {
+        uint32_t version;           // Version of the layout filled in by the sysmodule
+        uint32_t size;              // Number of bytes filled in by the sysmodule
+
+        // Decoding (per buffer of audio)
+        uint64_t buffersDecoded;    // Number of buffers decoded
+        float decodeMin;            // Fastest time to decode a buffer
+        float decodeAvg;            // Average time to decode a buffer
+        float decodeP99;            // Time 99% of buffers were decoded within
+        float realTimeFactor;       // Seconds of audio decoded per second spent decoding
+        uint32_t underruns;         // Number of times a buffer finished with nothing queued after it
+        uint32_t buffersUsed;       // Number of buffers currently filled ahead
+        uint32_t buffersMax;        // Number of buffers available
+
+        // File reads
+        uint64_t bytesRead;         // Bytes read from the SD card
+        float readLatency;          // Recent worst time taken to read a block
+        uint32_t seekHits;          // Seeks answered from buffered data
+        uint32_t seekPurges;        // Seeks which needed the buffer to be refilled
+
+        // Time spent waiting to lock the sysmodule's mutexes
+        float queueWait;            // Queues
+        float sourceWait;           // Playing song
+        float databaseWait;         // Database
+
+        // Memory (bytes)
+        uint32_t heapSize;          // Size of the heap
+        uint32_t heapUsed;          // Bytes currently allocated
+        uint32_t heapPeak;          // Most the heap has grown to
+
+        // Song changes (time from the request to the first audio being queued)
+        uint32_t songChanges;       // Number of song changes measured
+        float songChangeLast;       // Latest
+        float songChangeAvg;        // Average
+        float songChangeMax;        // Slowest
+
+        // Cache of the start of upcoming songs
+        uint32_t cacheLookups;      // Song changes which checked the cache
+        uint32_t cacheHits;         // Song changes started from the cache
+        uint32_t cacheMemory;       // Bytes used by the cache
+    };
+
+    // Memory used by one of the sysmodule's subsystems (in bytes)
+    struct MemoryUsage {
+        char name[16];              // Name of the subsystem
+        uint32_t used;              // Currently allocated
+        uint32_t peak;              // Most ever allocated
+        uint32_t budget;            // Amount it should stay within (zero if unlimited)
+        uint32_t overruns;          // Number of times it went over budget
+    };
+
     // Initialize and connect to the sysmodule
     // Common reasons of failure are either it's not running or there's a version mismatch
     bool initialize();
@@ -84,6 +198,15 @@ namespace TriPlayer {
     bool setQueueIdx(const size_t pos);
     // Remove the track at the given index from the queue
     bool removeFromQueue(const size_t pos);
+    // Insert the IDs into the main queue starting at the given index
+    bool insertIntoQueue(const size_t pos, const std::vector<int> & IDs);
+    // Remove a number of tracks starting at the given index from the queue
+    bool removeFromQueue(const size_t pos, const size_t count);
+    // Move a number of tracks starting at the given index so the first is at the new index
+    // (counted as if they had been removed)
+    bool moveInQueue(const size_t pos, const size_t count, const size_t to);
+    // Apply each edit in order as one operation. If any edit is invalid none are applied
+    bool editQueue(const std::vector<QueueEdit> & edits);
 
     // Get the TriPlayer::Repeat mode of the sysmodule
     bool getRepeatMode(Repeat & outMode);
@@ -116,6 +239,26 @@ namespace TriPlayer {
     // Release previously requested access to database
     bool releaseDatabaseLock();
 
+    // Get a snapshot of the playback state in one call
+    // Clients polling this can skip updating everything but the position while the generation is unchanged
+    bool getState(State & outState);
+    // Get a handle to an event which is signalled whenever the state's generation changes,
+    // so clients can wait on it rather than polling (open with eventLoadRemote(), and clear
+    // it before calling getState()). Each connection gets one event, closed along with it
+    bool subscribe(uint32_t & outHandle);
+
+    // Get the edits made to the queue and sub-queue since the given version (see State::queueVersion), along with
+    // the version they bring the queues up to. Applying them in order to copies of the queues at the given version
+    // brings them up to date. If the sysmodule no longer remembers that far back, outTruncated is set true and
+    // both queues need to be fetched in full instead
+    bool getQueueChanges(const uint64_t version, std::vector<QueueChange> & outChanges, uint64_t & outVersion, bool & outTruncated);
+
+    // Get the sysmodule's performance counters
+    // Fields added after the sysmodule's version of the layout are left zeroed
+    bool getStats(Stats & outStats);
+    // Get the memory used by each of the sysmodule's subsystems (also written to it's log)
+    bool getMemoryUsage(std::vector<MemoryUsage> & outUsage);
+
     // Request the sysmodule to re-read it's config file
     bool reloadConfig();
     // Reset everything but the IPC connection
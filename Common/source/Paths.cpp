@@ -32,5 +32,7 @@ namespace Path {
     namespace Sys {
         const std::string ConfigFile = Common::ConfigFolder + "sys_config.ini";
         const std::string LogFile = Common::SwitchFolder + "sysmodule.log";
+
+        const std::string SeekIndexFolder = Common::SwitchFolder + "index/";
     };
 };
\ No newline at end of file
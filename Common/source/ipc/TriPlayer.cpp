@@ -204,6 +204,42 @@ namespace TriPlayer {
         return (R_SUCCEEDED(serviceDispatchIn(service, static_cast<uint32_t>(Ipc::Command::RemoveFromQueue), pos)));
     }
 
+    bool insertIntoQueue(const size_t pos, const std::vector<int> & IDs) {
+        return editQueue({QueueEdit{Edit::Insert, static_cast<uint32_t>(pos), 0, 0, IDs}});
+    }
+
+    bool removeFromQueue(const size_t pos, const size_t count) {
+        return editQueue({QueueEdit{Edit::Remove, static_cast<uint32_t>(pos), static_cast<uint32_t>(count), 0, {}}});
+    }
+
+    bool moveInQueue(const size_t pos, const size_t count, const size_t to) {
+        return editQueue({QueueEdit{Edit::Move, static_cast<uint32_t>(pos), static_cast<uint32_t>(count), static_cast<uint32_t>(to), {}}});
+    }
+
+    bool editQueue(const std::vector<QueueEdit> & edits) {
+        // Pack each edit into a single buffer: a header followed by any IDs
+        std::vector<uint32_t> data;
+        for (const QueueEdit & edit : edits) {
+            data.push_back(static_cast<uint32_t>(edit.type));
+            data.push_back(edit.pos);
+            data.push_back(edit.type == Edit::Insert ? edit.IDs.size() : edit.count);
+            data.push_back(edit.to);
+            if (edit.type == Edit::Insert) {
+                data.insert(data.end(), edit.IDs.begin(), edit.IDs.end());
+            }
+        }
+        if (data.empty()) {
+            return true;
+        }
+
+        size_t size;
+        Result rc = serviceDispatchOut(service, static_cast<uint32_t>(Ipc::Command::EditQueue), size,
+            .buffer_attrs = {SfBufferAttr_In | SfBufferAttr_HipcMapAlias},
+            .buffers = {{&data[0], data.size() * sizeof(uint32_t)}},
+        );
+        return (R_SUCCEEDED(rc));
+    }
+
     bool getRepeatMode(Repeat & outMode) {
         return (R_SUCCEEDED(serviceDispatchOut(service, static_cast<uint32_t>(Ipc::Command::GetRepeat), outMode)));
     }
@@ -277,6 +313,95 @@ namespace TriPlayer {
         return (R_SUCCEEDED(serviceDispatch(service, static_cast<uint32_t>(Ipc::Command::ReleaseDBLock))));
     }
 
+    bool getState(State & outState) {
+        outState = State();
+        Result rc = serviceDispatch(service, static_cast<uint32_t>(Ipc::Command::GetState),
+            .buffer_attrs = {SfBufferAttr_Out | SfBufferAttr_HipcMapAlias},
+            .buffers = {{&outState, sizeof(State)}},
+        );
+        return (R_SUCCEEDED(rc) && outState.version > 0);
+    }
+
+    bool subscribe(uint32_t & outHandle) {
+        Handle handle = INVALID_HANDLE;
+        Result rc = serviceDispatch(service, static_cast<uint32_t>(Ipc::Command::Subscribe),
+            .out_handle_attrs = {SfOutHandleAttr_HipcCopy},
+            .out_handles = &handle,
+        );
+        outHandle = handle;
+        return (R_SUCCEEDED(rc));
+    }
+
+    bool getQueueChanges(const uint64_t version, std::vector<QueueChange> & outChanges, uint64_t & outVersion, bool & outTruncated) {
+        // Request changes in groups of 100
+        constexpr size_t count = 100;
+        outChanges.clear();
+        outVersion = version;
+        outTruncated = false;
+
+        // Repeatedly request groups until we've caught up
+        size_t offset = 0;
+        while (true) {
+            struct {
+                uint64_t version;
+                uint32_t count;
+                uint32_t truncated;
+            } out = {};
+            outChanges.resize(offset + count);
+
+            // Request data
+            Result rc = serviceDispatchInOut(service, static_cast<uint32_t>(Ipc::Command::GetQueueChanges), outVersion, out,
+                .buffer_attrs = {SfBufferAttr_Out | SfBufferAttr_HipcMapAlias},
+                .buffers = {{&outChanges[offset], count * sizeof(QueueChange)}},
+            );
+            if (R_FAILED(rc)) {
+                outChanges.clear();
+                return false;
+            }
+
+            // Nothing is returned if truncated
+            if (out.truncated != 0) {
+                outChanges.clear();
+                outTruncated = true;
+                return true;
+            }
+
+            // Stop if we didn't receive the amount requested (means we've got every change)
+            offset += (out.count < count ? out.count : count);
+            outVersion = out.version;
+            if (out.count != count) {
+                outChanges.resize(offset);
+                break;
+            }
+        }
+
+        return true;
+    }
+
+    bool getStats(Stats & outStats) {
+        // Anything the sysmodule doesn't know about is left zeroed
+        outStats = Stats();
+        Result rc = serviceDispatch(service, static_cast<uint32_t>(Ipc::Command::GetStats),
+            .buffer_attrs = {SfBufferAttr_Out | SfBufferAttr_HipcMapAlias},
+            .buffers = {{&outStats, sizeof(Stats)}},
+        );
+        return (R_SUCCEEDED(rc) && outStats.version > 0);
+    }
+
+    bool getMemoryUsage(std::vector<MemoryUsage> & outUsage) {
+        // There are only a handful of subsystems
+        constexpr size_t count = 16;
+        outUsage.resize(count);
+
+        size_t returned = 0;
+        Result rc = serviceDispatchOut(service, static_cast<uint32_t>(Ipc::Command::GetMemory), returned,
+            .buffer_attrs = {SfBufferAttr_Out | SfBufferAttr_HipcMapAlias},
+            .buffers = {{&outUsage[0], count * sizeof(MemoryUsage)}},
+        );
+        outUsage.resize(R_SUCCEEDED(rc) ? (returned < count ? returned : count) : 0);
+        return (R_SUCCEEDED(rc));
+    }
+
     bool reloadConfig() {
         return (R_SUCCEEDED(serviceDispatch(service, static_cast<uint32_t>(Ipc::Command::ReloadConfig))));
     }
@@ -20,6 +20,10 @@ namespace Gui {
             unsigned char ticks;        // Number of ticks in update() since last check
 
             int currentSongID;          // ID of song matching stored metadata
+            uint64_t stateGeneration;   // Generation of the last state shown
+            bool playing;               // Whether the last state shown was playing
+            bool subscribed;            // Whether stateEvent was received from the sysmodule
+            Event stateEvent;           // Signalled by the sysmodule whenever the state changes
 
         public:
             // Initialize objects
@@ -30,6 +34,9 @@ namespace Gui {
 
             // Periodically check if we need to update the element
             void update();
+
+            // Closes the state event
+            ~Player();
     };
 };
 
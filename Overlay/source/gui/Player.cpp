@@ -9,7 +9,16 @@ namespace Gui {
         this->database = db;
         this->player = nullptr;
         this->currentSongID = -100;
+        this->stateGeneration = 0;
+        this->playing = false;
         this->ticks = 0;
+
+        // Ask to be told when something changes so the state doesn't need polling while paused
+        uint32_t handle;
+        this->subscribed = TriPlayer::subscribe(handle);
+        if (this->subscribed) {
+            eventLoadRemote(&this->stateEvent, handle, true);
+        }
     }
 
     tsl::elm::Element * Player::createUI() {
@@ -28,18 +37,33 @@ namespace Gui {
     }
 
     void Player::update() {
-        // Only update 10 times per second
-        if (this->ticks < 6) {
-            this->ticks++;
-            return;
+        // Update straight away if the sysmodule says something has changed, otherwise only 10 times per second,
+        // and only while playing (for the position) once the initial state has been shown
+        bool changed = (this->subscribed && R_SUCCEEDED(eventWait(&this->stateEvent, 0)));
+        if (!changed) {
+            if (this->ticks < 6) {
+                this->ticks++;
+                return;
+            }
+            if (this->subscribed && !this->playing && this->stateGeneration != 0) {
+                return;
+            }
         }
         this->ticks = 0;
 
-        // Get currently playing song, and if changed update metadata
-        int songID;
-        if (!TriPlayer::getSongID(songID)) {
+        // Fetch everything at once, and only update the position if nothing else has changed
+        TriPlayer::State state;
+        if (!TriPlayer::getState(state)) {
             return;
         }
+        this->player->setPosition(state.position);
+        if (state.generation == this->stateGeneration) {
+            return;
+        }
+        this->stateGeneration = state.generation;
+
+        // Update metadata if the song has changed
+        int songID = state.song;
         if (songID != this->currentSongID) {
             // Get metadata from database
             Metadata meta;
@@ -74,32 +98,15 @@ namespace Gui {
             this->player->setAlbumArt(buffer);
         }
 
-        // Check playback status
-        TriPlayer::Status status;
-        if (!TriPlayer::getStatus(status)) {
-            return;
-        }
-        this->player->setPlaying(status == TriPlayer::Status::Playing);
-
-        // Check song position
-        double pos;
-        if (!TriPlayer::getPosition(pos)) {
-            return;
-        }
-        this->player->setPosition(pos);
-
-        // Check repeat
-        TriPlayer::Repeat repeat;
-        if (!TriPlayer::getRepeatMode(repeat)) {
-            return;
-        }
-        this->player->setRepeat(repeat != TriPlayer::Repeat::Off, repeat == TriPlayer::Repeat::One);
+        this->playing = (state.status == TriPlayer::Status::Playing);
+        this->player->setPlaying(this->playing);
+        this->player->setRepeat(state.repeat != TriPlayer::Repeat::Off, state.repeat == TriPlayer::Repeat::One);
+        this->player->setShuffle(state.shuffle == TriPlayer::Shuffle::On);
+    }
 
-        // Check shuffle
-        TriPlayer::Shuffle shuffle;
-        if (!TriPlayer::getShuffleMode(shuffle)) {
-            return;
+    Player::~Player() {
+        if (this->subscribed) {
+            eventClose(&this->stateEvent);
         }
-        this->player->setShuffle(shuffle == TriPlayer::Shuffle::On);
     }
 };
\ No newline at end of file
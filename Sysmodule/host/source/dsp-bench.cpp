@@ -0,0 +1,236 @@
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "dsp/Dither.hpp"
+#include "dsp/Equalizer.hpp"
+#include "nx/NX.hpp"
+#include <random>
+#include "source/Factory.hpp"
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+// Times the DSP chain's effects on stereo noise at the sample rates songs are usually in, and prints the
+// average time each took to process one second of audio (as logged by the service). Decoding is timed
+// the same way as a baseline, from a 16 bit WAV of the noise and from any files given.
+// Run without arguments for the default length.
+
+// Matches Service.cpp
+#define SCRATCH_SAMPLES 8192
+#define CHANNELS 2
+
+// Seconds of audio processed at each rate unless given
+#define SECONDS 60
+
+// Sample rates timed
+static const long rates[] = {44100, 48000};
+
+// Stereo noise which is copied into the scratch buffer before each call (so every call sees the same
+// kind of signal, instead of what the previous call left behind)
+static std::vector<float> noise(const size_t frames) {
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> dist(-0.5f, 0.5f);
+    std::vector<float> samples(frames * CHANNELS);
+    for (float & sample : samples) {
+        sample = dist(rng);
+    }
+    return samples;
+}
+
+// Run the effect over the given number of seconds of noise at the given rate, in blocks the size of the
+// decode thread's scratch buffer
+template <typename Effect>
+static void feed(Effect & effect, const long rate, const double seconds) {
+    const size_t chunkFrames = SCRATCH_SAMPLES/CHANNELS;
+    const std::vector<float> input = noise(chunkFrames);
+    std::vector<float> scratch(input.size());
+    const size_t total = seconds * rate;
+    for (size_t frames = 0; frames < total; frames += chunkFrames) {
+        scratch = input;
+        effect.process(scratch.data(), chunkFrames, CHANNELS, rate);
+    }
+}
+
+// Equalizer with all 32 bands active, alternating +6dB and -6dB so none can be skipped
+static double equalizerCost(const long rate, const double seconds) {
+    std::array<float, Dsp::Equalizer::bands> gains;
+    for (size_t i = 0; i < gains.size(); i++) {
+        gains[i] = (i % 2 == 0 ? 2.0f : 0.5f);
+    }
+    Dsp::Equalizer equalizer;
+    equalizer.setGains(gains);
+    feed(equalizer, rate, seconds);
+    return equalizer.costPerSecond();
+}
+
+// Dither with or without noise shaping
+static double ditherCost(const bool shaping, const long rate, const double seconds) {
+    Dsp::Dither dither;
+    dither.setNoiseShaping(shaping);
+    feed(dither, rate, seconds);
+    return dither.costPerSecond();
+}
+
+// Decode the whole file in blocks the size of the scratch buffer, returning the time taken per second of
+// audio (or a negative value if it couldn't be opened). The rate is returned through the last argument
+static double decodeCost(const std::string & path, long & rate) {
+    Source::Source * source = Source::Factory::getSource(path);
+    if (source == nullptr || !source->valid()) {
+        delete source;
+        return -1.0;
+    }
+
+    std::vector<float> scratch(SCRATCH_SAMPLES);
+    const size_t chunkFrames = SCRATCH_SAMPLES/source->channels();
+    size_t frames = 0;
+    std::chrono::steady_clock::time_point t = std::chrono::steady_clock::now();
+    while (!source->done()) {
+        const size_t decoded = source->decode(scratch.data(), chunkFrames);
+        if (decoded == 0) {
+            break;
+        }
+        frames += decoded;
+    }
+    const double time = std::chrono::duration<double>(std::chrono::steady_clock::now() - t).count();
+    rate = source->sampleRate();
+    delete source;
+    return (frames > 0 ? 1000000.0 * time / (static_cast<double>(frames) / rate) : -1.0);
+}
+
+// Write the given number of seconds of noise to a temporary 16 bit WAV, returning it's path (or an empty
+// string if it couldn't be written)
+static std::string writeNoise(const long rate, const double seconds) {
+    char path[] = "/tmp/dsp-bench-XXXXXX.wav";
+    const int fd = mkstemps(path, 4);
+    if (fd < 0) {
+        return "";
+    }
+
+    const size_t chunkFrames = SCRATCH_SAMPLES/CHANNELS;
+    const size_t chunks = (seconds * rate + chunkFrames - 1) / chunkFrames;
+    const uint32_t dataSize = chunks * chunkFrames * CHANNELS * sizeof(int16_t);
+    const uint32_t fmtSize = 16;
+    const uint32_t riffSize = 4 + (8 + fmtSize) + (8 + dataSize);
+    const uint16_t format = 1;
+    const uint16_t channels = CHANNELS;
+    const uint32_t sampleRate = rate;
+    const uint32_t byteRate = rate * CHANNELS * sizeof(int16_t);
+    const uint16_t blockAlign = CHANNELS * sizeof(int16_t);
+    const uint16_t bits = 16;
+
+    std::vector<uint8_t> header;
+    const auto append = [&header](const void * data, const size_t size) {
+        header.insert(header.end(), static_cast<const uint8_t *>(data), static_cast<const uint8_t *>(data) + size);
+    };
+    append("RIFF", 4);
+    append(&riffSize, 4);
+    append("WAVEfmt ", 8);
+    append(&fmtSize, 4);
+    append(&format, 2);
+    append(&channels, 2);
+    append(&sampleRate, 4);
+    append(&byteRate, 4);
+    append(&blockAlign, 2);
+    append(&bits, 2);
+    append("data", 4);
+    append(&dataSize, 4);
+    bool ok = (write(fd, header.data(), header.size()) == static_cast<ssize_t>(header.size()));
+
+    const std::vector<float> input = noise(chunkFrames);
+    std::vector<int16_t> samples(input.size());
+    for (size_t i = 0; i < input.size(); i++) {
+        samples[i] = input[i] * 32767.0f;
+    }
+    for (size_t i = 0; i < chunks && ok; i++) {
+        ok = (write(fd, samples.data(), samples.size() * sizeof(int16_t)) == static_cast<ssize_t>(samples.size() * sizeof(int16_t)));
+    }
+    close(fd);
+    if (!ok) {
+        unlink(path);
+        return "";
+    }
+    return path;
+}
+
+// Print one row of the results, with a value for each rate
+static void row(const std::string & name, const double (& values)[2]) {
+    std::printf("  %-28.28s", name.c_str());
+    for (const double value : values) {
+        if (value < 0.0) {
+            std::printf(" %10s", "-");
+        } else {
+            std::printf(" %10.1f", value);
+        }
+    }
+    std::printf("\n");
+}
+
+static void usage(const char * name) {
+    std::printf("Usage: %s [-s seconds] [file...]\n", name);
+    std::printf("  Processes the given number of seconds of stereo noise (%d if not given) at 44.1kHz and 48kHz\n", SECONDS);
+    std::printf("  through each effect, and decodes it from a 16 bit WAV, printing the time taken per second of\n");
+    std::printf("  audio. Each file given is also decoded, and listed under it's own sample rate\n");
+}
+
+int main(int argc, char * argv[]) {
+    double seconds = SECONDS;
+    std::vector<std::string> files;
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            seconds = std::strtod(argv[++i], nullptr);
+            if (seconds <= 0.0) {
+                usage(argv[0]);
+                return 1;
+            }
+        } else if (argv[i][0] == '-') {
+            usage(argv[0]);
+            return 1;
+        } else {
+            files.push_back(argv[i]);
+        }
+    }
+
+    if (!NX::startServices()) {
+        std::printf("Unable to start file I/O\n");
+        return 1;
+    }
+
+    double equalizer[2];
+    double flat[2];
+    double shaped[2];
+    double wav[2];
+    for (size_t i = 0; i < 2; i++) {
+        equalizer[i] = equalizerCost(rates[i], seconds);
+        flat[i] = ditherCost(false, rates[i], seconds);
+        shaped[i] = ditherCost(true, rates[i], seconds);
+
+        long rate = 0;
+        const std::string path = writeNoise(rates[i], seconds);
+        wav[i] = (path.empty() ? -1.0 : decodeCost(path, rate));
+        if (!path.empty()) {
+            unlink(path.c_str());
+        }
+    }
+
+    std::printf("us per second of audio %19s %10s\n", "44.1kHz", "48kHz");
+    row("Equalizer (32 bands)", equalizer);
+    row("Dither (flat)", flat);
+    row("Dither (noise shaped)", shaped);
+    row("Decode 16 bit WAV", wav);
+    for (const std::string & file : files) {
+        long rate = 0;
+        const double cost = decodeCost(file, rate);
+        if (cost < 0.0) {
+            std::printf("Unable to decode %s\n", file.c_str());
+            continue;
+        }
+        const double values[2] = {(rate == rates[0] ? cost : -1.0), (rate == rates[1] ? cost : -1.0)};
+        row("Decode " + file.substr(file.find_last_of('/') == std::string::npos ? 0 : file.find_last_of('/') + 1), values);
+    }
+
+    NX::stopServices();
+    return 0;
+}
@@ -0,0 +1,368 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "PlayQueue.hpp"
+#include <random>
+#include <string>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "utils/Memory.hpp"
+#include "utils/Random.hpp"
+#include <vector>
+
+// Times the play queue against the vector based queue it replaced, with the same operations the
+// service performs (filling, editing, shuffling and playing through), and prints how long each took
+// and how much of the heap each queue used. Run without arguments for the default sizes.
+
+// Number of edits of each kind, IDs in each edited range and songs played through for each size
+#define EDITS 1000
+#define RANGE 16
+#define PLAYS 10000
+// Number of IDs read at once while drawing the whole shuffled order
+#define DRAW_BATCH 1024
+
+// The previous PlayQueue (a vector of IDs with their original positions), cut down to what's timed.
+// Positions are widened from 16 to 32 bits so it can hold more than 65535 IDs, which keeps each entry
+// at 8 bytes. The 25k IDs it used to reserve at creation are still reserved, but it can grow past them
+class VectorQueue {
+    private:
+        struct Pair {
+            SongID id;
+            uint32_t pos;
+        };
+
+        size_t idx;
+        uint32_t maxPos;
+        std::vector<Pair> queue;
+        bool shuffled;
+
+    public:
+        VectorQueue() {
+            Utils::Memory::Scope scope(Utils::Memory::Tag::Queue);
+            this->idx = 0;
+            this->maxPos = 0;
+            this->queue.reserve(25000);
+            this->shuffled = false;
+        }
+
+        void addID(SongID id, size_t pos) {
+            Utils::Memory::Scope scope(Utils::Memory::Tag::Queue);
+            pos = std::min(pos, this->queue.size());
+            this->queue.insert(this->queue.begin() + pos, Pair{id, (this->shuffled ? this->maxPos + 1 : static_cast<uint32_t>(pos))});
+            if (!this->shuffled) {
+                for (size_t i = pos + 1; i < this->queue.size(); i++) {
+                    this->queue[i].pos++;
+                }
+            }
+            this->maxPos++;
+            if (this->queue.size() > 1 && pos <= this->idx) {
+                this->idx++;
+            }
+        }
+
+        void addIDs(const std::vector<SongID> & ids, size_t pos) {
+            Utils::Memory::Scope scope(Utils::Memory::Tag::Queue);
+            pos = std::min(pos, this->queue.size());
+            if (!this->shuffled) {
+                for (size_t i = pos; i < this->queue.size(); i++) {
+                    this->queue[i].pos += ids.size();
+                }
+            }
+
+            std::vector<Pair> pairs(ids.size());
+            for (size_t i = 0; i < ids.size(); i++) {
+                pairs[i].id = ids[i];
+                pairs[i].pos = (this->shuffled ? this->maxPos + 1 + i : pos + i);
+            }
+            this->queue.insert(this->queue.begin() + pos, pairs.begin(), pairs.end());
+            this->maxPos += ids.size();
+        }
+
+        void removeIDs(size_t pos, size_t count) {
+            this->queue.erase(this->queue.begin() + pos, this->queue.begin() + pos + count);
+            if (!this->shuffled) {
+                for (size_t i = pos; i < this->queue.size(); i++) {
+                    this->queue[i].pos -= count;
+                }
+                this->maxPos -= count;
+            }
+
+            if (this->idx >= pos + count) {
+                this->idx -= count;
+            } else if (this->idx >= pos) {
+                this->idx = std::min(pos, this->queue.size() - 1);
+            }
+        }
+
+        void moveIDs(size_t pos, size_t count, size_t to) {
+            const size_t first = std::min(pos, to);
+            const size_t last = std::max(pos, to) + count;
+            if (to < pos) {
+                std::rotate(this->queue.begin() + to, this->queue.begin() + pos, this->queue.begin() + pos + count);
+            } else {
+                std::rotate(this->queue.begin() + pos, this->queue.begin() + pos + count, this->queue.begin() + to + count);
+            }
+
+            if (!this->shuffled) {
+                for (size_t i = first; i < last; i++) {
+                    this->queue[i].pos = i;
+                }
+            }
+
+            if (this->idx >= pos && this->idx < pos + count) {
+                this->idx = to + (this->idx - pos);
+            } else if (this->idx >= first && this->idx < last) {
+                this->idx = (to < pos ? this->idx + count : this->idx - count);
+            }
+        }
+
+        SongID currentID() {
+            return (this->queue.empty() ? -1 : this->queue[this->idx].id);
+        }
+
+        SongID IDatPosition(size_t pos) {
+            return (pos >= this->queue.size() ? -1 : this->queue[pos].id);
+        }
+
+        void incrementIdx() {
+            if (this->idx + 1 < this->queue.size()) {
+                this->idx++;
+            }
+        }
+
+        size_t currentIdx() {
+            return this->idx;
+        }
+
+        size_t size() {
+            return this->queue.size();
+        }
+
+        void shuffle() {
+            this->shuffled = true;
+            if (this->queue.empty()) {
+                return;
+            }
+
+            std::swap(this->queue[this->idx], this->queue[0]);
+            this->idx = 0;
+            for (size_t i = this->queue.size() - 1; i > 1; i--) {
+                std::swap(this->queue[i], this->queue[Utils::Random::getSizeT(1, i)]);
+            }
+        }
+
+        void unshuffle() {
+            const uint32_t songPos = this->queue[this->idx].pos;
+            std::sort(this->queue.begin(), this->queue.end(), [](const Pair & lhs, const Pair & rhs) {
+                return lhs.pos < rhs.pos;
+            });
+            for (size_t i = 0; i < this->queue.size(); i++) {
+                if (this->queue[i].pos == songPos) {
+                    this->idx = i;
+                }
+                this->queue[i].pos = i;
+            }
+            this->maxPos = this->queue.size();
+            this->shuffled = false;
+        }
+};
+
+// Results for one queue and size
+struct BenchStats {
+    double fill;            // Milliseconds to add every ID at once
+    double insert;          // Microseconds to insert a range at a random position (unshuffled)
+    double remove;          // Microseconds to remove a range at a random position (unshuffled)
+    double move;            // Microseconds to move a range to a random position (unshuffled)
+    double shuffle;         // Milliseconds to shuffle
+    double draw;            // Milliseconds to draw the whole shuffled order (negative if shuffling already did)
+    double shuffledInsert;  // As above, once shuffled and drawn
+    double shuffledRemove;
+    double shuffledMove;
+    double play;            // Microseconds per song played (moving on and reading the current and next IDs)
+    double unshuffle;       // Milliseconds to unshuffle
+    size_t peak;            // Peak bytes used by the queue
+};
+
+static double msSince(const std::chrono::steady_clock::time_point & start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Make EDITS edits of each kind to ranges at random positions, setting the microseconds taken by each.
+// Inserts and removes are made in turn so the size stays the same
+template <typename Queue>
+static void edit(Queue * queue, std::mt19937 & rng, SongID & next, double & insert, double & remove, double & move) {
+    std::vector<SongID> ids(RANGE);
+    std::chrono::duration<double, std::micro> times[3] = {};
+    for (size_t i = 0; i < EDITS; i++) {
+        for (SongID & id : ids) {
+            id = next++;
+        }
+        size_t pos = rng() % (queue->size() + 1);
+        std::chrono::steady_clock::time_point t = std::chrono::steady_clock::now();
+        queue->addIDs(ids, pos);
+        times[0] += std::chrono::steady_clock::now() - t;
+
+        pos = rng() % (queue->size() - RANGE + 1);
+        t = std::chrono::steady_clock::now();
+        queue->removeIDs(pos, RANGE);
+        times[1] += std::chrono::steady_clock::now() - t;
+
+        pos = rng() % (queue->size() - RANGE + 1);
+        const size_t to = rng() % (queue->size() - RANGE + 1);
+        t = std::chrono::steady_clock::now();
+        queue->moveIDs(pos, RANGE, to);
+        times[2] += std::chrono::steady_clock::now() - t;
+    }
+    insert = times[0].count() / EDITS;
+    remove = times[1].count() / EDITS;
+    move = times[2].count() / EDITS;
+}
+
+// Draw the whole shuffled order (the vector was drawn by shuffling), returning the milliseconds taken
+static double drawAll(VectorQueue *) {
+    return -1.0;
+}
+
+static double drawAll(PlayQueue * queue) {
+    std::chrono::steady_clock::time_point t = std::chrono::steady_clock::now();
+    for (size_t pos = 0; pos < queue->size(); pos += DRAW_BATCH) {
+        queue->IDsFromPosition(pos, DRAW_BATCH);
+    }
+    return msSince(t);
+}
+
+// Run the same operations on either queue
+template <typename Queue>
+static BenchStats bench(const size_t count) {
+    BenchStats stats;
+    std::mt19937 rng(1);
+    std::vector<SongID> ids(count);
+    for (size_t i = 0; i < count; i++) {
+        ids[i] = i;
+    }
+
+    Queue * queue;
+    {
+        Utils::Memory::Scope scope(Utils::Memory::Tag::Queue);
+        queue = new Queue();
+    }
+    std::chrono::steady_clock::time_point t = std::chrono::steady_clock::now();
+    queue->addIDs(ids, 0);
+    stats.fill = msSince(t);
+
+    SongID next = count;
+    edit(queue, rng, next, stats.insert, stats.remove, stats.move);
+
+    t = std::chrono::steady_clock::now();
+    queue->shuffle();
+    stats.shuffle = msSince(t);
+    stats.draw = drawAll(queue);
+
+    edit(queue, rng, next, stats.shuffledInsert, stats.shuffledRemove, stats.shuffledMove);
+
+    SongID sum = 0;
+    t = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < PLAYS; i++) {
+        queue->incrementIdx();
+        sum += queue->currentID() + queue->IDatPosition(queue->currentIdx() + 1);
+    }
+    stats.play = 1000.0 * msSince(t) / PLAYS;
+
+    t = std::chrono::steady_clock::now();
+    queue->unshuffle();
+    stats.unshuffle = msSince(t);
+
+    stats.peak = Utils::Memory::usage(Utils::Memory::Tag::Queue).peak;
+    delete queue;
+    if (sum == 0) {
+        std::printf("(sum of IDs read was zero)\n");
+    }
+    return stats;
+}
+
+// Run a benchmark in a child process so the peak memory is only it's own, passing the results back
+// through a pipe. Returns false if it didn't finish
+template <typename Queue>
+static bool run(const size_t count, BenchStats & stats) {
+    int fds[2];
+    if (pipe(fds) != 0) {
+        return false;
+    }
+
+    std::fflush(stdout);
+    const pid_t pid = fork();
+    if (pid == 0) {
+        close(fds[0]);
+        const BenchStats result = bench<Queue>(count);
+        const bool ok = (write(fds[1], &result, sizeof(result)) == sizeof(result));
+        _exit(ok ? 0 : 1);
+    }
+
+    close(fds[1]);
+    const bool ok = (pid > 0 && read(fds[0], &stats, sizeof(stats)) == sizeof(stats));
+    close(fds[0]);
+    if (pid > 0) {
+        waitpid(pid, nullptr, 0);
+    }
+    return ok;
+}
+
+// Print one row of the results for both queues
+static void row(const char * name, const double vector, const double tree) {
+    const auto value = [](const double v) {
+        char str[16];
+        if (v < 0.0) {
+            std::snprintf(str, sizeof(str), "-");
+        } else {
+            std::snprintf(str, sizeof(str), "%.3f", v);
+        }
+        return std::string(str);
+    };
+    std::printf("  %-28s %10s %10s\n", name, value(vector).c_str(), value(tree).c_str());
+}
+
+int main(int argc, char * argv[]) {
+    std::vector<size_t> counts;
+    for (int i = 1; i < argc; i++) {
+        const size_t count = std::strtoul(argv[i], nullptr, 10);
+        if (count < 2 * RANGE) {
+            std::printf("Usage: %s [entries...]\n", argv[0]);
+            std::printf("  Compares the play queue to the vector it replaced with each number of entries (25000, 100000\n");
+            std::printf("  and 250000 if none are given). %d edits of %d IDs are made of each kind, both before shuffling\n", EDITS, RANGE);
+            std::printf("  and once the whole shuffled order is drawn, then %d songs are played\n", PLAYS);
+            return 1;
+        }
+        counts.push_back(count);
+    }
+    if (counts.empty()) {
+        counts = {25000, 100000, 250000};
+    }
+
+    for (const size_t count : counts) {
+        BenchStats vector;
+        BenchStats tree;
+        if (!run<VectorQueue>(count, vector) || !run<PlayQueue>(count, tree)) {
+            std::printf("Benchmark with %zu entries failed\n", count);
+            return 1;
+        }
+
+        std::printf("%zu entries %21s %10s %10s\n", count, "", "vector", "tree");
+        row("Fill (ms)", vector.fill, tree.fill);
+        row("Insert range (us)", vector.insert, tree.insert);
+        row("Remove range (us)", vector.remove, tree.remove);
+        row("Move range (us)", vector.move, tree.move);
+        row("Shuffle (ms)", vector.shuffle, tree.shuffle);
+        row("Draw whole order (ms)", vector.draw, tree.draw);
+        row("Shuffled insert range (us)", vector.shuffledInsert, tree.shuffledInsert);
+        row("Shuffled remove range (us)", vector.shuffledRemove, tree.shuffledRemove);
+        row("Shuffled move range (us)", vector.shuffledMove, tree.shuffledMove);
+        row("Play (us per song)", vector.play, tree.play);
+        row("Unshuffle (ms)", vector.unshuffle, tree.unshuffle);
+        row("Peak memory (kB)", vector.peak/1024.0, tree.peak/1024.0);
+        std::printf("\n");
+    }
+    return 0;
+}
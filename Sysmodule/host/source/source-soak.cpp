@@ -0,0 +1,119 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "nx/NX.hpp"
+#include "source/Factory.hpp"
+#include <string>
+#include "utils/Memory.hpp"
+#include <vector>
+
+// Opens and closes the given files through Source::Factory over and over, the same way the service moves
+// between songs (decoding the start of each, seeking and decoding a little more), and checks that the
+// memory attributed to sources returns to the same value after every cycle. Pooled memory is allowed to
+// settle during the first cycle. Exits with a non-zero status as soon as it doesn't.
+// Run without arguments for usage.
+
+// Matches Service.cpp
+#define SCRATCH_SAMPLES 8192
+
+// Number of cycles through the files unless given
+#define CYCLES 2000
+// Frames decoded from the start of each song, and after seeking
+#define DECODE_FRAMES 16384
+#define SEEK_FRAMES 4096
+
+static void usage(const char * name) {
+    std::printf("Usage: %s [-n cycles] file...\n", name);
+    std::printf("  Opens, decodes part of and closes each file in turn %d times (unless given), failing if the\n", CYCLES);
+    std::printf("  memory used by sources differs from what it was after the first time through\n");
+}
+
+// Decode up to the given number of frames, returning false if the source stopped being valid
+static bool decode(Source::Source * source, float * scratch, const size_t frames) {
+    const size_t chunkFrames = SCRATCH_SAMPLES/source->channels();
+    size_t total = 0;
+    while (total < frames && source->valid() && !source->done()) {
+        const size_t decoded = source->decode(scratch, (frames - total < chunkFrames ? frames - total : chunkFrames));
+        if (decoded == 0) {
+            break;
+        }
+        total += decoded;
+    }
+    return source->valid();
+}
+
+// Open, use and close a source for the file, returning false if it couldn't be
+static bool cycle(const std::string & path, float * scratch) {
+    Utils::Memory::Scope scope(Utils::Memory::Tag::Source);
+    Source::Source * source = Source::Factory::getSource(path);
+    if (source == nullptr || !source->valid()) {
+        delete source;
+        return false;
+    }
+
+    bool ok = decode(source, scratch, DECODE_FRAMES);
+    if (ok) {
+        source->seek(source->totalSamples()/2);
+        ok = decode(source, scratch, SEEK_FRAMES);
+    }
+    delete source;
+    return ok;
+}
+
+int main(int argc, char * argv[]) {
+    size_t cycles = CYCLES;
+    std::vector<std::string> files;
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            cycles = std::strtoul(argv[++i], nullptr, 10);
+        } else if (argv[i][0] == '-') {
+            usage(argv[0]);
+            return 1;
+        } else {
+            files.push_back(argv[i]);
+        }
+    }
+    if (files.empty() || cycles == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (!NX::startServices()) {
+        std::printf("Unable to start file I/O\n");
+        return 1;
+    }
+
+    float * scratch = new float[SCRATCH_SAMPLES];
+    const size_t start = Utils::Memory::usage(Utils::Memory::Tag::Source).used;
+    size_t settled = 0;
+    bool ok = true;
+    std::chrono::steady_clock::time_point t = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < cycles && ok; i++) {
+        for (const std::string & file : files) {
+            if (!cycle(file, scratch)) {
+                std::printf("Unable to open or decode %s (cycle %zu)\n", file.c_str(), i + 1);
+                ok = false;
+                break;
+            }
+        }
+
+        const size_t used = Utils::Memory::usage(Utils::Memory::Tag::Source).used;
+        if (i == 0) {
+            settled = used;
+        } else if (ok && used != settled) {
+            std::printf("Memory used by sources changed from %zu to %zu bytes after cycle %zu\n", settled, used, i + 1);
+            ok = false;
+        }
+    }
+    const double time = std::chrono::duration<double>(std::chrono::steady_clock::now() - t).count();
+
+    if (ok) {
+        std::printf("Opened %zu sources in %.2fs\n", cycles * files.size(), time);
+        std::printf("Memory used by sources: %zu bytes before, %zu kept by pools after every cycle, %zukB peak\n",
+                    start, settled - start, Utils::Memory::usage(Utils::Memory::Tag::Source).peak/1024);
+    }
+    delete[] scratch;
+    NX::stopServices();
+    return (ok ? 0 : 1);
+}
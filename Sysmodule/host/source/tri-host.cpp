@@ -0,0 +1,250 @@
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include "dsp/Chain.hpp"
+#include "dsp/Convert.hpp"
+#include "dsp/Dither.hpp"
+#include "dsp/Equalizer.hpp"
+#include "dsp/Gain.hpp"
+#include "dsp/Limiter.hpp"
+#include "Log.hpp"
+#include "nx/Audio.hpp"
+#include "nx/File.hpp"
+#include "nx/NX.hpp"
+#include "output/Host.hpp"
+#include "PlayQueue.hpp"
+#include "source/Factory.hpp"
+#include <string>
+#include "utils/Memory.hpp"
+#include <vector>
+
+// Plays the given files through the sysmodule's pipeline the same way the decode thread does
+// (source -> DSP chain -> 16 bit -> audio FIFO), with the next song queued gaplessly behind the
+// current one where possible, and prints how it went. Run without arguments for usage.
+
+// Matches Service.cpp
+#define SCRATCH_SAMPLES 8192
+#define LIMITER_CEILING 0.98f
+
+// Statistics for one song
+struct SongStats {
+    std::string path;       // File played
+    double audio;           // Seconds of audio decoded
+    double decode;          // Seconds spent decoding (and reading)
+    double dsp;             // Seconds spent in the DSP chain and converting
+    double open;            // Seconds taken to open the file
+    double change;          // Seconds between the previous song's last block and this song's first
+    bool gapless;           // Whether it was queued behind the previous song without stopping the voice
+};
+
+static void usage(const char * name) {
+    std::printf("Usage: %s [options] file...\n", name);
+    std::printf("  -o <file>  Write the played audio to a WAV file (otherwise it's discarded)\n");
+    std::printf("  -r         Play in real time (otherwise as fast as possible, where underruns aren't meaningful)\n");
+    std::printf("  -s         Shuffle the queue first\n");
+    std::printf("  -l <file>  Write the sysmodule's log to a file\n");
+}
+
+void audioThread(void * arg) {
+    static_cast<Audio *>(arg)->process();
+}
+
+int main(int argc, char * argv[]) {
+    std::string output;
+    std::string log;
+    bool realTime = false;
+    bool shuffle = false;
+    std::vector<std::string> files;
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            output = argv[++i];
+        } else if (std::strcmp(argv[i], "-l") == 0 && i + 1 < argc) {
+            log = argv[++i];
+        } else if (std::strcmp(argv[i], "-r") == 0) {
+            realTime = true;
+        } else if (std::strcmp(argv[i], "-s") == 0) {
+            shuffle = true;
+        } else if (argv[i][0] == '-') {
+            usage(argv[0]);
+            return 1;
+        } else {
+            files.push_back(argv[i]);
+        }
+    }
+    if (files.empty()) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (!log.empty()) {
+        Log::openFile(log, Log::Level::Info);
+    }
+    if (!NX::startServices()) {
+        std::printf("Unable to start file I/O\n");
+        return 1;
+    }
+
+    // Create audio output on the host backend, waking us whenever there's room or it stops
+    NX::Event event;
+    Audio::setBackend(new Output::Host(output, realTime));
+    Audio * audio = Audio::getInstance();
+    if (!audio->initialized()) {
+        std::printf("Unable to create audio output\n");
+        return 1;
+    }
+    audio->setBufferFunc([&event]() {
+        event.signal();
+    });
+    audio->setStatusFunc([&event]() {
+        event.signal();
+    });
+    NX::Thread::create("audio", audioThread, audio);
+
+    // Queue each file (IDs are indices into files)
+    PlayQueue * queue;
+    {
+        Utils::Memory::Scope scope(Utils::Memory::Tag::Queue);
+        queue = new PlayQueue();
+        std::vector<SongID> ids;
+        for (size_t i = 0; i < files.size(); i++) {
+            ids.push_back(i);
+        }
+        queue->addIDs(ids, 0);
+        if (shuffle) {
+            queue->shuffle();
+        }
+    }
+
+    // Same chain as the service, with defaults
+    Dsp::Chain dsp;
+    Dsp::Gain gain;
+    Dsp::Equalizer equalizer;
+    Dsp::Limiter limiter(LIMITER_CEILING);
+    Dsp::Dither dither;
+    dsp.add(&gain);
+    dsp.add(&equalizer);
+    dsp.add(&limiter);
+    dsp.add(&dither);
+
+    Utils::Memory::Scope scope(Utils::Memory::Tag::Source);
+    float * scratch = new float[SCRATCH_SAMPLES];
+    std::vector<SongStats> stats;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::time_point lastBlock = start;
+    bool first = true;
+    while (true) {
+        SongStats song = {files[queue->currentID()], 0.0, 0.0, 0.0, 0.0, 0.0, false};
+
+        // Open the song
+        std::chrono::steady_clock::time_point t = std::chrono::steady_clock::now();
+        Source::Source * source = Source::Factory::getSource(song.path);
+        song.open = std::chrono::duration<double>(std::chrono::steady_clock::now() - t).count();
+        if (source == nullptr || !source->valid()) {
+            std::printf("Unable to open %s, skipping\n", song.path.c_str());
+            delete source;
+
+        } else {
+            // Queue it behind the previous song, otherwise wait for that to finish and start again
+            song.gapless = (!first && audio->continueSong(source->sampleRate(), source->channels(), source->format()));
+            if (!song.gapless) {
+                while (!audio->finished()) {
+                    event.wait(100);
+                }
+                audio->newSong(source->sampleRate(), source->channels(), source->format());
+                dsp.reset();
+            }
+            first = false;
+
+            // Decode into the FIFO until the song is done
+            const int channels = source->channels();
+            const long rate = source->sampleRate();
+            const size_t maxFrames = audio->bufferSize()/(sizeof(int16_t) * channels);
+            const size_t chunkFrames = SCRATCH_SAMPLES/channels;
+            bool firstBlock = true;
+            while (source->valid() && !source->done()) {
+                uint8_t * buf = audio->acquireBuffer();
+                if (buf == nullptr) {
+                    event.wait(100);
+                    continue;
+                }
+
+                std::chrono::steady_clock::time_point blockStart = std::chrono::steady_clock::now();
+                size_t frames = 0;
+                while (frames < maxFrames) {
+                    size_t count = (maxFrames - frames < chunkFrames ? maxFrames - frames : chunkFrames);
+                    t = std::chrono::steady_clock::now();
+                    size_t decoded = source->decode(scratch, count);
+                    std::chrono::steady_clock::time_point decodeEnd = std::chrono::steady_clock::now();
+                    song.decode += std::chrono::duration<double>(decodeEnd - t).count();
+                    if (decoded == 0) {
+                        break;
+                    }
+
+                    dsp.process(scratch, decoded, channels, rate, source->exact());
+                    Dsp::floatToInt16(scratch, reinterpret_cast<int16_t *>(buf) + frames * channels, decoded * channels);
+                    song.dsp += std::chrono::duration<double>(std::chrono::steady_clock::now() - decodeEnd).count();
+                    frames += decoded;
+                }
+                if (frames == 0) {
+                    continue;
+                }
+
+                audio->commitBuffer(frames * channels * sizeof(int16_t));
+                std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+                audio->reportLatency(std::chrono::duration<double>(now - blockStart).count(), NX::File::stats().readLatency);
+                song.audio += static_cast<double>(frames)/rate;
+                if (firstBlock) {
+                    song.change = std::chrono::duration<double>(now - lastBlock).count();
+                    firstBlock = false;
+                }
+                lastBlock = now;
+            }
+            delete source;
+            stats.push_back(song);
+        }
+
+        // Move onto the next song
+        if (queue->currentIdx() + 1 >= queue->size()) {
+            break;
+        }
+        queue->incrementIdx();
+    }
+
+    // Wait for everything to be played
+    while (!audio->finished()) {
+        event.wait(100);
+    }
+    double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    // Report
+    double audioTotal = 0.0;
+    double decodeTotal = 0.0;
+    double dspTotal = 0.0;
+    std::printf("%-40s %9s %9s %9s %9s %9s %s\n", "Song", "Audio(s)", "Decode(x)", "DSP(x)", "Open(ms)", "Change(ms)", "Gapless");
+    for (const SongStats & song : stats) {
+        std::string name = song.path.substr(song.path.find_last_of('/') == std::string::npos ? 0 : song.path.find_last_of('/') + 1);
+        std::printf("%-40.40s %9.2f %9.1f %9.1f %9.2f %9.2f %s\n", name.c_str(), song.audio, song.audio/song.decode, song.audio/song.dsp,
+                    1000.0 * song.open, 1000.0 * song.change, (song.gapless ? "yes" : "no"));
+        audioTotal += song.audio;
+        decodeTotal += song.decode;
+        dspTotal += song.dsp;
+    }
+    std::printf("\nPlayed %.2fs of audio in %.2fs (decoding %.1fx real time, DSP %.1fx)\n", audioTotal, wall, audioTotal/decodeTotal, audioTotal/dspTotal);
+    std::printf("Underruns: %zu, buffers in use at the end: %zu of %zu\n", audio->underrunCount(), audio->bufferDepth(), audio->maxBufferDepth());
+
+    std::printf("\nPeak memory:\n");
+    for (size_t i = 0; i < static_cast<size_t>(Utils::Memory::Tag::Count); i++) {
+        const Utils::Memory::Tag tag = static_cast<Utils::Memory::Tag>(i);
+        std::printf("  %-10s %6zukB\n", Utils::Memory::name(tag), Utils::Memory::usage(tag).peak/1024);
+    }
+
+    // Clean up
+    delete[] scratch;
+    delete queue;
+    audio->exit();
+    NX::Thread::join("audio");
+    delete audio;
+    NX::stopServices();
+    Log::closeFile();
+    return 0;
+}
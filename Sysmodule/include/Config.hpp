@@ -4,6 +4,7 @@
 #include <array>
 #include "Log.hpp"
 #include <string>
+#include "Types.hpp"
 
 // Forward declaration as we only need the pointer here
 class minIni;
@@ -42,9 +43,27 @@ class Config {
         // Pause when headset unplugged
         bool pauseOnUnplug();
 
+        // ReplayGain values to apply (defaults to Track)
+        ReplayGain replayGain();
+
+        // Number of seconds before the end of a song to open and start reading the next one
+        // (defaults to 10, zero waits until the current song has been decoded)
+        int prefetchTime();
+
+        // Number of upcoming songs to keep the first second of decoded audio for, so skipping
+        // to them starts instantly (defaults to 2, zero disables the cache)
+        int pcmCacheSongs();
+
+        // Buffer as little audio as is safe while no game is running (defaults to true)
+        bool lowLatency();
+
+        // Dither when converting to 16 bit (defaults to true), optionally with noise shaping (defaults to false)
+        bool dither();
+        bool noiseShaping();
+
         // Seek method for mpg123 (defaults to false)
         bool MP3AccurateSeek();
-        // Equalizer values for mpg123 (all 1.0 by default)
+        // Equalizer band gains, applied to all formats (all 1.0 by default)
         // Returns all bands in order
         std::array<float, 32> MP3Equalizer();
 
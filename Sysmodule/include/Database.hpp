@@ -28,6 +28,9 @@ class Database {
 
         // Return a path matching given ID (or blank if not found)
         std::string getPathForID(SongID);
+        // Get the ReplayGain of the given song, or it's album if the bool is true (falling back to the song's)
+        // Fills the gain (dB) and peak (linear), returning false if not found or not measured
+        bool getGainForID(SongID, bool, float &, float &);
 
         // Destructor closes handle
         ~Database();
@@ -1,45 +1,84 @@
 #ifndef PLAYQUEUE_HPP
 #define PLAYQUEUE_HPP
 
+#include <cstdint>
 #include "Types.hpp"
+#include "utils/OrderTree.hpp"
 #include <vector>
 
-// Struct stored in vector
-typedef struct {
-    SongID id;              // 4 bytes (it's an int)
-    unsigned short pos;     // 2 bytes (we don't need more than 65535)
-} PlayQueuePair;
-
-// A play queue stores a list of song IDs and can be shuffled, unshuffled (due to keeping original positions)
-// and have IDs inserted/removed. Even though it uses a vector there is a hard limit to avoid running out of RAM
+// A play queue stores a list of song IDs and can be shuffled, unshuffled and have IDs inserted/removed.
+// IDs are kept in an OrderTree (in their original order) so edits don't shift every following ID, and
+// the queue can grow for as long as it's memory budget allows. When shuffled, a second tree holds the
+// shuffled order as keys, each being the song's original position when it was shuffled (songs added
+// afterwards get the keys following those). The original order then only loses songs or gains them at
+// the end, so a key's current position is it's value minus the number of removed keys before it.
+// The shuffled order is only drawn (one Fisher-Yates step per song) as far as it's been needed. Every
+// edit draws past the current song by the lookahead, so reading those songs never changes the queue.
 class PlayQueue {
     private:
         // Index of 'current' song
-        unsigned short idx;
-        // Largest pos in queue (used for adding IDs when shuffled)
-        unsigned short maxPos;
-        // Vector containing IDs
-        std::vector<PlayQueuePair> queue;
+        size_t idx;
+        // Tree containing IDs in their original order
+        Utils::OrderTree<SongID> queue;
         // Are we shuffled?
         bool shuffled;
+        // Shuffled order (as keys), of which only the first 'drawn' are in their final place
+        Utils::OrderTree<uint32_t> order;
+        size_t drawn;
+        // Number of songs after the current one which are always drawn
+        size_t lookahead;
+        // One bit per key which is set once it's song is removed, and a Fenwick tree over the
+        // number set in each word (so the number removed before a key can be counted in O(log n))
+        std::vector<uint64_t> removedBits;
+        std::vector<uint32_t> removedCounts;
+        // Number of keys handed out
+        uint32_t nextKey;
+
+        // Draw the shuffled order until it reaches the given position (or the end)
+        void draw(size_t);
+        // Start keys for the given number of songs added to the end of the original order
+        void addKeys(size_t);
+        // Mark the given key as removed
+        void removeKey(uint32_t);
+        // Returns the number of keys removed within the given number of words at the start
+        size_t removedWithin(size_t);
+        // Returns the position of the given key in the original order
+        size_t keyPosition(uint32_t);
 
     public:
         PlayQueue();
 
         // Add an ID at given position, shifting down (returns false if full)
-        bool addID(SongID, unsigned short);
+        bool addID(SongID, size_t);
         // Remove ID at given position (returns false if out of bounds)
-        bool removeID(unsigned short);
+        bool removeID(size_t);
+
+        // The following keep the current song the same unless it is removed, in which case the
+        // song after the removed range becomes current
+        // Add IDs starting at given position, shifting down (returns false if they won't all fit)
+        bool addIDs(const std::vector<SongID> &, size_t);
+        // Remove the given number of IDs starting at position (returns false if out of bounds)
+        bool removeIDs(size_t, size_t);
+        // Move the given number of IDs starting at position so the first is at the last position
+        // (which is counted as if they were removed first). Returns false if out of bounds
+        bool moveIDs(size_t, size_t, size_t);
 
         // Shift ID at position by given spots towards end (will move to end if too far)
-        void moveIDDown(unsigned short, unsigned short);
+        void moveIDDown(size_t, size_t);
         // Shift ID at position by given spots towards start (will move to start if too far)
-        void moveIDUp(unsigned short, unsigned short);
+        void moveIDUp(size_t, size_t);
 
+        // The following only read, so can be called while others do as well
         // Get the current ID (-1 if empty)
         SongID currentID();
-        // Returns ID at position (-1 if out of bounds)
-        SongID IDatPosition(unsigned short);
+        // Returns ID at position (-1 if out of bounds). While shuffled, only positions up to the lookahead
+        // past the current song are certain to be drawn, and -1 is returned for any which aren't
+        SongID IDatPosition(size_t);
+
+        // Returns up to the given number of IDs starting at position (drawing as far as needed)
+        std::vector<SongID> IDsFromPosition(size_t, size_t);
+        // Set the number of songs after the current one which can be read with IDatPosition() (defaults to 1)
+        void setLookahead(size_t);
 
         // Get the index of the current ID
         size_t currentIdx();
@@ -47,8 +86,8 @@ class PlayQueue {
         void decrementIdx();
         // Increase position (does nothing if at the end)
         void incrementIdx();
-        // Set position (set to end if larger than size)
-        void setIdx(unsigned short);
+        // Set position (set to end if larger than size, or the start if empty)
+        void setIdx(size_t);
 
         // Clear the queue
         void clear();
@@ -56,12 +95,14 @@ class PlayQueue {
         bool empty();
         // Return number of IDs in queue
         size_t size();
+        // Returns true if the queue can hold the given number of IDs
+        bool canHold(size_t);
 
         // Returns true if shuffled
         bool isShuffled();
         // (Re)shuffle the queue (current song will become the first song in queue)
         void shuffle();
-        // Unshuffle the queue (no effect if not shuffled)
+        // Return to the original order, keeping the current song (no effect if not shuffled)
         void unshuffle();
 };
 
@@ -0,0 +1,48 @@
+#ifndef QUEUEJOURNAL_HPP
+#define QUEUEJOURNAL_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include "ipc/TriPlayer.hpp"
+#include <mutex>
+#include "Types.hpp"
+#include <vector>
+
+// A QueueJournal remembers the most recent edits made to the queue and sub-queue,
+// so that clients holding a copy of them only need to fetch what has changed.
+// Each edit moves the journal onto a new version. Once it's full the oldest edits
+// are forgotten, and edits which replace a whole queue (e.g. shuffling) forget
+// everything, after which clients need to fetch the queues in full.
+// This class is thread-safe.
+class QueueJournal {
+    private:
+        std::mutex mutex;                               // Protects everything below
+        std::vector<TriPlayer::QueueChange> changes;    // Ring buffer of edits
+        size_t first;                                   // Index of the oldest edit
+        size_t count;                                   // Number of edits held
+        uint64_t version_;                              // Version reached by the newest edit
+
+        // Append an edit, dropping the oldest if full
+        void add(const TriPlayer::QueueChange &);
+
+    public:
+        // Constructor takes the maximum number of edits to remember
+        QueueJournal(const size_t);
+
+        // Record that the song was inserted at the position
+        void insert(const bool, const size_t, const SongID);
+        // Record that the number of songs were removed from the position
+        void remove(const bool, const size_t, const size_t);
+        // Record that the song at the first position was moved to the second
+        void move(const bool, const size_t, const size_t);
+        // Record that a whole queue has been replaced (forgets all edits)
+        void reset();
+
+        // Returns the current version
+        uint64_t version();
+        // Append up to the given number of edits made after the given version. Returns false
+        // if the journal no longer goes back that far (or the version is newer than the current one)
+        bool changesSince(const uint64_t, const size_t, std::vector<TriPlayer::QueueChange> &);
+};
+
+#endif
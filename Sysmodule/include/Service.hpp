@@ -2,22 +2,38 @@
 #define MAINSERVICE_HPP
 
 #include <atomic>
+#include <chrono>
 #include <ctime>
 #include <deque>
-#include <shared_mutex>
 #include "ipc/Command.hpp"
 #include "ipc/Result.hpp"
 #include "ipc/Server.hpp"
+#include "ipc/TriPlayer.hpp"
+#include "nx/NX.hpp"
 #include "Types.hpp"
+#include "utils/PcmCache.hpp"
+#include "utils/TimedMutex.hpp"
+#include <vector>
 
 // Forward declare pointers
 class Audio;
 class Config;
 class Database;
 class PlayQueue;
+class QueueJournal;
+namespace Dsp {
+    class Chain;
+    class Dither;
+    class Equalizer;
+    class Gain;
+    class Limiter;
+};
 namespace Source {
     class Source;
 };
+namespace Utils {
+    class LatencyStats;
+};
 
 // Class which manages all actions taken when receiving a command
 // Essentially encapsulates everything
@@ -37,12 +53,33 @@ class MainService {
         Config * cfg;
         // Database object
         Database * db;
+        // DSP chain applied to all decoded audio, and it's effects (protected by sMutex)
+        Dsp::Chain * dsp;
+        Dsp::Dither * dither;
+        Dsp::Equalizer * equalizer;
+        Dsp::Gain * gain;
+        Dsp::Limiter * limiter;
+        // ReplayGain mode, and the (linear) gain of the current/next source (protected by sMutex)
+        ReplayGain replayGain;
+        float sourceGain;
+        float nextSourceGain;
+        // Float samples decoded by the decode thread before they're run through the chain
+        float * scratch;
+        // Seconds spent decoding, and seconds of audio decoded (protected by sMutex)
+        double decodeTime;
+        double decodedTime;
+        // Time taken to fill each buffer, and to start each new song (reported by GetStats)
+        Utils::LatencyStats * bufferStats;
+        Utils::LatencyStats * changeStats;
         // IPC Server which clients interact with
         Ipc::Server * ipcServer;
         // Main queue of songs
         PlayQueue * queue;
         // Queue of 'queued' songs
         std::deque<SongID> subQueue;
+        // Recent edits to both queues, sent to clients so they don't need to fetch them in full
+        // (record an edit while still holding the queue's mutex so they're journalled in order)
+        QueueJournal * journal;
 
         // Whether to stop loop and exit
         std::atomic<bool> exit_;
@@ -50,6 +87,12 @@ class MainService {
         std::atomic<double> muteLevel;
         // String set by client indicating where the music is playing from
         std::string playingFrom;
+        // Last snapshot returned by GetState (without position/generation) and it's generation
+        std::mutex stateMutex;
+        TriPlayer::State lastState;
+        uint64_t stateGeneration;
+        // Generation subscribed clients were last told about (protected by stateMutex)
+        uint64_t notifiedGeneration;
         // Timestamp of last previous press
         std::atomic<std::time_t> pressTime;
         // Repeat mode
@@ -57,22 +100,70 @@ class MainService {
         // Status vars for comm. between threads
         std::atomic<SongAction> songAction; // (should this be a queue?)
         std::atomic<double> seekTo;
+        // Whether to buffer less audio while no game is running
+        std::atomic<bool> lowLatency;
         // Whether to listen for events
         std::atomic<bool> watchGpio;
         std::atomic<bool> watchHid;
         std::atomic<bool> watchSleep;
 
+        // Events used to wake threads once there is work for them to do
+        NX::Event decodeEvent;      // Room in the FIFO, or the source/song action changed
+        NX::Event gpioEvent;        // Audio status or config changed
+        NX::Event hidEvent;         // Config changed
+        NX::Event playbackEvent;    // Song action/seek requested, source decoded or audio status changed
+
         // Mutex for accessing queue
-        std::shared_mutex qMutex;
-        // Mutex for accessing source
-        std::shared_mutex sMutex;
+        Utils::SharedMutex qMutex;
+        // Mutex for accessing source (held by the decode thread while decoding)
+        Utils::SharedMutex sMutex;
         // Mutex for accessing sub-queue
-        std::shared_mutex sqMutex;
+        Utils::SharedMutex sqMutex;
         // Source currently playing
         Source::Source * source;
+        // Total samples in the current source (read without locking sMutex)
+        std::atomic<int> songLength;
+
+        // Source opened ahead of time to play once the current one finishes (protected by sMutex)
+        Source::Source * nextSource;
+        // ID of the song nextSource was opened for
+        SongID nextSourceID;
+        // Action to apply to the queue when moving onto nextSource
+        SongAction nextSourceAction;
+        // Set true once nextSource's audio is queued directly behind the current song's
+        bool nextSourceQueued;
+        // Set true once an attempt has been made to open nextSource for the current song
+        bool nextSourceOpened;
+        // Set true once an attempt has been made to queue nextSource behind the current song
+        bool nextSourceTried;
+        // Seconds before the end of the current song to open nextSource (protected by sMutex)
+        int prefetchTime;
+
+        // Start of the upcoming songs' decoded audio, filled by the decode thread while it has
+        // nothing else to do, so skipping to one of them plays straight away (protected by sMutex)
+        Utils::PcmCache * pcmCache;
+        // Number of upcoming songs to cache (protected by sMutex)
+        int pcmCacheSongs;
+        // Source being decoded into the cache, and the entry it's filling (protected by sMutex, though
+        // fillPcmCache() takes them out while decoding so the lock isn't held meanwhile)
+        Source::Source * cacheSource;
+        std::shared_ptr<Utils::PcmCache::Entry> cacheEntry;
+        // Cached audio played before the current source, and the next frame to play from it (protected by sMutex)
+        std::shared_ptr<Utils::PcmCache::Entry> cachePlayback;
+        size_t cachePlaybackPos;
+        // ID and path of the song started from the cache which still needs opening (-1 if none),
+        // and the number of frames to skip once it is (protected by sMutex, the ID can be read without)
+        std::atomic<SongID> cacheOpenID;
+        std::string cacheOpenPath;
+        size_t cacheOpenFrames;
+
+        // Time the last song change was requested (used to report time-to-first-sample)
+        std::chrono::steady_clock::time_point changeTime;
+        // Set true until the first buffer of a new song has been queued
+        bool changePending;
 
         // Mutex for access combo strings
-        std::shared_mutex cMutex;
+        Utils::SharedMutex cMutex;
         // Variables for reacting to press combinations
         std::atomic<bool> combosUpdated;
         std::string comboNextString;
@@ -80,12 +171,60 @@ class MainService {
         std::string comboPrevString;
 
         // Variables used for 'locking' DB access
-        std::mutex dbMutex;
+        Utils::Mutex dbMutex;
         std::atomic<bool> dbLocked;
 
         // Reads config from disk and sets up relevant objects
         void updateConfig();
 
+        // Move the queue according to the given action (requires qMutex and sqMutex)
+        void advanceQueue(const SongAction);
+        // Returns the ID of the song to play once the current one finishes (-1 if none), and the
+        // action that needs to be applied to the queue to get there (requires qMutex and sqMutex)
+        SongID peekNextSong(SongAction &);
+        // Wait until the database can be read and return the path for the given ID
+        std::string getPathForID(const SongID);
+        // Returns the linear gain to apply to the given song according to the ReplayGain mode
+        // (call after getPathForID, as it expects the database to be open)
+        float getGainForID(const SongID);
+
+        // Returns true once the current source is close enough to it's end to open the next one (requires sMutex)
+        bool nextSourceDue();
+        // Open the song after the current one, which starts reading it's file at a lower priority than
+        // the current song's (requires sMutex, qMutex and sqMutex)
+        void openNextSource();
+        // Open the song after the current one if it isn't already (or the queue has changed since), queueing
+        // it straight behind the current song if the audio voice can be reused (requires sMutex, qMutex and sqMutex)
+        void prepareNextSource();
+        // Move onto the source queued by prepareNextSource() (requires sMutex, qMutex and sqMutex)
+        void commitNextSource();
+        // Delete the source opened by openNextSource() (requires sMutex)
+        void discardNextSource();
+
+        // Returns the IDs of up to the given number of songs which follow the current one
+        // (requires qMutex and sqMutex)
+        std::vector<SongID> upcomingSongs(const size_t);
+        // Decode a little more of the next upcoming song which isn't fully cached
+        // Returns false if there was nothing to do
+        bool fillPcmCache();
+        // Open the song started from the cache and skip past the cached audio, without holding
+        // sMutex while opening so the decoder can play the cached audio meanwhile
+        void openCachedSong();
+        // Drop all cached audio, including any being played (requires sMutex)
+        void discardPcmCache();
+
+        // Returns the playback status/position/repeat mode as reported over IPC
+        TriPlayer::Status playbackStatus();
+        double playbackPosition();
+        TriPlayer::Repeat playbackRepeat();
+
+        // Fill in the reply to GetState
+        void getState(TriPlayer::State &);
+        // Signal subscribed clients if the state has moved onto a new generation since they were last signalled
+        void publishState();
+        // Fill in the reply to GetStats
+        void getStats(TriPlayer::Stats &);
+
         // Function run to handle an IPC Request
         Ipc::Result commandThread(Ipc::Request *);
 
@@ -100,9 +239,11 @@ class MainService {
         void gpioEventThread();
         // Listens for input events and executes required commands on button presses
         void hidEventThread();
+        // Decodes the current source into the audio FIFO
+        void decodeThread();
         // Handles interactions from client(s)
         void ipcThread();
-        // Handles decoding and shifting between songs due to commands
+        // Handles shifting between songs due to commands
         void playbackThread();
         // Listens for 'sleep' event and pauses playback
         void sleepEventThread();
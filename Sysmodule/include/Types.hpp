@@ -16,6 +16,13 @@ enum class RepeatMode {
     All         // Repeat the queue
 };
 
+// Which ReplayGain values to apply
+enum class ReplayGain {
+    Off,        // Don't adjust volume
+    Track,      // Use each song's own gain
+    Album       // Use the gain of the song's album
+};
+
 typedef int SongID;
 
 #endif
\ No newline at end of file
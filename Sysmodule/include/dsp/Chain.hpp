@@ -0,0 +1,32 @@
+#ifndef DSP_CHAIN_HPP
+#define DSP_CHAIN_HPP
+
+#include "dsp/Effect.hpp"
+#include <vector>
+
+// A Chain runs decoded audio through an ordered list of effects. Effects
+// are added once and then apply to every source, regardless of codec.
+// The chain doesn't take ownership of the effects.
+// This class is not thread-safe!
+namespace Dsp {
+    class Chain {
+        private:
+            // Effects in the order they are applied
+            std::vector<Effect *> effects;
+
+        public:
+            // Append an effect to the end of the chain
+            void add(Effect *);
+
+            // Run the buffer through each effect in order
+            // Takes buffer, number of frames, number of channels, sample rate and whether the samples
+            // are exactly 16 bit (i.e. decoded from 16 bit PCM). Effects which only guard against changes
+            // (the limiter and dither) are skipped while no earlier effect has changed such samples, so
+            // they're output bit-exact
+            void process(float *, size_t, int, long, bool);
+            // Reset each effect
+            void reset();
+    };
+};
+
+#endif
@@ -0,0 +1,16 @@
+#ifndef DSP_CONVERT_HPP
+#define DSP_CONVERT_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+// Conversions between the DSP chain's float samples (-1.0 to 1.0) and
+// 16 bit integer samples. These are vectorized where possible.
+namespace Dsp {
+    // Convert the given number of float samples to 16 bit, rounding and clipping
+    void floatToInt16(const float *, int16_t *, const size_t);
+    // Convert the given number of 16 bit samples to float
+    void int16ToFloat(const int16_t *, float *, const size_t);
+};
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef DSP_DITHER_HPP
+#define DSP_DITHER_HPP
+
+#include <cstdint>
+#include "dsp/Effect.hpp"
+#include <vector>
+
+// The Dither is the last stage of the chain, preparing the float samples to be
+// rounded to 16 bit. It adds triangular (TPDF) noise of +-1 LSB so the rounding
+// error isn't correlated with the signal (which would otherwise be heard as
+// distortion in quiet passages of high resolution sources, or after applying gain).
+// The plain dither is vectorized using the compiler's generic vectors. Optionally the
+// rounding error can be fed back (first order noise shaping) to push the noise
+// towards higher frequencies, which requires each sample to be handled in turn.
+// This class is not thread-safe!
+namespace Dsp {
+    class Dither : public Effect {
+        private:
+            uint32_t state[8];                  // State of the random number generators (one per lane)
+            bool enabled;                       // Whether dither is added at all
+            bool shaping;                       // Whether noise shaping is enabled
+            std::vector<float> error;           // Rounding error of the previous sample of each channel
+
+            // Processing statistics
+            double audioTime;                   // Seconds of audio processed
+            double processTime;                 // Seconds spent processing it
+
+            // Process with/without noise shaping
+            void processFlat(float *, size_t);
+            void processShaped(float *, size_t, int);
+
+        public:
+            // Constructor enables dither without noise shaping
+            Dither();
+
+            // Enable/disable dither (samples are left untouched when disabled)
+            void setEnabled(const bool);
+            // Enable/disable noise shaping
+            void setNoiseShaping(const bool);
+
+            bool process(float *, size_t, int, long);
+            bool skippedWhileExact();
+            // Clear the noise shaping error
+            void reset();
+
+            // Returns the average time (in microseconds) taken to process one second of audio
+            double costPerSecond();
+    };
+};
+
+#endif
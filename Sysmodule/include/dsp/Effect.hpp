@@ -0,0 +1,27 @@
+#ifndef DSP_EFFECT_HPP
+#define DSP_EFFECT_HPP
+
+#include <cstddef>
+
+// An Effect is an abstract class representing a single stage of the DSP
+// chain. It processes interleaved float samples (-1.0 to 1.0) in place.
+// Effects are not thread-safe; the owner of the chain handles locking.
+namespace Dsp {
+    class Effect {
+        public:
+            // Process the given buffer in place, returning true if any sample was changed
+            // Takes buffer, number of frames, number of channels and sample rate
+            virtual bool process(float *, size_t, int, long) = 0;
+            // Returns true if the effect has nothing to do while samples are still exactly 16 bit (it only
+            // guards against what earlier effects do to them), so it's skipped until then (see Chain::process())
+            virtual bool skippedWhileExact() {
+                return false;
+            }
+            // Clear any state carried between calls (called when the audio is not continuous)
+            virtual void reset() = 0;
+
+            virtual ~Effect() { }
+    };
+};
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef DSP_EQUALIZER_HPP
+#define DSP_EQUALIZER_HPP
+
+#include <array>
+#include "dsp/Effect.hpp"
+#include <vector>
+
+// The Equalizer applies the 32 band gains used by the config to decoded
+// audio as part of the DSP chain. Each band is a peaking biquad
+// centered on the same (evenly spaced) frequencies as mpg123's equalizer,
+// and the bands are run as a cascade. A pair of channels is filtered at once
+// using SIMD (NEON on the console, the compiler's generic vectors elsewhere).
+// This class is not thread-safe!
+namespace Dsp {
+    class Equalizer : public Effect {
+        public:
+            // Number of bands
+            static constexpr size_t bands = 32;
+
+        private:
+            // Coefficients of a single (normalized) biquad
+            struct Coefficients {
+                float b0, b1, b2, a1, a2;
+            };
+
+            std::array<float, bands> gains;             // Linear gain of each band
+            std::array<Coefficients, bands> coeffs;     // Coefficients calculated from the gains
+            std::array<bool, bands> active;             // Whether each band needs processing
+            long rate;                                  // Sample rate coefficients were calculated for
+            bool dirty;                                 // Set true when coefficients need recalculating
+
+            // Filter state of each active band, for each pair of channels (z1 and z2 of each channel)
+            std::vector<float> state;
+            int channels;                               // Number of channels state is allocated for
+
+            // Processing statistics
+            double audioTime;                           // Seconds of audio processed
+            double processTime;                         // Seconds spent processing it
+
+            // Recalculate coefficients for the current gains and rate
+            void calculate();
+
+        public:
+            // Constructor creates a flat equalizer
+            Equalizer();
+
+            // Set the gain of each band (1.0 is unchanged, as used by mpg123)
+            // The new gains are picked up on the next call to process(), keeping the filters' state
+            void setGains(const std::array<float, bands> &);
+            // Returns true if all bands are flat (i.e. process() won't do anything)
+            bool flat();
+
+            bool process(float *, size_t, int, long);
+            // Clear the filters' state
+            void reset();
+
+            // Returns the average time (in microseconds) taken to process one second of audio
+            double costPerSecond();
+    };
+};
+
+#endif
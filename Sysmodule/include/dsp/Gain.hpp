@@ -0,0 +1,29 @@
+#ifndef DSP_GAIN_HPP
+#define DSP_GAIN_HPP
+
+#include "dsp/Effect.hpp"
+
+// Applies a linear gain to all channels. Changes in gain are ramped
+// over a short period to prevent 'zipper' noise.
+namespace Dsp {
+    class Gain : public Effect {
+        private:
+            float current;          // Gain currently being applied
+            float target;           // Gain to ramp towards
+
+        public:
+            // Constructor creates a unity gain
+            Gain();
+
+            // Set the gain to ramp to (linear multiplier)
+            void setGain(const float);
+            // Returns the gain being ramped to
+            float gain();
+
+            bool process(float *, size_t, int, long);
+            // Jumps straight to the target gain
+            void reset();
+    };
+};
+
+#endif
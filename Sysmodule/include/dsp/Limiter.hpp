@@ -0,0 +1,29 @@
+#ifndef DSP_LIMITER_HPP
+#define DSP_LIMITER_HPP
+
+#include "dsp/Effect.hpp"
+
+// Peak limiter placed at the end of the chain so boosts from earlier effects
+// don't clip. Gain is reduced instantly whenever a frame would exceed the
+// ceiling, and then recovers smoothly. All channels share the same gain so
+// the stereo image isn't shifted. Samples which are still exactly 16 bit can't
+// clip, so they're passed through untouched.
+namespace Dsp {
+    class Limiter : public Effect {
+        private:
+            float ceiling;          // Maximum absolute sample value allowed through
+            float gain;             // Current gain reduction (1.0 when not limiting)
+            float release;          // Per-frame recovery coefficient (depends on sample rate)
+            long rate;              // Sample rate the release was calculated for
+
+        public:
+            // Constructor takes the ceiling (absolute sample value)
+            Limiter(const float);
+
+            bool process(float *, size_t, int, long);
+            bool skippedWhileExact();
+            void reset();
+    };
+};
+
+#endif
@@ -24,6 +24,7 @@ namespace Ipc {
         private:
             uint64_t cmd_;                              // IPC command id
             uint32_t result;                            // IPC result code
+            Handle session_;                            // Session the request was received on
             Type type_;                                 // Request type (see enum)
 
             std::vector<uint8_t> inArgs;                // Received 'arguments'
@@ -33,15 +34,16 @@ namespace Ipc {
 
             std::vector<uint8_t> outArgs;               // Reply value(s)
             std::vector<uint8_t> outData;               // Reply data
+            std::vector<Handle> outHandles;             // Handles to copy to the caller
             std::vector<HipcBufferDescriptor> outMeta;  // Copy of hipc metadata
 
             // Private constructor as we can instantiate a request using different data
             Request();
 
         public:
-            // Create a request from the thread-local storage
+            // Create a request received on the given session from the thread-local storage
             // Returns nullptr on a fatal error
-            static Request * fromTLS();
+            static Request * fromTLS(const Handle);
 
             // Use class members to construct a response on thread-local storage
             void toResponseTLS();
@@ -52,6 +54,9 @@ namespace Ipc {
             // Set result code to return to caller
             void setResult(const uint32_t);
 
+            // Return the session the request was received on
+            Handle session();
+
             // Return type of request
             Type type();
 
@@ -61,6 +66,9 @@ namespace Ipc {
             // Return a reference to the reply data buffer (as a vector)
             const std::vector<uint8_t> & getReplyBuffer();
 
+            // Return the size of the caller's buffer the reply data is copied into (zero if none)
+            size_t replyBufferSize();
+
             // Append a value to reply buffer
             template <typename T>
             Result appendReplyData(const T value) {
@@ -83,6 +91,9 @@ namespace Ipc {
                 return (Utils::Buffer::appendString(this->outArgs, str) ? Result::Ok : Result::BadInput);
             }
 
+            // Append a handle to copy to the caller (the original remains open)
+            void appendReplyHandle(const Handle);
+
             // Sequentially read from received data
             template <typename T>
             Result readRequestData(T & out) {
@@ -2,7 +2,9 @@
 #define IPC_SERVER_HPP
 
 #include <functional>
+#include <mutex>
 #include "ipc/Request.hpp"
+#include <unordered_map>
 
 // This was heavily inspired by sys-clk's ipc server, a big thanks to those
 // who wrote the original C version:
@@ -26,6 +28,12 @@ namespace Ipc {
             std::vector<Handle> handles;    // Server (index 0) and client's handles
             size_t maxHandles;              // Maximum number of clients
 
+            std::mutex subscriberMutex;                     // Protects subscribers
+            std::unordered_map<Handle, Event> subscribers;  // Event signalled by notify() for each subscribed session
+
+            // Close the session at the given index (and it's event if subscribed)
+            void closeSession(const int32_t);
+
             // Process a session
             bool processSession(const int32_t);
             bool processNewSession();
@@ -40,6 +48,12 @@ namespace Ipc {
             // Process any received requests (returns false once a fatal error occurs)
             bool process();
 
+            // Reply to the request with a handle to an event which is signalled on each call to notify()
+            // The event stays the same for the session, and is closed along with it
+            bool subscribe(Request *);
+            // Signal every subscribed session's event
+            void notify();
+
             // Clean up and stop the server
             ~Server();
     };
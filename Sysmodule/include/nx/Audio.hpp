@@ -3,16 +3,25 @@
 
 #include <atomic>
 #include <cstddef>
+#include <cstdint>
+#include <functional>
 #include <mutex>
+#include "nx/NX.hpp"
 #include "Types.hpp"
 
 // Forward declare types
-struct AudioDriverWaveBuf;
+namespace Output {
+    class Backend;
+};
+namespace Utils {
+    class PcmFifo;
+};
 
 // The Audio class handles audio output, but not decoding.
-// It is provided with decoded audio through public methods
-// which can also be invoked to control various aspects
-// of the output stream.
+// Decoded audio is written directly into the output backend's blocks
+// (which form a FIFO) through public methods, and the audio thread
+// queues them on the voice as they are committed. Other public methods
+// can be invoked to control various aspects of the output stream.
 //
 // It is a singleton class as we only ever want one instance
 // shared across the entire service.
@@ -26,31 +35,70 @@ class Audio {
         };
 
     private:
-        // Constructor initializes audio output
-        Audio();
+        // Constructor initializes audio output using the given backend (takes ownership)
+        Audio(Output::Backend *);
 
         std::atomic<Status> action;     // Action to take on next loop iteration
+        NX::Event event;                // Signalled to wake the audio thread when there is work to do
         std::atomic<bool> exit_;        // Set true to stop looping
         static Audio * instance;        // Single instance of class
-        std::mutex mutex;               // Mutex protecting all public methods
+        static Output::Backend * backend_;  // Backend to create the instance with (see setBackend())
+        std::mutex mutex;               // Mutex protecting the driver (not held while waiting for a frame)
+        std::atomic<size_t> contention; // Number of times a caller had to wait for the mutex
         std::atomic<bool> success;      // Indicates whether created successfullY
 
-        int channels;                   // Channels in current song
+        std::atomic<int> channels;      // Channels in current song
+        Format format;                  // Sample format of current song
+        std::atomic<long> rate;         // Sample rate of current song
         std::atomic<int> sampleOffset;  // Offset of voice's played sample count
+        std::atomic<int> playedSamples; // Samples played, published after each update so it can be read without locking
+        // The following count across gapless transitions, so are 64-bit to last through hours of continuous playback
+        std::atomic<int64_t> committedSamples;  // Number of samples committed to the FIFO since the last stop
+        int64_t consumedSamples;        // Number of samples played by the voice before it was last restarted
+        std::atomic<int64_t> songBoundary;  // Committed sample count at which the next song starts (-1 if none)
+        std::atomic<bool> songChanged;  // Set true once playback has moved past songBoundary
         std::atomic<Status> status_;    // Current status of playback (see above enum)
-        int voice;                      // ID of audio 'voice' (-1 if not set)
+        bool voice;                     // Whether the backend has a voice ready
         std::atomic<double> vol;        // Current volume level (0.0 - 100.0)
 
-        uint8_t ** memPool;             // Array of pointers to buffers containing decoded audio
-        int nextBuf;                    // Index in waveBuf array of next buffer to fill
-        int sink;                       // ID of audio 'sink'
-        AudioDriverWaveBuf * waveBuf;   // Array of buffers
+        Output::Backend * backend;      // Device the audio is played on
+        size_t bufferSize_;             // Real size of each of the backend's blocks
+        Utils::PcmFifo * fifo;          // FIFO of decoded audio, backed by the backend's blocks
+        size_t submitted;               // Number of blocks at the front of the FIFO queued on the voice
+
+        // The FIFO's depth is adapted to how long the decoder has recently been stalled for, so more audio is
+        // buffered while the SD card is busy (e.g. a game is loading) and less otherwise, keeping pauses,
+        // seeks and EQ changes responsive. Underruns raise the depth, which then decays back over time.
+        double latency;                 // Decaying peak of the time taken to produce a block (decoder only)
+        double underrunPenalty;         // Extra seconds buffered after underruns (decoder only)
+        size_t seenUnderruns;           // Underruns already added to the penalty (decoder only)
+        std::atomic<size_t> underruns;  // Number of times the voice ran dry while more audio was still to come
+        std::atomic<bool> lowLatency;   // Whether to buffer as little as is safe
+        // Set the FIFO's depth from the latest measurements (decoder only)
+        void adaptDepth();
+
+        std::function<void()> bufferFunc;   // Called when blocks of the FIFO are freed
+        std::function<void()> statusFunc;   // Called when the status changes or the next song is reached
+
+        // Lock the mutex, counting whether we had to wait for it
+        std::unique_lock<std::mutex> lockMutex();
+        // Update playedSamples from the voice (mutex must be held)
+        void publishPlayed();
+        // Release played blocks and queue newly committed ones on the voice (mutex must be held)
+        void submitBuffers();
+        // Check if playback has moved past the song boundary (mutex must be held)
+        void checkSongBoundary();
+        // Stop the voice once it has played everything, without touching the FIFO (mutex must be held)
+        void stopVoice();
 
     public:
         // Delete copy constructors as this is a singleton
         Audio(Audio const &) = delete;
         void operator=(Audio const &) = delete;
 
+        // Set the backend to play audio on, taking ownership of it. This must be called before the instance
+        // is first created, otherwise the console's renderer is used (or a real-time null sink off the console)
+        static void setBackend(Output::Backend *);
         // Create or return instance
         static Audio * getInstance();
 
@@ -59,23 +107,50 @@ class Audio {
         // Call to indicate the main loop (process()) should stop and return
         void exit();
 
-        // Append a buffer of audio data to play (does nothing if there is no free slot)
-        // Takes pointer to buffer and it's size (does not free afterwards!)
-        void addBuffer(uint8_t *, size_t);
-        // Returns whether a buffer slot is available
+        // (Decoder) Returns a pointer into the next free (aligned) memory pool to decode into,
+        // or nullptr if all are in use. The block is bufferSize() bytes long.
+        uint8_t * acquireBuffer();
+        // (Decoder) Queue the acquired block to be played, containing the given number of bytes
+        void commitBuffer(size_t);
+        // Returns whether a block is available to decode into
         bool bufferAvailable();
         // Returns the maximum size of a single buffer
         size_t bufferSize();
+        // (Decoder) Report how long the last committed block took to decode, and how long the SD card
+        // is currently taking to read a block (both in seconds), which adapts the number of buffers used
+        void reportLatency(double, double);
+        // Set whether to keep as little audio buffered as is safe (e.g. when no game is running)
+        void setLowLatency(bool);
+        // Returns the number of buffers currently used, and the number available
+        size_t bufferDepth();
+        size_t maxBufferDepth();
+        // Returns the number of times playback ran out of audio before the song had finished decoding
+        size_t underrunCount();
+        // Returns true once everything that was committed has been played
+        bool finished();
+
+        // Set callback when blocks of the FIFO are freed (i.e. acquireBuffer() may succeed again)
+        // Note that this is called with the audio mutex held, so it must not call back into this class
+        void setBufferFunc(const std::function<void()> &);
+        // Set callback when the status changes or playback moves onto the next song (same restriction as above)
+        void setStatusFunc(const std::function<void()> &);
 
         // Call to prepare the output device for a new song with the given info
         // Takes sample rate, number of channels and sample format, returns whether successful
         bool newSong(long, int, Format);
+        // Call to queue a new song directly behind the one currently playing, without stopping
+        // the voice. Takes sample rate, number of channels and sample format, and returns false
+        // if the voice can't be reused (in which case newSong() should be called once stopped)
+        bool continueSong(long, int, Format);
+        // Returns true (once) when playback has moved onto the song queued with continueSong()
+        bool reachedNextSong();
 
         // Resume playback if paused
         void resume();
         // Pause playback if currently playing
         void pause();
-        // Stop playback (discards buffers)
+        // Stop playback (discards buffers, including those in the FIFO)
+        // Must not be called while the decoder is writing into a block
         void stop();
         // Return the current state of playback
         Status status();
@@ -84,6 +159,8 @@ class Audio {
         int samplesPlayed();
         // Set the number of samples played so far (used when seeking)
         void setSamplesPlayed(int);
+        // Returns the number of times a caller has had to wait on the audio thread
+        size_t contentionCount();
 
         // Return the current volume level (0.0 - 100.0)
         double volume();
@@ -98,4 +175,4 @@ class Audio {
         ~Audio();
 };
 
-#endif
\ No newline at end of file
+#endif
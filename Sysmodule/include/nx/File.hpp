@@ -3,14 +3,23 @@
 
 #include <atomic>
 #include <cstddef>
+#include <cstdint>
 #include <mutex>
+#include "nx/NX.hpp"
 #include <string>
+#include <sys/types.h>
+#include <vector>
 
 // The File class represents a file on the SD Card. It uses libnx's fs* calls
 // behind the scenes to actually read from the file. The file is opened using
 // the constructor and is closed when the object is deleted. It also handles
 // a read buffer behind the scenes in order to still be able to "read" when
 // the SD Card is under heavy load.
+// All open files are filled by one shared I/O thread, which is woken whenever a
+// file's buffer has room for another block and services the file being played
+// before any others. Each buffer is a single producer (I/O thread) single consumer
+// (reader) ring, so reading doesn't need to lock unless the buffer runs dry.
+// Reading and seeking a single file is not thread-safe!
 namespace NX {
     class File {
         public:
@@ -21,61 +30,137 @@ namespace NX {
                 End             // End of file
             };
 
+            // Order in which files are filled by the I/O thread
+            enum class Priority {
+                Playing,        // File is being played (filled first)
+                Prefetch,       // File will be played later
+                Background      // File is only read when no others need to be (e.g. to fill a cache)
+            };
+
+            // Counters summed over every file opened so far
+            struct Stats {
+                size_t seekHits;        // Seeks which landed inside the buffered data
+                size_t headHits;        // Seeks which were served by the head of file cache
+                size_t purges;          // Seeks which discarded the buffer
+                uint64_t bytesRead;     // Bytes read from the SD card
+                double readLatency;     // Recent worst time taken to read one block (seconds)
+            };
+
         private:
             // Forward declare file structures
             struct FFile;
             struct FFileSystem;
 
-            // Read bytes into the file's buffer (below)
-            // Run on a separate thread when the buffer is below a threshold
-            static void fillBufferThread(void *);
-            std::mutex bufferMutex;                 // Mutex protecting access to the buffer
-            size_t id;                              // This file's thread ID
-            std::atomic<bool> stopThread;           // Set true to exit the thread
-
-            // Returns size of buffer
-            size_t bufferSize();
-            // Copy from read buffer into given buffer (handles wrapping around)
-            size_t copyToBuffer(void *, const size_t);
-            uint8_t * buffer;                       // Buffer of read data (circular buffer)
-            std::atomic<size_t> bufferHead;         // Index marking 'front' of buffer
-            std::atomic<size_t> bufferTail;         // Index marking 'back' of buffer
-            off_t offset;                           // Relative file offset
+            // Wrappers around the platform's file operations (libnx's fs* calls on the console,
+            // stdio elsewhere) which return false on an error
+            static bool platformOpen(const std::string &, FFile *);
+            static bool platformSize(FFile *, int64_t *);
+            static bool platformRead(FFile *, const off_t, uint8_t *, const size_t, uint64_t *);
+            static void platformClose(FFile *);
+
+            // Shared I/O thread which fills the buffers of all open files
+            static void ioThread(void *);
+            static std::vector<File *> files;       // All open files
+            static std::mutex filesMutex;           // Mutex protecting the above (only held while choosing a file to read)
+            static Event ioEvent;                   // Signalled when a buffer has room for another block
+            static std::atomic<bool> stopIO;        // Set true to exit the I/O thread
+            static bool ioRunning;                  // Whether the I/O thread was started
+
+            // Returns the offset up to which the I/O thread can fill the buffer in one read (at most
+            // the next block), or the current tail if there isn't a whole block free
+            off_t fillLimit();
+            // Read the next block into the buffer (called by the I/O thread, requires fillMutex)
+            void fill();
+
+            // The buffer is a ring indexed by absolute file offsets (modulo it's size), which
+            // keeps reads aligned to the SD card's blocks. The consumer only moves the head
+            // and the I/O thread only moves the tail, so neither needs to lock to read the other.
+            uint8_t * buffer;                       // Buffer of read data
+            std::atomic<size_t> capacity;           // Size of the buffer
+            std::atomic<off_t> bufferHead;          // Offset of the next byte to be read
+            std::atomic<off_t> bufferTail;          // Offset of the end of buffered data
+            std::mutex fillMutex;                   // Held by the I/O thread while reading, so seeking can move both ends
+            std::atomic<bool> fillRequested;        // Set when the I/O thread has been asked to fill this buffer
+            void requestFill();                     // Wake the I/O thread if there's room for another block
+            Event readEvent;                        // Signalled when new data is in the buffer (or EOF/error)
+            std::atomic<Priority> priority;         // Priority of this file's reads
+            off_t bufferStart;                      // Offset the buffer was last purged at (nothing before it is buffered)
+
+            // Discard the buffer and start filling it from the given offset (requires fillMutex)
+            void purge(const off_t);
+
+            // Files waiting to be played get a larger buffer, with the extra space coming
+            // from a fixed size pool so only a couple can read that far ahead at once
+            static std::atomic<size_t> poolUsed;    // Bytes of the pool in use
+            std::atomic<bool> shrinkPending;        // Set once a prefetched file is played, until it's buffer shrinks
+            // Move the buffered data into a buffer of the given size (a multiple of the block size), returning
+            // false if the pool doesn't have room or the unread data wouldn't fit
+            bool resize(const size_t);
+
+            // Copy of the start of the file (where tags and headers live) taken on the first read,
+            // so seeking back to the start is answered without going back to the SD card
+            uint8_t * headCache;
+            std::atomic<size_t> headLength;         // Number of bytes in the cache (set once by the I/O thread)
+            bool fromHead;                          // Set true while reads are served from the cache
+            off_t headPos;                          // Offset of the next byte to read from the cache
+
+            // Number of seeks handled each way for this file (logged when closed)
+            size_t seekHits;
+            size_t headHits;
+            size_t purges;
+            static std::atomic<size_t> totalSeekHits;
+            static std::atomic<size_t> totalHeadHits;
+            static std::atomic<size_t> totalPurges;
+            static std::atomic<uint64_t> totalBytesRead;
+            static std::atomic<double> readLatency;     // Decaying peak of the time per block (written by the I/O thread)
 
             std::atomic<bool> error;                // Set true if an fs error occurred
             FFile * file;                           // File object
-            std::mutex fileMutex;                   // Mutex protecting access to file metadata
-            off_t fileOffset;                       // Current offset in file
             int64_t size;                           // Size of file in bytes
 
             static FFileSystem * filesystem;        // Filesystem to read files from
-            static size_t fileID;                   // 'ID' of next file (used for identifying thread)
 
         public:
             // Constructor attempts to open file and create buffer
             File(const std::string &);
 
             // Read (copy) the requested number of bytes into the given buffer
+            // Blocks until either the requested number of bytes have been read or EOF is reached
             // Returns -1 on an error
             ssize_t read(void *, const size_t);
 
             // Seek to the given position in the file using the given relative position
+            // The buffered data is kept if the position is within it
             // Returns -1 on an error
             off_t seek(const off_t, const Position);
+            // Returns the current position in the file
+            off_t tell();
+
+            // Set the priority of this file's reads
+            // Prefetched files read further ahead, which is given back once they're played
+            // (not to be called while reading)
+            void setPriority(const Priority);
 
             // Destructor closes file handle
             ~File();
 
-            // Initializes the required services
+            // Initializes the required services and starts the I/O thread
             static bool initializeService();
-            // Closes the initialized services
+            // Stops the I/O thread and closes the initialized services
             static void closeService();
+            // Returns the counters summed over all files
+            static Stats stats();
 
             // Helper functions to operate on the provided file object using read() and
             // lseek() like function structure (as required by mpg123)
             static ssize_t readFile(void *, void *, const size_t);
             static off_t seekFile(void *, const off_t, const int);
+
+            // Helper which reads until the requested number of bytes have been copied
+            // or EOF is reached (as required by dr_flac and dr_wav's read callbacks)
+            // Returns the number of bytes read, which may be short on an error
+            static size_t readFileFully(void *, void *, const size_t);
     };
 };
 
-#endif
\ No newline at end of file
+#endif
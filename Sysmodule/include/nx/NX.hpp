@@ -1,7 +1,9 @@
 #ifndef NX_NX_HPP
 #define NX_NX_HPP
 
+#include <condition_variable>
 #include <functional>
+#include <mutex>
 #include "utils/nx/Button.hpp"
 
 // Switch specific functions
@@ -36,6 +38,11 @@ namespace NX {
         bool comboPressed(const std::vector<Button> &);
     };
 
+    namespace Pm {
+        // Returns true if a game (or other application) is running, or if it can't be checked
+        bool applicationRunning();
+    };
+
     namespace Psc {
         // Prepare psc for use
         bool prepare();
@@ -52,6 +59,27 @@ namespace NX {
         void monitor(const size_t);
     };
 
+    // An auto-resetting event which a single thread can block on until another thread
+    // signals it. A signal raised while nothing is waiting is kept until the next wait.
+    class Event {
+        private:
+            std::condition_variable cv;     // Condition the waiting thread blocks on
+            std::mutex mutex;               // Mutex protecting signalled
+            bool signalled;                 // Set true when signalled, reset once a wait returns
+
+        public:
+            // Constructor creates an unsignalled event
+            Event();
+
+            // Wake the waiting thread (or the next thread to wait)
+            void signal();
+            // Clear a pending signal
+            void reset();
+            // Block until signalled, returning true, or until the given number of milliseconds
+            // have passed, returning false (waits indefinitely if zero is passed)
+            bool wait(const size_t = 0);
+    };
+
     namespace Thread {
         // Start a new thread with the given function and argument
         // Uses given id to identify a thread
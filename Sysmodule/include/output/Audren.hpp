@@ -0,0 +1,57 @@
+#ifndef OUTPUT_AUDREN_HPP
+#define OUTPUT_AUDREN_HPP
+
+#include "output/Backend.hpp"
+
+// Extends Backend to play audio on the console using libnx's audren driver.
+// Only one instance may exist at a time, and audren must be initialized
+// and started before it is created.
+namespace Output {
+    class Audren : public Backend {
+        private:
+            // Forward declare driver structures
+            struct Driver;
+            struct WaveBuf;
+
+            Driver * drv;                       // Audio output driver
+            bool success;                       // Indicates whether created successfully
+            int channels;                       // Channels of the current voice
+            int sink;                           // ID of audio 'sink'
+            int voice;                          // ID of audio 'voice' (-1 if not set)
+
+            size_t count;                       // Number of blocks
+            uint8_t ** memPool;                 // Array of pointers to blocks (memory pools)
+            size_t size;                        // Aligned size of each block
+            WaveBuf * waveBuf;                  // Wave buffer for each block
+
+        public:
+            // Constructor creates the driver and sink
+            Audren();
+
+            bool initialized();
+
+            bool createBlocks(size_t, size_t);
+            size_t blockSize();
+            uint8_t * blockData(size_t);
+            void flushBlock(size_t, size_t);
+
+            bool openVoice(long, int, Format);
+            void queueBlock(size_t, size_t);
+            bool blockDone(size_t);
+
+            void startVoice();
+            void stopVoice();
+            void setPaused(bool);
+            uint32_t playedSamples();
+
+            void setVolume(double);
+
+            void update();
+            void waitFrame();
+
+            // Drops the voice, frees blocks and closes the driver
+            ~Audren();
+    };
+};
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef OUTPUT_BACKEND_HPP
+#define OUTPUT_BACKEND_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+// Forward declarations
+enum class Format;
+
+// A Backend is an abstract class representing the device decoded audio is
+// played on. It owns a fixed set of equally sized blocks of memory which are
+// filled by the Audio class and queued on a single 'voice' to be played in
+// order. Backend specific classes inherit this and implement the required
+// behaviour. None of these methods are thread-safe; the Audio class handles
+// locking.
+namespace Output {
+    class Backend {
+        public:
+            // Returns true if the device was initialized successfully
+            virtual bool initialized() = 0;
+
+            // Allocate the given number of blocks of at least the given size
+            // Returns false on an error
+            virtual bool createBlocks(size_t, size_t) = 0;
+            // Returns the real size of each block (may be larger than requested)
+            virtual size_t blockSize() = 0;
+            // Returns a pointer to the memory of the block with the given index
+            virtual uint8_t * blockData(size_t) = 0;
+            // Make the given number of bytes written into a block visible to the device
+            virtual void flushBlock(size_t, size_t) = 0;
+
+            // Create a voice with the given sample rate, number of channels and sample format,
+            // replacing any existing voice. Returns false if it couldn't be created.
+            virtual bool openVoice(long, int, Format) = 0;
+            // Queue the given number of bytes of a block on the voice
+            virtual void queueBlock(size_t, size_t) = 0;
+            // Returns true if the block with the given index isn't queued (i.e. has been played)
+            virtual bool blockDone(size_t) = 0;
+
+            // Start playing queued blocks
+            virtual void startVoice() = 0;
+            // Stop the voice, dropping any queued blocks and resetting the played sample count
+            virtual void stopVoice() = 0;
+            // Pause/unpause the voice
+            virtual void setPaused(bool) = 0;
+            // Returns number of samples played since the voice was last started
+            virtual uint32_t playedSamples() = 0;
+
+            // Set output volume (0.0 - 1.0)
+            virtual void setVolume(double) = 0;
+
+            // Push any changes to the device and fetch the state of queued blocks
+            virtual void update() = 0;
+            // Block until the device is ready for the next update
+            virtual void waitFrame() = 0;
+
+            virtual ~Backend() { }
+    };
+};
+
+#endif
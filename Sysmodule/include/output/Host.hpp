@@ -0,0 +1,86 @@
+#ifndef OUTPUT_HOST_HPP
+#define OUTPUT_HOST_HPP
+
+#include <chrono>
+#include <cstdio>
+#include <deque>
+#include "output/Backend.hpp"
+#include <string>
+#include <vector>
+
+// Extends Backend to 'play' audio without any audio hardware, so that the
+// rest of the playback pipeline can be run and measured off the console.
+// Queued blocks are consumed either at the voice's real-time rate or as fast
+// as they are queued, and are written to a WAV file or simply discarded.
+namespace Output {
+    class Host : public Backend {
+        private:
+            // Block queued on the voice
+            struct Queued {
+                size_t index;                   // Index of block
+                size_t size;                    // Number of bytes queued
+                size_t offset;                  // Number of bytes already consumed
+            };
+
+            bool realTime;                      // Consume at the voice's sample rate instead of instantly
+            std::FILE * file;                   // WAV file to write to (nullptr to discard audio)
+            std::string path;                   // Path to WAV file (empty to discard audio)
+            size_t written;                     // Number of bytes written to the WAV's data chunk
+
+            std::vector<uint8_t *> blocks;      // Memory for each block
+            std::vector<bool> done;             // Whether each block has been consumed
+            std::deque<Queued> queue;           // Blocks queued on the voice, in order
+            size_t size;                        // Size of each block
+
+            int channels;                       // Channels of the current voice
+            size_t frameSize;                   // Bytes per sample (all channels) of the current voice
+            long rate;                          // Sample rate of the current voice
+            bool voice;                         // Whether a voice has been opened
+
+            bool playing;                       // Set true while the voice is started
+            bool paused;                        // Set true while the voice is paused
+            double pending;                     // Samples due to be consumed but not yet (real-time only)
+            uint32_t played;                    // Samples consumed since the voice was started
+            std::chrono::steady_clock::time_point lastUpdate;  // Time of last update
+            size_t underruns_;                  // Number of times the queue ran dry while playing
+
+            // Consume (and write out) up to the given number of samples, returning the number consumed
+            size_t consume(size_t);
+            // Write the WAV header (using placeholder sizes until the file is closed)
+            void writeHeader(Format);
+
+        public:
+            // Constructor takes path of WAV file to write to (pass an empty string to discard audio),
+            // and whether to consume audio in real-time or as fast as possible
+            Host(const std::string &, bool);
+
+            bool initialized();
+
+            bool createBlocks(size_t, size_t);
+            size_t blockSize();
+            uint8_t * blockData(size_t);
+            void flushBlock(size_t, size_t);
+
+            bool openVoice(long, int, Format);
+            void queueBlock(size_t, size_t);
+            bool blockDone(size_t);
+
+            void startVoice();
+            void stopVoice();
+            void setPaused(bool);
+            uint32_t playedSamples();
+
+            void setVolume(double);
+
+            void update();
+            void waitFrame();
+
+            // Returns number of times the voice ran out of audio while playing
+            size_t underruns();
+
+            // Finalizes the WAV file and frees blocks
+            ~Host();
+    };
+};
+
+#endif
@@ -18,7 +18,7 @@ namespace Source {
             // Constructor takes path to FLAC file
             FLAC(const std::string &);
 
-            size_t decode(unsigned char *, size_t);
+            size_t decode(float *, size_t);
             void seek(size_t);
             size_t tell();
 
@@ -1,39 +1,63 @@
 #ifndef SOURCE_MP3_HPP
 #define SOURCE_MP3_HPP
 
-#include <array>
+#include <cstdint>
+#include <mutex>
 #include "source/Source.hpp"
 #include <string>
+#include <vector>
 
-// Forward declaration as we only need the pointers here
+// Forward declaration as we only need the pointer here
 typedef struct mpg123_handle_struct mpg123_handle;
-namespace NX {
-    class File;
-};
 
 // Extends Source to support MP3 files
 // This class is not thread-safe!
 namespace Source {
     class MP3 : public Source {
         private:
-            // mpg123 instance
-            static mpg123_handle * mpg;
+            // Whether mpg123 has been initialized
+            static bool initialized;
+            // Settings applied to each handle
+            static bool accurateSeek;
+            // All handles currently open (so settings can be updated)
+            static std::vector<mpg123_handle *> handles;
+            // Handles no longer used by a source, kept to be reused by the next one
+            // (mpg123 allocates a lot of memory for each handle)
+            static std::vector<mpg123_handle *> spareHandles;
+            // Protects the above (sources are opened and closed on different threads)
+            static std::mutex handlesMutex;
+
+            // mpg123 instance (each source has it's own so that the next
+            // song can be opened while the current one is still playing)
+            mpg123_handle * mpg;
+
+            // Path to the file and number of frames covered by the stored seek index
+            // (the index is only rewritten when decoding has covered more)
+            std::string path;
+            size_t indexedFrames;
+
+            // 16 bit samples read from mpg123 before they're converted to float
+            std::vector<int16_t> samples;
+
+            // Logs most recent error for the given handle
+            static void logErrorMsg(mpg123_handle *);
 
-            // Object associated with file
-            NX::File * file;
+            // Apply the current settings to the given handle
+            static bool applyAccurateSeek(mpg123_handle *);
 
-            // Logs most recent error
-            static void logErrorMsg();
+            // Load/store the file's seek index
+            void loadIndex();
+            void saveIndex();
 
         public:
             // Takes path to a .mp3 file
             MP3(const std::string &);
 
-            size_t decode(unsigned char *, size_t);
+            size_t decode(float *, size_t);
             void seek(size_t);
             size_t tell();
 
-            // Closes associated file
+            // Saves the seek index and closes associated file
             ~MP3();
 
             // Initialize mpg123
@@ -43,9 +67,7 @@ namespace Source {
 
             // Set seek method
             static bool setAccurateSeek(const bool);
-            // Set the equalizer for decoding
-            static bool setEqualizer(const std::array<float, 32> &);
     };
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,30 @@
+#ifndef SOURCE_SEEKINDEX_HPP
+#define SOURCE_SEEKINDEX_HPP
+
+#include <string>
+#include <sys/types.h>
+#include <vector>
+
+// The SeekIndex stores the frame offsets mpg123 gathers while decoding a file,
+// so that an accurate seek on a later play can jump straight to the nearest
+// indexed frame instead of parsing the file from the start. Each file's index
+// is kept in it's own small file (named by a hash of the path) inside the
+// sysmodule's index folder, along with the path, size and modification time
+// of the audio file so stale or colliding entries are ignored.
+namespace Source::SeekIndex {
+    // Index read from/written to disk
+    struct Index {
+        off_t step;                     // Number of frames between each offset
+        std::vector<off_t> offsets;     // Byte offset of every step'th frame
+    };
+
+    // Reads the stored index for the given audio file
+    // Returns false if there isn't one or it's out of date
+    bool load(const std::string &, Index &);
+
+    // Writes the given index for the audio file, replacing any existing one
+    // Returns false on an error
+    bool save(const std::string &, const off_t, const off_t *, const size_t);
+};
+
+#endif
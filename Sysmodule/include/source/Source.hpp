@@ -5,6 +5,9 @@
 
 // Forward declarations
 enum class Format;
+namespace NX {
+    class File;
+};
 
 // A Source is an abstract class representing an audio source.
 // Codec specific class will inherit this an implement required behaviour.
@@ -14,17 +17,22 @@ namespace Source {
             // These must be set by children
             int channels_;
             bool done_;
+            bool exact_;
             Format format_;
             long sampleRate_;
             int totalSamples_;
             bool valid_;
 
+            // Buffered file object read by the decoder (nullptr if the decoder reads
+            // the file itself), which is deleted after the child's destructor
+            NX::File * file;
+
         public:
             Source();
 
-            // Decode audio into buffer with limiting size
-            // Returns number of bytes decoded
-            virtual size_t decode(unsigned char *, size_t) = 0;
+            // Decode up to the given number of frames into the buffer as interleaved
+            // float samples (-1.0 to 1.0). Returns number of frames decoded
+            virtual size_t decode(float *, size_t) = 0;
 
             // Returns true when all data has been decoded
             bool done();
@@ -38,13 +46,30 @@ namespace Source {
 
             // Return number of channels
             int channels();
-            // Return format of decoded samples
+            // Returns true if every decoded sample is exactly a 16 bit value (i.e. the file
+            // is 16 bit or lower PCM), so it can be output untouched by the DSP chain
+            bool exact();
+            // Return format of samples sent to the output device (after the DSP chain)
             Format format();
             // Returns sample rate
             long sampleRate();
             // Returns total number of samples
             int totalSamples();
 
+            // Set whether this source is being played, as it's file is read before any
+            // others (e.g. the next song which is being prepared) when it is
+            void setPlaying(const bool);
+            // Only read this source's file once no other file needs reading
+            void setBackground();
+
+            // Sources, and their decoder's state, are allocated from a pool which keeps the memory
+            // of closed sources for the ones opened next instead of going back to the heap each song
+            static void * allocate(const size_t);
+            static void * reallocate(void *, const size_t);
+            static void release(void *);
+            static void * operator new(size_t);
+            static void operator delete(void *);
+
             virtual ~Source();
     };
 };
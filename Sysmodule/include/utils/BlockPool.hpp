@@ -0,0 +1,65 @@
+#ifndef UTILS_BLOCKPOOL_HPP
+#define UTILS_BLOCKPOOL_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+// A BlockPool hands out blocks of memory and keeps some of them once they're
+// freed, so that similar allocations made over and over again (e.g. a decoder's
+// state for every song played) reuse the same memory instead of slowly fragmenting
+// the heap. A kept block is reused for any request it can hold without wasting more
+// than half of it. Up to the given number of bytes are kept, with the blocks kept
+// the longest freed first to make room.
+// This class is thread-safe.
+namespace Utils {
+    class BlockPool {
+        public:
+            // Counters since creation
+            struct Stats {
+                size_t hits;                    // Allocations which reused a kept block
+                size_t misses;                  // Allocations which needed new memory
+                size_t kept;                    // Bytes currently kept for reuse
+            };
+
+        private:
+            std::mutex mutex;                   // Protects blocks
+            std::vector<void *> blocks;         // Blocks kept for reuse (oldest first)
+            size_t granularity;                 // Sizes are rounded up to a multiple of this
+            size_t maxKept;                     // Most bytes to keep
+            std::atomic<size_t> hits;
+            std::atomic<size_t> misses;
+            std::atomic<size_t> kept;
+
+            // Returns the usable size of a block handed out by the pool
+            static size_t blockSize(void *);
+            // Free a block's memory
+            static void release(void *);
+            // Returns whether the block can be used for the given (rounded) size
+            static bool suitable(void *, const size_t);
+
+        public:
+            // Takes the granularity of block sizes, and the number of bytes to keep
+            BlockPool(const size_t, const size_t);
+
+            // Returns a block of at least the given number of bytes (aligned like malloc)
+            // or nullptr if out of memory
+            void * allocate(const size_t);
+            // Resize a block, returning the (possibly moved) block or nullptr if out of
+            // memory (in which case the original is untouched)
+            void * reallocate(void *, const size_t);
+            // Return a block to the pool (nullptr is ignored)
+            void free(void *);
+
+            // Free every kept block
+            void trim();
+            // Returns the current counters
+            Stats stats();
+
+            // Frees kept blocks
+            ~BlockPool();
+    };
+};
+
+#endif
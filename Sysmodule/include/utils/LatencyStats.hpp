@@ -0,0 +1,47 @@
+#ifndef UTILS_LATENCYSTATS_HPP
+#define UTILS_LATENCYSTATS_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+// LatencyStats summarises a stream of durations (e.g. the time taken to decode
+// each buffer) without storing them. Alongside the count, minimum, maximum and
+// average, a histogram with buckets spaced logarithmically (eight per doubling,
+// from 10us to around 10s) lets percentiles be estimated to within ~10%.
+// This class is thread-safe.
+namespace Utils {
+    class LatencyStats {
+        private:
+            std::mutex mutex;                       // Protects everything below
+            std::array<uint32_t, 160> buckets;      // Number of durations in each bucket
+            size_t count_;                          // Number of durations added
+            double min_;                            // Shortest duration
+            double max_;                            // Longest duration
+            double last_;                           // Most recent duration
+            double total;                           // Sum of all durations
+
+        public:
+            // Constructor creates an empty set
+            LatencyStats();
+
+            // Add a duration (in seconds)
+            void add(const double);
+            // Forget all durations
+            void reset();
+
+            // Returns the number of durations added
+            size_t count();
+            // Returns the shortest, longest and average duration (zero if none were added)
+            double min();
+            double max();
+            double average();
+            // Returns the most recent duration (zero if none were added)
+            double last();
+            // Returns the duration the given fraction (0.0 - 1.0) of durations are at or below
+            double percentile(const double);
+    };
+};
+
+#endif
@@ -0,0 +1,75 @@
+#ifndef UTILS_MEMORY_HPP
+#define UTILS_MEMORY_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+// Memory keeps track of how much of the (small, fixed size) heap each part of the
+// sysmodule is using. Every allocation made through operator new is attributed to the
+// subsystem set for the calling thread by a Scope, while memory allocated in other ways
+// (e.g. the audio memory pool) is added explicitly. SQLite's usage is read from SQLite.
+// Allocations made by C libraries (mpg123, dr_libs) aren't tracked.
+//
+// Each subsystem has a budget. Going over it doesn't fail the allocation (there's no way
+// to recover from that), but it is counted and reported. Anything optional (prefetching,
+// caching, growing a queue) should check fits() first and skip the work if it doesn't.
+// All functions are thread-safe.
+namespace Utils::Memory {
+    // Subsystems memory is attributed to
+    enum class Tag : uint8_t {
+        Other,          // Anything not covered below
+        Audio,          // Audio output and it's memory pool
+        Queue,          // Main play queue
+        SubQueue,       // Sub-queue
+        Source,         // Open songs (decoders and file buffers)
+        Cache,          // Decoded audio cache
+        Database,       // SQLite and database queries
+        Ipc,            // IPC requests and replies
+        Count           // Number of tags (not a subsystem)
+    };
+
+    // Snapshot of a subsystem's usage (in bytes)
+    struct Usage {
+        size_t used;        // Currently allocated
+        size_t peak;        // Most ever allocated
+        size_t budget;      // Budget (zero if unlimited)
+        size_t overruns;    // Number of times usage went over the budget
+    };
+
+    // Attributes allocations made by the calling thread to the given subsystem until
+    // destroyed, after which the previous subsystem is restored
+    class Scope {
+        private:
+            Tag previous;
+
+        public:
+            Scope(const Tag);
+            ~Scope();
+    };
+
+    // Returns the name of the subsystem
+    const char * name(const Tag);
+
+    // Set the number of bytes the subsystem should stay within (zero for unlimited)
+    void setBudget(const Tag, const size_t);
+    // Returns the subsystem's budget
+    size_t budget(const Tag);
+    // Returns whether the given number of bytes can be allocated without going over budget
+    bool fits(const Tag, const size_t);
+
+    // Account for memory not allocated through operator new
+    void add(const Tag, const size_t);
+    void remove(const Tag, const size_t);
+
+    // Returns the subsystem's current usage
+    Usage usage(const Tag);
+    // Returns the number of bytes allocated by the heap (tracked or not)
+    size_t heapUsed();
+    // Returns whether any subsystem has gone over budget since the last call
+    bool overrun();
+
+    // Write a breakdown of usage to the log
+    void log();
+};
+
+#endif
@@ -0,0 +1,492 @@
+#ifndef UTILS_ORDERTREE_HPP
+#define UTILS_ORDERTREE_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// An OrderTree holds a sequence of values as an implicit treap (a randomly balanced
+// binary tree where each node's position is found from the sizes of the subtrees
+// before it). Looking up, inserting, removing and moving values by position all take
+// O(log n), compared to O(n) for a vector. Each node holds a run of up to NodeValues
+// values, so the links and sizes are shared between them. Nodes either side of a
+// split are joined again if they fit in one, which keeps them at least half full on
+// average. Nodes live in fixed size blocks which are only added as needed, so the
+// tree never has to copy itself to grow.
+// This class is not thread-safe.
+namespace Utils {
+    template <typename T>
+    class OrderTree {
+        private:
+            // Index used for 'no node'
+            static constexpr uint32_t None = UINT32_MAX;
+            // Values per node (making 256 byte nodes for 4 byte values)
+            static constexpr size_t NodeValues = 60;
+
+            struct Node {
+                uint32_t left;
+                uint32_t right;
+                uint32_t size;                  // Number of values in this subtree
+                uint16_t count;                 // Number of values in this node
+                T values[NodeValues];
+            };
+
+            static constexpr size_t BlockSize = 32;                     // Nodes per block
+            std::vector< std::unique_ptr<Node[]> > blocks;
+            uint32_t root;
+            uint32_t freeList;                  // Released nodes (linked through left)
+            uint32_t nextNode;                  // Next never-used node
+            uint32_t usedNodes;                 // Nodes currently in the tree
+
+            Node & node(const uint32_t idx) {
+                return this->blocks[idx / BlockSize][idx % BlockSize];
+            }
+
+            uint32_t sizeOf(const uint32_t idx) {
+                return (idx == None ? 0 : this->node(idx).size);
+            }
+
+            // Priorities are derived from the node's index (using the murmur3 finalizer)
+            // rather than stored, as the indices handed out are effectively random in shape
+            static uint32_t priority(uint32_t idx) {
+                idx ^= idx >> 16;
+                idx *= 0x85ebca6b;
+                idx ^= idx >> 13;
+                idx *= 0xc2b2ae35;
+                idx ^= idx >> 16;
+                return idx;
+            }
+
+            // Recalculate size
+            void update(const uint32_t idx) {
+                Node & n = this->node(idx);
+                n.size = n.count + this->sizeOf(n.left) + this->sizeOf(n.right);
+            }
+
+            // Returns an empty node
+            uint32_t allocate() {
+                uint32_t idx = this->freeList;
+                if (idx != None) {
+                    this->freeList = this->node(idx).left;
+                } else {
+                    idx = this->nextNode++;
+                    if (idx / BlockSize == this->blocks.size()) {
+                        this->blocks.emplace_back(new Node[BlockSize]);
+                    }
+                }
+                this->usedNodes++;
+
+                Node & n = this->node(idx);
+                n.left = None;
+                n.right = None;
+                n.size = 0;
+                n.count = 0;
+                return idx;
+            }
+
+            // Release every node in the subtree
+            void release(const uint32_t idx) {
+                std::vector<uint32_t> stack;
+                if (idx != None) {
+                    stack.push_back(idx);
+                }
+                while (!stack.empty()) {
+                    const uint32_t top = stack.back();
+                    stack.pop_back();
+                    Node & n = this->node(top);
+                    if (n.left != None) {
+                        stack.push_back(n.left);
+                    }
+                    if (n.right != None) {
+                        stack.push_back(n.right);
+                    }
+                    n.left = this->freeList;
+                    this->freeList = top;
+                    this->usedNodes--;
+                }
+            }
+
+            // Join two trees, with every node in the first coming before the second
+            uint32_t merge(const uint32_t a, const uint32_t b) {
+                if (a == None || b == None) {
+                    return (a == None ? b : a);
+                }
+
+                if (priority(a) > priority(b)) {
+                    this->node(a).right = this->merge(this->node(a).right, b);
+                    this->update(a);
+                    return a;
+                }
+                this->node(b).left = this->merge(a, this->node(b).left);
+                this->update(b);
+                return b;
+            }
+
+            // Split a tree into the first given number of values and the rest. If the split falls within
+            // a node, the values after it are moved to a new node which is returned separately
+            void split(const uint32_t idx, const size_t count, uint32_t & outA, uint32_t & outB, uint32_t & outRest) {
+                if (idx == None) {
+                    outA = None;
+                    outB = None;
+                    return;
+                }
+
+                Node & n = this->node(idx);
+                const size_t leftSize = this->sizeOf(n.left);
+                if (count <= leftSize) {
+                    this->split(n.left, count, outA, n.left, outRest);
+                    outB = idx;
+                } else if (count >= leftSize + n.count) {
+                    this->split(n.right, count - leftSize - n.count, n.right, outB, outRest);
+                    outA = idx;
+                } else {
+                    const size_t keep = count - leftSize;
+                    outRest = this->allocate();
+                    Node & r = this->node(outRest);
+                    std::copy(n.values + keep, n.values + n.count, r.values);
+                    r.count = n.count - keep;
+                    r.size = r.count;
+                    n.count = keep;
+                    outB = n.right;
+                    n.right = None;
+                    outA = idx;
+                }
+                this->update(idx);
+            }
+
+            // As above, but with the new node merged into the front of the second tree (once split, so
+            // it's priority is respected)
+            void split(const uint32_t idx, const size_t count, uint32_t & outA, uint32_t & outB) {
+                uint32_t rest = None;
+                this->split(idx, count, outA, outB, rest);
+                outB = this->merge(rest, outB);
+            }
+
+            // Add values to the end of the last node in the subtree (which must have room)
+            void append(const uint32_t idx, const T * values, const size_t count) {
+                Node & n = this->node(idx);
+                if (n.right != None) {
+                    this->append(n.right, values, count);
+                } else {
+                    std::copy(values, values + count, n.values + n.count);
+                    n.count += count;
+                }
+                n.size += count;
+            }
+
+            // Insert a value into the node holding the given position if it has room
+            // Returns false if it doesn't, leaving the tree unchanged
+            bool insertInto(const uint32_t idx, const size_t pos, const T & value) {
+                if (idx == None) {
+                    return false;
+                }
+
+                Node & n = this->node(idx);
+                const size_t leftSize = this->sizeOf(n.left);
+                bool inserted;
+                if (pos < leftSize) {
+                    inserted = this->insertInto(n.left, pos, value);
+                } else if (pos <= leftSize + n.count) {
+                    inserted = (n.count < NodeValues);
+                    if (inserted) {
+                        std::copy_backward(n.values + (pos - leftSize), n.values + n.count, n.values + n.count + 1);
+                        n.values[pos - leftSize] = value;
+                        n.count++;
+                    }
+                } else {
+                    inserted = this->insertInto(n.right, pos - leftSize - n.count, value);
+                }
+
+                if (inserted) {
+                    n.size++;
+                }
+                return inserted;
+            }
+
+            // Remove values from the node holding the given position if they're all in it (and it keeps at least one),
+            // setting the range the node now covers. Returns false if they aren't, leaving the tree unchanged
+            bool eraseFrom(const uint32_t idx, const size_t pos, const size_t count, size_t & outStart, size_t & outEnd) {
+                if (idx == None) {
+                    return false;
+                }
+
+                Node & n = this->node(idx);
+                const size_t leftSize = this->sizeOf(n.left);
+                bool erased;
+                if (pos < leftSize) {
+                    erased = this->eraseFrom(n.left, pos, count, outStart, outEnd);
+                } else if (pos < leftSize + n.count) {
+                    const size_t offset = pos - leftSize;
+                    erased = (offset + count <= n.count && count < n.count);
+                    if (erased) {
+                        std::copy(n.values + offset + count, n.values + n.count, n.values + offset);
+                        n.count -= count;
+                        outStart = leftSize;
+                        outEnd = leftSize + n.count;
+                    }
+                } else {
+                    const size_t skipped = leftSize + n.count;
+                    erased = this->eraseFrom(n.right, pos - skipped, count, outStart, outEnd);
+                    if (erased) {
+                        outStart += skipped;
+                        outEnd += skipped;
+                    }
+                }
+
+                if (erased) {
+                    n.size -= count;
+                }
+                return erased;
+            }
+
+            // Returns the node holding the given position (which must be in bounds), and the position of it's first value
+            uint32_t find(size_t pos, size_t & start) {
+                uint32_t idx = this->root;
+                start = 0;
+                while (true) {
+                    Node & n = this->node(idx);
+                    const size_t leftSize = this->sizeOf(n.left);
+                    if (pos < leftSize) {
+                        idx = n.left;
+                    } else if (pos < leftSize + n.count) {
+                        start += leftSize;
+                        return idx;
+                    } else {
+                        pos -= leftSize + n.count;
+                        start += leftSize + n.count;
+                        idx = n.right;
+                    }
+                }
+            }
+
+            // Join the nodes either side of the given position if they fit in one (nothing is done if
+            // it's within a node)
+            void joinAt(const size_t pos) {
+                if (pos == 0 || pos >= this->size()) {
+                    return;
+                }
+
+                size_t start;
+                const uint32_t last = this->find(pos - 1, start);
+                const uint32_t first = this->find(pos, start);
+                const size_t count = this->node(first).count;
+                if (last == first || this->node(last).count + count > NodeValues) {
+                    return;
+                }
+
+                // Take the first node out of the second half and move it's values onto the end of the first
+                uint32_t a, b, c;
+                this->split(this->root, pos, a, b);
+                this->split(b, count, b, c);
+                this->append(a, this->node(b).values, count);
+                this->release(b);
+                this->root = this->merge(a, c);
+            }
+
+            // Join nodes around the given position after it has been split at. The nodes either side of it
+            // may have shrunk, so they're checked against each other and against the nodes on their other side
+            void join(const size_t pos) {
+                const size_t size = this->size();
+                size_t start = pos;
+                size_t end = pos;
+                if (pos > 0 && pos <= size) {
+                    this->find(pos - 1, start);
+                }
+                if (pos < size) {
+                    const uint32_t idx = this->find(pos, end);
+                    end += this->node(idx).count;
+                }
+                this->joinAt(end);
+                this->joinAt(pos);
+                this->joinAt(start);
+            }
+
+        public:
+            // Constructor creates an empty tree (without allocating)
+            OrderTree() {
+                this->root = None;
+                this->freeList = None;
+                this->nextNode = 0;
+                this->usedNodes = 0;
+            }
+
+            // Returns the number of values
+            size_t size() {
+                return this->sizeOf(this->root);
+            }
+
+            // Returns true if there are no values
+            bool empty() {
+                return (this->root == None);
+            }
+
+            // Returns the number of bytes that would be allocated to insert the given number of values
+            // (at most one node per NodeValues of them, plus one for a node they're inserted into being split)
+            size_t extraBytes(const size_t count) {
+                const size_t held = this->blocks.size() * BlockSize;
+                const size_t needed = this->usedNodes + (count + NodeValues - 1) / NodeValues + 1;
+                return (needed > held ? ((needed - held + BlockSize - 1) / BlockSize) * BlockSize * sizeof(Node) : 0);
+            }
+
+            // Returns the value at the given position (which must be in bounds)
+            T & at(size_t pos) {
+                uint32_t idx = this->root;
+                while (true) {
+                    Node & n = this->node(idx);
+                    const size_t leftSize = this->sizeOf(n.left);
+                    if (pos < leftSize) {
+                        idx = n.left;
+                    } else if (pos < leftSize + n.count) {
+                        return n.values[pos - leftSize];
+                    } else {
+                        pos -= leftSize + n.count;
+                        idx = n.right;
+                    }
+                }
+            }
+
+            // Insert a value at the given position (the end if past it)
+            void insert(const size_t pos, const T & value) {
+                if (!this->insertInto(this->root, std::min(pos, this->size()), value)) {
+                    this->insert(pos, std::vector<T>{value});
+                }
+            }
+
+            // Insert values starting at the given position (the end if past it)
+            void insert(size_t pos, const std::vector<T> & values) {
+                if (values.empty()) {
+                    return;
+                }
+                pos = std::min(pos, this->size());
+
+                // Build a tree of full nodes holding the new values first (in linear time, by keeping
+                // the path down it's right side) so the existing tree is only split once
+                std::vector<uint32_t> path;
+                for (size_t i = 0; i < values.size(); i += NodeValues) {
+                    const uint32_t idx = this->allocate();
+                    Node & n = this->node(idx);
+                    n.count = std::min(NodeValues, values.size() - i);
+                    std::copy(values.begin() + i, values.begin() + i + n.count, n.values);
+                    this->update(idx);
+
+                    uint32_t last = None;
+                    while (!path.empty() && priority(path.back()) < priority(idx)) {
+                        last = path.back();
+                        path.pop_back();
+                        this->update(last);
+                    }
+                    n.left = last;
+                    if (!path.empty()) {
+                        this->node(path.back()).right = idx;
+                    }
+                    path.push_back(idx);
+                }
+                uint32_t middle = None;
+                while (!path.empty()) {
+                    middle = path.back();
+                    path.pop_back();
+                    this->update(middle);
+                }
+
+                uint32_t a, b;
+                this->split(this->root, pos, a, b);
+                this->root = this->merge(this->merge(a, middle), b);
+                this->join(pos + values.size());
+                this->join(pos);
+            }
+
+            // Remove the given number of values starting at the given position
+            void erase(const size_t pos, const size_t count) {
+                // Values within one node are removed in place, after which only it's seams with it's
+                // neighbours can have become joinable
+                size_t start;
+                size_t end;
+                if (this->eraseFrom(this->root, pos, count, start, end)) {
+                    this->joinAt(end);
+                    this->joinAt(start);
+                    return;
+                }
+
+                uint32_t a, b, c;
+                this->split(this->root, pos, a, b);
+                this->split(b, count, b, c);
+                this->release(b);
+                this->root = this->merge(a, c);
+                this->join(pos);
+            }
+
+            // Move the given number of values starting at the given position so the first is
+            // at the new position (counted as if they had been removed first)
+            void move(const size_t pos, const size_t count, const size_t to) {
+                uint32_t a, b, c;
+                this->split(this->root, pos, a, b);
+                this->split(b, count, b, c);
+                this->root = this->merge(a, c);
+                this->join(pos);
+                this->split(this->root, to, a, c);
+                this->root = this->merge(this->merge(a, b), c);
+                this->join(to + count);
+                this->join(to);
+            }
+
+            // Call the given function with each value in order
+            template <typename Func>
+            void forEach(Func func) {
+                this->forEach(0, this->size(), func);
+            }
+
+            // Call the given function with the given number of values in order, starting at the position
+            template <typename Func>
+            void forEach(size_t pos, size_t count, Func func) {
+                // Start with the path down to the node holding the first value
+                std::vector<uint32_t> stack;
+                size_t offset = 0;
+                uint32_t idx = (pos < this->size() ? this->root : None);
+                while (idx != None) {
+                    Node & n = this->node(idx);
+                    const size_t leftSize = this->sizeOf(n.left);
+                    if (pos < leftSize) {
+                        stack.push_back(idx);
+                        idx = n.left;
+                    } else if (pos < leftSize + n.count) {
+                        stack.push_back(idx);
+                        offset = pos - leftSize;
+                        break;
+                    } else {
+                        pos -= leftSize + n.count;
+                        idx = n.right;
+                    }
+                }
+
+                idx = None;
+                while (count > 0 && (idx != None || !stack.empty())) {
+                    while (idx != None) {
+                        stack.push_back(idx);
+                        idx = this->node(idx).left;
+                    }
+                    idx = stack.back();
+                    stack.pop_back();
+                    Node & n = this->node(idx);
+                    for (size_t i = offset; i < n.count && count > 0; i++, count--) {
+                        func(n.values[i]);
+                    }
+                    offset = 0;
+                    idx = n.right;
+                }
+            }
+
+            // Remove all values and free all memory
+            void clear() {
+                this->blocks.clear();
+                this->blocks.shrink_to_fit();
+                this->root = None;
+                this->freeList = None;
+                this->nextNode = 0;
+                this->usedNodes = 0;
+            }
+    };
+};
+
+#endif
@@ -0,0 +1,78 @@
+#ifndef UTILS_PCMCACHE_HPP
+#define UTILS_PCMCACHE_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include "Types.hpp"
+#include <vector>
+
+// A PcmCache holds the first moments of decoded (but not yet processed) audio
+// for a few songs as 16 bit samples, so that skipping to one of them can start
+// playing straight away while it's file is opened. The total size of all entries
+// is limited to the budget given at creation. Entries are shared pointers so one
+// can still be played from after it has been dropped from the cache.
+// Only the statistics are thread-safe!
+namespace Utils {
+    class PcmCache {
+        public:
+            // Decoded audio at the start of a song
+            struct Entry {
+                SongID id;                      // ID of the song
+                long sampleRate;                // Sample rate of the song
+                int channels;                   // Number of channels
+                int totalSamples;               // Total samples in the song
+                size_t maxFrames;               // Number of frames the entry will hold once complete
+                bool complete;                  // Set true once no more frames will be added
+                std::vector<int16_t> samples;   // Interleaved samples
+
+                // Returns the number of frames currently held
+                size_t frames() const;
+            };
+
+            // Counters since creation
+            struct Stats {
+                size_t lookups;                 // Songs started which were looked up
+                size_t hits;                    // Songs started from the cache
+                size_t memory;                  // Bytes used by the entries
+                size_t budget;                  // Bytes the entries may use
+            };
+
+        private:
+            std::vector< std::shared_ptr<Entry> > entries;
+            size_t budget;
+            std::atomic<size_t> lookups;
+            std::atomic<size_t> hits;
+            std::atomic<size_t> memory;
+
+        public:
+            // Takes the maximum number of bytes the entries may use
+            PcmCache(const size_t);
+
+            // Returns the entry for the given song, or nullptr if there isn't one
+            std::shared_ptr<Entry> find(const SongID);
+            // As above, but counts towards the hit rate (call when a song is started)
+            std::shared_ptr<Entry> lookup(const SongID);
+
+            // Create an (empty) entry for the given song, which will hold the given number of
+            // frames of audio in the given format. Returns nullptr if it wouldn't fit in the budget
+            std::shared_ptr<Entry> create(const SongID, const long, const int, const int, const size_t);
+            // Append the given number of (float) frames to the entry, marking it complete once full
+            // or when no frames are given
+            void append(const std::shared_ptr<Entry> &, const float *, const size_t);
+            // Read up to the given number of frames from the entry starting at the given frame into
+            // the buffer as float samples. Returns the number of frames read
+            static size_t read(const std::shared_ptr<Entry> &, const size_t, float *, const size_t);
+
+            // Drop every entry except those for the given songs
+            void retain(const std::vector<SongID> &);
+            // Drop all entries
+            void clear();
+
+            // Returns the current counters
+            Stats stats();
+    };
+};
+
+#endif
@@ -0,0 +1,66 @@
+#ifndef UTILS_PCMFIFO_HPP
+#define UTILS_PCMFIFO_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// A PcmFifo is a lock-free ring of fixed size blocks of decoded audio, which is
+// shared between exactly one producer (the decoder) and one consumer (the audio
+// output). The memory backing each block is provided by the owner and is not
+// freed by this class.
+namespace Utils {
+    class PcmFifo {
+        public:
+            // A single block of decoded audio
+            struct Block {
+                uint8_t * data;                 // Pointer to start of memory
+                size_t size;                    // Number of valid bytes
+                size_t index;                   // Index of block's memory in the vector passed at creation
+            };
+
+        private:
+            std::vector<Block> blocks;          // Ring of blocks
+            size_t capacity;                    // Size of the memory backing each block
+            std::atomic<size_t> head;           // Total blocks consumed (only written by consumer)
+            std::atomic<size_t> tail;           // Total blocks produced (only written by producer)
+            std::atomic<size_t> depth_;         // Number of blocks the producer may have filled at once
+
+        public:
+            // Takes pointers to memory for each block, and the size of each
+            PcmFifo(const std::vector<uint8_t *> &, const size_t);
+
+            // Returns the size of the memory backing each block
+            size_t blockSize();
+            // Returns the number of blocks ready to be consumed
+            size_t count();
+            // Returns true if there are no blocks ready to be consumed
+            bool empty();
+            // Returns true if there are no blocks available to the producer
+            bool full();
+
+            // Returns the number of blocks the producer may have filled at once
+            size_t depth();
+            // Set the number of blocks the producer may have filled at once (clamped between one and
+            // the number of blocks). Lowering it below count() only stops the producer until enough are consumed
+            void setDepth(const size_t);
+
+            // (Producer) Returns the next block to write into, or nullptr if full
+            // Calling this again before commit() returns the same block
+            Block * acquire();
+            // (Producer) Mark the acquired block as ready, containing the given number of bytes
+            void commit(const size_t);
+
+            // (Consumer) Returns the oldest ready block, or nullptr if empty
+            Block * front();
+            // (Consumer) Returns the ready block the given number of blocks after the oldest, or nullptr if there isn't one
+            Block * peek(const size_t);
+            // (Consumer) Release the oldest ready block back to the producer
+            void pop();
+            // (Consumer) Release all ready blocks back to the producer
+            void flush();
+    };
+};
+
+#endif
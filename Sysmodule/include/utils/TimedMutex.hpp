@@ -0,0 +1,72 @@
+#ifndef UTILS_TIMEDMUTEX_HPP
+#define UTILS_TIMEDMUTEX_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <shared_mutex>
+
+// A TimedMutex wraps a standard (shared) mutex and adds up how long callers
+// have spent waiting to lock it, which shows where threads are held up.
+// Locking without waiting costs a single try_lock(). It can be used with
+// std::unique_lock, std::shared_lock and std::scoped_lock like the mutex it wraps.
+namespace Utils {
+    template <typename Mutex>
+    class TimedMutex {
+        private:
+            Mutex mutex;                            // Wrapped mutex
+            std::atomic<uint64_t> waited;           // Nanoseconds spent waiting to lock
+
+            // Add the time since the given point to the total
+            void addWait(const std::chrono::steady_clock::time_point start) {
+                this->waited += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+            }
+
+        public:
+            TimedMutex() : waited(0) { }
+
+            void lock() {
+                if (!this->mutex.try_lock()) {
+                    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+                    this->mutex.lock();
+                    this->addWait(start);
+                }
+            }
+
+            bool try_lock() {
+                return this->mutex.try_lock();
+            }
+
+            void unlock() {
+                this->mutex.unlock();
+            }
+
+            void lock_shared() {
+                if (!this->mutex.try_lock_shared()) {
+                    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+                    this->mutex.lock_shared();
+                    this->addWait(start);
+                }
+            }
+
+            bool try_lock_shared() {
+                return this->mutex.try_lock_shared();
+            }
+
+            void unlock_shared() {
+                this->mutex.unlock_shared();
+            }
+
+            // Returns the total number of seconds callers have waited
+            double waitTime() {
+                return this->waited / 1000000000.0;
+            }
+    };
+
+    // Wrapped versions of the standard mutexes
+    typedef TimedMutex<std::mutex> Mutex;
+    typedef TimedMutex<std::shared_mutex> SharedMutex;
+};
+
+#endif
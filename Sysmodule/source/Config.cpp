@@ -95,6 +95,40 @@ bool Config::pauseOnUnplug() {
     return this->ini->getbool("General", "pause_on_unplug", true);
 }
 
+ReplayGain Config::replayGain() {
+    const std::string mode = this->ini->gets("General", "replaygain", "Track");
+    if (mode == "Off") {
+        return ReplayGain::Off;
+
+    } else if (mode == "Album") {
+        return ReplayGain::Album;
+    }
+
+    return ReplayGain::Track;
+}
+
+int Config::prefetchTime() {
+    int secs = this->ini->geti("General", "prefetch_seconds", 10);
+    return (secs < 0 ? 0 : secs);
+}
+
+int Config::pcmCacheSongs() {
+    int songs = this->ini->geti("General", "pcm_cache_songs", 2);
+    return (songs < 0 ? 0 : songs);
+}
+
+bool Config::lowLatency() {
+    return this->ini->getbool("General", "low_latency", true);
+}
+
+bool Config::dither() {
+    return this->ini->getbool("General", "dither", true);
+}
+
+bool Config::noiseShaping() {
+    return this->ini->getbool("General", "noise_shaping", false);
+}
+
 bool Config::MP3AccurateSeek() {
     return this->ini->getbool("MP3", "accurate_seek", false);
 }
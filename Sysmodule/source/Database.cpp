@@ -1,9 +1,10 @@
 #include "Database.hpp"
 #include "Log.hpp"
 #include "Paths.hpp"
+#include "utils/Memory.hpp"
 
 // Version of the database (database begins with zero from 'template', so this started at 1)
-#define DB_VERSION 7
+#define DB_VERSION 8
 
 // Custom boolean 'operator' which instead of 'keeping' true, will 'keep' false
 bool keepFalse(const bool & a, const bool & b) {
@@ -12,10 +13,12 @@ bool keepFalse(const bool & a, const bool & b) {
 
 Database::Database() {
     // Create the database object
+    Utils::Memory::Scope scope(Utils::Memory::Tag::Database);
     this->db = new SQLite(Path::Common::DatabaseFile);
 }
 
 bool Database::getVersion(int & version) {
+    Utils::Memory::Scope scope(Utils::Memory::Tag::Database);
     bool ok = this->db->prepareQuery("SELECT value FROM Variables WHERE name = 'version';");
     if (ok) {
         ok = this->db->executeQuery();
@@ -32,6 +35,7 @@ bool Database::getVersion(int & version) {
 }
 
 bool Database::matchingVersion() {
+    Utils::Memory::Scope scope(Utils::Memory::Tag::Database);
     int version;
     if (!this->getVersion(version)) {
         return false;
@@ -49,6 +53,7 @@ bool Database::matchingVersion() {
 //       PUBLIC FUNCTIONS       //
 // ============================ //
 bool Database::openReadWrite() {
+    Utils::Memory::Scope scope(Utils::Memory::Tag::Database);
     if (!this->db->openConnection(SQLite::Connection::ReadWrite)) {
         return false;
     }
@@ -63,6 +68,7 @@ bool Database::openReadWrite() {
 }
 
 bool Database::openReadOnly() {
+    Utils::Memory::Scope scope(Utils::Memory::Tag::Database);
     if (!this->db->openConnection(SQLite::Connection::ReadOnly)) {
         return false;
     }
@@ -81,6 +87,7 @@ void Database::close() {
 }
 
 std::string Database::getPathForID(SongID id) {
+    Utils::Memory::Scope scope(Utils::Memory::Tag::Database);
     // Check we can read
     if (this->db->connectionType() == SQLite::Connection::None) {
         Log::writeError("[DB] [getPathForID] No open connection");
@@ -102,6 +109,39 @@ std::string Database::getPathForID(SongID id) {
     return path;
 }
 
+bool Database::getGainForID(SongID id, bool album, float & gain, float & peak) {
+    Utils::Memory::Scope scope(Utils::Memory::Tag::Database);
+    // Check we can read
+    if (this->db->connectionType() == SQLite::Connection::None) {
+        Log::writeError("[DB] [getGainForID] No open connection");
+        return false;
+    }
+
+    // Query both song and album values
+    double songGain, songPeak, albumGain, albumPeak;
+    bool ok = this->db->prepareQuery("SELECT Songs.gain, Songs.peak, Albums.gain, Albums.peak FROM Songs JOIN Albums ON Albums.id = Songs.album_id WHERE Songs.id = ?;");
+    ok = keepFalse(ok, this->db->bindInt(0, id));
+    ok = keepFalse(ok, this->db->executeQuery());
+    ok = keepFalse(ok, this->db->getDouble(0, songGain));
+    ok = keepFalse(ok, this->db->getDouble(1, songPeak));
+    ok = keepFalse(ok, this->db->getDouble(2, albumGain));
+    ok = keepFalse(ok, this->db->getDouble(3, albumPeak));
+    if (!ok) {
+        Log::writeError("[DB] [getGainForID] An error occurred querying the gain");
+        return false;
+    }
+
+    // A peak of zero indicates the values haven't been set
+    if (album && albumPeak > 0.0) {
+        gain = albumGain;
+        peak = albumPeak;
+    } else {
+        gain = songGain;
+        peak = songPeak;
+    }
+    return (peak > 0.0);
+}
+
 Database::~Database() {
     this->close();
 }
\ No newline at end of file
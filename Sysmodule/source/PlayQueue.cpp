@@ -1,136 +1,237 @@
 #include <algorithm>
 #include "PlayQueue.hpp"
+#include "utils/Memory.hpp"
 #include "utils/Random.hpp"
 
-// Maximum number of IDs (reserved at creation)
-#define MAX_SIZE 25000  // Requires 150kB (100kB for IDs, 50kB for position)
+// Number of keys added to the shuffled order at a time when shuffling
+#define SHUFFLE_BATCH 1024
 
 PlayQueue::PlayQueue() {
     this->idx = 0;
-    this->queue.reserve(MAX_SIZE);
     this->shuffled = false;
+    this->drawn = 0;
+    this->lookahead = 1;
+    this->nextKey = 0;
 }
 
-bool PlayQueue::addID(SongID id, unsigned short pos) {
+void PlayQueue::draw(size_t pos) {
+    // Uses the Yates-Fisher algorithm, swapping a random undrawn key into each position
+    const size_t size = this->order.size();
+    while (this->drawn <= pos && this->drawn < size) {
+        const size_t r = Utils::Random::getSizeT(this->drawn, size - 1);
+        if (r != this->drawn) {
+            std::swap(this->order.at(this->drawn), this->order.at(r));
+        }
+        this->drawn++;
+    }
+}
+
+void PlayQueue::addKeys(size_t count) {
+    Utils::Memory::Scope scope(Utils::Memory::Tag::Queue);
+    this->nextKey += count;
+    while (this->removedBits.size() * 64 < this->nextKey) {
+        // Each node of the Fenwick tree counts the words between it and the previous power of two boundary
+        const size_t node = this->removedCounts.size() + 1;
+        const size_t removed = this->removedWithin(node - 1) - this->removedWithin(node - (node & (~node + 1)));
+        this->removedBits.push_back(0);
+        this->removedCounts.push_back(removed);
+    }
+}
+
+void PlayQueue::removeKey(uint32_t key) {
+    const size_t word = key / 64;
+    this->removedBits[word] |= (uint64_t)1 << (key % 64);
+    for (size_t node = word + 1; node <= this->removedCounts.size(); node += (node & (~node + 1))) {
+        this->removedCounts[node - 1]++;
+    }
+}
+
+size_t PlayQueue::removedWithin(size_t words) {
+    size_t count = 0;
+    for (size_t node = words; node > 0; node &= node - 1) {
+        count += this->removedCounts[node - 1];
+    }
+    return count;
+}
+
+size_t PlayQueue::keyPosition(uint32_t key) {
+    const size_t word = key / 64;
+    const uint64_t before = this->removedBits[word] & (((uint64_t)1 << (key % 64)) - 1);
+    return key - this->removedWithin(word) - __builtin_popcountll(before);
+}
+
+bool PlayQueue::addID(SongID id, size_t pos) {
+    return this->addIDs(std::vector<SongID>{id}, pos);
+}
+
+bool PlayQueue::removeID(size_t pos) {
+    return this->removeIDs(pos, 1);
+}
+
+bool PlayQueue::addIDs(const std::vector<SongID> & ids, size_t pos) {
     // Sanity check
-    if (this->queue.size() == MAX_SIZE) {
+    Utils::Memory::Scope scope(Utils::Memory::Tag::Queue);
+    const size_t count = ids.size();
+    if (!this->canHold(this->queue.size() + count)) {
         return false;
     }
+    if (count == 0) {
+        return true;
+    }
 
     // If past the end add at end
     if (pos > this->queue.size()) {
         pos = this->queue.size();
     }
 
-    PlayQueuePair p;
-    p.id = id;
-    p.pos = (this->shuffled ? this->maxPos + 1 : pos);
-    this->queue.insert(this->queue.begin() + pos, p);
-
-    if (!this->shuffled) {
-        // If it's not shuffled we update following pairs
-        for (size_t i = pos + 1; i < this->queue.size(); i++) {
-            this->queue[i].pos++;
+    const bool wasEmpty = this->queue.empty();
+    if (this->shuffled) {
+        // New songs go after all others in the original order, and are placed (drawn) in the shuffled order
+        std::vector<uint32_t> keys;
+        for (size_t i = 0; i < count; i++) {
+            keys.push_back(this->nextKey + i);
+        }
+        this->queue.insert(this->queue.size(), ids);
+        this->addKeys(count);
+        if (pos > 0) {
+            this->draw(pos - 1);
         }
+        this->order.insert(pos, keys);
+        this->drawn += count;
+
+    } else {
+        this->queue.insert(pos, ids);
+    }
+
+    // Keep the current song if it was shifted down
+    if (!wasEmpty && pos <= this->idx) {
+        this->idx += count;
     }
-    this->maxPos++;
 
+    this->draw(this->idx + this->lookahead);
     return true;
 }
 
-bool PlayQueue::removeID(unsigned short pos) {
+bool PlayQueue::removeIDs(size_t pos, size_t count) {
     // Sanity check
-    if (this->queue.size() == MAX_SIZE || pos >= this->queue.size()) {
+    if (count == 0 || pos >= this->queue.size() || count > this->queue.size() - pos) {
         return false;
     }
 
-    this->queue.erase(this->queue.begin() + pos);
-    if (!this->shuffled) {
-        // If it's not shuffled we update following pairs
-        for (size_t i = pos + 1; i < this->queue.size(); i++) {
-            this->queue[i].pos--;
-        }
-        this->maxPos--;
+    if (this->shuffled) {
+        // Remove from the original order too
+        this->draw(pos + count - 1);
+        this->order.forEach(pos, count, [this](const uint32_t key) {
+            this->queue.erase(this->keyPosition(key), 1);
+            this->removeKey(key);
+        });
+        this->order.erase(pos, count);
+        this->drawn -= count;
+
+    } else {
+        this->queue.erase(pos, count);
+    }
+
+    // Keep the current song if it was after the range, otherwise move to the song that followed it
+    if (this->idx >= pos + count) {
+        this->idx -= count;
+    } else if (this->idx >= pos) {
+        this->setIdx(pos);
     }
 
+    this->draw(this->idx + this->lookahead);
     return true;
 }
 
-void PlayQueue::moveIDDown(unsigned short pos, unsigned short amt) {
+bool PlayQueue::moveIDs(size_t pos, size_t count, size_t to) {
     // Sanity check
-    if (pos >= this->queue.size() || amt == 0) {
-        return;
+    if (count == 0 || pos >= this->queue.size() || count > this->queue.size() - pos || to > this->queue.size() - count) {
+        return false;
+    }
+    if (to == pos) {
+        return true;
     }
 
-    // If too large move to the end
-    if ((pos + amt) > this->queue.size()) {
-        amt = (this->queue.size() - pos);
+    // Moves while shuffled only change the shuffled order
+    if (this->shuffled) {
+        this->draw(std::max(pos, to) + count - 1);
+        this->order.move(pos, count, to);
+    } else {
+        this->queue.move(pos, count, to);
     }
 
-    // Move (need to update positions if not shuffled)
-    if (!this->shuffled) {
-        for (size_t i = pos + 1; i < pos + amt; i++) {
-            PlayQueuePair tmp = this->queue[i-1];
-            this->queue[i-1] = this->queue[i];
-            this->queue[i] = tmp;
-            this->queue[i-1].pos--;
-            this->queue[i].pos++;
-        }
+    // Keep the current song
+    const size_t first = std::min(pos, to);
+    const size_t last = std::max(pos, to) + count;
+    if (this->idx >= pos && this->idx < pos + count) {
+        this->idx = to + (this->idx - pos);
+    } else if (this->idx >= first && this->idx < last) {
+        this->idx = (to < pos ? this->idx + count : this->idx - count);
+    }
 
-    } else {
-        for (size_t i = pos + 1; i < pos + amt; i++) {
-            PlayQueuePair tmp = this->queue[i-1];
-            this->queue[i-1] = this->queue[i];
-            this->queue[i] = tmp;
-        }
+    this->draw(this->idx + this->lookahead);
+    return true;
+}
+
+void PlayQueue::moveIDDown(size_t pos, size_t amt) {
+    // Sanity check
+    if (pos >= this->queue.size() || amt == 0) {
+        return;
     }
+
+    // If too large move to the end
+    this->moveIDs(pos, 1, std::min(pos + amt, this->queue.size() - 1));
 }
 
-void PlayQueue::moveIDUp(unsigned short pos, unsigned short amt) {
+void PlayQueue::moveIDUp(size_t pos, size_t amt) {
     // Sanity check
     if (pos == 0 || pos >= this->queue.size() || amt == 0) {
         return;
     }
 
     // If too large move to the start
-    if (amt > pos) {
-        amt = pos;
-    }
-
-    // Move (need to update positions if not shuffled)
-    unsigned short mv = pos - amt;
-    if (!this->shuffled) {
-        for (size_t i = pos - 1; i >= mv && i <= MAX_SIZE; i--) {
-            PlayQueuePair tmp = this->queue[i+1];
-            this->queue[i+1] = this->queue[i];
-            this->queue[i] = tmp;
-            this->queue[i+1].pos++;
-            this->queue[i].pos--;
-        }
-
-    } else {
-        for (size_t i = pos - 1; i >= mv && i <= MAX_SIZE; i--) {
-            PlayQueuePair tmp = this->queue[i+1];
-            this->queue[i+1] = this->queue[i];
-            this->queue[i] = tmp;
-        }
-    }
+    this->moveIDs(pos, 1, pos - std::min(amt, pos));
 }
 
 SongID PlayQueue::currentID() {
-    if (this->queue.size() == 0) {
+    return this->IDatPosition(this->idx);
+}
+
+SongID PlayQueue::IDatPosition(size_t pos) {
+    if (pos >= this->queue.size()) {
         return -1;
     }
 
-    return this->queue[this->idx].id;
+    if (!this->shuffled) {
+        return this->queue.at(pos);
+    }
+    if (pos >= this->drawn) {
+        return -1;
+    }
+    return this->queue.at(this->keyPosition(this->order.at(pos)));
 }
 
-SongID PlayQueue::IDatPosition(unsigned short pos) {
-    if (this->queue.size() == 0 || pos >= this->queue.size()) {
-        return -1;
+std::vector<SongID> PlayQueue::IDsFromPosition(size_t pos, size_t count) {
+    std::vector<SongID> ids;
+    if (!this->shuffled) {
+        this->queue.forEach(pos, count, [&ids](const SongID id) {
+            ids.push_back(id);
+        });
+        return ids;
     }
 
-    return this->queue[pos].id;
+    if (pos < this->queue.size() && count > 0) {
+        this->draw(std::min(pos + count, this->queue.size()) - 1);
+    }
+    this->order.forEach(pos, count, [this, &ids](const uint32_t key) {
+        ids.push_back(this->queue.at(this->keyPosition(key)));
+    });
+    return ids;
+}
+
+void PlayQueue::setLookahead(size_t count) {
+    this->lookahead = count;
+    this->draw(this->idx + this->lookahead);
 }
 
 size_t PlayQueue::currentIdx() {
@@ -146,24 +247,36 @@ void PlayQueue::decrementIdx() {
 }
 
 void PlayQueue::incrementIdx() {
-    if (this->idx == this->queue.size() - 1) {
+    if (this->queue.size() == 0 || this->idx == this->queue.size() - 1) {
         return;
     }
 
     this->idx++;
+    this->draw(this->idx + this->lookahead);
 }
 
-void PlayQueue::setIdx(unsigned short i) {
-    if (i >= this->queue.size() && this->queue.size() > 0) {
+void PlayQueue::setIdx(size_t i) {
+    // An empty queue can only be at the start, as there's no song to keep when it's filled
+    if (this->queue.size() == 0) {
+        this->idx = 0;
+    } else if (i >= this->queue.size()) {
         this->idx = this->queue.size() - 1;
     } else {
         this->idx = i;
     }
+    this->draw(this->idx + this->lookahead);
 }
 
 void PlayQueue::clear() {
     this->idx = 0;
-    this->queue.erase(this->queue.begin(), this->queue.end());
+    this->queue.clear();
+    this->order.clear();
+    this->drawn = 0;
+    this->removedBits.clear();
+    this->removedBits.shrink_to_fit();
+    this->removedCounts.clear();
+    this->removedCounts.shrink_to_fit();
+    this->nextKey = 0;
     this->shuffled = false;
 }
 
@@ -175,30 +288,58 @@ size_t PlayQueue::size() {
     return this->queue.size();
 }
 
+bool PlayQueue::canHold(size_t count) {
+    if (count <= this->queue.size()) {
+        return true;
+    }
+
+    // While shuffled, each song also needs a key in the shuffled order and a bit (plus a share of a counter)
+    const size_t extra = count - this->queue.size();
+    size_t bytes = this->queue.extraBytes(extra);
+    if (this->shuffled) {
+        bytes += this->order.extraBytes(extra) + ((extra + 63) / 64 + 1) * (sizeof(uint64_t) + sizeof(uint32_t));
+    }
+    return Utils::Memory::fits(Utils::Memory::Tag::Queue, bytes);
+}
+
 bool PlayQueue::isShuffled() {
     return this->shuffled;
 }
 
 void PlayQueue::shuffle() {
+    // Keys are handed out from the original positions, so start again from scratch
+    Utils::Memory::Scope scope(Utils::Memory::Tag::Queue);
+    const size_t size = this->queue.size();
+    const size_t current = (this->shuffled && size > 0 ? this->keyPosition(this->order.at(this->idx)) : this->idx);
+    this->order.clear();
+    this->removedBits.clear();
+    this->removedCounts.clear();
+    this->nextKey = 0;
+    this->addKeys(size);
     this->shuffled = true;
-
-    if (this->queue.size() == 0) {
+    if (size == 0) {
+        this->drawn = 0;
         return;
     }
 
-    // Set current song as first
-    PlayQueuePair tmp = this->queue[this->idx];
-    this->queue[this->idx] = this->queue[0];
-    this->queue[0] = tmp;
-    this->setIdx(0);
-
-    // Uses the Yates-Fisher algorithm
-    for (size_t i = this->queue.size() - 1; i > 1; i--) {
-        size_t r = Utils::Random::getSizeT(1, i);
-        tmp = this->queue[i];
-        this->queue[i] = this->queue[r];
-        this->queue[r] = tmp;
+    // Start the shuffled order with the current song, followed by the rest in their original order
+    // to be drawn from as needed
+    this->order.insert(0, static_cast<uint32_t>(current));
+    std::vector<uint32_t> keys;
+    keys.reserve(SHUFFLE_BATCH);
+    for (size_t key = 0; key < size; key++) {
+        if (key != current) {
+            keys.push_back(key);
+        }
+        if (keys.size() == SHUFFLE_BATCH) {
+            this->order.insert(this->order.size(), keys);
+            keys.clear();
+        }
     }
+    this->order.insert(this->order.size(), keys);
+    this->drawn = 1;
+    this->idx = 0;
+    this->draw(this->lookahead);
 }
 
 void PlayQueue::unshuffle() {
@@ -206,23 +347,16 @@ void PlayQueue::unshuffle() {
         return;
     }
 
-    // Get pos of current song
-    unsigned short songPos = this->queue[this->currentIdx()].pos;
-
-    // Sort by pos value
-    std::sort(this->queue.begin(), this->queue.end(), [](const PlayQueuePair & lhs, const PlayQueuePair & rhs) {
-        return lhs.pos < rhs.pos;
-    });
-
-    // Update pos values
-    for (size_t i = 0; i < this->queue.size(); i++) {
-        // Set same song as current song
-        if (this->queue[i].pos == songPos) {
-            this->setIdx(i);
-        }
-        this->queue[i].pos = i;
+    // The original order is always kept, so only the current song's position is needed
+    if (this->queue.size() > 0) {
+        this->idx = this->keyPosition(this->order.at(this->idx));
     }
-    this->maxPos = this->queue.size();
-
+    this->order.clear();
+    this->drawn = 0;
+    this->removedBits.clear();
+    this->removedBits.shrink_to_fit();
+    this->removedCounts.clear();
+    this->removedCounts.shrink_to_fit();
+    this->nextKey = 0;
     this->shuffled = false;
-}
\ No newline at end of file
+}
@@ -0,0 +1,65 @@
+#include "QueueJournal.hpp"
+#include "utils/Memory.hpp"
+
+QueueJournal::QueueJournal(const size_t max) {
+    Utils::Memory::Scope scope(Utils::Memory::Tag::Queue);
+    this->changes.resize(max > 0 ? max : 1);
+    this->first = 0;
+    this->count = 0;
+
+    // Clients start at zero, so their first request is always answered with a full fetch
+    this->version_ = 1;
+}
+
+void QueueJournal::add(const TriPlayer::QueueChange & change) {
+    std::scoped_lock<std::mutex> mtx(this->mutex);
+    if (this->count == this->changes.size()) {
+        this->first = (this->first + 1) % this->changes.size();
+        this->count--;
+    }
+    this->changes[(this->first + this->count) % this->changes.size()] = change;
+    this->count++;
+    this->version_++;
+}
+
+void QueueJournal::insert(const bool sub, const size_t pos, const SongID id) {
+    this->add(TriPlayer::QueueChange{TriPlayer::Change::Insert, sub, static_cast<uint32_t>(pos), 0, id});
+}
+
+void QueueJournal::remove(const bool sub, const size_t pos, const size_t num) {
+    if (num > 0) {
+        this->add(TriPlayer::QueueChange{TriPlayer::Change::Remove, sub, static_cast<uint32_t>(pos), static_cast<uint32_t>(num), -1});
+    }
+}
+
+void QueueJournal::move(const bool sub, const size_t from, const size_t to) {
+    if (from != to) {
+        this->add(TriPlayer::QueueChange{TriPlayer::Change::Move, sub, static_cast<uint32_t>(from), static_cast<uint32_t>(to), -1});
+    }
+}
+
+void QueueJournal::reset() {
+    std::scoped_lock<std::mutex> mtx(this->mutex);
+    this->first = 0;
+    this->count = 0;
+    this->version_++;
+}
+
+uint64_t QueueJournal::version() {
+    std::scoped_lock<std::mutex> mtx(this->mutex);
+    return this->version_;
+}
+
+bool QueueJournal::changesSince(const uint64_t version, const size_t max, std::vector<TriPlayer::QueueChange> & out) {
+    // The oldest edit held moved the queues onto (version_ - count + 1)
+    std::scoped_lock<std::mutex> mtx(this->mutex);
+    if (version > this->version_ || version + this->count < this->version_) {
+        return false;
+    }
+
+    size_t skip = this->count - (this->version_ - version);
+    for (size_t i = skip; i < this->count && i - skip < max; i++) {
+        out.push_back(this->changes[(this->first + i) % this->changes.size()]);
+    }
+    return true;
+}
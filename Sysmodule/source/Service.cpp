@@ -1,36 +1,116 @@
+#include <cmath>
+#include <cstring>
 #include "Config.hpp"
 #include "Database.hpp"
+#include "dsp/Chain.hpp"
+#include "dsp/Convert.hpp"
+#include "dsp/Dither.hpp"
+#include "dsp/Equalizer.hpp"
+#include "dsp/Gain.hpp"
+#include "dsp/Limiter.hpp"
 #include "ipc/TriPlayer.hpp"
 #include "nx/Audio.hpp"
+#include "nx/File.hpp"
 #include "nx/NX.hpp"
 #include "Paths.hpp"
 #include "PlayQueue.hpp"
+#include "QueueJournal.hpp"
 #include "Service.hpp"
 #include "source/Factory.hpp"
 #include "source/MP3.hpp"
 #include "utils/FS.hpp"
+#include "utils/LatencyStats.hpp"
+#include "utils/Memory.hpp"
+#include <malloc.h>
 
 // Interval (in seconds) to test if DB file is accessible
 #define DB_TEST_INTERVAL 2
 // Number of milliseconds between polling system state
 #define POLL_INTERVAL 10
+// Number of milliseconds to wait for a power event before checking whether to exit
+#define PSC_WAIT_INTERVAL 500
 // Number of seconds to wait before previous becomes (back to start)
 #define PREV_WAIT 2
 // Max size of sub-queue (requires 20kB)
 #define SUBQUEUE_MAX_SIZE 5000
+// Number of queue edits remembered for clients (requires 10kB)
+#define JOURNAL_SIZE 512
+// Number of IDs added to the queue at once by SetQueue (requires 4kB)
+#define SETQUEUE_BATCH 1024
+// Number of float samples decoded at once before being converted into the FIFO (requires 32kB)
+#define SCRATCH_SAMPLES 8192
+// Number of milliseconds between checking whether a game is running (for low latency mode)
+#define APP_POLL_INTERVAL 1000
+// Size of the heap (see main.cpp)
+extern "C" size_t nx_inner_heap_size;
+
+// Ceiling of the limiter at the end of the DSP chain (just under full scale)
+#define LIMITER_CEILING 0.98f
+// Memory an open song is expected to need (file buffers + decoder)
+#define SOURCE_SIZE_ESTIMATE (160 * 1024)
+// Seconds of audio cached for each upcoming song
+#define PCM_CACHE_SECONDS 1
 
 MainService::MainService() {
     this->audio = Audio::getInstance();
+    this->bufferStats = new Utils::LatencyStats();
+    this->cacheOpenFrames = 0;
+    this->cacheOpenID = -1;
+    this->cachePlaybackPos = 0;
+    this->cacheSource = nullptr;
+    this->changePending = false;
+    this->changeStats = new Utils::LatencyStats();
+    std::memset(&this->lastState, 0, sizeof(TriPlayer::State));
+    this->stateGeneration = 0;
+    this->notifiedGeneration = 0;
     this->combosUpdated = false;
     this->dbLocked = false;
+    this->decodeTime = 0.0;
+    this->decodedTime = 0.0;
+    this->lowLatency = false;
+    this->scratch = new float[SCRATCH_SAMPLES];
+
+    // Create DSP chain (order matters!)
+    this->dsp = new Dsp::Chain();
+    this->gain = new Dsp::Gain();
+    this->equalizer = new Dsp::Equalizer();
+    this->limiter = new Dsp::Limiter(LIMITER_CEILING);
+    this->dither = new Dsp::Dither();
+    this->dsp->add(this->gain);
+    this->dsp->add(this->equalizer);
+    this->dsp->add(this->limiter);
+    this->dsp->add(this->dither);
     this->muteLevel = 0.0;
+    this->nextSource = nullptr;
+    this->nextSourceAction = SongAction::Nothing;
+    this->nextSourceID = -1;
+    this->nextSourceOpened = false;
+    this->nextSourceQueued = false;
+    this->nextSourceTried = false;
+    this->nextSourceGain = 1.0f;
+    this->pcmCache = new Utils::PcmCache(Utils::Memory::budget(Utils::Memory::Tag::Cache));
+    this->pcmCacheSongs = 0;
+    this->prefetchTime = 0;
     this->pressTime = std::time(nullptr);
     this->queue = new PlayQueue();
+    this->journal = new QueueJournal(JOURNAL_SIZE);
     this->repeatMode = RepeatMode::Off;
+    this->replayGain = ReplayGain::Off;
     this->seekTo = -1;
+    this->songLength = 0;
     this->source = nullptr;
+    this->sourceGain = 1.0f;
     this->songAction = SongAction::Nothing;
 
+    // Wake the relevant threads when the audio state changes
+    this->audio->setBufferFunc([this]() {
+        this->decodeEvent.signal();
+    });
+    this->audio->setStatusFunc([this]() {
+        this->gpioEvent.signal();
+        this->playbackEvent.signal();
+    });
+
     // Read and set config
     this->cfg = new Config(Path::Sys::ConfigFile);
     this->updateConfig();
@@ -51,19 +131,31 @@ MainService::MainService() {
 
 void MainService::updateConfig() {
     Log::setLogLevel(this->cfg->logLevel());
+    this->lowLatency = this->cfg->lowLatency();
     this->watchGpio = this->cfg->pauseOnUnplug();
     this->watchHid = this->cfg->keyComboEnabled();
     this->watchSleep = this->cfg->pauseOnSleep();
+    this->gpioEvent.signal();
 
-    std::scoped_lock<std::shared_mutex> cMtx(this->cMutex);
+    std::scoped_lock<Utils::SharedMutex> cMtx(this->cMutex);
     this->comboNextString = this->cfg->keyComboNext();
     this->comboPlayString = this->cfg->keyComboPlay();
     this->comboPrevString = this->cfg->keyComboPrev();
     this->combosUpdated = true;
+    this->hidEvent.signal();
 
-    std::scoped_lock<std::shared_mutex> sMtx(this->sMutex);
+    std::scoped_lock<Utils::SharedMutex> sMtx(this->sMutex);
     Source::MP3::setAccurateSeek(this->cfg->MP3AccurateSeek());
-    Source::MP3::setEqualizer(this->cfg->MP3Equalizer());
+    this->equalizer->setGains(this->cfg->MP3Equalizer());
+    this->replayGain = this->cfg->replayGain();
+    this->prefetchTime = this->cfg->prefetchTime();
+    this->pcmCacheSongs = this->cfg->pcmCacheSongs();
+    this->dither->setEnabled(this->cfg->dither());
+    this->dither->setNoiseShaping(this->cfg->noiseShaping());
+
+    // Upcoming songs are read (to be cached) while the queue is only shared, so have them drawn in advance
+    std::scoped_lock<Utils::SharedMutex> qMtx(this->qMutex);
+    this->queue->setLookahead(this->pcmCacheSongs > 1 ? this->pcmCacheSongs : 1);
 }
 
 Ipc::Result MainService::commandThread(Ipc::Request * request) {
@@ -95,12 +187,14 @@ Ipc::Result MainService::commandThread(Ipc::Request * request) {
             }
 
             this->pressTime = std::time(nullptr);
+            this->playbackEvent.signal();
             break;
 
         // Simply set the 'SongAction' to Next
         // The other thread will handle changing songs
         case Ipc::Command::Next:
             this->songAction = SongAction::Next;
+            this->playbackEvent.signal();
             this->pressTime = std::time(nullptr);
             break;
 
@@ -139,7 +233,7 @@ Ipc::Result MainService::commandThread(Ipc::Request * request) {
 
         case Ipc::Command::GetSubQueue: {
             // Return if empty
-            std::unique_lock<std::shared_mutex> mtx(this->sqMutex);
+            std::unique_lock<Utils::SharedMutex> mtx(this->sqMutex);
             if (this->subQueue.empty()) {
                 size_t zero = 0;
                 request->appendReplyValue(zero);
@@ -185,18 +279,20 @@ Ipc::Result MainService::commandThread(Ipc::Request * request) {
 
             // Pop songs from queue and skip
             size_t skipped = 0;
-            std::unique_lock<std::shared_mutex> mtx(this->sqMutex);
+            std::unique_lock<Utils::SharedMutex> mtx(this->sqMutex);
             while (skipped < count && !this->subQueue.empty()) {
                 this->subQueue.pop_front();
                 skipped++;
             }
+            this->journal->remove(true, 0, skipped);
             this->songAction = SongAction::Next;
+            this->playbackEvent.signal();
             request->appendReplyValue(skipped);
             break;
         }
 
         case Ipc::Command::SubQueueSize: {
-            std::shared_lock<std::shared_mutex> mtx(this->sqMutex);
+            std::shared_lock<Utils::SharedMutex> mtx(this->sqMutex);
             request->appendReplyValue(this->subQueue.size());
             break;
         }
@@ -210,18 +306,23 @@ Ipc::Result MainService::commandThread(Ipc::Request * request) {
             }
 
             // Lock and update queue
-            std::unique_lock<std::shared_mutex> mtx(this->sqMutex);
-            if (this->subQueue.size() < SUBQUEUE_MAX_SIZE) {
+            std::unique_lock<Utils::SharedMutex> mtx(this->sqMutex);
+            if (this->subQueue.size() < SUBQUEUE_MAX_SIZE && Utils::Memory::fits(Utils::Memory::Tag::SubQueue, sizeof(SongID))) {
+                Utils::Memory::Scope scope(Utils::Memory::Tag::SubQueue);
                 this->subQueue.push_back(id);
+                this->journal->insert(true, this->subQueue.size() - 1, id);
                 mtx.unlock();
 
                 // Start playing if there is nothing playing
-                std::shared_lock<std::shared_mutex> qMtx(this->qMutex);
+                std::shared_lock<Utils::SharedMutex> qMtx(this->qMutex);
                 if (this->queue->currentID() == -1) {
                     this->songAction = SongAction::Next;
                 }
 
-            // Return error code if subqueue full
+                // Wake playback in case it stopped at the end of the queue
+                this->playbackEvent.signal();
+
+            // Return error code if subqueue full (or out of memory)
             } else {
                 return Ipc::Result::SubQueueFull;
             }
@@ -237,14 +338,18 @@ Ipc::Result MainService::commandThread(Ipc::Request * request) {
             }
 
             // Erase element
-            std::unique_lock<std::shared_mutex> mtx(this->sqMutex);
+            std::unique_lock<Utils::SharedMutex> mtx(this->sqMutex);
+            if (this->subQueue.empty()) {
+                break;
+            }
             index = (index >= this->subQueue.size() ? this->subQueue.size()-1 : index);
             this->subQueue.erase(this->subQueue.begin() + index);
+            this->journal->remove(true, index, 1);
             break;
         }
 
         case Ipc::Command::QueueIdx: {
-            std::shared_lock<std::shared_mutex> mtx(this->qMutex);
+            std::shared_lock<Utils::SharedMutex> mtx(this->qMutex);
             request->appendReplyValue(this->queue->currentIdx());
             break;
         }
@@ -258,15 +363,16 @@ Ipc::Result MainService::commandThread(Ipc::Request * request) {
             }
 
             // Jump to and return current index
-            std::unique_lock<std::shared_mutex> mtx(this->qMutex);
+            std::unique_lock<Utils::SharedMutex> mtx(this->qMutex);
             this->queue->setIdx(pos);
             this->songAction = SongAction::Replay;
+            this->playbackEvent.signal();
             request->appendReplyValue(this->queue->currentIdx());
             break;
         }
 
         case Ipc::Command::QueueSize: {
-            std::shared_lock<std::shared_mutex> mtx(this->qMutex);
+            std::shared_lock<Utils::SharedMutex> mtx(this->qMutex);
             request->appendReplyValue(this->queue->size());
             break;
         }
@@ -280,16 +386,17 @@ Ipc::Result MainService::commandThread(Ipc::Request * request) {
             }
 
             // Remove from queue
-            std::unique_lock<std::shared_mutex> mtx(this->qMutex);
+            std::unique_lock<Utils::SharedMutex> mtx(this->qMutex);
             if (!this->queue->removeID(pos)) {
                 return Ipc::Result::BadInput;
             }
+            this->journal->remove(false, pos, 1);
             break;
         }
 
         case Ipc::Command::GetQueue: {
             // Return if empty
-            std::unique_lock<std::shared_mutex> mtx(this->qMutex);
+            std::unique_lock<Utils::SharedMutex> mtx(this->qMutex);
             if (this->queue->empty()) {
                 size_t zero = 0;
                 request->appendReplyValue(zero);
@@ -317,57 +424,54 @@ Ipc::Result MainService::commandThread(Ipc::Request * request) {
             }
 
             // Iterate over queue and append each ID
-            size_t max = (count > this->queue->size()-index ? this->queue->size()-index : count);
-            for (size_t i = 0; i < max; i++) {
-                request->appendReplyData(this->queue->IDatPosition(index + i));
+            std::vector<SongID> ids = this->queue->IDsFromPosition(index, count);
+            for (const SongID id : ids) {
+                request->appendReplyData(id);
             }
-            request->appendReplyValue(max);
+            request->appendReplyValue(ids.size());
             break;
         }
 
         case Ipc::Command::SetQueue: {
-            // Clear sub queue
-            std::unique_lock<std::shared_mutex> sqMtx(this->sqMutex);
+            // Clear both queues, holding both locks until the journal is reset so nobody
+            // can see (or record edits to) a half replaced queue
+            std::scoped_lock<Utils::SharedMutex> sqMtx(this->sqMutex);
+            std::scoped_lock<Utils::SharedMutex> qMtx(this->qMutex);
             this->subQueue.clear();
-            sqMtx.unlock();
-
-            // Clear main queue
-            std::unique_lock<std::shared_mutex> mtx(this->qMutex);
             this->queue->clear();
 
-            // Add each value present in the buffer
-            while (true) {
-                SongID id;
-                Ipc::Result rc = request->readRequestData(id);
-                if (rc != Ipc::Result::Ok) {
-                    break;
+            // Add each value present in the buffer (all of them, or as many as fit). They're added in
+            // batches so they're never all copied out of the buffer at once
+            const bool fits = this->queue->canHold(request->getRequestBuffer().size() / sizeof(SongID));
+            std::vector<SongID> ids;
+            ids.reserve(SETQUEUE_BATCH);
+            SongID id;
+            while (request->readRequestData(id) == Ipc::Result::Ok) {
+                if (!fits) {
+                    if (!this->queue->addID(id, this->queue->size())) {
+                        break;
+                    }
+                    continue;
+                }
+
+                ids.push_back(id);
+                if (ids.size() == SETQUEUE_BATCH) {
+                    this->queue->addIDs(ids, this->queue->size());
+                    ids.clear();
                 }
-                this->queue->addID(id, this->queue->size());
             }
+            this->queue->addIDs(ids, this->queue->size());
 
             // Reply with number of songs inserted
+            this->journal->reset();
             request->appendReplyValue(this->queue->size());
+            this->playbackEvent.signal();
             break;
         }
 
-        case Ipc::Command::GetRepeat: {
-            TriPlayer::Repeat rm = TriPlayer::Repeat::Off;
-            switch (this->repeatMode) {
-                case RepeatMode::Off:
-                    rm = TriPlayer::Repeat::Off;
-                    break;
-
-                case RepeatMode::One:
-                    rm = TriPlayer::Repeat::One;
-                    break;
-
-                case RepeatMode::All:
-                    rm = TriPlayer::Repeat::All;
-                    break;
-            }
-            request->appendReplyValue(rm);
+        case Ipc::Command::GetRepeat:
+            request->appendReplyValue(this->playbackRepeat());
             break;
-        }
 
         case Ipc::Command::SetRepeat: {
             // Read repeat mode from args
@@ -391,11 +495,12 @@ Ipc::Result MainService::commandThread(Ipc::Request * request) {
                     this->repeatMode = RepeatMode::All;
                     break;
             }
+            this->playbackEvent.signal();
             break;
         }
 
         case Ipc::Command::GetShuffle: {
-            std::shared_lock<std::shared_mutex> mtx(this->qMutex);
+            std::shared_lock<Utils::SharedMutex> mtx(this->qMutex);
             request->appendReplyValue((this->queue->isShuffled() ? TriPlayer::Shuffle::On : TriPlayer::Shuffle::Off));
             break;
         }
@@ -409,60 +514,29 @@ Ipc::Result MainService::commandThread(Ipc::Request * request) {
             }
 
             // Adjust accordingly
-            std::unique_lock<std::shared_mutex> mtx(this->qMutex);
+            std::unique_lock<Utils::SharedMutex> mtx(this->qMutex);
             if (sm == TriPlayer::Shuffle::Off) {
                 this->queue->unshuffle();
             } else {
                 this->queue->shuffle();
             }
+            this->journal->reset();
             break;
         }
 
         case Ipc::Command::GetSong: {
-            std::shared_lock<std::shared_mutex> mtx(this->qMutex);
+            std::shared_lock<Utils::SharedMutex> mtx(this->qMutex);
             request->appendReplyValue(this->queue->currentID());
             break;
         }
 
-        case Ipc::Command::GetStatus: {
-            TriPlayer::Status s = TriPlayer::Status::Error;
-
-            // Say that we're playing if the song is currently seeking
-            if (this->seekTo >= 0) {
-                s = TriPlayer::Status::Playing;
-            } else {
-                switch (audio->status()) {
-                    case Audio::Status::Playing:
-                        s = TriPlayer::Status::Playing;
-                        break;
-
-                    case Audio::Status::Paused:
-                        s = TriPlayer::Status::Paused;
-                        break;
-
-                    case Audio::Status::Stopped:
-                        s = TriPlayer::Status::Stopped;
-                        break;
-                }
-            }
-            request->appendReplyValue(s);
+        case Ipc::Command::GetStatus:
+            request->appendReplyValue(this->playbackStatus());
             break;
-        }
 
-        case Ipc::Command::GetPosition: {
-            // Check position if not seeking
-            double pos = 100.0 * this->seekTo;
-            if (pos < 0) {
-                std::shared_lock<std::shared_mutex> mtx(this->sMutex);
-                if (this->source == nullptr) {
-                    pos = 0;
-                } else {
-                    pos = 100 * (this->audio->samplesPlayed()/(double)this->source->totalSamples());
-                }
-            }
-            request->appendReplyValue(pos);
+        case Ipc::Command::GetPosition:
+            request->appendReplyValue(this->playbackPosition());
             break;
-        }
 
         case Ipc::Command::SetPosition: {
             // Read position from args
@@ -475,12 +549,13 @@ Ipc::Result MainService::commandThread(Ipc::Request * request) {
             // Set seek value and return it
             pos /= 100.0;
             this->seekTo = pos;
+            this->playbackEvent.signal();
             request->appendReplyValue(pos);
             break;
         }
 
         case Ipc::Command::GetPlayingFrom: {
-            std::shared_lock<std::shared_mutex> mtx(this->qMutex);
+            std::shared_lock<Utils::SharedMutex> mtx(this->qMutex);
             request->appendReplyData(this->playingFrom);
             break;
         }
@@ -494,7 +569,7 @@ Ipc::Result MainService::commandThread(Ipc::Request * request) {
             }
 
             // Lock queue to allow updating and return string
-            std::unique_lock<std::shared_mutex> mtx(this->qMutex);
+            std::unique_lock<Utils::SharedMutex> mtx(this->qMutex);
             this->playingFrom = str.substr(0, (str.length() > 100) ? 100 : str.length());
             break;
         }
@@ -502,7 +577,7 @@ Ipc::Result MainService::commandThread(Ipc::Request * request) {
         // Lock the mutex and mark that the database is being used for writing by the app
         // Once we lock the mutex the decode thread is guaranteed to not be using the DB
         case Ipc::Command::RequestDBLock: {
-            std::scoped_lock<std::mutex> mtx(this->dbMutex);
+            std::scoped_lock<Utils::Mutex> mtx(this->dbMutex);
             this->db->close();
             this->dbLocked = true;
             break;
@@ -519,10 +594,10 @@ Ipc::Result MainService::commandThread(Ipc::Request * request) {
 
         case Ipc::Command::Reset: {
             // Need to lock everything!!
-            std::scoped_lock<std::shared_mutex> sMtx(this->sMutex);
-            std::scoped_lock<std::shared_mutex> sqMtx(this->sqMutex);
-            std::scoped_lock<std::shared_mutex> qMtx(this->qMutex);
-            std::scoped_lock<std::mutex> mtx(this->dbMutex);
+            std::scoped_lock<Utils::SharedMutex> sMtx(this->sMutex);
+            std::scoped_lock<Utils::SharedMutex> sqMtx(this->sqMutex);
+            std::scoped_lock<Utils::SharedMutex> qMtx(this->qMutex);
+            std::scoped_lock<Utils::Mutex> mtx(this->dbMutex);
 
             // Ensure we're disconnected from the DB
             this->db->close();
@@ -531,24 +606,337 @@ Ipc::Result MainService::commandThread(Ipc::Request * request) {
             this->audio->stop();
             this->queue->clear();
             this->subQueue.clear();
+            this->journal->reset();
+            this->discardNextSource();
+            this->discardPcmCache();
             delete this->source;
             this->source = nullptr;
+            this->songLength = 0;
 
             request->appendReplyValue(std::string(VER_STRING));
             break;
         }
 
         case Ipc::Command::Quit:
-            this->exit_ = true;
+            this->exit();
+            break;
+
+        case Ipc::Command::GetStats: {
+            TriPlayer::Stats stats;
+            this->getStats(stats);
+            request->appendReplyData(stats);
+            break;
+        }
+
+        case Ipc::Command::GetState: {
+            TriPlayer::State state;
+            this->getState(state);
+            request->appendReplyData(state);
+            break;
+        }
+
+        case Ipc::Command::Subscribe:
+            if (!this->ipcServer->subscribe(request)) {
+                return Ipc::Result::Unknown;
+            }
+            break;
+
+        case Ipc::Command::GetQueueChanges: {
+            // Read version the client has
+            uint64_t version;
+            Ipc::Result rc = request->readRequestValue(version);
+            if (rc != Ipc::Result::Ok) {
+                return rc;
+            }
+
+            // Reply with the edits since then which fit in the buffer, or tell the client to fetch
+            // the queues in full if they've been forgotten
+            const size_t max = request->replyBufferSize() / sizeof(TriPlayer::QueueChange);
+            std::vector<TriPlayer::QueueChange> changes;
+            uint32_t truncated = (this->journal->changesSince(version, max, changes) ? 0 : 1);
+            for (const TriPlayer::QueueChange & change : changes) {
+                request->appendReplyData(change);
+            }
+            request->appendReplyValue(version + changes.size());
+            request->appendReplyValue(static_cast<uint32_t>(changes.size()));
+            request->appendReplyValue(truncated);
             break;
+        }
+
+        case Ipc::Command::EditQueue: {
+            // Read every edit before touching the queue
+            struct Edit {
+                uint32_t type;
+                uint32_t pos;
+                uint32_t count;
+                uint32_t to;
+                std::vector<SongID> ids;
+            };
+            std::vector<Edit> edits;
+            while (true) {
+                Edit edit;
+                if (request->readRequestData(edit.type) != Ipc::Result::Ok) {
+                    break;
+                }
+                if (request->readRequestData(edit.pos) != Ipc::Result::Ok || request->readRequestData(edit.count) != Ipc::Result::Ok || request->readRequestData(edit.to) != Ipc::Result::Ok) {
+                    return Ipc::Result::BadInput;
+                }
+                if (edit.type == static_cast<uint32_t>(TriPlayer::Edit::Insert)) {
+                    if (edit.count > request->getRequestBuffer().size() / sizeof(SongID)) {
+                        return Ipc::Result::BadInput;
+                    }
+                    edit.ids.resize(edit.count);
+                    for (SongID & id : edit.ids) {
+                        if (request->readRequestData(id) != Ipc::Result::Ok) {
+                            return Ipc::Result::BadInput;
+                        }
+                    }
+                }
+                edits.push_back(std::move(edit));
+            }
+
+            // Check they're all valid against the size the queue will be at the time
+            std::unique_lock<Utils::SharedMutex> mtx(this->qMutex);
+            size_t size = this->queue->size();
+            for (const Edit & edit : edits) {
+                switch (static_cast<TriPlayer::Edit>(edit.type)) {
+                    case TriPlayer::Edit::Insert:
+                        size += edit.count;
+                        if (!this->queue->canHold(size)) {
+                            return Ipc::Result::BadInput;
+                        }
+                        break;
+
+                    case TriPlayer::Edit::Remove:
+                        if (edit.count == 0 || edit.pos >= size || edit.count > size - edit.pos) {
+                            return Ipc::Result::BadInput;
+                        }
+                        size -= edit.count;
+                        break;
+
+                    case TriPlayer::Edit::Move:
+                        if (edit.count == 0 || edit.pos >= size || edit.count > size - edit.pos || edit.to > size - edit.count) {
+                            return Ipc::Result::BadInput;
+                        }
+                        break;
+
+                    default:
+                        return Ipc::Result::BadInput;
+                }
+            }
+
+            // Apply them in order, recording each in the journal the same way single edits are
+            SongID current = this->queue->currentID();
+            for (const Edit & edit : edits) {
+                switch (static_cast<TriPlayer::Edit>(edit.type)) {
+                    case TriPlayer::Edit::Insert: {
+                        const size_t pos = std::min(static_cast<size_t>(edit.pos), this->queue->size());
+                        if (!this->queue->addIDs(edit.ids, pos)) {
+                            // Only reached if memory ran out, so stop here and have the app refetch
+                            Log::writeError("[IPC] Unable to insert " + std::to_string(edit.ids.size()) + " songs into the queue");
+                            this->journal->reset();
+                            return Ipc::Result::Unknown;
+                        }
+                        for (size_t i = 0; i < edit.ids.size(); i++) {
+                            this->journal->insert(false, pos + i, edit.ids[i]);
+                        }
+                        break;
+                    }
+
+                    case TriPlayer::Edit::Remove:
+                        this->queue->removeIDs(edit.pos, edit.count);
+                        this->journal->remove(false, edit.pos, edit.count);
+                        break;
+
+                    case TriPlayer::Edit::Move:
+                        this->queue->moveIDs(edit.pos, edit.count, edit.to);
+                        for (size_t i = 0; i < edit.count && edit.to != edit.pos; i++) {
+                            if (edit.to < edit.pos) {
+                                this->journal->move(false, edit.pos + i, edit.to + i);
+                            } else {
+                                this->journal->move(false, edit.pos, edit.to + edit.count - 1);
+                            }
+                        }
+                        break;
+                }
+            }
+
+            // Play the new current song if the old one was removed
+            if (this->queue->currentID() != current && this->queue->currentID() != -1) {
+                this->songAction = SongAction::Replay;
+            }
+            request->appendReplyValue(this->queue->size());
+            this->playbackEvent.signal();
+            break;
+        }
+
+        case Ipc::Command::GetMemory: {
+            // Reply with each subsystem's usage, and log it too
+            size_t count = static_cast<size_t>(Utils::Memory::Tag::Count);
+            for (size_t i = 0; i < count; i++) {
+                const Utils::Memory::Tag tag = static_cast<Utils::Memory::Tag>(i);
+                const Utils::Memory::Usage use = Utils::Memory::usage(tag);
+                TriPlayer::MemoryUsage usage = TriPlayer::MemoryUsage();
+                std::strncpy(usage.name, Utils::Memory::name(tag), sizeof(usage.name) - 1);
+                usage.used = use.used;
+                usage.peak = use.peak;
+                usage.budget = use.budget;
+                usage.overruns = use.overruns;
+                request->appendReplyData(usage);
+            }
+            request->appendReplyValue(count);
+            Utils::Memory::log();
+            break;
+        }
     }
 
     // If we make it this far then everything went OK
     return Ipc::Result::Ok;
 }
 
+TriPlayer::Status MainService::playbackStatus() {
+    // Say that we're playing if the song is currently seeking
+    if (this->seekTo >= 0) {
+        return TriPlayer::Status::Playing;
+    }
+
+    switch (this->audio->status()) {
+        case Audio::Status::Playing:
+            return TriPlayer::Status::Playing;
+
+        case Audio::Status::Paused:
+            return TriPlayer::Status::Paused;
+
+        case Audio::Status::Stopped:
+            return TriPlayer::Status::Stopped;
+    }
+    return TriPlayer::Status::Error;
+}
+
+double MainService::playbackPosition() {
+    // Check position if not seeking
+    // (this doesn't lock the source so that it's not blocked by decoding)
+    double pos = 100.0 * this->seekTo;
+    if (pos < 0) {
+        int length = this->songLength;
+        if (length <= 0) {
+            pos = 0;
+        } else {
+            pos = 100 * (this->audio->samplesPlayed()/(double)length);
+        }
+    }
+    return pos;
+}
+
+TriPlayer::Repeat MainService::playbackRepeat() {
+    switch (this->repeatMode) {
+        case RepeatMode::Off:
+            return TriPlayer::Repeat::Off;
+
+        case RepeatMode::One:
+            return TriPlayer::Repeat::One;
+
+        case RepeatMode::All:
+            return TriPlayer::Repeat::All;
+    }
+    return TriPlayer::Repeat::Off;
+}
+
+void MainService::getState(TriPlayer::State & state) {
+    // Zeroed with memset so that the padding compares equal below
+    std::memset(&state, 0, sizeof(TriPlayer::State));
+    state.version = TriPlayer::stateVersion;
+    state.size = sizeof(TriPlayer::State);
+    state.status = this->playbackStatus();
+    state.repeat = this->playbackRepeat();
+    state.volume = this->audio->volume();
+    {
+        std::shared_lock<Utils::SharedMutex> sqMtx(this->sqMutex);
+        std::shared_lock<Utils::SharedMutex> qMtx(this->qMutex);
+        state.song = this->queue->currentID();
+        state.shuffle = (this->queue->isShuffled() ? TriPlayer::Shuffle::On : TriPlayer::Shuffle::Off);
+        state.queueIdx = this->queue->currentIdx();
+        state.queueSize = this->queue->size();
+        state.subQueueSize = this->subQueue.size();
+        state.queueVersion = this->journal->version();
+        std::strncpy(state.playingFrom, this->playingFrom.c_str(), sizeof(state.playingFrom) - 1);
+    }
+
+    // Move onto a new generation if anything differs from the last snapshot
+    std::scoped_lock<std::mutex> mtx(this->stateMutex);
+    if (std::memcmp(&state, &this->lastState, sizeof(TriPlayer::State)) != 0) {
+        std::memcpy(&this->lastState, &state, sizeof(TriPlayer::State));
+        this->stateGeneration++;
+    }
+    state.generation = this->stateGeneration;
+
+    // The position changes constantly while playing, so it isn't part of the generation
+    state.position = this->playbackPosition();
+}
+
+void MainService::publishState() {
+    TriPlayer::State state;
+    this->getState(state);
+
+    std::scoped_lock<std::mutex> mtx(this->stateMutex);
+    if (state.generation != this->notifiedGeneration) {
+        this->notifiedGeneration = state.generation;
+        this->ipcServer->notify();
+    }
+}
+
+void MainService::getStats(TriPlayer::Stats & stats) {
+    stats = TriPlayer::Stats();
+    stats.version = TriPlayer::statsVersion;
+    stats.size = sizeof(TriPlayer::Stats);
+
+    stats.buffersDecoded = this->bufferStats->count();
+    stats.decodeMin = 1000.0 * this->bufferStats->min();
+    stats.decodeAvg = 1000.0 * this->bufferStats->average();
+    stats.decodeP99 = 1000.0 * this->bufferStats->percentile(0.99);
+    {
+        std::shared_lock<Utils::SharedMutex> sMtx(this->sMutex);
+        stats.realTimeFactor = (this->decodeTime > 0.0 ? this->decodedTime / this->decodeTime : 0.0);
+    }
+    stats.underruns = this->audio->underrunCount();
+    stats.buffersUsed = this->audio->bufferDepth();
+    stats.buffersMax = this->audio->maxBufferDepth();
+
+    NX::File::Stats file = NX::File::stats();
+    stats.bytesRead = file.bytesRead;
+    stats.readLatency = 1000.0 * file.readLatency;
+    stats.seekHits = file.seekHits + file.headHits;
+    stats.seekPurges = file.purges;
+
+    stats.queueWait = 1000.0 * (this->qMutex.waitTime() + this->sqMutex.waitTime());
+    stats.sourceWait = 1000.0 * this->sMutex.waitTime();
+    stats.databaseWait = 1000.0 * this->dbMutex.waitTime();
+
+    // newlib reports the most it has ever taken from the heap in usmblks
+    struct mallinfo info = mallinfo();
+    stats.heapSize = nx_inner_heap_size;
+    stats.heapUsed = info.uordblks;
+    stats.heapPeak = (info.usmblks > info.arena ? info.usmblks : info.arena);
+
+    stats.songChanges = this->changeStats->count();
+    stats.songChangeAvg = 1000.0 * this->changeStats->average();
+    stats.songChangeMax = 1000.0 * this->changeStats->max();
+    stats.songChangeLast = 1000.0 * this->changeStats->last();
+
+    Utils::PcmCache::Stats cache = this->pcmCache->stats();
+    stats.cacheLookups = cache.lookups;
+    stats.cacheHits = cache.hits;
+    stats.cacheMemory = cache.memory;
+}
+
 void MainService::exit() {
     this->exit_ = true;
+
+    // Wake any blocked threads so they see the exit flag
+    this->decodeEvent.signal();
+    this->gpioEvent.signal();
+    this->hidEvent.signal();
+    this->playbackEvent.signal();
 }
 
 void MainService::gpioEventThread() {
@@ -560,7 +948,16 @@ void MainService::gpioEventThread() {
 
     // Loop until the service has signalled to exit
     while (!this->exit_) {
-        if (NX::Gpio::headsetUnplugged() && this->watchGpio) {
+        // There's nothing to pause unless we're playing, so block until that changes
+        if (!this->watchGpio || this->audio->status() != Audio::Status::Playing) {
+            this->gpioEvent.wait();
+
+            // Read the current state so a change while not playing isn't treated as an unplug
+            NX::Gpio::headsetUnplugged();
+            continue;
+        }
+
+        if (NX::Gpio::headsetUnplugged()) {
             this->audio->pause();
         }
         NX::Thread::sleepMilli(POLL_INTERVAL);
@@ -589,15 +986,15 @@ void MainService::hidEventThread() {
 
     // Loop until the service has signalled to exit
     while (!this->exit_) {
-        // Don't bother checking if we're told not to
+        // Don't bother checking if we're told not to (block until the config changes)
         if (!this->watchHid) {
-            NX::Thread::sleepMilli(10);
+            this->hidEvent.wait();
             continue;
         }
 
         // Re-read combos if needed
         if (this->combosUpdated) {
-            std::scoped_lock<std::shared_mutex> mtx(this->cMutex);
+            std::scoped_lock<Utils::SharedMutex> mtx(this->cMutex);
             comboNext = NX::stringToCombo(this->comboNextString);
             if (comboNext.empty()) {
                 Log::writeWarning("[HID] Couldn't parse next combination config, skipping via button press will be unavailable");
@@ -618,6 +1015,7 @@ void MainService::hidEventThread() {
             if (!nextPressed) {
                 this->songAction = SongAction::Next;
                 this->pressTime = std::time(nullptr);
+                this->playbackEvent.signal();
                 nextPressed = true;
             }
 
@@ -640,6 +1038,7 @@ void MainService::hidEventThread() {
                     this->songAction = SongAction::Replay;
                 }
                 this->pressTime = std::time(nullptr);
+                this->playbackEvent.signal();
                 prevPressed = true;
             }
 
@@ -658,102 +1057,629 @@ void MainService::hidEventThread() {
 }
 
 void MainService::ipcThread() {
+    Utils::Memory::Scope scope(Utils::Memory::Tag::Ipc);
     while (!this->exit_) {
         // Stop the service if a fatal error occurs
         if (!this->ipcServer->process()) {
             this->exit();
         }
+
+        // Most commands change the state straight away
+        this->publishState();
     }
 }
 
-void MainService::playbackThread() {
+void MainService::advanceQueue(const SongAction action) {
+    switch (action) {
+        case SongAction::Previous:
+            // If repeat is on and we're at the start, wrap around
+            if (this->repeatMode != RepeatMode::Off && this->queue->currentIdx() == 0) {
+                this->queue->setIdx(this->queue->size());
+
+            // Go back to last song on queue otherwise (won't do anything if at the start)
+            } else {
+                this->queue->decrementIdx();
+            }
+
+            this->repeatMode = (this->repeatMode != RepeatMode::Off ? RepeatMode::All : RepeatMode::Off);
+            break;
+
+        case SongAction::Next:
+            // If repeat is on and we're at the end, wrap around
+            if (this->repeatMode != RepeatMode::Off && (this->queue->currentIdx() == this->queue->size() - 1) && this->subQueue.empty()) {
+                this->queue->setIdx(0);
+
+            // Otherwise advance to next song (check subqueue if there's one there)
+            } else {
+                // Check if we need to pop off of subqueue
+                if (!this->subQueue.empty()) {
+                    size_t pos = this->queue->currentIdx() + 1;
+                    if (this->queue->addID(this->subQueue.front(), pos)) {
+                        this->journal->insert(false, (pos < this->queue->size() ? pos : this->queue->size() - 1), this->subQueue.front());
+                    }
+                    this->subQueue.pop_front();
+                    this->journal->remove(true, 0, 1);
+                }
+
+                this->queue->incrementIdx();
+            }
+
+            this->repeatMode = (this->repeatMode != RepeatMode::Off ? RepeatMode::All : RepeatMode::Off);
+            break;
+
+        default:
+            // Do nothing if set to SongAction::Replay (just want to replay current song)
+            break;
+    }
+}
+
+SongID MainService::peekNextSong(SongAction & action) {
+    // Replay the current song if repeat is set to one
+    if (this->repeatMode == RepeatMode::One) {
+        action = SongAction::Replay;
+        return this->queue->currentID();
+    }
+
+    // Songs in the sub-queue are played next
+    action = SongAction::Next;
+    if (!this->subQueue.empty()) {
+        return this->subQueue.front();
+    }
+
+    // Otherwise it's the next song in the queue, wrapping around if repeat is on
+    if (this->queue->empty() || this->queue->currentIdx() >= this->queue->size() - 1) {
+        if (this->repeatMode == RepeatMode::Off) {
+            action = SongAction::Nothing;
+            return -1;
+        }
+        return this->queue->IDatPosition(0);
+    }
+    return this->queue->IDatPosition(this->queue->currentIdx() + 1);
+}
+
+std::string MainService::getPathForID(const SongID id) {
+    // In order to read the file path we need to:
+    // - Lock the mutex and either:
+    // -> Wait until it is marked as unlocked OR
+    // -> Wait until it's readable (in case application crashes)
+    std::unique_lock<Utils::Mutex> mtx(this->dbMutex);
+    std::chrono::steady_clock::time_point last = std::chrono::steady_clock::now();
+    while (this->dbLocked) {
+        NX::Thread::sleepMilli(50);
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if (std::chrono::duration_cast< std::chrono::duration<double> >(now - last).count() > DB_TEST_INTERVAL) {
+            if (Utils::Fs::fileAccessible("/switch/TriPlayer/data.sqlite3")) {
+                this->dbLocked = false;
+            }
+            last = now;
+        }
+    }
+
+    // Now that the database is available actually read from it (note that this read-only connection
+    // is left intact until either RESET or REQUESTDBLOCK is received)
+    if (!this->db->openReadOnly()) {
+        this->exit();
+    }
+    return this->db->getPathForID(id);
+}
+
+float MainService::getGainForID(const SongID id) {
+    if (this->replayGain == ReplayGain::Off) {
+        return 1.0f;
+    }
+
+    // The connection may have been closed since the path was read, in which case the gain is skipped
+    std::scoped_lock<Utils::Mutex> mtx(this->dbMutex);
+    float gain, peak;
+    if (!this->db->getGainForID(id, (this->replayGain == ReplayGain::Album), gain, peak)) {
+        return 1.0f;
+    }
+
+    // Don't amplify the song past it's peak (the limiter catches anything pushed over by the equalizer)
+    float linear = std::pow(10.0f, gain/20.0f);
+    if (linear * peak > 1.0f) {
+        linear = 1.0f/peak;
+    }
+    Log::writeInfo("[PLAYBACK] Applying ReplayGain of " + std::to_string(20.0f * std::log10(linear)) + "dB");
+    return linear;
+}
+
+bool MainService::nextSourceDue() {
+    if (this->prefetchTime <= 0 || this->source == nullptr || !this->source->valid()) {
+        return false;
+    }
+
+    const long remaining = this->source->totalSamples() - static_cast<long>(this->source->tell());
+    return (remaining < this->prefetchTime * this->source->sampleRate());
+}
+
+void MainService::openNextSource() {
+    this->nextSourceOpened = true;
+
+    // Check there is actually a song to play next
+    SongAction action;
+    SongID id = this->peekNextSong(action);
+    if (id < 0) {
+        return;
+    }
+
+    // Only open it ahead of time if there's memory to spare
+    if (!Utils::Memory::fits(Utils::Memory::Tag::Source, SOURCE_SIZE_ESTIMATE)) {
+        Log::writeWarning("[PLAYBACK] Not enough memory to open the next song early");
+        return;
+    }
+
+    // Open the song now so it's ready to go
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    Source::Source * next = Source::Factory::getSource(this->getPathForID(id));
+    if (next == nullptr) {
+        return;
+    }
+    if (!next->valid()) {
+        delete next;
+        return;
+    }
+
+    this->nextSource = next;
+    this->nextSourceAction = action;
+    this->nextSourceGain = this->getGainForID(id);
+    this->nextSourceID = id;
+
+    // Read the start of the song ahead, without holding up the current song's file
+    next->setPlaying(false);
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    Log::writeInfo("[PLAYBACK] Opened next song in " + std::to_string(ms) + "ms");
+}
+
+void MainService::prepareNextSource() {
+    this->nextSourceTried = true;
+
+    // Drop the song opened ahead of time if the queue has changed since
+    if (this->nextSource != nullptr) {
+        SongAction action;
+        if (this->peekNextSong(action) != this->nextSourceID || action != this->nextSourceAction) {
+            Log::writeInfo("[PLAYBACK] Queue changed since the next song was opened, dropping it");
+            delete this->nextSource;
+            this->nextSource = nullptr;
+            this->nextSourceOpened = false;
+        }
+    }
+    if (!this->nextSourceOpened) {
+        this->openNextSource();
+    }
+    if (this->nextSource == nullptr) {
+        return;
+    }
+
+    // Queue it's audio straight after the current song's if the voice matches, otherwise it'll
+    // be picked up once the current song has stopped
+    this->nextSourceQueued = this->audio->continueSong(this->nextSource->sampleRate(), this->nextSource->channels(), this->nextSource->format());
+
+    // A queued song is decoded straight away, so it's file becomes the priority
+    if (this->nextSourceQueued) {
+        this->nextSource->setPlaying(true);
+        Log::writeInfo("[PLAYBACK] Gapless transition prepared");
+    } else {
+        Log::writeInfo("[PLAYBACK] Format of next song differs, unable to play gaplessly");
+    }
+}
+
+void MainService::commitNextSource() {
+    // Move the queue along in the same way as if the song had finished normally
+    this->advanceQueue(this->nextSourceAction);
+    if (this->queue->currentID() != this->nextSourceID) {
+        // The queue was changed after the song was opened, so restart whatever should be playing
+        Log::writeWarning("[PLAYBACK] Queue changed during gapless transition, restarting song");
+        this->songAction = SongAction::Replay;
+    }
+
+    delete this->source;
+    this->source = this->nextSource;
+    this->source->setPlaying(true);
+    this->sourceGain = this->nextSourceGain;
+    this->songLength = this->source->totalSamples();
+    this->nextSource = nullptr;
+    this->nextSourceOpened = false;
+    this->nextSourceQueued = false;
+    this->nextSourceTried = false;
+    Log::writeInfo("[PLAYBACK] Moved to next song with no gap");
+}
+
+void MainService::discardNextSource() {
+    delete this->nextSource;
+    this->nextSource = nullptr;
+    this->nextSourceOpened = false;
+    this->nextSourceQueued = false;
+    this->nextSourceTried = false;
+}
+
+std::vector<SongID> MainService::upcomingSongs(const size_t count) {
+    // Songs in the sub-queue are played first
+    std::vector<SongID> ids;
+    for (size_t i = 0; i < this->subQueue.size() && ids.size() < count; i++) {
+        ids.push_back(this->subQueue[i]);
+    }
+
+    // Followed by the rest of the queue, wrapping around if repeat is on
+    const size_t size = this->queue->size();
+    const size_t idx = this->queue->currentIdx();
+    for (size_t i = 1; i < size && ids.size() < count; i++) {
+        if (idx + i >= size && this->repeatMode == RepeatMode::Off) {
+            break;
+        }
+        const SongID id = this->queue->IDatPosition((idx + i) % size);
+        if (id < 0) {
+            break;
+        }
+        ids.push_back(id);
+    }
+    return ids;
+}
+
+bool MainService::fillPcmCache() {
+    // Nothing is cached while the decoder is about to be needed, or while the database can't be read
+    // (as getPathForID() would block playback until it can)
+    std::unique_lock<Utils::SharedMutex> sMtx(this->sMutex);
+    if (this->songAction != SongAction::Nothing || this->seekTo >= 0 || this->cacheOpenID >= 0 || this->dbLocked) {
+        return false;
+    }
+
+    // Drop anything which is no longer coming up (everything if the cache has been disabled),
+    // and find the first song which isn't fully cached
+    std::vector<SongID> ids;
+    {
+        std::shared_lock<Utils::SharedMutex> sqMtx(this->sqMutex);
+        std::shared_lock<Utils::SharedMutex> qMtx(this->qMutex);
+        ids = this->upcomingSongs(this->pcmCacheSongs > 0 ? this->pcmCacheSongs : 0);
+    }
+    this->pcmCache->retain(ids);
+    SongID id = -1;
+    for (SongID i : ids) {
+        std::shared_ptr<Utils::PcmCache::Entry> entry = this->pcmCache->find(i);
+        if (entry == nullptr || !entry->complete) {
+            id = i;
+            break;
+        }
+    }
+
+    if (this->cacheEntry != nullptr && this->cacheEntry->id != id) {
+        delete this->cacheSource;
+        this->cacheSource = nullptr;
+        this->cacheEntry = nullptr;
+    }
+    if (id < 0) {
+        return false;
+    }
+
+    // Opening and decoding can take a while, so the song's source is taken and used without holding
+    // the lock. If the song is started in the meantime the playback thread opens it itself
+    Source::Source * source = this->cacheSource;
+    std::shared_ptr<Utils::PcmCache::Entry> entry = this->cacheEntry;
+    this->cacheSource = nullptr;
+    this->cacheEntry = nullptr;
+    sMtx.unlock();
+
+    // Open the song, reading it's file only once nothing else needs to be read. If it can't be cached
+    // an empty entry is left so it isn't tried again
+    if (entry == nullptr) {
+        if (!Utils::Memory::fits(Utils::Memory::Tag::Source, SOURCE_SIZE_ESTIMATE)) {
+            return false;
+        }
+        source = Source::Factory::getSource(this->getPathForID(id));
+        if (source != nullptr && source->valid()) {
+            source->setBackground();
+        }
+
+        sMtx.lock();
+        if (source != nullptr && source->valid()) {
+            const long rate = source->sampleRate();
+            entry = this->pcmCache->create(id, rate, source->channels(), source->totalSamples(), rate * PCM_CACHE_SECONDS);
+        }
+        if (entry == nullptr) {
+            this->pcmCache->create(id, 0, 1, 0, 0);
+            sMtx.unlock();
+            delete source;
+            return true;
+        }
+        this->cacheSource = source;
+        this->cacheEntry = entry;
+        return true;
+    }
+
+    // Decode one chunk at a time so the FIFO is topped up as soon as there's room
+    const size_t remaining = entry->maxFrames - entry->frames();
+    const size_t chunkFrames = SCRATCH_SAMPLES/entry->channels;
+    size_t decoded = source->decode(this->scratch, (remaining < chunkFrames ? remaining : chunkFrames));
+
+    // The entry may have been dropped meanwhile, or started playing, in which case it mustn't grow
+    // past the point the song is opened from
+    sMtx.lock();
+    if (this->pcmCache->find(id) != entry || this->cachePlayback == entry) {
+        sMtx.unlock();
+        delete source;
+        return true;
+    }
+    this->pcmCache->append(entry, this->scratch, decoded);
+    if (entry->complete) {
+        sMtx.unlock();
+        delete source;
+        return true;
+    }
+    this->cacheSource = source;
+    this->cacheEntry = entry;
+    return true;
+}
+
+void MainService::openCachedSong() {
+    std::unique_lock<Utils::SharedMutex> sMtx(this->sMutex);
+    const SongID id = this->cacheOpenID;
+    const std::string path = this->cacheOpenPath;
+    const size_t frames = this->cacheOpenFrames;
+    sMtx.unlock();
+
+    // Open and seek to where the cached audio ends
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    Source::Source * source = Source::Factory::getSource(path);
+    if (source != nullptr && source->valid()) {
+        source->seek(frames);
+    }
+
+    // Another song may have been requested (or the queue reset) in the meantime
+    sMtx.lock();
+    if (this->cacheOpenID != id || this->songAction != SongAction::Nothing || this->source != nullptr) {
+        delete source;
+        return;
+    }
+    this->cacheOpenID = -1;
+
+    // Skip the song if it can't be opened at all
+    if (source == nullptr) {
+        Log::writeError("[PLAYBACK] Unable to open song " + std::to_string(id) + " after playing it's cached audio");
+        this->songAction = SongAction::Next;
+        return;
+    }
+
+    // The file may have changed since it was cached, in which case the song is restarted without the cache
+    if (source->valid() && this->cachePlayback != nullptr) {
+        if (source->sampleRate() != this->cachePlayback->sampleRate || source->channels() != this->cachePlayback->channels) {
+            Log::writeWarning("[PLAYBACK] Cached audio doesn't match song " + std::to_string(id) + ", restarting it");
+            delete source;
+            this->discardPcmCache();
+            this->songAction = SongAction::Replay;
+            return;
+        }
+    }
+
+    this->source = source;
+    this->songLength = source->totalSamples();
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    Log::writeInfo("[PLAYBACK] Opened song behind cached audio in " + std::to_string(ms) + "ms");
+    this->decodeEvent.signal();
+}
+
+void MainService::discardPcmCache() {
+    delete this->cacheSource;
+    this->cacheSource = nullptr;
+    this->cacheEntry = nullptr;
+    this->cacheOpenID = -1;
+    this->cachePlayback = nullptr;
+    this->pcmCache->clear();
+}
+
+void MainService::decodeThread() {
+    Utils::Memory::Scope scope(Utils::Memory::Tag::Source);
+
     // Request a higher priority for FS access
     NX::Fs::setHighPriority(true);
+    std::chrono::steady_clock::time_point appCheckTime;
 
     while (!this->exit_) {
-        std::unique_lock<std::shared_mutex> sMtx(this->sMutex);
-        std::unique_lock<std::shared_mutex> sqMtx(this->sqMutex);
-        std::unique_lock<std::shared_mutex> qMtx(this->qMutex);
+        // Buffer less while there's no game competing for the SD card (checked every so often)
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if (std::chrono::duration_cast<std::chrono::milliseconds>(now - appCheckTime).count() >= APP_POLL_INTERVAL) {
+            this->audio->setLowLatency(this->lowLatency && !NX::Pm::applicationRunning());
+            appCheckTime = now;
+        }
 
-        // Change source if the current song has been changed
-        if (this->songAction != SongAction::Nothing) {
-            // Only do something if a queue has something in it
-            if (!(this->queue->empty() && this->subQueue.empty())) {
-                switch (this->songAction) {
-                    case SongAction::Previous:
-                        // If repeat is on and we're at the start, wrap around
-                        if (this->repeatMode != RepeatMode::Off && this->queue->currentIdx() == 0) {
-                            this->queue->setIdx(this->queue->size());
-
-                        // Go back to last song on queue otherwise (won't do anything if at the start)
-                        } else {
-                            this->queue->decrementIdx();
-                        }
+        // Wait until there is room in the FIFO
+        uint8_t * buf = this->audio->acquireBuffer();
+        if (buf == nullptr) {
+            // Use the spare time to cache the start of upcoming songs
+            if (!this->fillPcmCache()) {
+                this->decodeEvent.wait();
+            }
+            continue;
+        }
 
-                        this->repeatMode = (this->repeatMode != RepeatMode::Off ? RepeatMode::All : RepeatMode::Off);
-                        break;
+        // Don't decode if a song change/seek is waiting to be handled, as the buffer will just be discarded
+        std::unique_lock<Utils::SharedMutex> sMtx(this->sMutex);
+        if (this->songAction != SongAction::Nothing || this->seekTo >= 0) {
+            sMtx.unlock();
+            this->decodeEvent.wait();
+            continue;
+        }
 
-                    case SongAction::Next:
-                        // If repeat is on and we're at the end, wrap around
-                        if (this->repeatMode != RepeatMode::Off && (this->queue->currentIdx() == this->queue->size() - 1) && this->subQueue.empty()) {
-                            this->queue->setIdx(0);
-
-                        // Otherwise advance to next song (check subqueue if there's one there)
-                        } else {
-                            // Check if we need to pop off of subqueue
-                            if (!this->subQueue.empty()) {
-                                this->queue->addID(this->subQueue.front(), this->queue->currentIdx() + 1);
-                                this->subQueue.pop_front();
-                            }
+        // Once the next song has been queued behind the current one, decode from it instead
+        // A song started from the cache plays the cached audio first (before it's source may be open)
+        Source::Source * source = (this->nextSourceQueued ? this->nextSource : this->source);
+        const bool fromCache = (this->cachePlayback != nullptr);
+        if (!fromCache && (source == nullptr || !source->valid() || source->done())) {
+            sMtx.unlock();
+            this->decodeEvent.wait();
+            continue;
+        }
+        this->gain->setGain(this->nextSourceQueued ? this->nextSourceGain : this->sourceGain);
+
+        // Decode in chunks into the scratch buffer, run each through the DSP chain and then
+        // convert straight into the FIFO's block
+        const int channels = (fromCache ? this->cachePlayback->channels : source->channels());
+        const long sampleRate = (fromCache ? this->cachePlayback->sampleRate : source->sampleRate());
+        const size_t maxFrames = this->audio->bufferSize()/(sizeof(int16_t) * channels);
+        const size_t chunkFrames = SCRATCH_SAMPLES/channels;
+        std::chrono::steady_clock::time_point blockStart = std::chrono::steady_clock::now();
+        size_t frames = 0;
+        while (frames < maxFrames) {
+            size_t count = (maxFrames - frames < chunkFrames ? maxFrames - frames : chunkFrames);
+            size_t decoded;
+            if (fromCache) {
+                decoded = Utils::PcmCache::read(this->cachePlayback, this->cachePlaybackPos, this->scratch, count);
+                this->cachePlaybackPos += decoded;
+            } else {
+                std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+                decoded = source->decode(this->scratch, count);
+                this->decodeTime += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                this->decodedTime += static_cast<double>(decoded) / sampleRate;
+            }
+            if (decoded == 0) {
+                break;
+            }
 
-                            this->queue->incrementIdx();
-                        }
+            // Cached audio was stored as 16 bit
+            this->dsp->process(this->scratch, decoded, channels, sampleRate, fromCache || source->exact());
+            Dsp::floatToInt16(this->scratch, reinterpret_cast<int16_t *>(buf) + frames * channels, decoded * channels);
+            frames += decoded;
+        }
 
-                        this->repeatMode = (this->repeatMode != RepeatMode::Off ? RepeatMode::All : RepeatMode::Off);
-                        break;
+        size_t dec = frames * channels * sizeof(int16_t);
+        if (dec > 0) {
+            this->audio->commitBuffer(dec);
 
-                    default:
-                        // Do nothing if set to SongAction::Replay (just want to replay current song)
-                        break;
-                }
+            // Let the number of buffers follow how long decoding (and reading) is taking
+            if (!fromCache) {
+                double blockTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - blockStart).count();
+                this->audio->reportLatency(blockTime, NX::File::stats().readLatency);
+                this->bufferStats->add(blockTime);
+            }
+
+            // Report how long it took for the new song to start
+            if (this->changePending) {
+                double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - this->changeTime).count();
+                Log::writeInfo("[PLAYBACK] Time to first sample: " + std::to_string(ms) + "ms");
+                this->changeStats->add(ms/1000.0);
+                this->changePending = false;
+            }
+        }
+
+        // Carry on from the source once all of the cached audio has been played
+        if (fromCache) {
+            if (this->cachePlaybackPos >= this->cachePlayback->frames()) {
+                this->cachePlayback = nullptr;
+            }
+            continue;
+        }
+
+        // Let the playback thread know once the source has been completely decoded (or has failed),
+        // or is close enough to the end to open the next song
+        if (!source->valid() || source->done() || (!this->nextSourceOpened && this->nextSourceDue())) {
+            this->playbackEvent.signal();
+        }
+    }
+}
+
+void MainService::playbackThread() {
+    // Request a higher priority for FS access
+    NX::Fs::setHighPriority(true);
+
+    while (!this->exit_) {
+        // Report which subsystems are using what if one goes over budget
+        if (Utils::Memory::overrun()) {
+            Log::writeWarning("[MEMORY] A subsystem has gone over it's budget");
+            Utils::Memory::log();
+        }
+
+        // Open a song started from the cache while the decoder plays it's cached audio
+        if (this->cacheOpenID >= 0) {
+            this->openCachedSong();
+        }
+
+        std::unique_lock<Utils::SharedMutex> sMtx(this->sMutex);
+        std::unique_lock<Utils::SharedMutex> sqMtx(this->sqMutex);
+        std::unique_lock<Utils::SharedMutex> qMtx(this->qMutex);
+
+        // Finish moving onto the next song once it has started playing
+        if (this->nextSourceQueued && this->audio->reachedNextSong()) {
+            this->commitNextSource();
+        }
+
+        // Change source if the current song has been changed
+        if (this->songAction != SongAction::Nothing) {
+            // Only do something if a queue has something in it
+            if (!(this->queue->empty() && this->subQueue.empty())) {
+                this->advanceQueue(this->songAction);
 
                 // Reset action as it was handled
                 this->songAction = SongAction::Nothing;
+                this->changePending = true;
+                this->changeTime = std::chrono::steady_clock::now();
 
-                // In order to read the file path we need to:
-                // - Lock the mutex and either:
-                // -> Wait until it is marked as unlocked OR
-                // -> Wait until it's readable (in case application crashes)
-                std::unique_lock<std::mutex> mtx(this->dbMutex);
-                std::chrono::steady_clock::time_point last = std::chrono::steady_clock::now();
-                while (this->dbLocked) {
-                    NX::Thread::sleepMilli(50);
-                    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
-                    if (std::chrono::duration_cast< std::chrono::duration<double> >(now - last).count() > DB_TEST_INTERVAL) {
-                        if (Utils::Fs::fileAccessible("/switch/TriPlayer/data.sqlite3")) {
-                            this->dbLocked = false;
-                        }
-                        last = now;
-                    }
+                // The new song isn't continuous with the previous one, so don't carry the filters over
+                if (!this->equalizer->flat()) {
+                    Log::writeInfo("[DSP] Equalizer cost: " + std::to_string(this->equalizer->costPerSecond()) + "us per second of audio");
                 }
-
-                // Now that the database is available actually read from it (note that this read-only connection
-                // is left intact until either RESET or REQUESTDBLOCK is received)
-                if (!this->db->openReadOnly()) {
-                    this->exit_ = true;
+                if (this->decodedTime > 0.0) {
+                    double decodeCost = 1000000.0 * (this->decodeTime / this->decodedTime);
+                    Log::writeInfo("[DSP] Dither cost: " + std::to_string(this->dither->costPerSecond()) + "us per second of audio (decoding: " + std::to_string(decodeCost) + "us)");
                 }
-                std::string path = this->db->getPathForID(this->queue->currentID());
-                mtx.unlock();
+                this->dsp->reset();
 
-                // Delete old source and prepare a new one
+                // Use the song opened in advance if it's the one we want (and nothing's been decoded from it),
+                // otherwise start with it's cached audio if there is some, and open the new song if not
+                SongID id = this->queue->currentID();
                 delete this->source;
-                this->source = Source::Factory::getSource(path);
+                this->source = nullptr;
+                this->cacheOpenID = -1;
+                this->cachePlayback = nullptr;
+                std::shared_ptr<Utils::PcmCache::Entry> cached = nullptr;
+                if (this->nextSource != nullptr && !this->nextSourceQueued && this->nextSourceID == id) {
+                    this->source = this->nextSource;
+                    this->source->setPlaying(true);
+                    this->sourceGain = this->nextSourceGain;
+                    this->nextSource = nullptr;
+                } else if (this->pcmCacheSongs > 0 && (cached = this->pcmCache->lookup(id)) != nullptr) {
+                    // The source being decoded into the cache is already past the cached audio, so is
+                    // taken over if it's this song's, otherwise it's opened once the decoder has started
+                    this->cacheOpenPath = this->getPathForID(id);
+                    this->sourceGain = this->getGainForID(id);
+                    if (this->cacheEntry == cached) {
+                        this->source = this->cacheSource;
+                        this->source->setPlaying(true);
+                        this->cacheSource = nullptr;
+                        this->cacheEntry = nullptr;
+                    }
+                } else {
+                    this->source = Source::Factory::getSource(this->getPathForID(id));
+                    this->sourceGain = this->getGainForID(id);
+                }
+
+                // Start the new song at it's own gain rather than ramping from the previous song's
+                this->gain->setGain(this->sourceGain);
+                this->gain->reset();
+                this->discardNextSource();
+                this->songLength = (this->source == nullptr ? 0 : this->source->totalSamples());
+
+                // Play the cached audio while the song is opened
+                if (cached != nullptr) {
+                    this->songLength = cached->totalSamples;
+                    if (this->audio->newSong(cached->sampleRate, cached->channels, Format::Int16)) {
+                        this->cachePlayback = cached;
+                        this->cachePlaybackPos = 0;
+                        this->cacheOpenFrames = cached->frames();
+                        this->cacheOpenID = (this->source == nullptr ? id : -1);
+                        Utils::PcmCache::Stats stats = this->pcmCache->stats();
+                        Log::writeInfo("[PLAYBACK] Starting from cached audio (" + std::to_string(stats.hits) + "/" + std::to_string(stats.lookups) + " hits, " + std::to_string(stats.memory/1024) + "kB cached)");
+                    } else {
+                        delete this->source;
+                        this->source = nullptr;
+                        this->songLength = 0;
+                        this->songAction = SongAction::Next;
+                    }
 
                 // Skip to next song if renderer didn't init successfully
-                if (this->source != nullptr) {
+                } else if (this->source != nullptr) {
                     if (!this->audio->newSong(this->source->sampleRate(), this->source->channels(), this->source->format())) {
                         delete this->source;
                         this->source = nullptr;
+                        this->songLength = 0;
                         this->songAction = SongAction::Next;
                     }
                 }
@@ -762,46 +1688,61 @@ void MainService::playbackThread() {
             } else {
                 this->songAction = SongAction::Nothing;
             }
+            this->decodeEvent.signal();
         }
 
         // Don't need queues for a while
         qMtx.unlock();
         sqMtx.unlock();
 
-        bool sleep = true;
         if (this->source != nullptr) {
-            sleep = false;
-
-            // Seek to a position if required
+            // Seek to a position if required (this cancels any queued next song or cached audio)
             if (this->source->valid() && this->seekTo >= 0) {
                 this->audio->stop();
+
+                // The voice may have already crossed into the next song, in which case that's the one to seek in
+                if (this->nextSourceQueued && this->audio->reachedNextSong()) {
+                    sqMtx.lock();
+                    qMtx.lock();
+                    this->commitNextSource();
+                    qMtx.unlock();
+                    sqMtx.unlock();
+                }
+                this->discardNextSource();
+                this->cachePlayback = nullptr;
                 this->source->seek(this->seekTo * this->source->totalSamples());
                 this->audio->setSamplesPlayed(this->source->tell());
+                this->dsp->reset();
                 this->seekTo = -1;
+                this->decodeEvent.signal();
             }
 
-            // If the source is not corrupt and not done decode into an available buffer
+            // Nothing to do while the decode thread is still working through the source, other than
+            // opening the next song once it's near the end (the decode thread signals at both points)
             if (this->source->valid() && !this->source->done()) {
-                uint8_t * buf = new uint8_t[this->audio->bufferSize()];
-                size_t dec = this->source->decode(buf, this->audio->bufferSize());
-                sMtx.unlock();
-
-                // Wait until a buffer is available to queue or there is an update
-                while (this->songAction == SongAction::Nothing && this->seekTo < 0 && !this->exit_) {
-                    if (this->audio->bufferAvailable()) {
-                        this->audio->addBuffer(buf, dec);
-                        break;
+                if (!this->nextSourceOpened && this->nextSourceDue()) {
+                    sqMtx.lock();
+                    qMtx.lock();
+                    this->openNextSource();
+                    qMtx.unlock();
+                    sqMtx.unlock();
+                }
 
-                    // Sleep if no buffer is available (duration depends on state)
-                    } else {
-                        NX::Thread::sleepMilli((this->audio->status() == Audio::Status::Paused ? 20 : 5));
+            // Otherwise if the source is not corrupt and has finished being decoded, prepare the next song while
+            // the audio device finishes playing the current song's buffers
+            } else if (this->source->valid() && (!this->audio->finished() || this->nextSourceQueued)) {
+                if (!this->nextSourceTried) {
+                    sqMtx.lock();
+                    qMtx.lock();
+                    this->prepareNextSource();
+                    qMtx.unlock();
+                    sqMtx.unlock();
+
+                    // The decoder can carry straight on with the next song if it was queued
+                    if (this->nextSourceQueued) {
+                        this->decodeEvent.signal();
                     }
                 }
-                delete[] buf;
-
-            // Otherwise if the source is not corrupt and has finished being decoded, wait until the audio device has finished playing it's buffers
-            } else if (this->source->valid() && this->source->done() && this->audio->status() != Audio::Status::Stopped) {
-                sleep = true;
 
             // If not valid attempt to move to change song
             } else {
@@ -823,16 +1764,18 @@ void MainService::playbackThread() {
 
                 qMtx.unlock();
                 sqMtx.unlock();
-
-                if (this->songAction == SongAction::Nothing) {
-                    sleep = true;
-                }
             }
         }
+        bool pending = (this->songAction != SongAction::Nothing || this->cacheOpenID >= 0 || (this->seekTo >= 0 && this->source != nullptr && this->source->valid()));
+        sMtx.unlock();
+
+        // Let subscribed clients know about any song/status change made above
+        this->publishState();
 
-        // Sleep if no action is required
-        if (sleep) {
-            NX::Thread::sleepMilli(50);
+        // Block until there's something to handle (the decoder finishing, the audio moving onto the
+        // next song/stopping, or a command), unless there's already a song change or seek pending
+        if (!pending) {
+            this->playbackEvent.wait();
         }
     }
 }
@@ -853,7 +1796,7 @@ void MainService::sleepEventThread() {
 
     // Loop until the service has signalled to exit
     while (!this->exit_) {
-        NX::Psc::monitor(POLL_INTERVAL);
+        NX::Psc::monitor(PSC_WAIT_INTERVAL);
     }
 
     // Cleanup
@@ -861,9 +1804,23 @@ void MainService::sleepEventThread() {
 }
 
 MainService::~MainService() {
+    this->audio->setBufferFunc(nullptr);
+    this->audio->setStatusFunc(nullptr);
+    delete this->bufferStats;
     delete this->cfg;
+    delete this->changeStats;
     delete this->db;
+    delete this->dsp;
+    delete this->dither;
+    delete this->equalizer;
+    delete this->gain;
+    delete this->limiter;
+    delete[] this->scratch;
     delete this->ipcServer;
     delete this->queue;
+    delete this->journal;
+    delete this->nextSource;
+    delete this->cacheSource;
+    delete this->pcmCache;
     delete this->source;
 }
@@ -0,0 +1,24 @@
+#include "dsp/Chain.hpp"
+
+namespace Dsp {
+    void Chain::add(Effect * effect) {
+        this->effects.push_back(effect);
+    }
+
+    void Chain::process(float * buf, size_t frames, int channels, long rate, bool exact) {
+        for (Effect * effect : this->effects) {
+            if (exact && effect->skippedWhileExact()) {
+                continue;
+            }
+            if (effect->process(buf, frames, channels, rate)) {
+                exact = false;
+            }
+        }
+    }
+
+    void Chain::reset() {
+        for (Effect * effect : this->effects) {
+            effect->reset();
+        }
+    }
+};
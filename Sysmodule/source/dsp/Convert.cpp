@@ -0,0 +1,53 @@
+#include <cmath>
+#include "dsp/Convert.hpp"
+
+#if defined(__ARM_NEON)
+    #include <arm_neon.h>
+#elif defined(__SSE2__)
+    #include <emmintrin.h>
+#endif
+
+constexpr float int16Scale = 32768.0f;      // Scale between float and 16 bit samples
+
+namespace Dsp {
+    void floatToInt16(const float * in, int16_t * out, const size_t count) {
+        size_t i = 0;
+
+    #if defined(__ARM_NEON)
+        // Rounding conversion and saturating narrow handle clipping
+        const float32x4_t scale = vdupq_n_f32(int16Scale);
+        for (; i + 8 <= count; i += 8) {
+            int32x4_t a = vcvtnq_s32_f32(vmulq_f32(vld1q_f32(in + i), scale));
+            int32x4_t b = vcvtnq_s32_f32(vmulq_f32(vld1q_f32(in + i + 4), scale));
+            vst1q_s16(out + i, vcombine_s16(vqmovn_s32(a), vqmovn_s32(b)));
+        }
+
+    #elif defined(__SSE2__)
+        // Clamp first as out of range conversions don't saturate, then the saturating pack handles +1.0
+        const __m128 scale = _mm_set1_ps(int16Scale);
+        const __m128 max = _mm_set1_ps(1.0f);
+        const __m128 min = _mm_set1_ps(-1.0f);
+        for (; i + 8 <= count; i += 8) {
+            __m128 a = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(in + i), min), max);
+            __m128 b = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(in + i + 4), min), max);
+            __m128i ia = _mm_cvtps_epi32(_mm_mul_ps(a, scale));
+            __m128i ib = _mm_cvtps_epi32(_mm_mul_ps(b, scale));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), _mm_packs_epi32(ia, ib));
+        }
+    #endif
+
+        // Handle whatever is left over (or everything without SIMD)
+        for (; i < count; i++) {
+            float sample = std::nearbyint(in[i] * int16Scale);
+            out[i] = (sample > 32767.0f ? 32767 : (sample < -32768.0f ? -32768 : static_cast<int16_t>(sample)));
+        }
+    }
+
+    void int16ToFloat(const int16_t * in, float * out, const size_t count) {
+        // Simple enough for the compiler to vectorize
+        constexpr float scale = 1.0f / int16Scale;
+        for (size_t i = 0; i < count; i++) {
+            out[i] = in[i] * scale;
+        }
+    }
+};
@@ -0,0 +1,127 @@
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include "dsp/Dither.hpp"
+
+// Four lanes of integers/floats
+typedef int32_t Vec4i __attribute__((vector_size(16)));
+typedef uint32_t Vec4u __attribute__((vector_size(16)));
+typedef float Vec4f __attribute__((vector_size(16)));
+
+constexpr float int16Scale = 32768.0f;              // Scale between float and 16 bit samples
+constexpr float randomScale = 1.0f / 16777216.0f;   // Scales a 24 bit random number to [0, 1)
+
+// Advance xorshift32 generators, returning the new values
+static inline Vec4u nextRandom(Vec4u & s) {
+    s ^= s << 13;
+    s ^= s >> 17;
+    s ^= s << 5;
+    return s;
+}
+
+static inline uint32_t nextRandom(uint32_t & s) {
+    s ^= s << 13;
+    s ^= s >> 17;
+    s ^= s << 5;
+    return s;
+}
+
+namespace Dsp {
+    Dither::Dither() {
+        // Any non-zero seeds will do
+        const uint32_t seeds[8] = {0x9E3779B9, 0x7F4A7C15, 0x85EBCA6B, 0xC2B2AE35, 0x27D4EB2F, 0x165667B1, 0xD3A2646C, 0xFD7046C5};
+        std::memcpy(this->state, seeds, sizeof(this->state));
+        this->audioTime = 0.0;
+        this->enabled = true;
+        this->processTime = 0.0;
+        this->shaping = false;
+    }
+
+    void Dither::processFlat(float * buf, size_t count) {
+        // Each sample gets the sum of two uniform values (each up to 1 LSB), offset to be centered on zero
+        Vec4u a, b;
+        std::memcpy(&a, &this->state[0], sizeof(a));
+        std::memcpy(&b, &this->state[4], sizeof(b));
+        const Vec4f scale = {randomScale / int16Scale, randomScale / int16Scale, randomScale / int16Scale, randomScale / int16Scale};
+        const Vec4f offset = {1.0f / int16Scale, 1.0f / int16Scale, 1.0f / int16Scale, 1.0f / int16Scale};
+
+        for (size_t i = 0; i < count; i += 4) {
+            // (24 bit values fit in a signed integer, which converts faster)
+            Vec4f ra = __builtin_convertvector(reinterpret_cast<Vec4i>(nextRandom(a) >> 8), Vec4f);
+            Vec4f rb = __builtin_convertvector(reinterpret_cast<Vec4i>(nextRandom(b) >> 8), Vec4f);
+            Vec4f noise = (ra + rb) * scale - offset;
+
+            // The last few samples use as many lanes as needed
+            if (i + 4 <= count) {
+                Vec4f x;
+                std::memcpy(&x, buf + i, sizeof(x));
+                x += noise;
+                std::memcpy(buf + i, &x, sizeof(x));
+            } else {
+                for (size_t j = 0; i + j < count; j++) {
+                    buf[i + j] += noise[j];
+                }
+            }
+        }
+
+        std::memcpy(&this->state[0], &a, sizeof(a));
+        std::memcpy(&this->state[4], &b, sizeof(b));
+    }
+
+    void Dither::processShaped(float * buf, size_t frames, int channels) {
+        if (this->error.size() != static_cast<size_t>(channels)) {
+            this->error.assign(channels, 0.0f);
+        }
+
+        // Work in units of 16 bit samples, subtracting the previous rounding error before rounding
+        // (this gives the noise a first order high pass shape)
+        for (size_t i = 0; i < frames * channels; i++) {
+            float & error = this->error[i % channels];
+            const float noise = (nextRandom(this->state[0]) >> 8) * randomScale + (nextRandom(this->state[4]) >> 8) * randomScale - 1.0f;
+            const float value = buf[i] * int16Scale - error;
+            float rounded = std::nearbyint(value + noise);
+            rounded = (rounded > 32767.0f ? 32767.0f : (rounded < -32768.0f ? -32768.0f : rounded));
+
+            error = rounded - value;
+            buf[i] = rounded / int16Scale;
+        }
+    }
+
+    void Dither::setEnabled(const bool b) {
+        this->enabled = b;
+    }
+
+    void Dither::setNoiseShaping(const bool b) {
+        this->shaping = b;
+        std::fill(this->error.begin(), this->error.end(), 0.0f);
+    }
+
+    bool Dither::process(float * buf, size_t frames, int channels, long rate) {
+        if (!this->enabled || frames == 0 || channels <= 0 || rate <= 0) {
+            return false;
+        }
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+        if (this->shaping) {
+            this->processShaped(buf, frames, channels);
+        } else {
+            this->processFlat(buf, frames * channels);
+        }
+
+        this->audioTime += static_cast<double>(frames) / rate;
+        this->processTime += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return true;
+    }
+
+    bool Dither::skippedWhileExact() {
+        return true;
+    }
+
+    void Dither::reset() {
+        std::fill(this->error.begin(), this->error.end(), 0.0f);
+    }
+
+    double Dither::costPerSecond() {
+        return (this->audioTime > 0.0 ? 1000000.0 * (this->processTime / this->audioTime) : 0.0);
+    }
+};
@@ -0,0 +1,168 @@
+#include <chrono>
+#include <cmath>
+#include "dsp/Equalizer.hpp"
+
+// Vector of two floats (one sample of a pair of channels)
+#if defined(__ARM_NEON)
+    #include <arm_neon.h>
+    typedef float32x2_t Vec2;
+#else
+    typedef float Vec2 __attribute__((vector_size(8)));
+#endif
+
+constexpr size_t chunkFrames = 256;         // Number of frames filtered at once (keeps the chunk in L1 cache)
+constexpr float minGain = 0.001f;           // Smallest gain allowed (-60dB)
+
+namespace Dsp {
+    Equalizer::Equalizer() {
+        this->active.fill(false);
+        this->audioTime = 0.0;
+        this->channels = 0;
+        this->dirty = true;
+        this->gains.fill(1.0f);
+        this->processTime = 0.0;
+        this->rate = 0;
+    }
+
+    void Equalizer::calculate() {
+        for (size_t i = 0; i < bands; i++) {
+            // Bands are evenly spaced between 0Hz and the Nyquist frequency (matching mpg123),
+            // so the Q factor which covers one band is simply the band's 'index'
+            const float freq = (i + 0.5f) * (this->rate / (2.0f * bands));
+            const float q = i + 0.5f;
+            const float gain = (this->gains[i] < minGain ? minGain : this->gains[i]);
+
+            // RBJ peaking EQ
+            const float a = std::sqrt(gain);
+            const float w0 = 2.0f * M_PI * freq / this->rate;
+            const float alpha = std::sin(w0) / (2.0f * q);
+            const float cosW0 = std::cos(w0);
+            const float a0 = 1.0f + alpha / a;
+
+            Coefficients & c = this->coeffs[i];
+            c.b0 = (1.0f + alpha * a) / a0;
+            c.b1 = (-2.0f * cosW0) / a0;
+            c.b2 = (1.0f - alpha * a) / a0;
+            c.a1 = (-2.0f * cosW0) / a0;
+            c.a2 = (1.0f - alpha / a) / a0;
+
+            // Once a band has been used it's left running until reset, as a flat band is an identity
+            // filter and it's state needs to decay smoothly (dropping it would cause a click)
+            if (this->gains[i] != 1.0f) {
+                this->active[i] = true;
+            }
+        }
+        this->dirty = false;
+    }
+
+    void Equalizer::setGains(const std::array<float, bands> & gains) {
+        this->gains = gains;
+        this->dirty = true;
+    }
+
+    bool Equalizer::flat() {
+        for (size_t i = 0; i < bands; i++) {
+            if (this->gains[i] != 1.0f || this->active[i]) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool Equalizer::process(float * buf, size_t frames, int channels, long rate) {
+        if (this->flat() || frames == 0 || channels <= 0 || rate <= 0) {
+            return false;
+        }
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+        // Prepare for the given format
+        if (rate != this->rate) {
+            this->rate = rate;
+            this->dirty = true;
+        }
+        if (this->dirty) {
+            this->calculate();
+        }
+        const size_t pairs = (channels + 1)/2;
+        if (channels != this->channels) {
+            this->channels = channels;
+            this->state.assign(pairs * bands * 4, 0.0f);
+        }
+
+        Vec2 chunk[chunkFrames];
+        for (size_t pair = 0; pair < pairs; pair++) {
+            const size_t left = pair * 2;
+            const bool hasRight = (left + 1 < static_cast<size_t>(channels));
+            float * state = &this->state[pair * bands * 4];
+
+            for (size_t offset = 0; offset < frames; offset += chunkFrames) {
+                const size_t count = (frames - offset < chunkFrames ? frames - offset : chunkFrames);
+
+                // Deinterleave the pair into the chunk
+                float * in = buf + offset * channels + left;
+                for (size_t i = 0; i < count; i++) {
+                    chunk[i] = Vec2{in[0], (hasRight ? in[1] : 0.0f)};
+                    in += channels;
+                }
+
+                // Run the chunk through each band in turn (transposed direct form II), which keeps
+                // the coefficients and state in registers for the whole chunk
+                for (size_t b = 0; b < bands; b++) {
+                    if (!this->active[b]) {
+                        continue;
+                    }
+
+                    const Coefficients & c = this->coeffs[b];
+                    const Vec2 b0 = {c.b0, c.b0};
+                    const Vec2 b1 = {c.b1, c.b1};
+                    const Vec2 b2 = {c.b2, c.b2};
+                    const Vec2 a1 = {c.a1, c.a1};
+                    const Vec2 a2 = {c.a2, c.a2};
+                    float * z = state + b * 4;
+                    Vec2 z1 = {z[0], z[1]};
+                    Vec2 z2 = {z[2], z[3]};
+
+                    for (size_t i = 0; i < count; i++) {
+                        const Vec2 x = chunk[i];
+                        const Vec2 y = b0 * x + z1;
+                        z1 = b1 * x - a1 * y + z2;
+                        z2 = b2 * x - a2 * y;
+                        chunk[i] = y;
+                    }
+
+                    z[0] = z1[0];
+                    z[1] = z1[1];
+                    z[2] = z2[0];
+                    z[3] = z2[1];
+                }
+
+                // Interleave back (clipping is left to the end of the chain)
+                float * out = buf + offset * channels + left;
+                for (size_t i = 0; i < count; i++) {
+                    out[0] = chunk[i][0];
+                    if (hasRight) {
+                        out[1] = chunk[i][1];
+                    }
+                    out += channels;
+                }
+            }
+        }
+
+        this->audioTime += static_cast<double>(frames) / rate;
+        this->processTime += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return true;
+    }
+
+    void Equalizer::reset() {
+        std::fill(this->state.begin(), this->state.end(), 0.0f);
+
+        // Bands which have been flattened no longer need to run
+        for (size_t i = 0; i < bands; i++) {
+            this->active[i] = (this->gains[i] != 1.0f);
+        }
+    }
+
+    double Equalizer::costPerSecond() {
+        return (this->audioTime > 0.0 ? 1000000.0 * (this->processTime / this->audioTime) : 0.0);
+    }
+};
@@ -0,0 +1,52 @@
+#include "dsp/Gain.hpp"
+
+constexpr long rampDivisor = 100;           // Gain changes are ramped over 1/rampDivisor seconds (10ms)
+
+namespace Dsp {
+    Gain::Gain() {
+        this->current = 1.0f;
+        this->target = 1.0f;
+    }
+
+    void Gain::setGain(const float g) {
+        this->target = g;
+    }
+
+    float Gain::gain() {
+        return this->target;
+    }
+
+    bool Gain::process(float * buf, size_t frames, int channels, long rate) {
+        // Nothing to do at unity
+        if (this->current == 1.0f && this->target == 1.0f) {
+            return false;
+        }
+
+        // Ramp towards the target first
+        size_t frame = 0;
+        if (this->current != this->target) {
+            size_t ramp = (rate/rampDivisor > 0 ? rate/rampDivisor : 1);
+            float step = (this->target - this->current) / ramp;
+            for (; frame < frames && frame < ramp; frame++) {
+                this->current += step;
+                for (int ch = 0; ch < channels; ch++) {
+                    buf[frame * channels + ch] *= this->current;
+                }
+            }
+            if (frame == ramp) {
+                this->current = this->target;
+            }
+        }
+
+        // Then apply a constant gain to the rest
+        const float g = this->current;
+        for (size_t i = frame * channels; i < frames * channels; i++) {
+            buf[i] *= g;
+        }
+        return true;
+    }
+
+    void Gain::reset() {
+        this->current = this->target;
+    }
+};
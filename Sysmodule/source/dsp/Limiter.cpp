@@ -0,0 +1,59 @@
+#include <cmath>
+#include "dsp/Limiter.hpp"
+
+constexpr float releaseTime = 0.05f;        // Time (in seconds) for gain to mostly recover
+
+namespace Dsp {
+    Limiter::Limiter(const float ceiling) {
+        this->ceiling = ceiling;
+        this->gain = 1.0f;
+        this->rate = 0;
+        this->release = 1.0f;
+    }
+
+    bool Limiter::process(float * buf, size_t frames, int channels, long rate) {
+        if (rate != this->rate) {
+            this->rate = rate;
+            this->release = 1.0f - std::exp(-1.0f / (releaseTime * rate));
+        }
+
+        bool changed = false;
+        for (size_t frame = 0; frame < frames; frame++) {
+            float * samples = buf + frame * channels;
+
+            // Find the loudest channel
+            float peak = 0.0f;
+            for (int ch = 0; ch < channels; ch++) {
+                float s = std::fabs(samples[ch]);
+                peak = (s > peak ? s : peak);
+            }
+
+            // Don't touch anything if we're not limiting
+            if (this->gain == 1.0f && peak <= this->ceiling) {
+                continue;
+            }
+
+            // Pull the gain down instantly if needed, otherwise let it recover
+            if (peak * this->gain > this->ceiling) {
+                this->gain = this->ceiling / peak;
+            }
+            for (int ch = 0; ch < channels; ch++) {
+                samples[ch] *= this->gain;
+            }
+            changed = true;
+            this->gain += (1.0f - this->gain) * this->release;
+            if (this->gain > 0.9999f) {
+                this->gain = 1.0f;
+            }
+        }
+        return changed;
+    }
+
+    bool Limiter::skippedWhileExact() {
+        return true;
+    }
+
+    void Limiter::reset() {
+        this->gain = 1.0f;
+    }
+};
@@ -19,6 +19,7 @@ namespace Ipc {
         this->inData.clear();
         this->outArgs.clear();
         this->outData.clear();
+        this->outHandles.clear();
         this->outMeta.clear();
 
         // Set start positions to beginning of vectors
@@ -28,16 +29,18 @@ namespace Ipc {
         // Set default attributes
         this->cmd_ = 0;
         this->result = 0;
+        this->session_ = INVALID_HANDLE;
         this->type_ = Type::Other;
     }
 
-    Request * Request::fromTLS() {
+    Request * Request::fromTLS(const Handle session) {
         // Read structure from thread-local storage
         uint8_t * base = static_cast<uint8_t *>(armGetTls());
         HipcParsedRequest hipc = hipcParseRequest(base);
 
         // Create object and set data/type
         Request * req = new Request();
+        req->session_ = session;
         if (hipc.meta.type == CmifCommandType_Request) {
             req->type_ = Type::Request;
 
@@ -90,12 +93,17 @@ namespace Ipc {
             std::memcpy(hipcGetBufferAddress(&this->outMeta[0]), &this->outData[0], size);
         }
 
-        // Create response on thread-local storage
+        // Create response on thread-local storage (handles are only passed back on success)
         uint8_t * base = static_cast<uint8_t *>(armGetTls());
+        size_t handles = (R_SUCCEEDED(this->result) ? this->outHandles.size() : 0);
         HipcRequest hipc = hipcMakeRequestInline(base,
             .type = CmifCommandType_Request,
             .num_data_words = static_cast<uint32_t>(sizeof(Header) + this->outArgs.size() + 0x10)/4,
+            .num_copy_handles = static_cast<uint32_t>(handles),
         );
+        for (size_t i = 0; i < handles; i++) {
+            hipc.copy_handles[i] = this->outHandles[i];
+        }
 
         // Create header
         Header * header = static_cast<Header *>(cmifGetAlignedDataStart(hipc.data_words, base));
@@ -117,6 +125,14 @@ namespace Ipc {
         this->result = r;
     }
 
+    Handle Request::session() {
+        return this->session_;
+    }
+
+    void Request::appendReplyHandle(const Handle handle) {
+        this->outHandles.push_back(handle);
+    }
+
     Request::Type Request::type() {
         return this->type_;
     }
@@ -129,6 +145,10 @@ namespace Ipc {
         return this->outData;
     }
 
+    size_t Request::replyBufferSize() {
+        return (this->outMeta.empty() ? 0 : hipcGetBufferSize(&this->outMeta[0]));
+    }
+
     Request::~Request() {
 
     }
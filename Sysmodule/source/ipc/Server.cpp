@@ -40,6 +40,18 @@ namespace Ipc {
         this->handles.push_back(serverHandle);
     }
 
+    void Server::closeSession(const int32_t index) {
+        std::scoped_lock<std::mutex> mtx(this->subscriberMutex);
+        std::unordered_map<Handle, Event>::iterator it = this->subscribers.find(this->handles[index]);
+        if (it != this->subscribers.end()) {
+            eventClose(&it->second);
+            this->subscribers.erase(it);
+        }
+
+        svcCloseHandle(this->handles[index]);
+        this->handles.erase(this->handles.begin() + index);
+    }
+
     bool Server::processSession(const int32_t index) {
         int tmp;
 
@@ -47,13 +59,12 @@ namespace Ipc {
         ::Result rc = svcReplyAndReceive(&tmp, &this->handles[index], 1, 0, UINT64_MAX);
         if (R_FAILED(rc)) {
             Log::writeError("[IPC] Couldn't receive request (closing handle): " + std::to_string(rc));
-            svcCloseHandle(this->handles[index]);
-            this->handles.erase(this->handles.begin() + index);
+            this->closeSession(index);
             return true;        // Return true as closing a session is valid behaviour
         }
 
         // Create object from received data
-        Request * request = Request::fromTLS();
+        Request * request = Request::fromTLS(this->handles[index]);
         if (!request) {
             Log::writeError("[IPC] An error occurred creating the request object (most likely bad header magic)");
             return false;
@@ -95,8 +106,7 @@ namespace Ipc {
         // Close session on error or close request
         if (R_FAILED(rc) || closeSession) {
             Log::writeInfo("Closing session " + std::to_string(index) + " due to error/request");
-            svcCloseHandle(this->handles[index]);
-            this->handles.erase(this->handles.begin() + index);
+            this->closeSession(index);
         }
 
         return (R_SUCCEEDED(rc));
@@ -166,8 +176,37 @@ namespace Ipc {
         return !this->error_;
     }
 
+    bool Server::subscribe(Request * request) {
+        std::scoped_lock<std::mutex> mtx(this->subscriberMutex);
+
+        // Create the session's event the first time it subscribes
+        std::unordered_map<Handle, Event>::iterator it = this->subscribers.find(request->session());
+        if (it == this->subscribers.end()) {
+            Event event;
+            ::Result rc = eventCreate(&event, false);
+            if (R_FAILED(rc)) {
+                Log::writeError("[IPC] Couldn't create event for subscriber: " + std::to_string(rc));
+                return false;
+            }
+            it = this->subscribers.emplace(request->session(), event).first;
+        }
+
+        request->appendReplyHandle(it->second.revent);
+        return true;
+    }
+
+    void Server::notify() {
+        std::scoped_lock<std::mutex> mtx(this->subscriberMutex);
+        for (std::pair<const Handle, Event> & subscriber : this->subscribers) {
+            eventFire(&subscriber.second);
+        }
+    }
+
     Server::~Server() {
-        // Close all client handles
+        // Close all subscriber events and client handles
+        for (std::pair<const Handle, Event> & subscriber : this->subscribers) {
+            eventClose(&subscriber.second);
+        }
         for (size_t i = 1; i < this->handles.size(); i++) {
             svcCloseHandle(this->handles[i]);
         }
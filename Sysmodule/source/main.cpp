@@ -3,13 +3,22 @@
 #include "Service.hpp"
 #include "source/MP3.hpp"
 #include <switch.h>
-
-// Heap size:
-// DB:      ~0.5MB
-// IPC:     ~0.2MB
-// Queue:   ~0.2MB
-// Sources: ~0.5MB
+#include "utils/Memory.hpp"
+
+// Budget for each subsystem (see utils/Memory.hpp), from the peaks measured with the host build
+#define BUDGET_AUDIO    (size_t)(368 * 1024)    // 350kB memory pool + FIFO (351kB measured)
+#define BUDGET_QUEUE    (size_t)(256 * 1024)    // 25k songs while shuffled (240kB measured) + 10kB journal
+#define BUDGET_SUBQUEUE (size_t)(24 * 1024)     // 5000 IDs (21kB measured)
+#define BUDGET_SOURCE   (size_t)(480 * 1024)    // Three open FLACs (current, next, cache) + closed file's buffers (447kB + 33kB measured)
+#define BUDGET_CACHE    (size_t)(352 * 1024)    // First second of two 44.1kHz songs (344kB measured)
+#define BUDGET_DATABASE (size_t)(192 * 1024)    // SQLite's page cache is dropped beyond this (was 200kB)
+#define BUDGET_IPC      (size_t)(112 * 1024)    // Setting a 25k song queue (104kB measured)
+#define BUDGET_OTHER    (size_t)(64 * 1024)     // Service, config, DSP, logging
+
+// Heap size: all of the above plus room for allocations made by C libraries (mpg123, dr_libs)
 #define INNER_HEAP_SIZE (size_t)(2 * 1024 * 1024)
+static_assert(BUDGET_AUDIO + BUDGET_QUEUE + BUDGET_SUBQUEUE + BUDGET_SOURCE + BUDGET_CACHE + BUDGET_DATABASE + BUDGET_IPC + BUDGET_OTHER + (size_t)(200 * 1024) <= INNER_HEAP_SIZE,
+              "Budgets don't leave room for C libraries in the heap");
 
 // It hangs if I don't use C... I wish I knew why!
 extern "C" {
@@ -57,6 +66,10 @@ void audioThread(void * arg) {
     static_cast<Audio *>(arg)->process();
 }
 
+void serviceDecodeThread(void * arg) {
+    static_cast<MainService *>(arg)->decodeThread();
+}
+
 void serviceGpioThread(void * arg) {
     static_cast<MainService *>(arg)->gpioEventThread();
 }
@@ -74,11 +87,22 @@ void servicePowerThread(void * arg) {
 }
 
 int main(int argc, char * argv[]) {
+    // Set memory budgets
+    Utils::Memory::setBudget(Utils::Memory::Tag::Audio, BUDGET_AUDIO);
+    Utils::Memory::setBudget(Utils::Memory::Tag::Queue, BUDGET_QUEUE);
+    Utils::Memory::setBudget(Utils::Memory::Tag::SubQueue, BUDGET_SUBQUEUE);
+    Utils::Memory::setBudget(Utils::Memory::Tag::Source, BUDGET_SOURCE);
+    Utils::Memory::setBudget(Utils::Memory::Tag::Cache, BUDGET_CACHE);
+    Utils::Memory::setBudget(Utils::Memory::Tag::Database, BUDGET_DATABASE);
+    Utils::Memory::setBudget(Utils::Memory::Tag::Ipc, BUDGET_IPC);
+    Utils::Memory::setBudget(Utils::Memory::Tag::Other, BUDGET_OTHER);
+
     // Create Service
     MainService * service = new MainService();
 
     // Spawn threads
     NX::Thread::create("audio", audioThread, Audio::getInstance());
+    NX::Thread::create("decode", serviceDecodeThread, service);
     NX::Thread::create("gpio", serviceGpioThread, service);
     NX::Thread::create("hid", serviceHidThread, service);
     NX::Thread::create("ipc", serviceIpcThread, service);
@@ -93,6 +117,7 @@ int main(int argc, char * argv[]) {
     NX::Thread::join("ipc");
     NX::Thread::join("hid");
     NX::Thread::join("gpio");
+    NX::Thread::join("decode");
     NX::Thread::join("audio");
 
     // Finally delete service
@@ -1,143 +1,139 @@
-#include <cstdlib>
-#include <cstring>
 #include "Log.hpp"
 #include "nx/Audio.hpp"
 #include "nx/NX.hpp"
-#include <switch.h>
-
-constexpr size_t bufferSize = 0xC800;       // Size of each buffer (50kB)
-constexpr size_t maxBuffers = 6;            // Maximum number of buffer slots (50KB * 6 = 300KB)
-constexpr size_t outputChannels = 2;        // Number of channels to output (should always be 2)
+#include "output/Backend.hpp"
+#ifdef __SWITCH__
+  #include "output/Audren.hpp"
+#else
+  #include "output/Host.hpp"
+#endif
+#include "utils/Memory.hpp"
+#include "utils/PcmFifo.hpp"
+#include <vector>
+
+constexpr size_t blockSize = 0xC800;        // Size of each buffer (50kB)
+constexpr size_t maxBuffers = 7;            // Maximum number of buffer slots (50KB * 7 = 350KB)
+constexpr size_t minBuffers = 2;            // Fewest buffers used (one playing while the other is decoded)
+constexpr double minBuffered = 1.0;         // Seconds always kept buffered, or in low latency mode (below)
+constexpr double minBufferedLow = 0.25;
+constexpr double latencyDecay = 0.98;       // Factor the latency peak decays by with each block
+constexpr double underrunStep = 0.5;        // Extra seconds buffered after each underrun
+constexpr double underrunDecay = 60.0;      // Seconds of audio played for the extra to decay by one second
 
 Audio * Audio::instance = nullptr;          // Our singleton instance
-static AudioDriver drv;                     // Audio output driver (should be safe as this is a singleton class)
-
-// Real size of a buffer due to alignment
-constexpr size_t realSize = ((bufferSize + (AUDREN_MEMPOOL_ALIGNMENT - 1)) &~ (AUDREN_MEMPOOL_ALIGNMENT - 1));
+Output::Backend * Audio::backend_ = nullptr;    // Backend to create the instance with
 
-Audio::Audio() {
-    this->nextBuf = 0;
-    this->waveBuf = nullptr;
+Audio::Audio(Output::Backend * backend) {
     this->action = Status::Stopped;
+    this->backend = backend;
+    this->bufferSize_ = 0;
+    this->channels = 0;
+    this->committedSamples = 0;
+    this->consumedSamples = 0;
+    this->contention = 0;
     this->exit_ = true;
-    this->memPool = nullptr;
+    this->fifo = nullptr;
+    this->format = Format::Int16;
+    this->latency = 0.0;
+    this->lowLatency = false;
+    this->playedSamples = 0;
+    this->rate = 0;
     this->sampleOffset = 0;
-    this->sink = -1;
+    this->songBoundary = -1;
+    this->songChanged = false;
     this->status_ = Status::Stopped;
-    this->success = true;
-    this->voice = -1;
+    this->seenUnderruns = 0;
+    this->submitted = 0;
+    this->success = this->backend->initialized();
+    this->underrunPenalty = 0.0;
+    this->underruns = 0;
+    this->voice = false;
     this->vol = 100.0;
 
-    // Create the driver
-    constexpr AudioRendererConfig audrenCfg = {
-        .output_rate     = AudioRendererOutputRate_48kHz,
-        .num_voices      = 4,
-        .num_effects     = 0,
-        .num_sinks       = 1,
-        .num_mix_objs    = 1,
-        .num_mix_buffers = 2,
-    };
-    Result rc = audrvCreate(&drv, &audrenCfg, outputChannels);
-    if (R_FAILED(rc)) {
-        this->success = false;
-        Log::writeError("[AUDIO] Unable to create driver!");
-    }
-
-    // Create wave buffers
-    this->waveBuf = new AudioDriverWaveBuf[maxBuffers];
-    if (this->waveBuf == nullptr) {
-        delete[] this->waveBuf;
-        this->success = false;
-        Log::writeError("[AUDIO] Unable to allocate memory for buffers!");
-    }
-
-    // Allocate memory pool and align
+    // Create the blocks which audio is decoded into
     if (this->success) {
-        this->memPool = new uint8_t *[maxBuffers];
-        bool error = false;
-        for (size_t i = 0; i < maxBuffers; i++) {
-            this->memPool[i] = static_cast<uint8_t *>(aligned_alloc(AUDREN_MEMPOOL_ALIGNMENT, realSize));
-            if (this->memPool[i] == nullptr) {
-                error = true;
-                break;
-            }
-        }
-
-        if (error) {
-            this->success = false;
-            for (size_t i = 0; i < maxBuffers; i++) {
-                free(this->memPool[i]);
-            }
-            delete[] this->memPool;
-            delete[] this->waveBuf;
-            audrvClose(&drv);
-            Log::writeError("[AUDIO] Unable to allocate memory pool (size: " + std::to_string(maxBuffers) + "x" + std::to_string(realSize) + ")");
-        }
+        this->success = this->backend->createBlocks(maxBuffers, blockSize);
     }
 
-    // Register memory pools with driver and set sink
+    // The FIFO's blocks are the backend's, so the decoder can write straight into them
     if (this->success) {
+        std::vector<uint8_t *> blocks;
         for (size_t i = 0; i < maxBuffers; i++) {
-            int id = audrvMemPoolAdd(&drv, this->memPool[i], realSize);
-            audrvMemPoolAttach(&drv, id);
+            blocks.push_back(this->backend->blockData(i));
         }
-        const uint8_t sinkChannels[outputChannels] = {0, 1};
-        this->sink = audrvDeviceSinkAdd(&drv, AUDREN_DEFAULT_DEVICE_NAME, 2, sinkChannels);
-        audrvUpdate(&drv);
+        this->bufferSize_ = this->backend->blockSize();
+        this->fifo = new Utils::PcmFifo(blocks, this->bufferSize_);
         this->exit_ = false;
         Log::writeSuccess("[AUDIO] Audio object created successfully");
     }
 }
 
+void Audio::setBackend(Output::Backend * backend) {
+    if (Audio::instance == nullptr) {
+        delete Audio::backend_;
+        Audio::backend_ = backend;
+    }
+}
+
 Audio * Audio::getInstance() {
     if (Audio::instance == nullptr) {
-        Audio::instance = new Audio();
+        Utils::Memory::Scope scope(Utils::Memory::Tag::Audio);
+
+        // Use the console's renderer unless told otherwise (and there's only a host backend off the console)
+        Output::Backend * backend = Audio::backend_;
+        if (backend == nullptr) {
+#ifdef __SWITCH__
+            backend = new Output::Audren();
+#else
+            backend = new Output::Host("", true);
+#endif
+        }
+        Audio::backend_ = nullptr;
+        Audio::instance = new Audio(backend);
     }
     return Audio::instance;
 }
 
+std::unique_lock<std::mutex> Audio::lockMutex() {
+    // Note when we have to wait (i.e. the audio thread or another caller holds the mutex)
+    std::unique_lock<std::mutex> mtx(this->mutex, std::try_to_lock);
+    if (!mtx.owns_lock()) {
+        this->contention++;
+        mtx.lock();
+    }
+    return mtx;
+}
+
+void Audio::publishPlayed() {
+    this->playedSamples = this->sampleOffset + this->backend->playedSamples();
+}
+
 bool Audio::initialized() {
     return this->success;
 }
 
 void Audio::exit() {
     this->exit_ = true;
+    this->event.signal();
 }
 
 bool Audio::newSong(long rate, int channels, Format format) {
     this->stop();
-    std::scoped_lock<std::mutex> mtx(this->mutex);
+    std::unique_lock<std::mutex> mtx = this->lockMutex();
     this->sampleOffset = 0;
+    this->songChanged = false;
+    this->publishPlayed();
+    Log::writeInfo("[AUDIO] Mutex contended " + std::to_string(this->contention) + " times so far");
 
-    // Drop previous voice
-    if (this->voice >= 0) {
-        audrvVoiceDrop(&drv, this->voice);
-        audrvUpdate(&drv);
-        this->voice = -1;
-    }
-
-    // Create voice matching rate and channels
+    // Create voice matching rate and channels (replacing the previous one)
     this->channels = channels;
-    this->voice = 0;
-    bool b = audrvVoiceInit(&drv, this->voice, this->channels, static_cast<PcmFormat>(format), rate);
+    this->format = format;
+    this->rate = rate;
+    bool b = this->backend->openVoice(rate, channels, format);
+    this->voice = b;
     if (!b) {
-        this->voice = -1;
         Log::writeError("[AUDIO] Failed to init a new voice!");
-
     } else {
-        // Set volume levels
-        audrvVoiceSetDestinationMix(&drv, this->voice, AUDREN_FINAL_MIX_ID);
-        if (this->channels == 1) {
-            // Mono audio
-            audrvVoiceSetMixFactor(&drv, this->voice, 1.0f, 0, 0);
-            audrvVoiceSetMixFactor(&drv, this->voice, 1.0f, 0, 1);
-        } else {
-            // Stereo-o-o
-            audrvVoiceSetMixFactor(&drv, this->voice, 1.0f, 0, 0);
-            audrvVoiceSetMixFactor(&drv, this->voice, 0.0f, 0, 1);
-            audrvVoiceSetMixFactor(&drv, this->voice, 0.0f, 1, 0);
-            audrvVoiceSetMixFactor(&drv, this->voice, 1.0f, 1, 1);
-        }
         Log::writeInfo("[AUDIO] Created a new voice");
     }
 
@@ -145,65 +141,232 @@ bool Audio::newSong(long rate, int channels, Format format) {
     return b;
 }
 
-void Audio::addBuffer(uint8_t * buf, size_t sz) {
-    // Ensure appropriate size and a buffer is available
-    if (sz > realSize || sz == 0 || !this->bufferAvailable() || this->voice < 0) {
-        return;
+bool Audio::continueSong(long rate, int channels, Format format) {
+    std::unique_lock<std::mutex> mtx = this->lockMutex();
+
+    // The voice can only be reused if it exists and matches the new song
+    if (!this->voice || this->songBoundary >= 0) {
+        return false;
+    }
+    if (rate != this->rate || channels != this->channels || format != this->format) {
+        return false;
     }
 
-    // Copy contents into mempool
-    std::scoped_lock<std::mutex> mtx(this->mutex);
-    std::memcpy(this->memPool[this->nextBuf], buf, sz);
-    armDCacheFlush(this->memPool[this->nextBuf], sz);
-
-    // Fill relevant waveBuf
-    this->waveBuf[this->nextBuf].data_raw = this->memPool[nextBuf];
-    this->waveBuf[this->nextBuf].size = sz;
-    this->waveBuf[this->nextBuf].start_sample_offset = 0;
-    this->waveBuf[this->nextBuf].end_sample_offset = sz/(2 * this->channels);
-    audrvVoiceAddWaveBuf(&drv, this->voice, &this->waveBuf[this->nextBuf]);
-
-    // Move to next buffer
-    this->nextBuf = (this->nextBuf + 1) % maxBuffers;
-
-    // Indicate playing
-    if (this->status_ == Status::Stopped) {
-        audrvVoiceStart(&drv, this->voice);
-        this->status_ = Status::Playing;
+    // Any buffers committed from now on belong to the next song
+    this->songBoundary = this->committedSamples.load();
+    this->songChanged = false;
+    Log::writeInfo("[AUDIO] Queued next song behind current voice at sample " + std::to_string(this->songBoundary));
+    return true;
+}
+
+bool Audio::reachedNextSong() {
+    return this->songChanged.exchange(false);
+}
+
+uint8_t * Audio::acquireBuffer() {
+    Utils::PcmFifo::Block * block = this->fifo->acquire();
+    return (block == nullptr ? nullptr : block->data);
+}
+
+void Audio::commitBuffer(size_t sz) {
+    // Ensure appropriate size and a voice to play it on
+    Utils::PcmFifo::Block * block = this->fifo->acquire();
+    if (sz > this->bufferSize_ || sz == 0 || !this->voice || block == nullptr) {
+        return;
     }
+
+    // The data was written in place, so it only needs to be made visible to the device
+    this->backend->flushBlock(block->index, sz);
+    this->committedSamples += sz/(2 * this->channels);
+    this->fifo->commit(sz);
+    this->event.signal();
 }
 
 bool Audio::bufferAvailable() {
-    std::scoped_lock<std::mutex> mtx(this->mutex);
-    return (this->waveBuf[this->nextBuf].state == AudioDriverWaveBufState_Done);
+    return !this->fifo->full();
+}
+
+void Audio::submitBuffers() {
+    // Release blocks back to the decoder once they've been played
+    Utils::PcmFifo::Block * block;
+    bool released = false;
+    while (this->submitted > 0 && (block = this->fifo->front()) != nullptr) {
+        if (!this->backend->blockDone(block->index)) {
+            break;
+        }
+        this->fifo->pop();
+        this->submitted--;
+        released = true;
+    }
+    if (released && this->bufferFunc != nullptr) {
+        this->bufferFunc();
+    }
+
+    // Queue any newly committed blocks on the voice
+    while (this->voice && (block = this->fifo->peek(this->submitted)) != nullptr) {
+        this->backend->queueBlock(block->index, block->size);
+        this->submitted++;
+
+        // Indicate playing (the voice only restarts without being stopped when it ran dry mid-song)
+        if (this->status_ == Status::Stopped) {
+            if (this->consumedSamples > 0) {
+                this->underruns++;
+            }
+            this->backend->startVoice();
+            this->status_ = Status::Playing;
+            if (this->statusFunc != nullptr) {
+                this->statusFunc();
+            }
+        }
+    }
+}
+
+void Audio::checkSongBoundary() {
+    if (this->songBoundary < 0 || !this->voice) {
+        return;
+    }
+
+    // Switch the played sample offset over once the next song starts playing
+    int64_t played = this->consumedSamples + this->backend->playedSamples();
+    if (played >= this->songBoundary) {
+        this->sampleOffset = this->consumedSamples - this->songBoundary;
+        this->songBoundary = -1;
+        this->songChanged = true;
+        this->publishPlayed();
+        if (this->statusFunc != nullptr) {
+            this->statusFunc();
+        }
+    }
+}
+
+void Audio::stopVoice() {
+    // Stop the voice but continue counting from where it was, as the FIFO
+    // may still receive more buffers (i.e. the decoder couldn't keep up)
+    int64_t played = this->backend->playedSamples();
+    this->sampleOffset += played;
+    this->consumedSamples += played;
+    this->backend->stopVoice();
+    this->publishPlayed();
+    this->status_ = Status::Stopped;
+    if (this->statusFunc != nullptr) {
+        this->statusFunc();
+    }
 }
 
 size_t Audio::bufferSize() {
-    return realSize;
+    return this->bufferSize_;
+}
+
+void Audio::reportLatency(double blockTime, double readTime) {
+    // Follow increases straight away and decreases slowly
+    double stall = blockTime + readTime;
+    this->latency = (stall > this->latency * latencyDecay ? stall : this->latency * latencyDecay);
+    this->adaptDepth();
+}
+
+void Audio::adaptDepth() {
+    if (this->channels <= 0 || this->rate <= 0) {
+        return;
+    }
+    const double blockSecs = static_cast<double>(this->bufferSize_) / (this->rate * this->channels * sizeof(int16_t));
+
+    // Each underrun adds to the penalty, which wears off as audio is played
+    size_t count = this->underruns;
+    if (count != this->seenUnderruns) {
+        this->underrunPenalty += (count - this->seenUnderruns) * underrunStep;
+        this->seenUnderruns = count;
+        Log::writeWarning("[AUDIO] Playback underran (" + std::to_string(count) + " times so far)");
+    } else if (this->underrunPenalty > 0.0) {
+        this->underrunPenalty -= blockSecs/underrunDecay;
+        this->underrunPenalty = (this->underrunPenalty < 0.0 ? 0.0 : this->underrunPenalty);
+    }
+
+    // Buffer enough to ride out twice the worst recent stall, plus the block being decoded
+    double target = (this->lowLatency ? minBufferedLow : minBuffered) + 2.0 * this->latency + this->underrunPenalty;
+    size_t depth = static_cast<size_t>(target/blockSecs + 0.999) + 1;
+    depth = (depth < minBuffers ? minBuffers : (depth > maxBuffers ? maxBuffers : depth));
+    if (depth != this->fifo->depth()) {
+        this->fifo->setDepth(depth);
+        Log::writeInfo("[AUDIO] Using " + std::to_string(depth) + " buffers (" + std::to_string(depth * blockSecs) + "s)");
+    }
+}
+
+void Audio::setLowLatency(bool low) {
+    if (this->lowLatency.exchange(low) != low) {
+        Log::writeInfo(std::string("[AUDIO] Low latency mode ") + (low ? "enabled" : "disabled"));
+    }
+}
+
+size_t Audio::bufferDepth() {
+    return (this->fifo == nullptr ? 0 : this->fifo->depth());
+}
+
+size_t Audio::maxBufferDepth() {
+    return (this->fifo == nullptr ? 0 : maxBuffers);
+}
+
+size_t Audio::underrunCount() {
+    return this->underruns;
+}
+
+void Audio::setBufferFunc(const std::function<void()> & f) {
+    std::unique_lock<std::mutex> mtx = this->lockMutex();
+    this->bufferFunc = f;
+}
+
+void Audio::setStatusFunc(const std::function<void()> & f) {
+    std::unique_lock<std::mutex> mtx = this->lockMutex();
+    this->statusFunc = f;
+}
+
+bool Audio::finished() {
+    // The FIFO must be checked first, as the voice is started as blocks are taken from it
+    if (!this->fifo->empty()) {
+        return false;
+    }
+    return (this->status_ == Status::Stopped);
 }
 
 void Audio::resume() {
     this->action = Status::Playing;
+    this->event.signal();
 }
 
 void Audio::pause() {
     this->action = Status::Paused;
+    this->event.signal();
 }
 
 void Audio::stop() {
-    std::scoped_lock<std::mutex> mtx(this->mutex);
-    if (this->voice >= 0) {
-        this->sampleOffset += audrvVoiceGetPlayedSampleCount(&drv, this->voice);
-        audrvVoiceStop(&drv, this->voice);
-        audrvUpdate(&drv);
+    std::unique_lock<std::mutex> mtx = this->lockMutex();
+    if (this->voice) {
+        // If we've played past the start of a queued song then the offset is relative to it instead
+        int64_t played = this->backend->playedSamples();
+        if (this->songBoundary >= 0 && this->consumedSamples + played >= this->songBoundary) {
+            this->sampleOffset = this->consumedSamples + played - this->songBoundary;
+            this->songChanged = true;
+        } else {
+            this->sampleOffset += played;
+        }
     }
 
-    // Indicate buffers are 'empty'
-    for (size_t i = 0; i < maxBuffers; i++) {
-        this->waveBuf[i].state = AudioDriverWaveBufState_Done;
-    }
-    this->nextBuf = 0;
+    // Discard anything not yet played (this also marks all blocks as 'empty')
+    this->backend->stopVoice();
+    this->fifo->flush();
+    this->committedSamples = 0;
+    this->consumedSamples = 0;
+    this->songBoundary = -1;
+    this->submitted = 0;
+    this->publishPlayed();
     this->status_ = Status::Stopped;
+
+    // Let the decoder know it can refill the FIFO
+    if (this->bufferFunc != nullptr) {
+        this->bufferFunc();
+    }
+    if (this->statusFunc != nullptr) {
+        this->statusFunc();
+    }
 }
 
 Audio::Status Audio::status() {
@@ -211,17 +374,17 @@ Audio::Status Audio::status() {
 }
 
 int Audio::samplesPlayed() {
-    if (this->voice < 0) {
-        return this->sampleOffset;
-    }
-
-    std::scoped_lock<std::mutex> mtx(this->mutex);
-    return (this->sampleOffset + audrvVoiceGetPlayedSampleCount(&drv, this->voice));
+    return this->playedSamples;
 }
 
 void Audio::setSamplesPlayed(int s) {
-    std::scoped_lock<std::mutex> mtx(this->mutex);
+    std::unique_lock<std::mutex> mtx = this->lockMutex();
     this->sampleOffset = s;
+    this->publishPlayed();
+}
+
+size_t Audio::contentionCount() {
+    return this->contention;
 }
 
 double Audio::volume() {
@@ -234,36 +397,52 @@ void Audio::setVolume(double v) {
         return;
     }
 
-    std::scoped_lock<std::mutex> mtx(this->mutex);
+    std::unique_lock<std::mutex> mtx = this->lockMutex();
     this->vol = v;
-    audrvMixSetVolume(&drv, this->sink, this->vol/100.0);
+    this->backend->setVolume(this->vol/100.0);
     Log::writeInfo("[AUDIO] Volume set to " + std::to_string(this->vol));
 }
 
 void Audio::process() {
+    Utils::Memory::Scope scope(Utils::Memory::Tag::Audio);
     while (!this->exit_) {
+        std::unique_lock<std::mutex> mtx(this->mutex);
+
+        // Move any newly decoded audio onto the voice (this will start it if stopped)
+        this->submitBuffers();
+
         switch (this->status_) {
             case Status::Playing: {
                 // Check if we actually need to update
-                std::unique_lock<std::mutex> mtx(this->mutex);
-                int lastBuf = ((this->nextBuf - 1) < 0 ? maxBuffers-1 : this->nextBuf - 1);
-                if (this->waveBuf[lastBuf].state != AudioDriverWaveBufState_Done) {
-                    audrvUpdate(&drv);
-                    audrenWaitFrame();
-                }
+                if (this->submitted > 0) {
+                    this->backend->update();
+                    this->publishPlayed();
 
-                // Check if we need to move to stopped state (no more buffers)
-                if (this->waveBuf[lastBuf].state == AudioDriverWaveBufState_Done) {
+                    // Don't hold the mutex while waiting on the renderer, and check
+                    // we're still playing afterwards (i.e. stop() wasn't called)
                     mtx.unlock();
-                    this->stop();
+                    this->backend->waitFrame();
+                    mtx.lock();
+                    if (this->status_ != Status::Playing) {
+                        break;
+                    }
+                }
+                this->checkSongBoundary();
+
+                // Check if we need to move to stopped state (everything has been played)
+                this->submitBuffers();
+                if (this->fifo->empty()) {
+                    this->stopVoice();
                 }
 
                 // Check if we need to pause
                 if (this->action == Status::Paused) {
-                    audrvVoiceSetPaused(&drv, this->voice, true);
-                    audrvUpdate(&drv);
+                    this->backend->setPaused(true);
                     this->status_ = Status::Paused;
                     this->action = Status::Stopped;
+                    if (this->statusFunc != nullptr) {
+                        this->statusFunc();
+                    }
                 }
                 break;
             }
@@ -271,37 +450,26 @@ void Audio::process() {
             case Status::Paused:
                 // Check if we need to resume
                 if (this->action == Status::Playing) {
-                    std::unique_lock<std::mutex> mtx(this->mutex);
-                    audrvVoiceSetPaused(&drv, this->voice, false);
-                    audrvUpdate(&drv);
+                    this->backend->setPaused(false);
                     this->status_ = Status::Playing;
                     this->action = Status::Stopped;
+                    if (this->statusFunc != nullptr) {
+                        this->statusFunc();
+                    }
                     break;
                 }
 
             case Status::Stopped:
-                // Sleep if not doing anything
-                NX::Thread::sleepMilli(5);
+                // Block until a buffer is committed or an action is requested
+                mtx.unlock();
+                this->event.wait();
                 break;
         }
     }
 }
 
 Audio::~Audio() {
-    if (this->success) {
-        // Drop voice
-        if (this->voice >= 0) {
-            audrvVoiceStop(&drv, this->voice);
-            audrvVoiceDrop(&drv, this->voice);
-        }
-
-        // Free stuff
-        for (size_t i = 0; i < maxBuffers; i++) {
-            free(this->memPool[i]);
-        }
-        delete[] this->memPool;
-        audrvClose(&drv);
-        delete[] this->waveBuf;
-    }
+    delete this->fifo;
+    delete this->backend;
     Audio::instance = nullptr;
-}
\ No newline at end of file
+}
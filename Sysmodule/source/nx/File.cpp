@@ -1,25 +1,122 @@
+#include <algorithm>
+#include <chrono>
 #include <cstring>
-#include <future>
 #include "Log.hpp"
 #include "nx/File.hpp"
 #include "nx/NX.hpp"
-#include <switch.h>
+#include "utils/BlockPool.hpp"
+#include "utils/Memory.hpp"
+#ifdef __SWITCH__
+  #include <switch.h>
+#else
+  #include <cstdio>
+#endif
 
 namespace NX {
+#ifdef __SWITCH__
     // Inherit proper structs for forward declared ones
     struct File::FFile : public FsFile {};
     struct File::FFileSystem : public FsFileSystem {};
+#else
+    // Without libnx files are read using stdio instead, so the same buffering
+    // can be used (and tested) on other platforms
+    struct File::FFile {
+        std::FILE * fp;
+    };
+    struct File::FFileSystem {};
+#endif
+
+    bool File::platformOpen(const std::string & path, FFile * file) {
+    #ifdef __SWITCH__
+        return R_SUCCEEDED(fsFsOpenFile(File::filesystem, path.c_str(), FsOpenMode_Read, file));
+    #else
+        file->fp = std::fopen(path.c_str(), "rb");
+        return (file->fp != nullptr);
+    #endif
+    }
+
+    bool File::platformSize(FFile * file, int64_t * size) {
+    #ifdef __SWITCH__
+        return R_SUCCEEDED(fsFileGetSize(file, size));
+    #else
+        if (std::fseek(file->fp, 0, SEEK_END) != 0) {
+            return false;
+        }
+        *size = std::ftell(file->fp);
+        return (*size >= 0);
+    #endif
+    }
+
+    bool File::platformRead(FFile * file, const off_t offset, uint8_t * buf, const size_t count, uint64_t * read) {
+    #ifdef __SWITCH__
+        Result rc = fsFileRead(file, offset, buf, count, FsReadOption_None, read);
+        if (R_FAILED(rc)) {
+            Log::writeError("[FS] I/O error when reading file: " + std::to_string(rc));
+            return false;
+        }
+        return true;
+    #else
+        if (std::fseek(file->fp, offset, SEEK_SET) != 0) {
+            Log::writeError("[FS] I/O error when seeking file");
+            return false;
+        }
+        *read = std::fread(buf, 1, count, file->fp);
+        if (std::ferror(file->fp)) {
+            Log::writeError("[FS] I/O error when reading file");
+            return false;
+        }
+        return true;
+    #endif
+    }
+
+    void File::platformClose(FFile * file) {
+    #ifdef __SWITCH__
+        fsFileClose(file);
+    #else
+        std::fclose(file->fp);
+    #endif
+    }
 
     File::FFileSystem * File::filesystem = nullptr;             // FsFileSystem object used to open FsFiles with
-    size_t File::fileID = 0;                                    // ID of the next file
-    constexpr size_t readBufferDelay = 10;                      // Number of milliseconds between checking if buffer needs topping up
-    constexpr size_t readBufferSize = 0x19000;                  // Size of read buffer (100kB)
-    constexpr size_t readBufferThreshold = readBufferSize/2;    // Read in new data when the buffer hits this level
+    std::vector<File *> File::files;                            // Files filled by the I/O thread
+    std::mutex File::filesMutex;                                // Mutex protecting the above
+    Event File::ioEvent;                                        // Wakes the I/O thread
+    std::atomic<bool> File::stopIO = false;                     // Set true to stop the I/O thread
+    bool File::ioRunning = false;                               // Whether the I/O thread was started
+    std::atomic<size_t> File::totalSeekHits = 0;                // Counters summed over all files
+    std::atomic<size_t> File::totalHeadHits = 0;
+    std::atomic<size_t> File::totalPurges = 0;
+    std::atomic<uint64_t> File::totalBytesRead = 0;
+    std::atomic<double> File::readLatency = 0.0;                // Recent worst time to read a block
+    constexpr double readLatencyDecay = 0.95;                   // Factor the above decays by with each read
+    constexpr size_t headCacheSize = 0x4000;                    // Size of the head of file cache (16kB)
+    constexpr size_t readBlockSize = 0x8000;                    // Size (and alignment) of each read from the SD card (32kB)
+    constexpr size_t readBufferSize = 3 * readBlockSize;        // Size of read buffer (96kB, must be a multiple of the block size)
+    constexpr size_t prefetchBufferSize = 8 * readBlockSize;    // Size of a prefetching file's buffer (256kB)
+    constexpr size_t prefetchPoolSize = 2 * (prefetchBufferSize - readBufferSize);  // Space shared by prefetching files (beyond their normal buffer)
+    std::atomic<size_t> File::poolUsed = 0;                     // Space currently taken from the pool
+    static Utils::BlockPool bufferPool(0x1000, readBufferSize + headCacheSize);    // Keeps a closed file's buffers for the next one opened
 
     File::File(const std::string & path) {
         // Initialize variables in case error occurrs
         this->buffer = nullptr;
+        this->capacity = readBufferSize;
+        this->bufferHead = 0;
+        this->bufferStart = 0;
+        this->bufferTail = 0;
         this->error = true;
+        this->file = nullptr;
+        this->fillRequested = false;
+        this->fromHead = false;
+        this->headCache = nullptr;
+        this->headHits = 0;
+        this->headLength = 0;
+        this->headPos = 0;
+        this->priority = Priority::Playing;
+        this->purges = 0;
+        this->seekHits = 0;
+        this->shrinkPending = false;
+        this->size = 0;
 
         // Check the fs is ready
         if (this->filesystem == nullptr) {
@@ -28,8 +125,7 @@ namespace NX {
         }
         // Try to open file and set nullptr if unable to
         this->file = new FFile;
-        Result rc = fsFsOpenFile(this->filesystem, path.c_str(), FsOpenMode_Read, this->file);
-        if (R_FAILED(rc)) {
+        if (!platformOpen(path, this->file)) {
             Log::writeError("[FS] Failed to open file: " + path);
             delete file;
             file = nullptr;
@@ -37,117 +133,140 @@ namespace NX {
         }
 
         // Get file size in order to seek
-        rc = fsFileGetSize(this->file, &this->size);
-        if (R_FAILED(rc)) {
+        if (!platformSize(this->file, &this->size)) {
             Log::writeError("[FS] Couldn't get file size for: " + path);
+            platformClose(this->file);
             delete file;
             file = nullptr;
             return;
         }
 
-        // Properly initialize variables and buffer
-        this->buffer = new uint8_t[readBufferSize];
-        this->bufferHead = 0;
-        this->bufferTail = 0;
+        // Create buffer and hand the file to the I/O thread, which starts filling it straight away
+        this->buffer = static_cast<uint8_t *>(bufferPool.allocate(readBufferSize));
+        this->headCache = static_cast<uint8_t *>(bufferPool.allocate(std::min<size_t>(this->size, headCacheSize)));
+        if (this->buffer == nullptr || this->headCache == nullptr) {
+            Log::writeError("[FS] Not enough memory to buffer: " + path);
+            return;
+        }
         this->error = false;
-        this->fileOffset = 0;
-        this->id = this->fileID++;
-        this->offset = 0;
-        this->stopThread = false;
-
-        // Start fill thread
-        Thread::create("file" + std::to_string(this->id), fillBufferThread, this, 0x4000);
+        std::scoped_lock<std::mutex> mtx(File::filesMutex);
+        File::files.push_back(this);
+        this->requestFill();
     }
 
-    // Note: We can freely _read_ this->bufferTail in this thread (producer)
-    void File::fillBufferThread(void * arg) {
-        File * file = static_cast<File *>(arg);
-
-        // Loop until we're signalled to exit
-        while (!file->stopThread) {
-            // Check if the buffer is getting low (subtract one as it's reserved)
-            size_t emptyBytes = (readBufferSize - 1) - file->bufferSize();
-            if (emptyBytes >= readBufferThreshold) {
-                // Also check if we're not at the end
-                std::scoped_lock<std::mutex> mtx(file->fileMutex);
-                if (!(file->fileOffset >= file->size)) {
-                    // Read from file into buffer
-                    Result rc;
-                    uint64_t actualRead = 0;
-
-                    // If we have to wrap around then read in two goes
-                    if (file->bufferTail + emptyBytes > readBufferSize) {
-                        size_t firstPart = readBufferSize - file->bufferTail;
-                        uint64_t read = 0;
-
-                        rc = fsFileRead(file->file, file->fileOffset, file->buffer + file->bufferTail, firstPart, FsReadOption_None, &read);
-                        actualRead += read;
-
-                        // Stop if we're at the end
-                        if (read == firstPart) {
-                            rc = fsFileRead(file->file, file->fileOffset + read, file->buffer, emptyBytes - firstPart, FsReadOption_None, &read);
-                            actualRead += read;
-                        }
-
-                    // Otherwise just read as normal
-                    } else {
-                        rc = fsFileRead(file->file, file->fileOffset, file->buffer + file->bufferTail, emptyBytes, FsReadOption_None, &actualRead);
+    void File::ioThread(void * arg) {
+        Utils::Memory::Scope scope(Utils::Memory::Tag::Source);
+
+        // Reads are made on behalf of the decoder, so should get the same priority
+    #ifdef __SWITCH__
+        Fs::setHighPriority(true);
+    #endif
+
+        while (!File::stopIO) {
+            // Keep reading a block for the most important file which has room for one, until none do
+            bool filled = true;
+            while (filled && !File::stopIO) {
+                std::unique_lock<std::mutex> mtx(File::filesMutex);
+                File * next = nullptr;
+                off_t nextBuffered = 0;
+                for (File * file : File::files) {
+                    // Clear the request before checking, so a reader making room from now on signals again
+                    file->fillRequested = false;
+                    const off_t tail = file->bufferTail.load(std::memory_order_acquire);
+                    if (file->fillLimit() <= tail) {
+                        continue;
                     }
 
-                    // If an error occurred break out of loop
-                    if (R_FAILED(rc)) {
-                        Log::writeError("[FS] I/O error when reading file: " + std::to_string(rc));
-                        file->error = true;
-                        break;
+                    // The playing file comes first, then whichever has the least buffered
+                    const off_t buffered = tail - file->bufferHead.load(std::memory_order_acquire);
+                    if (next == nullptr || file->priority < next->priority || (file->priority == next->priority && buffered < nextBuffered)) {
+                        next = file;
+                        nextBuffered = buffered;
                     }
+                }
 
-                    // Lock mutex so we can safely update the end of the buffer
-                    file->fileOffset += actualRead;
-                    std::scoped_lock<std::mutex> mtx2(file->bufferMutex);
-                    file->bufferTail += actualRead;
-                    file->bufferTail = file->bufferTail % readBufferSize;
+                // The file's fillMutex keeps it open while reading (it's destructor waits for it), so files
+                // can be opened and closed while the SD card is busy
+                filled = (next != nullptr);
+                if (filled) {
+                    std::scoped_lock<std::mutex> fillMtx(next->fillMutex);
+                    mtx.unlock();
+                    next->fill();
                 }
             }
 
-            // Pause before checking again
-            Thread::sleepMilli(readBufferDelay);
+            // Block until a reader makes room (or a file is opened/seeked)
+            File::ioEvent.wait();
         }
     }
 
-    size_t File::bufferSize() {
-        std::scoped_lock<std::mutex> mtx(this->bufferMutex);
-        if (this->bufferHead > this->bufferTail) {
-            return (readBufferSize - (this->bufferHead - this->bufferTail));
-        } else {
-            return this->bufferTail - this->bufferHead;
+    off_t File::fillLimit() {
+        const off_t head = this->bufferHead.load(std::memory_order_acquire);
+        const off_t tail = this->bufferTail.load(std::memory_order_acquire);
+        if (this->error || tail >= this->size) {
+            return tail;
         }
+
+        // Fill up to the head (wrapped around) or the end of the file, without wrapping the buffer
+        // Once a prefetched file is being played only the normal amount is kept, so it's buffer can shrink
+        const size_t capacity = this->capacity.load(std::memory_order_relaxed);
+        const size_t window = (this->shrinkPending ? readBufferSize : capacity);
+        off_t limit = std::min<off_t>(head + window, this->size);
+        limit = std::min<off_t>(limit, tail - (tail % capacity) + capacity);
+
+        // Read one block at a time, so the most important file is chosen again after each one.
+        // Only stop at a block boundary (unless it's the end of the file)
+        limit = std::min<off_t>(limit, tail - (tail % readBlockSize) + readBlockSize);
+        if (limit < this->size) {
+            limit -= (limit % readBlockSize);
+        }
+        return (limit > tail ? limit : tail);
     }
 
-    size_t File::copyToBuffer(void * outBuffer, const size_t count) {
-        // Edge case
-        if (count == 0) {
-            return 0;
+    void File::fill() {
+        const off_t tail = this->bufferTail.load(std::memory_order_relaxed);
+        const off_t limit = this->fillLimit();
+        if (limit <= tail) {
+            return;
         }
 
-        // If we have to wrap around then read in two goes
-        if (this->bufferHead + count > readBufferSize) {
-            size_t firstPart = readBufferSize - this->bufferHead;
-            std::memcpy(outBuffer, this->buffer + this->bufferHead, firstPart);
-            std::memcpy(static_cast<uint8_t *>(outBuffer) + firstPart, this->buffer, count - firstPart);
+        // The block never wraps around the end of the buffer, so it's read in one go
+        uint64_t read = 0;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        bool ok = platformRead(this->file, tail, this->buffer + (tail % this->capacity), limit - tail, &read);
+        if (ok && read == 0) {
+            Log::writeError("[FS] Unexpected end of file");
+            ok = false;
+        }
 
+        if (!ok) {
+            this->error = true;
         } else {
-            std::memcpy(outBuffer, this->buffer + this->bufferHead, count);
+            // Keep the start of the file the first time it's read
+            if (tail == 0 && this->headLength == 0) {
+                const size_t length = std::min<size_t>(std::min<size_t>(this->size, headCacheSize), read);
+                std::memcpy(this->headCache, this->buffer, length);
+                this->headLength.store(length, std::memory_order_release);
+            }
+            this->bufferTail.store(tail + read, std::memory_order_release);
+            File::totalBytesRead += read;
+
+            // Track how long the SD card is taking per block (following increases straight away)
+            double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            secs = secs * readBlockSize / read;
+            double peak = File::readLatency * readLatencyDecay;
+            File::readLatency = (secs > peak ? secs : peak);
         }
+        this->readEvent.signal();
+    }
 
-        // Move start index
-        this->bufferHead += count;
-        this->bufferHead = this->bufferHead % readBufferSize;
-        this->offset += count;
-
-        return count;
+    void File::requestFill() {
+        // Only signal once until the I/O thread picks up the request
+        if (this->fillLimit() > this->bufferTail.load(std::memory_order_acquire) && !this->fillRequested.exchange(true)) {
+            File::ioEvent.signal();
+        }
     }
 
-    // Note: We can freely access this->bufferHead in this thread (consumer)
     ssize_t File::read(void * outBuffer, const size_t count) {
         // Edge case
         if (count == 0) {
@@ -159,42 +278,54 @@ namespace NX {
             return -1;
         }
 
-        // Check how many bytes we have in the buffer
-        size_t size = this->bufferSize();
-
-        // Simply copy and return if we have enough
-        if (size >= count) {
-            return this->copyToBuffer(outBuffer, count);
+        // Start with the head cache if a seek landed in it (the buffer continues from where it ends)
+        uint8_t * out = static_cast<uint8_t *>(outBuffer);
+        size_t copied = 0;
+        if (this->fromHead) {
+            const size_t length = this->headLength.load(std::memory_order_acquire);
+            copied = std::min<size_t>(length - this->headPos, count);
+            std::memcpy(out, this->headCache + this->headPos, copied);
+            this->headPos += copied;
+            this->fromHead = (this->headPos < static_cast<off_t>(length));
         }
 
-        // Otherwise wait until we have more bytes or reach EOF
-        while (size < count) {
-            // Stop if an I/O error is reported
-            if (this->error) {
-                return -1;
+        // Copy whatever is buffered, waiting for the I/O thread when it runs out
+        while (copied < count) {
+            const off_t head = this->bufferHead.load(std::memory_order_relaxed);
+            const off_t tail = this->bufferTail.load(std::memory_order_acquire);
+            if (tail > head) {
+                // Copy in two goes if we have to wrap around
+                const size_t bytes = std::min<size_t>(tail - head, count - copied);
+                const size_t index = head % this->capacity;
+                const size_t firstPart = std::min<size_t>(bytes, this->capacity - index);
+                std::memcpy(out + copied, this->buffer + index, firstPart);
+                std::memcpy(out + copied + firstPart, this->buffer, bytes - firstPart);
+
+                copied += bytes;
+                this->bufferHead.store(head + bytes, std::memory_order_release);
+
+                // Give the prefetch space back once the reader has caught up
+                if (this->shrinkPending && tail - (head + static_cast<off_t>(bytes)) <= static_cast<off_t>(readBufferSize)) {
+                    this->shrinkPending = !this->resize(readBufferSize);
+                }
+                this->requestFill();
+                continue;
             }
 
-            // Return remaining bytes if EOF
-            std::unique_lock<std::mutex> mtx(this->fileMutex);
-            if (this->fileOffset >= this->size) {
-                return this->copyToBuffer(outBuffer, size);
+            // Return what we have at EOF or on an error
+            if (head >= this->size) {
+                break;
             }
-            mtx.unlock();
-
-            // Return what we have if requested more than we can buffer
-            if (count >= readBufferSize && size > 0) {
-                return this->copyToBuffer(outBuffer, size);
+            if (this->error) {
+                return (copied > 0 ? copied : -1);
             }
 
-            // Sleep for a while before checking again
-            Thread::sleepMilli(readBufferDelay);
-
-            // Check buffer size again
-            size = this->bufferSize();
+            // Wait for the I/O thread to read more before checking again
+            this->requestFill();
+            this->readEvent.wait();
         }
 
-        // Copy as usual now that we have enough bytes
-        return this->copyToBuffer(outBuffer, count);
+        return copied;
     }
 
     off_t File::seek(const off_t offset, const Position position) {
@@ -203,43 +334,169 @@ namespace NX {
             return -1;
         }
 
-        // Seek in file first (we need to lock for the whole operation)
-        std::scoped_lock<std::mutex> mtx(this->fileMutex);
+        off_t target = offset;
         switch (position) {
             case Position::Start:
-                this->fileOffset = offset;
                 break;
 
             case Position::Current:
-                this->fileOffset = this->offset + offset;
+                target += this->tell();
                 break;
 
             case Position::End:
-                this->fileOffset = this->size + offset;
+                target += this->size;
                 break;
         }
+        if (target < 0) {
+            Log::writeError("[FS] Attempted to seek before the start of the file");
+            return -1;
+        }
 
-        // Purge buffer, which will cause a read operation as soon as this function returns
-        // This is safe as read() and seek() are called in a single-threaded context,
-        // so we can assume that this->bufferTail won't be accessed
-        std::scoped_lock<std::mutex> mtx2(this->bufferMutex);
-        this->bufferHead = 0;
-        this->bufferTail = 0;
-        this->offset = this->fileOffset;
+        // Skipping forward within the buffered data only moves the head, which the reader owns
+        if (!this->fromHead) {
+            const off_t head = this->bufferHead.load(std::memory_order_relaxed);
+            if (target >= head && target <= this->bufferTail.load(std::memory_order_acquire)) {
+                this->bufferHead.store(target, std::memory_order_release);
+                this->requestFill();
+                this->seekHits++;
+                File::totalSeekHits++;
+                return target;
+            }
+        }
+
+        // Otherwise wait for any read in progress to finish, as the data behind the head is only
+        // intact up to one buffer's length back from the tail
+        std::scoped_lock<std::mutex> mtx(this->fillMutex);
+        const off_t tail = this->bufferTail.load(std::memory_order_relaxed);
+        const off_t start = std::max<off_t>(this->bufferStart, tail - this->capacity);
+        const off_t length = this->headLength.load(std::memory_order_acquire);
+        this->fromHead = false;
+        if (target >= start && target <= tail) {
+            this->bufferHead.store(target, std::memory_order_release);
+            this->seekHits++;
+            File::totalSeekHits++;
+
+        } else if (target < length) {
+            // Read from the cache, with the buffer picking up where it ends
+            this->fromHead = true;
+            this->headPos = target;
+            if (length >= start && length <= tail) {
+                this->bufferHead.store(length, std::memory_order_release);
+            } else {
+                this->purge(length);
+            }
+            this->headHits++;
+            File::totalHeadHits++;
+
+        } else {
+            this->purge(target);
+            this->purges++;
+            File::totalPurges++;
+        }
+        this->requestFill();
+
+        return target;
+    }
+
+    void File::purge(const off_t offset) {
+        // The I/O thread will refill from the new position as soon as it's woken
+        this->bufferHead = offset;
+        this->bufferStart = offset;
+        this->bufferTail = offset;
+        this->readEvent.reset();
+        this->fillRequested = false;
+    }
+
+    off_t File::tell() {
+        return (this->fromHead ? this->headPos : this->bufferHead.load(std::memory_order_relaxed));
+    }
+
+    bool File::resize(const size_t capacity) {
+        const size_t oldCapacity = this->capacity;
+        if (this->buffer == nullptr || capacity == oldCapacity) {
+            return true;
+        }
+
+        // Anything beyond the normal size has to fit in the pool
+        const size_t extra = capacity - readBufferSize;
+        const size_t oldExtra = oldCapacity - readBufferSize;
+        if (extra > oldExtra) {
+            size_t used = File::poolUsed;
+            do {
+                if (used + (extra - oldExtra) > prefetchPoolSize) {
+                    return false;
+                }
+            } while (!File::poolUsed.compare_exchange_weak(used, used + (extra - oldExtra)));
+        }
+
+        // Move whatever is still buffered into the new buffer (waiting for any read in progress to finish)
+        uint8_t * buffer = static_cast<uint8_t *>(bufferPool.allocate(capacity));
+        if (buffer == nullptr) {
+            if (extra > oldExtra) {
+                File::poolUsed -= (extra - oldExtra);
+            }
+            return false;
+        }
+        std::scoped_lock<std::mutex> mtx(this->fillMutex);
+        const off_t tail = this->bufferTail;
+        const off_t start = std::max<off_t>(std::max<off_t>(this->bufferStart, tail - oldCapacity), tail - capacity);
+        if (this->bufferHead < start) {
+            // Unread data wouldn't fit (only happens when shrinking)
+            bufferPool.free(buffer);
+            return false;
+        }
+        off_t pos = start;
+        while (pos < tail) {
+            const size_t bytes = std::min<size_t>(std::min<size_t>(tail - pos, oldCapacity - (pos % oldCapacity)), capacity - (pos % capacity));
+            std::memcpy(buffer + (pos % capacity), this->buffer + (pos % oldCapacity), bytes);
+            pos += bytes;
+        }
 
-        return this->offset;
+        bufferPool.free(this->buffer);
+        this->buffer = buffer;
+        this->bufferStart = start;
+        this->capacity = capacity;
+        if (extra < oldExtra) {
+            File::poolUsed -= (oldExtra - extra);
+        }
+        return true;
+    }
+
+    void File::setPriority(const Priority priority) {
+        this->priority = priority;
+
+        // A file waiting to be played reads further ahead (if there's room in the pool)
+        if (priority == Priority::Prefetch) {
+            this->shrinkPending = false;
+            if (this->resize(prefetchBufferSize)) {
+                this->requestFill();
+            }
+
+        } else if (this->capacity > readBufferSize) {
+            this->shrinkPending = true;
+        }
     }
 
     File::~File() {
-        // Join fill thread
-        this->stopThread = true;
-        Thread::join("file" + std::to_string(this->id));
+        // Stop the I/O thread using this file, then wait for any read in progress
+        {
+            std::scoped_lock<std::mutex> mtx(File::filesMutex);
+            File::files.erase(std::remove(File::files.begin(), File::files.end(), this), File::files.end());
+        }
+        std::scoped_lock<std::mutex> fillMtx(this->fillMutex);
 
-        // Close file and free buffer
+        // Close file and free buffers
         if (this->file != nullptr) {
-            fsFileClose(this->file);
+            platformClose(this->file);
+            delete this->file;
+        }
+        bufferPool.free(this->buffer);
+        bufferPool.free(this->headCache);
+        File::poolUsed -= (this->capacity - readBufferSize);
+
+        if (this->seekHits + this->headHits + this->purges > 0) {
+            Log::writeInfo("[FS] Closed file after " + std::to_string(this->seekHits) + " buffered, " + std::to_string(this->headHits) + " cached and " + std::to_string(this->purges) + " purging seeks");
         }
-        delete this->buffer;
     }
 
     bool File::initializeService() {
@@ -250,6 +507,7 @@ namespace NX {
 
         // Open SD Card filesystem
         File::filesystem = new FFileSystem;
+    #ifdef __SWITCH__
         Result rc = fsOpenSdCardFileSystem(File::filesystem);
         if (R_FAILED(rc)) {
             Log::writeError("[FS] Couldn't open SD Card fs");
@@ -257,16 +515,36 @@ namespace NX {
             File::filesystem = nullptr;
             return false;
         }
+    #endif
 
-        return true;
+        // Start the I/O thread
+        File::stopIO = false;
+        File::ioRunning = Thread::create("fileio", ioThread, nullptr, 0x4000);
+        return File::ioRunning;
     }
 
     void File::closeService() {
+        if (File::ioRunning) {
+            File::stopIO = true;
+            File::ioEvent.signal();
+            Thread::join("fileio");
+            File::ioRunning = false;
+        }
+
+    #ifdef __SWITCH__
+        if (File::filesystem != nullptr) {
+            fsFsClose(File::filesystem);
+        }
+    #endif
         delete File::filesystem;
         File::filesystem = nullptr;
     }
 
 
+    File::Stats File::stats() {
+        return Stats{File::totalSeekHits, File::totalHeadHits, File::totalPurges, File::totalBytesRead, File::readLatency};
+    }
+
     ssize_t File::readFile(void * file, void * buffer, size_t count) {
         return static_cast<File *>(file)->read(buffer, count);
     }
@@ -295,4 +573,16 @@ namespace NX {
 
         return static_cast<File *>(file)->seek(offset, position);
     }
+
+    size_t File::readFileFully(void * file, void * buffer, const size_t count) {
+        size_t total = 0;
+        while (total < count) {
+            ssize_t read = static_cast<File *>(file)->read(static_cast<uint8_t *>(buffer) + total, count - total);
+            if (read <= 0) {
+                break;
+            }
+            total += read;
+        }
+        return total;
+    }
 };
\ No newline at end of file
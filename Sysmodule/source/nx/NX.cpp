@@ -2,12 +2,16 @@
 #include "nx/Audio.hpp"
 #include "nx/File.hpp"
 #include "nx/NX.hpp"
+#include <chrono>
 #include <mutex>
-#include <switch.h>
+#ifdef __SWITCH__
+  #include <switch.h>
+#endif
 #include <thread>
 #include <unordered_map>
 
 namespace NX {
+#ifdef __SWITCH__
     // Helper to log messages
     void logError(const std::string & service, const Result & rc) {
         Log::writeError("[NX] Failed to initialize " + service + ": " + std::to_string(rc));
@@ -18,13 +22,14 @@ namespace NX {
     static bool fsInitialized = false;
     static bool hidInitialized = false;
     static bool gpioInitialized = false;
+    static bool pmdmntInitialized = false;
     static bool pscmInitialized = false;
     static bool smInitialized = false;
 
     // Starts all needed services
     bool startServices() {
         // Prevent starting twice
-        if (audrenInitialized || fsInitialized || gpioInitialized || hidInitialized || pscmInitialized || smInitialized) {
+        if (audrenInitialized || fsInitialized || gpioInitialized || hidInitialized || pmdmntInitialized || pscmInitialized || smInitialized) {
             return true;
         }
         Result rc;
@@ -110,12 +115,27 @@ namespace NX {
             logError("pscm", rc);
         }
 
-        // We don't care if gpio, hid or pscm don't initialize
+        // PM
+        rc = pmdmntInitialize();
+        if (R_SUCCEEDED(rc)) {
+            pmdmntInitialized = true;
+
+        } else {
+            logError("pmdmnt", rc);
+        }
+
+        // We don't care if gpio, hid, pscm or pmdmnt don't initialize
         return true;
     }
 
     // Stops all started services (in reverse order)
     void stopServices() {
+        // PM
+        if (pmdmntInitialized) {
+            pmdmntExit();
+            pmdmntInitialized = false;
+        }
+
         // PSC
         if (pscmInitialized) {
             pscmExit();
@@ -227,6 +247,18 @@ namespace NX {
         }
     };
 
+    namespace Pm {
+        bool applicationRunning() {
+            // Assume there is one if we can't tell
+            if (!pmdmntInitialized) {
+                return true;
+            }
+
+            u64 pid;
+            return R_SUCCEEDED(pmdmntGetApplicationProcessId(&pid));
+        }
+    };
+
     namespace Hid {
         static PadState hidPad;                                     // Pad object
         static bool hidPrepared = false;                            // Set true if prepared
@@ -358,6 +390,115 @@ namespace NX {
         }
     };
 
+#else
+    // Off the console there are no services to start, other than the file I/O thread. The
+    // rest do nothing, which is enough to run (and measure) playback on another platform
+    static bool fsInitialized = false;
+
+    bool startServices() {
+        if (!fsInitialized) {
+            fsInitialized = File::initializeService();
+        }
+        return fsInitialized;
+    }
+
+    void stopServices() {
+        if (fsInitialized) {
+            File::closeService();
+            fsInitialized = false;
+        }
+    }
+
+    namespace Fs {
+        void setHighPriority(const bool b) {
+
+        }
+    };
+
+    namespace Gpio {
+        bool prepare() {
+            return false;
+        }
+
+        void cleanup() {
+
+        }
+
+        bool headsetUnplugged() {
+            return false;
+        }
+    };
+
+    namespace Pm {
+        bool applicationRunning() {
+            return false;
+        }
+    };
+
+    namespace Hid {
+        bool prepare() {
+            return false;
+        }
+
+        void cleanup() {
+
+        }
+
+        bool comboPressed(const std::vector<Button> & buttons) {
+            return false;
+        }
+    };
+
+    namespace Psc {
+        bool prepare() {
+            return false;
+        }
+
+        void cleanup() {
+
+        }
+
+        void setSleepFunc(const std::function<void()> & f) {
+
+        }
+
+        void setWakeFunc(const std::function<void()> & f) {
+
+        }
+
+        void monitor(const size_t ms) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+        }
+    };
+#endif
+
+    Event::Event() {
+        this->signalled = false;
+    }
+
+    void Event::signal() {
+        std::scoped_lock<std::mutex> mtx(this->mutex);
+        this->signalled = true;
+        this->cv.notify_one();
+    }
+
+    void Event::reset() {
+        std::scoped_lock<std::mutex> mtx(this->mutex);
+        this->signalled = false;
+    }
+
+    bool Event::wait(const size_t ms) {
+        std::unique_lock<std::mutex> mtx(this->mutex);
+        if (ms == 0) {
+            this->cv.wait(mtx, [this]() { return this->signalled; });
+        } else if (!this->cv.wait_for(mtx, std::chrono::milliseconds(ms), [this]() { return this->signalled; })) {
+            return false;
+        }
+
+        this->signalled = false;
+        return true;
+    }
+
     // I wanted to use libnx's API for threads but apparently that causes a Data Abort when a thread's
     // function returns (like literally after the last line)
     namespace Thread {
@@ -391,7 +532,11 @@ namespace NX {
         }
 
         void sleepNano(const size_t ns) {
+        #ifdef __SWITCH__
             svcSleepThread(ns);
+        #else
+            std::this_thread::sleep_for(std::chrono::nanoseconds(ns));
+        #endif
         }
 
         void sleepMilli(const size_t ms) {
@@ -0,0 +1,221 @@
+#include <cstdlib>
+#include "Log.hpp"
+#include "output/Audren.hpp"
+#include <switch.h>
+#include "Types.hpp"
+#include "utils/Memory.hpp"
+
+constexpr size_t outputChannels = 2;        // Number of channels to output (should always be 2)
+
+namespace Output {
+    // Inherit proper structs for forward declared ones
+    struct Audren::Driver : public AudioDriver {};
+    struct Audren::WaveBuf : public AudioDriverWaveBuf {};
+
+    Audren::Audren() {
+        this->channels = 0;
+        this->count = 0;
+        this->memPool = nullptr;
+        this->sink = -1;
+        this->size = 0;
+        this->success = true;
+        this->voice = -1;
+        this->waveBuf = nullptr;
+
+        // Create the driver
+        constexpr AudioRendererConfig audrenCfg = {
+            .output_rate     = AudioRendererOutputRate_48kHz,
+            .num_voices      = 4,
+            .num_effects     = 0,
+            .num_sinks       = 1,
+            .num_mix_objs    = 1,
+            .num_mix_buffers = 2,
+        };
+        this->drv = new Driver;
+        Result rc = audrvCreate(this->drv, &audrenCfg, outputChannels);
+        if (R_FAILED(rc)) {
+            delete this->drv;
+            this->drv = nullptr;
+            this->success = false;
+            Log::writeError("[AUDIO] Unable to create driver!");
+            return;
+        }
+
+        // Set sink
+        const uint8_t sinkChannels[outputChannels] = {0, 1};
+        this->sink = audrvDeviceSinkAdd(this->drv, AUDREN_DEFAULT_DEVICE_NAME, 2, sinkChannels);
+        audrvUpdate(this->drv);
+    }
+
+    bool Audren::initialized() {
+        return this->success;
+    }
+
+    bool Audren::createBlocks(size_t count, size_t size) {
+        if (!this->success || this->memPool != nullptr) {
+            return false;
+        }
+
+        // Real size of a buffer due to alignment
+        this->size = ((size + (AUDREN_MEMPOOL_ALIGNMENT - 1)) &~ (AUDREN_MEMPOOL_ALIGNMENT - 1));
+
+        // Allocate memory pool and align
+        this->memPool = new uint8_t *[count];
+        bool error = false;
+        for (size_t i = 0; i < count; i++) {
+            this->memPool[i] = static_cast<uint8_t *>(aligned_alloc(AUDREN_MEMPOOL_ALIGNMENT, this->size));
+            if (this->memPool[i] == nullptr) {
+                error = true;
+                break;
+            }
+        }
+
+        if (error) {
+            for (size_t i = 0; i < count; i++) {
+                free(this->memPool[i]);
+            }
+            delete[] this->memPool;
+            this->memPool = nullptr;
+            Log::writeError("[AUDIO] Unable to allocate memory pool (size: " + std::to_string(count) + "x" + std::to_string(this->size) + ")");
+            return false;
+        }
+
+        // Register memory pools with driver and create a wave buffer for each
+        this->waveBuf = new WaveBuf[count];
+        for (size_t i = 0; i < count; i++) {
+            int id = audrvMemPoolAdd(this->drv, this->memPool[i], this->size);
+            audrvMemPoolAttach(this->drv, id);
+            this->waveBuf[i].state = AudioDriverWaveBufState_Done;
+        }
+        this->count = count;
+        audrvUpdate(this->drv);
+        Utils::Memory::add(Utils::Memory::Tag::Audio, this->count * this->size);
+        return true;
+    }
+
+    size_t Audren::blockSize() {
+        return this->size;
+    }
+
+    uint8_t * Audren::blockData(size_t index) {
+        return (index < this->count ? this->memPool[index] : nullptr);
+    }
+
+    void Audren::flushBlock(size_t index, size_t bytes) {
+        // The DSP reads from memory, so the data needs to leave the cache first
+        armDCacheFlush(this->memPool[index], bytes);
+    }
+
+    bool Audren::openVoice(long rate, int channels, Format format) {
+        // Drop previous voice
+        if (this->voice >= 0) {
+            audrvVoiceDrop(this->drv, this->voice);
+            audrvUpdate(this->drv);
+            this->voice = -1;
+        }
+
+        // Create voice matching rate and channels
+        this->channels = channels;
+        this->voice = 0;
+        bool b = audrvVoiceInit(this->drv, this->voice, channels, static_cast<PcmFormat>(format), rate);
+        if (!b) {
+            this->voice = -1;
+            return false;
+        }
+
+        // Set volume levels
+        audrvVoiceSetDestinationMix(this->drv, this->voice, AUDREN_FINAL_MIX_ID);
+        if (channels == 1) {
+            // Mono audio
+            audrvVoiceSetMixFactor(this->drv, this->voice, 1.0f, 0, 0);
+            audrvVoiceSetMixFactor(this->drv, this->voice, 1.0f, 0, 1);
+        } else {
+            // Stereo-o-o
+            audrvVoiceSetMixFactor(this->drv, this->voice, 1.0f, 0, 0);
+            audrvVoiceSetMixFactor(this->drv, this->voice, 0.0f, 0, 1);
+            audrvVoiceSetMixFactor(this->drv, this->voice, 0.0f, 1, 0);
+            audrvVoiceSetMixFactor(this->drv, this->voice, 1.0f, 1, 1);
+        }
+        return true;
+    }
+
+    void Audren::queueBlock(size_t index, size_t bytes) {
+        if (this->voice < 0 || index >= this->count) {
+            return;
+        }
+
+        WaveBuf & buf = this->waveBuf[index];
+        buf.data_raw = this->memPool[index];
+        buf.size = bytes;
+        buf.start_sample_offset = 0;
+        buf.end_sample_offset = bytes/(2 * this->channels);
+        audrvVoiceAddWaveBuf(this->drv, this->voice, &buf);
+    }
+
+    bool Audren::blockDone(size_t index) {
+        return (this->waveBuf[index].state == AudioDriverWaveBufState_Done);
+    }
+
+    void Audren::startVoice() {
+        if (this->voice >= 0) {
+            audrvVoiceStart(this->drv, this->voice);
+        }
+    }
+
+    void Audren::stopVoice() {
+        if (this->voice >= 0) {
+            audrvVoiceStop(this->drv, this->voice);
+            audrvUpdate(this->drv);
+        }
+
+        // Indicate buffers are 'empty'
+        for (size_t i = 0; i < this->count; i++) {
+            this->waveBuf[i].state = AudioDriverWaveBufState_Done;
+        }
+    }
+
+    void Audren::setPaused(bool paused) {
+        if (this->voice >= 0) {
+            audrvVoiceSetPaused(this->drv, this->voice, paused);
+            audrvUpdate(this->drv);
+        }
+    }
+
+    uint32_t Audren::playedSamples() {
+        return (this->voice < 0 ? 0 : audrvVoiceGetPlayedSampleCount(this->drv, this->voice));
+    }
+
+    void Audren::setVolume(double vol) {
+        audrvMixSetVolume(this->drv, this->sink, vol);
+    }
+
+    void Audren::update() {
+        audrvUpdate(this->drv);
+    }
+
+    void Audren::waitFrame() {
+        audrenWaitFrame();
+    }
+
+    Audren::~Audren() {
+        if (this->drv == nullptr) {
+            return;
+        }
+
+        // Drop voice
+        if (this->voice >= 0) {
+            audrvVoiceStop(this->drv, this->voice);
+            audrvVoiceDrop(this->drv, this->voice);
+        }
+
+        // Free stuff
+        for (size_t i = 0; i < this->count; i++) {
+            free(this->memPool[i]);
+        }
+        Utils::Memory::remove(Utils::Memory::Tag::Audio, this->count * this->size);
+        delete[] this->memPool;
+        audrvClose(this->drv);
+        delete this->drv;
+        delete[] this->waveBuf;
+    }
+};
@@ -0,0 +1,232 @@
+#include <cstring>
+#include "Log.hpp"
+#include "output/Host.hpp"
+#include <thread>
+#include "Types.hpp"
+
+constexpr size_t frameDelay = 5;            // Number of milliseconds in a 'frame' (matches audren)
+
+// Helper to write a little-endian value of the given number of bytes
+static void writeLE(std::FILE * file, uint32_t value, size_t bytes) {
+    for (size_t i = 0; i < bytes; i++) {
+        std::fputc((value >> (8 * i)) & 0xFF, file);
+    }
+}
+
+namespace Output {
+    Host::Host(const std::string & path, bool realTime) {
+        this->channels = 0;
+        this->file = nullptr;
+        this->frameSize = 0;
+        this->path = path;
+        this->paused = false;
+        this->pending = 0;
+        this->played = 0;
+        this->playing = false;
+        this->rate = 0;
+        this->realTime = realTime;
+        this->size = 0;
+        this->underruns_ = 0;
+        this->voice = false;
+        this->written = 0;
+    }
+
+    void Host::writeHeader(Format format) {
+        uint16_t bits = static_cast<int>(format) * 8;
+        uint16_t type = (format == Format::Float ? 3 : 1);
+
+        // RIFF chunk (sizes are patched once closed)
+        std::fwrite("RIFF", 1, 4, this->file);
+        writeLE(this->file, 0, 4);
+        std::fwrite("WAVE", 1, 4, this->file);
+
+        // Format chunk
+        std::fwrite("fmt ", 1, 4, this->file);
+        writeLE(this->file, 16, 4);
+        writeLE(this->file, type, 2);
+        writeLE(this->file, this->channels, 2);
+        writeLE(this->file, this->rate, 4);
+        writeLE(this->file, this->rate * this->frameSize, 4);
+        writeLE(this->file, this->frameSize, 2);
+        writeLE(this->file, bits, 2);
+
+        // Data chunk
+        std::fwrite("data", 1, 4, this->file);
+        writeLE(this->file, 0, 4);
+    }
+
+    size_t Host::consume(size_t samples) {
+        size_t consumed = 0;
+        while (consumed < samples && !this->queue.empty()) {
+            // Take as much as needed from the front block
+            Queued & front = this->queue.front();
+            size_t bytes = (samples - consumed) * this->frameSize;
+            if (bytes > front.size - front.offset) {
+                bytes = front.size - front.offset;
+            }
+
+            if (this->file != nullptr) {
+                this->written += std::fwrite(this->blocks[front.index] + front.offset, 1, bytes, this->file);
+            }
+            front.offset += bytes;
+            consumed += bytes/this->frameSize;
+
+            // Hand the block back once it's been completely played
+            if (front.offset >= front.size) {
+                this->done[front.index] = true;
+                this->queue.pop_front();
+            }
+        }
+
+        // Note if we were left waiting for more audio
+        if (consumed < samples && this->queue.empty()) {
+            this->underruns_++;
+        }
+        return consumed;
+    }
+
+    bool Host::initialized() {
+        return true;
+    }
+
+    bool Host::createBlocks(size_t count, size_t size) {
+        if (!this->blocks.empty()) {
+            return false;
+        }
+
+        for (size_t i = 0; i < count; i++) {
+            this->blocks.push_back(new uint8_t[size]);
+            this->done.push_back(true);
+        }
+        this->size = size;
+        return true;
+    }
+
+    size_t Host::blockSize() {
+        return this->size;
+    }
+
+    uint8_t * Host::blockData(size_t index) {
+        return (index < this->blocks.size() ? this->blocks[index] : nullptr);
+    }
+
+    void Host::flushBlock(size_t index, size_t bytes) {
+        // Nothing to do as there's no device reading from memory
+    }
+
+    bool Host::openVoice(long rate, int channels, Format format) {
+        this->stopVoice();
+        this->channels = channels;
+        this->frameSize = channels * static_cast<int>(format);
+        this->rate = rate;
+        this->voice = true;
+
+        // The WAV file is created for the first voice, and can only hold one format
+        if (!this->path.empty()) {
+            if (this->file == nullptr && this->written == 0) {
+                this->file = std::fopen(this->path.c_str(), "wb");
+                if (this->file == nullptr) {
+                    Log::writeError("[AUDIO] Unable to open output file: " + this->path);
+                    this->path.clear();
+                } else {
+                    this->writeHeader(format);
+                }
+
+            } else if (this->file != nullptr) {
+                Log::writeWarning("[AUDIO] Output file format is fixed by the first song, later songs may sound incorrect");
+            }
+        }
+        return true;
+    }
+
+    void Host::queueBlock(size_t index, size_t bytes) {
+        if (!this->voice || index >= this->blocks.size()) {
+            return;
+        }
+
+        this->done[index] = false;
+        this->queue.push_back(Queued{index, bytes, 0});
+    }
+
+    bool Host::blockDone(size_t index) {
+        return this->done[index];
+    }
+
+    void Host::startVoice() {
+        this->lastUpdate = std::chrono::steady_clock::now();
+        this->pending = 0;
+        this->playing = true;
+    }
+
+    void Host::stopVoice() {
+        this->playing = false;
+        this->played = 0;
+        this->queue.clear();
+        for (size_t i = 0; i < this->done.size(); i++) {
+            this->done[i] = true;
+        }
+    }
+
+    void Host::setPaused(bool paused) {
+        this->paused = paused;
+        this->lastUpdate = std::chrono::steady_clock::now();
+    }
+
+    uint32_t Host::playedSamples() {
+        return this->played;
+    }
+
+    void Host::setVolume(double vol) {
+        // Volume isn't applied to the written audio
+    }
+
+    void Host::update() {
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if (this->playing && !this->paused && this->frameSize > 0) {
+            // Consume however much would have been played since the last update, otherwise everything
+            if (this->realTime) {
+                this->pending += std::chrono::duration<double>(now - this->lastUpdate).count() * this->rate;
+                size_t samples = static_cast<size_t>(this->pending);
+                this->pending -= samples;
+                this->played += this->consume(samples);
+
+            } else {
+                size_t samples = 0;
+                for (const Queued & q : this->queue) {
+                    samples += (q.size - q.offset)/this->frameSize;
+                }
+                this->played += this->consume(samples);
+            }
+        }
+        this->lastUpdate = now;
+    }
+
+    void Host::waitFrame() {
+        // Only real-time playback needs to wait
+        if (this->realTime) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(frameDelay));
+        } else {
+            std::this_thread::yield();
+        }
+    }
+
+    size_t Host::underruns() {
+        return this->underruns_;
+    }
+
+    Host::~Host() {
+        // Patch sizes in the header now that they're known
+        if (this->file != nullptr) {
+            std::fseek(this->file, 4, SEEK_SET);
+            writeLE(this->file, 36 + this->written, 4);
+            std::fseek(this->file, 40, SEEK_SET);
+            writeLE(this->file, this->written, 4);
+            std::fclose(this->file);
+            Log::writeInfo("[AUDIO] Wrote " + std::to_string(this->written) + " bytes to " + this->path);
+        }
+
+        for (uint8_t * block : this->blocks) {
+            delete[] block;
+        }
+    }
+};
@@ -1,19 +1,48 @@
 #define DR_FLAC_IMPLEMENTATION
 #include "decoders/dr_flac.h"
 
-#include <cstring>
 #include "Log.hpp"
 #include "source/FLAC.hpp"
 #include "Types.hpp"
 
+#ifdef USE_FILE_BUFFER
+#include "nx/File.hpp"
+
+// Seek callback for the custom file object
+static drflac_bool32 seekFile(void * file, int offset, drflac_seek_origin origin) {
+    NX::File::Position position = (origin == drflac_seek_origin_start ? NX::File::Position::Start : NX::File::Position::Current);
+    return (static_cast<NX::File *>(file)->seek(offset, position) >= 0 ? DRFLAC_TRUE : DRFLAC_FALSE);
+}
+#endif
+
 // Inherit actual struct
 struct dr_flac : public drflac {};
 
+// The decoder's state is allocated from the sources' pool
+static void * allocateMem(size_t size, void *) {
+    return Source::Source::allocate(size);
+}
+
+static void * reallocateMem(void * ptr, size_t size, void *) {
+    return Source::Source::reallocate(ptr, size);
+}
+
+static void freeMem(void * ptr, void *) {
+    Source::Source::release(ptr);
+}
+
+static const drflac_allocation_callbacks allocationCallbacks = {nullptr, allocateMem, reallocateMem, freeMem};
+
 namespace Source {
     FLAC::FLAC(const std::string & path) : Source() {
         // Create decoder for file
         Log::writeInfo("[FLAC] Opening file: " + path);
-        this->flac = static_cast<dr_flac *>(drflac_open_file(path.c_str(), nullptr));
+    #ifdef USE_FILE_BUFFER
+        this->file = new NX::File(path);
+        this->flac = static_cast<dr_flac *>(drflac_open(NX::File::readFileFully, seekFile, this->file, &allocationCallbacks));
+    #else
+        this->flac = static_cast<dr_flac *>(drflac_open_file(path.c_str(), &allocationCallbacks));
+    #endif
 
         // Check if opened succesfully
         if (this->flac == nullptr) {
@@ -26,53 +55,34 @@ namespace Source {
         this->channels_ = this->flac->channels;
         this->sampleRate_ = this->flac->sampleRate;
         this->totalSamples_ = this->flac->totalPCMFrameCount;
+        this->exact_ = (this->flac->bitsPerSample <= 16);
 
-        // This is set to Int16 as libnx doesn't support anything else,
-        // but should it support other bit depths this class is ready for it!
+        // Output is always converted to Int16 as libnx doesn't support anything else
         this->format_ = Format::Int16;
-        // this->format_ = static_cast<Format>(this->flac->bitsPerSample/8);
 
         Log::writeInfo("[FLAC] File opened successfully");
     }
 
-    size_t FLAC::decode(unsigned char * buf, size_t sz) {
+    size_t FLAC::decode(float * buf, size_t frames) {
         if (!this->valid_) {
             return 0;
         }
 
-        // Call appropriate decode function based on bit depth of samples
-        // Sample size is rounded up to preserve quality (e.g. 24 bits -> 32 bits)
-        size_t decoded = 0;
-        std::memset(buf, 0, sz);
-        const size_t frames = sz/this->channels_/(static_cast<int>(this->format_));
-        switch (this->format_) {
-            case Format::Int8:
-            case Format::Int16:
-                decoded = drflac_read_pcm_frames_s16(this->flac, frames, reinterpret_cast<int16_t *>(buf));
-                break;
-
-            case Format::Int24:
-            case Format::Int32:
-                decoded = drflac_read_pcm_frames_s32(this->flac, frames, reinterpret_cast<int32_t *>(buf));
-                break;
-
-            // This actually shouldn't be called
-            case Format::Float:
-                decoded = drflac_read_pcm_frames_f32(this->flac, frames, reinterpret_cast<float *>(buf));
-                break;
-        }
+        // Always decode to float, any conversion is handled after the DSP chain
+        size_t decoded = drflac_read_pcm_frames_f32(this->flac, frames, buf);
         if (decoded == 0) {
             Log::writeInfo("[FLAC] Finished decoding file");
             this->done_ = true;
         }
 
-        return (decoded * this->channels_ * (static_cast<int>(this->format_)));
+        return decoded;
     }
 
     void FLAC::seek(size_t pos) {
         if (!this->valid_) {
             return;
         }
+        this->done_ = false;
 
         drflac_bool32 ok = drflac_seek_to_pcm_frame(this->flac, pos);
         if (ok != DRFLAC_TRUE) {
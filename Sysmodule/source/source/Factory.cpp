@@ -1,12 +1,17 @@
 #include <cctype>
 #include "source/Factory.hpp"
 #include "source/FLAC.hpp"
-#include "source/MP3.hpp"
+#ifdef USE_MP3
+  #include "source/MP3.hpp"
+#endif
 #include "source/WAV.hpp"
 #include "utils/FS.hpp"
+#include "utils/Memory.hpp"
 
 namespace Source {
     Source * Factory::getSource(const std::string & path) {
+        Utils::Memory::Scope scope(Utils::Memory::Tag::Source);
+
         // Get extension
         std::string ext = Utils::Fs::getExtension(path);
         for (char & c : ext) {
@@ -14,10 +19,13 @@ namespace Source {
         }
 
         // Match source based on extension
+    #ifdef USE_MP3
         if (ext == ".mp3") {
             return new MP3(path);
+        }
+    #endif
 
-        } else if (ext == ".flac") {
+        if (ext == ".flac") {
             return new FLAC(path);
 
         } else if (ext == ".wav" || ext == ".wave") {
@@ -1,7 +1,9 @@
-#include <cstring>
+#include <algorithm>
+#include "dsp/Convert.hpp"
 #include "Log.hpp"
 #include <mpg123.h>
 #include "source/MP3.hpp"
+#include "source/SeekIndex.hpp"
 #include "Types.hpp"
 
 #ifdef USE_FILE_BUFFER
@@ -9,29 +11,73 @@
 #endif
 
 namespace Source {
-    mpg123_handle * MP3::mpg = nullptr;
+    bool MP3::initialized = false;
+    bool MP3::accurateSeek = false;
+    std::vector<mpg123_handle *> MP3::handles;
+    std::vector<mpg123_handle *> MP3::spareHandles;
+    std::mutex MP3::handlesMutex;
+
+    // Number of spare handles kept (enough for the current, next and cached songs)
+    constexpr size_t maxSpareHandles = 3;
 
     MP3::MP3(const std::string & path) : Source() {
         Log::writeInfo("[MP3] Opening file: " + path);
+        this->indexedFrames = 0;
+        this->mpg = nullptr;
+        this->path = path;
 
         // Check the library is initialized
-        if (this->mpg == nullptr) {
+        if (!MP3::initialized) {
             Log::writeError("[MP3] Couldn't open file as library is not initialized!");
             this->valid_ = false;
             return;
         }
 
+        // Reuse a spare handle, otherwise create one
+        int result;
+        std::unique_lock<std::mutex> mtx(MP3::handlesMutex);
+        if (!MP3::spareHandles.empty()) {
+            this->mpg = MP3::spareHandles.back();
+            MP3::spareHandles.pop_back();
+        } else {
+            this->mpg = mpg123_new(nullptr, &result);
+            if (this->mpg == nullptr) {
+                Log::writeError("[MP3] Failed to create instance: " + std::to_string(result));
+                this->valid_ = false;
+                return;
+            }
+        }
+        MP3::handles.push_back(this->mpg);
+        mtx.unlock();
+
+        // Enable support for custom file object
+    #ifdef USE_FILE_BUFFER
+        result = mpg123_replace_reader_handle(this->mpg, NX::File::readFile, NX::File::seekFile, nullptr);
+        if (result != MPG123_OK) {
+            Log::writeError("[MP3] Unable to enable custom file object support: " + std::to_string(result));
+            this->valid_ = false;
+            return;
+        }
+    #endif
+
+        // Enable gapless decoding
+        result = mpg123_param(this->mpg, MPG123_FLAGS, MPG123_QUIET | MPG123_GAPLESS, 0.0f);
+        if (result != MPG123_OK) {
+            MP3::logErrorMsg(this->mpg);
+            Log::writeWarning("[MP3] Unable to set quiet + gapless flags: " + std::to_string(result));
+        }
+        MP3::applyAccurateSeek(this->mpg);
+
         // Attempt to open file
     #ifdef USE_FILE_BUFFER
         this->file = new NX::File(path);
-        int result = mpg123_open_handle(this->mpg, this->file);
+        result = mpg123_open_handle(this->mpg, this->file);
     #else
-        this->file = nullptr;
-        int result = mpg123_open(this->mpg, path.c_str());
+        result = mpg123_open(this->mpg, path.c_str());
     #endif
 
         if (result != MPG123_OK) {
-            MP3::logErrorMsg();
+            MP3::logErrorMsg(this->mpg);
             Log::writeError("[MP3] Unable to open file");
             this->valid_ = false;
             return;
@@ -42,7 +88,7 @@ namespace Source {
         this->format_ = Format::Int16;
         result = mpg123_getformat(this->mpg, &this->sampleRate_, &this->channels_, &encoding);
         if (result != MPG123_OK) {
-            MP3::logErrorMsg();
+            MP3::logErrorMsg(this->mpg);
             Log::writeError("[MP3] Unable to get format from file");
             this->valid_ = false;
             return;
@@ -55,35 +101,77 @@ namespace Source {
             this->totalSamples_ = 1;
         }
 
+        this->loadIndex();
         Log::writeInfo("[MP3] File opened successfully");
     }
 
-    void MP3::logErrorMsg() {
-        const char * msg = mpg123_strerror(MP3::mpg);
+    void MP3::loadIndex() {
+        SeekIndex::Index index;
+        if (!SeekIndex::load(this->path, index)) {
+            return;
+        }
+
+        // mpg123 copies the offsets, so the index doesn't need to be kept
+        int result = mpg123_set_index(this->mpg, index.offsets.data(), index.step, index.offsets.size());
+        if (result != MPG123_OK) {
+            MP3::logErrorMsg(this->mpg);
+            Log::writeWarning("[MP3] Unable to use stored seek index");
+            return;
+        }
+        this->indexedFrames = index.step * index.offsets.size();
+        Log::writeInfo("[MP3] Loaded seek index covering " + std::to_string(this->indexedFrames) + " frames");
+    }
+
+    void MP3::saveIndex() {
+        off_t * offsets;
+        off_t step;
+        size_t fill;
+        if (mpg123_index(this->mpg, &offsets, &step, &fill) != MPG123_OK || step <= 0) {
+            return;
+        }
+
+        // Only write if decoding (or seeking) got further through the file than the stored index
+        if (fill * step <= this->indexedFrames) {
+            return;
+        }
+        if (SeekIndex::save(this->path, step, offsets, fill)) {
+            Log::writeInfo("[MP3] Saved seek index covering " + std::to_string(fill * step) + " frames");
+        }
+    }
+
+    void MP3::logErrorMsg(mpg123_handle * mpg) {
+        const char * msg = mpg123_strerror(mpg);
         std::string str(msg);
         Log::writeError("[MP3] " + str);
     }
 
-    size_t MP3::decode(unsigned char * buf, size_t sz) {
+    size_t MP3::decode(float * buf, size_t frames) {
         if (!this->valid_) {
             return 0;
         }
 
+        // mpg123 outputs 16 bit samples, which are then converted for the DSP chain
+        size_t count = frames * this->channels_;
+        if (this->samples.size() < count) {
+            this->samples.resize(count);
+        }
         size_t decoded = 0;
-        std::memset(buf, 0, sz);
-        mpg123_read(mpg, buf, sz, &decoded);
+        mpg123_read(this->mpg, reinterpret_cast<unsigned char *>(this->samples.data()), count * sizeof(int16_t), &decoded);
         if (decoded == 0) {
             Log::writeInfo("[MP3] Finished decoding file");
             this->done_ = true;
         }
 
-        return decoded;
+        count = decoded/sizeof(int16_t);
+        Dsp::int16ToFloat(this->samples.data(), buf, count);
+        return count/this->channels_;
     }
 
     void MP3::seek(size_t pos) {
         if (!this->valid_) {
             return;
         }
+        this->done_ = false;
 
         off_t res = mpg123_seek(this->mpg, pos, SEEK_SET);
         if (res < 0) {
@@ -105,13 +193,20 @@ namespace Source {
 
     MP3::~MP3() {
         if (this->mpg != nullptr) {
+            if (this->valid_) {
+                this->saveIndex();
+            }
             mpg123_close(this->mpg);
+            std::scoped_lock<std::mutex> mtx(MP3::handlesMutex);
+            MP3::handles.erase(std::remove(MP3::handles.begin(), MP3::handles.end(), this->mpg), MP3::handles.end());
+
+            // Keep the handle for the next song (opening a file resets it's state)
+            if (MP3::spareHandles.size() < maxSpareHandles) {
+                MP3::spareHandles.push_back(this->mpg);
+            } else {
+                mpg123_delete(this->mpg);
+            }
         }
-
-        // Delete file handle
-    #ifdef USE_FILE_BUFFER
-        delete this->file;
-    #endif
     }
 
     bool MP3::initLib() {
@@ -122,55 +217,29 @@ namespace Source {
             return false;
         }
 
-        // Create handle
-        MP3::mpg = mpg123_new(nullptr, &result);
-        if (MP3::mpg == nullptr) {
-            Log::writeError("[MP3] Failed to create instance: " + std::to_string(result));
-            return false;
-        }
-
-        // Enable support for custom file object
-    #ifdef USE_FILE_BUFFER
-        result = mpg123_replace_reader_handle(MP3::mpg, NX::File::readFile, NX::File::seekFile, nullptr);
-        if (result != MPG123_OK) {
-            Log::writeError("[MP3] Unable to enable custom file object support: " + std::to_string(result));
-            return false;
-        }
-    #endif
-
-        // Enable gapless decoding
-        result = mpg123_param(MP3::mpg, MPG123_FLAGS, MPG123_QUIET | MPG123_GAPLESS, 0.0f);
-        if (result != MPG123_OK) {
-            MP3::logErrorMsg();
-            Log::writeWarning("[MP3] Unable to set quiet + gapless flags: " + std::to_string(result));
-        }
-
-        // Use fuzzy seeking by default
-        MP3::setAccurateSeek(false);
-
+        MP3::initialized = true;
         Log::writeSuccess("[MP3] Initialized successfully");
         return true;
     }
 
-
     void MP3::freeLib() {
-        // Delete handle
-        if (MP3::mpg != nullptr) {
-            Log::writeSuccess("[MP3] Library tidied up!");
-            mpg123_delete(MP3::mpg);
-            MP3::mpg = nullptr;
+        std::unique_lock<std::mutex> mtx(MP3::handlesMutex);
+        for (mpg123_handle * mpg : MP3::spareHandles) {
+            mpg123_delete(mpg);
         }
-    }
+        MP3::spareHandles.clear();
+        mtx.unlock();
 
-    bool MP3::setAccurateSeek(bool b) {
-        // Sanity check
-        if (MP3::mpg == nullptr) {
-            return false;
+        if (MP3::initialized) {
+            Log::writeSuccess("[MP3] Library tidied up!");
+            MP3::initialized = false;
         }
+    }
 
-        int result = mpg123_param(MP3::mpg, (b ? MPG123_REMOVE_FLAGS : MPG123_ADD_FLAGS), MPG123_FUZZY, 0.0f);
+    bool MP3::applyAccurateSeek(mpg123_handle * mpg) {
+        int result = mpg123_param(mpg, (MP3::accurateSeek ? MPG123_REMOVE_FLAGS : MPG123_ADD_FLAGS), MPG123_FUZZY, 0.0f);
         if (result != MPG123_OK) {
-            MP3::logErrorMsg();
+            MP3::logErrorMsg(mpg);
             Log::writeWarning("[MP3] Unable to toggle fuzzy seeking");
             return false;
         }
@@ -178,23 +247,15 @@ namespace Source {
         return true;
     }
 
-    bool MP3::setEqualizer(const std::array<float, 32> & eq) {
-        // Sanity check
-        if (MP3::mpg == nullptr) {
-            return false;
-        }
-
-        // Iterate over array and set each eq band
-        int result;
-        for (size_t i = 0; i < eq.size(); i++) {
-            result = mpg123_eq(MP3::mpg, MPG123_LR, i, eq[i]);
-            if (result != MPG123_OK) {
-                MP3::logErrorMsg();
-                Log::writeError("[MP3] Failed to adjust equalizer band " + std::to_string(i));
-                return false;
-            }
+    bool MP3::setAccurateSeek(bool b) {
+        // Store for new handles and update any open ones
+        MP3::accurateSeek = b;
+        bool ok = true;
+        std::scoped_lock<std::mutex> mtx(MP3::handlesMutex);
+        for (mpg123_handle * mpg : MP3::handles) {
+            ok = (MP3::applyAccurateSeek(mpg) && ok);
         }
 
-        return true;
+        return ok;
     }
-};
\ No newline at end of file
+};
@@ -0,0 +1,143 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include "Log.hpp"
+#include "Paths.hpp"
+#include "source/SeekIndex.hpp"
+#include <sys/stat.h>
+#include "utils/FS.hpp"
+
+// Identifies an index file (and the layout it uses)
+static const unsigned char magic[4] = {'T', 'P', 'S', 'I'};
+constexpr uint64_t version = 1;
+
+// Numbers are stored as variable length integers (7 bits per byte, least significant first),
+// and offsets as the difference from the previous one, which keeps most entries to two bytes
+static void writeVarint(std::vector<unsigned char> & buf, uint64_t value) {
+    while (value >= 0x80) {
+        buf.push_back((value & 0x7F) | 0x80);
+        value >>= 7;
+    }
+    buf.push_back(value);
+}
+
+static bool readVarint(const std::vector<unsigned char> & buf, size_t & pos, uint64_t & value) {
+    value = 0;
+    for (size_t shift = 0; shift < 64; shift += 7) {
+        if (pos >= buf.size()) {
+            return false;
+        }
+
+        const unsigned char byte = buf[pos++];
+        value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Returns the file the index for the given path is stored in
+static std::string indexFile(const std::string & path) {
+    char name[17];
+    std::snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(std::hash<std::string>{}(path)));
+    return Path::Sys::SeekIndexFolder + name + ".idx";
+}
+
+// Gets the size and modification time of the file, returning false if it couldn't be read
+static bool fileStamp(const std::string & path, uint64_t & size, uint64_t & mtime) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) {
+        return false;
+    }
+
+    size = st.st_size;
+    mtime = st.st_mtime;
+    return true;
+}
+
+namespace Source::SeekIndex {
+    bool load(const std::string & path, Index & index) {
+        uint64_t size, mtime;
+        if (!fileStamp(path, size, mtime)) {
+            return false;
+        }
+
+        std::vector<unsigned char> buf;
+        const std::string file = indexFile(path);
+        if (!Utils::Fs::fileExists(file) || !Utils::Fs::readFile(file, buf)) {
+            return false;
+        }
+
+        // Check the header matches this version and file
+        if (buf.size() < sizeof(magic) || !std::equal(magic, magic + sizeof(magic), buf.begin())) {
+            return false;
+        }
+        size_t pos = sizeof(magic);
+        uint64_t ver, storedSize, storedMtime, length;
+        if (!readVarint(buf, pos, ver) || ver != version) {
+            return false;
+        }
+        if (!readVarint(buf, pos, storedSize) || !readVarint(buf, pos, storedMtime) || storedSize != size || storedMtime != mtime) {
+            return false;
+        }
+        if (!readVarint(buf, pos, length) || length > buf.size() - pos || path.compare(0, std::string::npos, reinterpret_cast<const char *>(&buf[pos]), length) != 0) {
+            return false;
+        }
+        pos += length;
+
+        // Read the offsets
+        uint64_t step, count;
+        if (!readVarint(buf, pos, step) || !readVarint(buf, pos, count) || step == 0 || count > buf.size() - pos) {
+            return false;
+        }
+        index.step = step;
+        index.offsets.resize(count);
+        uint64_t offset = 0;
+        for (size_t i = 0; i < count; i++) {
+            uint64_t delta;
+            if (!readVarint(buf, pos, delta)) {
+                Log::writeWarning("[SEEKINDEX] Ignoring truncated index: " + file);
+                return false;
+            }
+            offset += delta;
+            index.offsets[i] = offset;
+        }
+
+        return true;
+    }
+
+    bool save(const std::string & path, const off_t step, const off_t * offsets, const size_t count) {
+        uint64_t size, mtime;
+        if (step <= 0 || offsets == nullptr || count == 0 || !fileStamp(path, size, mtime)) {
+            return false;
+        }
+
+        std::vector<unsigned char> buf(magic, magic + sizeof(magic));
+        buf.reserve(64 + path.length() + 3 * count);
+        writeVarint(buf, version);
+        writeVarint(buf, size);
+        writeVarint(buf, mtime);
+        writeVarint(buf, path.length());
+        buf.insert(buf.end(), path.begin(), path.end());
+
+        writeVarint(buf, step);
+        writeVarint(buf, count);
+        off_t prev = 0;
+        for (size_t i = 0; i < count; i++) {
+            // Offsets only ever increase, anything else means the index is unusable
+            if (offsets[i] < prev) {
+                return false;
+            }
+            writeVarint(buf, offsets[i] - prev);
+            prev = offsets[i];
+        }
+
+        if (!Utils::Fs::createPath(Path::Sys::SeekIndexFolder) || !Utils::Fs::writeFile(indexFile(path), buf)) {
+            Log::writeError("[SEEKINDEX] Unable to write index for: " + path);
+            return false;
+        }
+        return true;
+    }
+};
@@ -1,10 +1,18 @@
+#include <cstdlib>
+#include "nx/File.hpp"
 #include "source/Source.hpp"
 #include "Types.hpp"
+#include "utils/BlockPool.hpp"
+
+// Memory kept after sources are closed (enough for a FLAC decoder's state)
+static Utils::BlockPool pool(0x100, 0x20000);
 
 namespace Source {
     Source::Source() {
         this->channels_ = 0;
         this->done_ = false;
+        this->exact_ = false;
+        this->file = nullptr;
         this->format_ = Format::Int16;
         this->sampleRate_ = 0;
         this->totalSamples_ = 1;    // avoid NaN
@@ -15,6 +23,10 @@ namespace Source {
         return this->done_;
     }
 
+    bool Source::exact() {
+        return this->exact_;
+    }
+
     Format Source::format() {
         return this->format_;
     }
@@ -35,7 +47,43 @@ namespace Source {
         return this->totalSamples_;
     }
 
-    Source::~Source() {
+    void Source::setPlaying(const bool playing) {
+        if (this->file != nullptr) {
+            this->file->setPriority(playing ? NX::File::Priority::Playing : NX::File::Priority::Prefetch);
+        }
+    }
+
+    void Source::setBackground() {
+        if (this->file != nullptr) {
+            this->file->setPriority(NX::File::Priority::Background);
+        }
+    }
+
+    void * Source::allocate(const size_t size) {
+        return pool.allocate(size);
+    }
 
+    void * Source::reallocate(void * ptr, const size_t size) {
+        return pool.reallocate(ptr, size);
+    }
+
+    void Source::release(void * ptr) {
+        pool.free(ptr);
+    }
+
+    void * Source::operator new(size_t size) {
+        void * ptr = pool.allocate(size);
+        if (ptr == nullptr) {
+            std::abort();
+        }
+        return ptr;
+    }
+
+    void Source::operator delete(void * ptr) {
+        pool.free(ptr);
+    }
+
+    Source::~Source() {
+        delete this->file;
     }
 };
\ No newline at end of file
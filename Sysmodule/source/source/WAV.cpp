@@ -1,22 +1,53 @@
 #define DR_WAV_IMPLEMENTATION
 #include "decoders/dr_wav.h"
 
-#include <cstring>
 #include "Log.hpp"
 #include "source/WAV.hpp"
 #include "Types.hpp"
 
+#ifdef USE_FILE_BUFFER
+#include "nx/File.hpp"
+
+// Seek callback for the custom file object
+static drwav_bool32 seekFile(void * file, int offset, drwav_seek_origin origin) {
+    NX::File::Position position = (origin == drwav_seek_origin_start ? NX::File::Position::Start : NX::File::Position::Current);
+    return (static_cast<NX::File *>(file)->seek(offset, position) >= 0 ? DRWAV_TRUE : DRWAV_FALSE);
+}
+#endif
+
 // Inherit actual struct
 struct dr_wav : public drwav {};
 
+// The decoder's state is allocated from the sources' pool
+static void * allocateMem(size_t size, void *) {
+    return Source::Source::allocate(size);
+}
+
+static void * reallocateMem(void * ptr, size_t size, void *) {
+    return Source::Source::reallocate(ptr, size);
+}
+
+static void freeMem(void * ptr, void *) {
+    Source::Source::release(ptr);
+}
+
+static const drwav_allocation_callbacks allocationCallbacks = {nullptr, allocateMem, reallocateMem, freeMem};
+
 namespace Source {
     WAV::WAV(const std::string & path) : Source() {
         // Create decoder for file
         Log::writeInfo("[WAV] Opening file: " + path);
-        this->wav = new dr_wav;
-        drwav_bool32 ok = drwav_init_file(static_cast<drwav *>(this->wav), path.c_str(), nullptr);
+        this->wav = static_cast<dr_wav *>(Source::allocate(sizeof(dr_wav)));
+    #ifdef USE_FILE_BUFFER
+        this->file = new NX::File(path);
+        drwav_bool32 ok = (this->wav != nullptr && drwav_init(static_cast<drwav *>(this->wav), NX::File::readFileFully, seekFile, this->file, &allocationCallbacks));
+    #else
+        drwav_bool32 ok = (this->wav != nullptr && drwav_init_file(static_cast<drwav *>(this->wav), path.c_str(), &allocationCallbacks));
+    #endif
         if (ok != DRWAV_TRUE) {
             Log::writeError("[WAV] Unable to open file");
+            Source::release(this->wav);
+            this->wav = nullptr;
             this->valid_ = false;
             return;
         }
@@ -27,53 +58,34 @@ namespace Source {
         this->totalSamples_ = this->wav->totalPCMFrameCount;
 
         this->frameSize = drwav_get_bytes_per_pcm_frame(this->wav);
+        this->exact_ = (this->wav->translatedFormatTag == DR_WAVE_FORMAT_PCM && this->wav->bitsPerSample <= 16);
 
-        // This is set to Int16 as libnx doesn't support anything else,
-        // but should it support other bit depths this class is ready for it!
+        // Output is always converted to Int16 as libnx doesn't support anything else
         this->format_ = Format::Int16;
-        // this->format_ = static_cast<Format>(this->wav->bitsPerSample/8);
 
         Log::writeInfo("[WAV] File opened successfully");
     }
 
-    size_t WAV::decode(unsigned char * buf, size_t sz) {
+    size_t WAV::decode(float * buf, size_t frames) {
         if (!this->valid_) {
             return 0;
         }
 
-        // Call appropriate decode function based on bit depth of samples
-        // Sample size is rounded up to preserve quality (e.g. 24 bits -> 32 bits)
-        size_t decoded = 0;
-        std::memset(buf, 0, sz);
-        const size_t frames = sz/this->channels_/(static_cast<int>(this->format_));
-        switch (this->format_) {
-            case Format::Int8:
-            case Format::Int16:
-                decoded = drwav_read_pcm_frames_s16(this->wav, frames, reinterpret_cast<int16_t *>(buf));
-                break;
-
-            case Format::Int24:
-            case Format::Int32:
-                decoded = drwav_read_pcm_frames_s32(this->wav, frames, reinterpret_cast<int32_t *>(buf));
-                break;
-
-            // This actually shouldn't be called
-            case Format::Float:
-                decoded = drwav_read_pcm_frames_f32(this->wav, frames, reinterpret_cast<float *>(buf));
-                break;
-        }
+        // Always decode to float, any conversion is handled after the DSP chain
+        size_t decoded = drwav_read_pcm_frames_f32(this->wav, frames, buf);
         if (decoded == 0) {
             Log::writeInfo("[WAV] Finished decoding file");
             this->done_ = true;
         }
 
-        return (decoded * this->channels_ * (static_cast<int>(this->format_)));
+        return decoded;
     }
 
     void WAV::seek(size_t pos) {
         if (!this->valid_) {
             return;
         }
+        this->done_ = false;
 
         drwav_bool32 ok = drwav_seek_to_pcm_frame(this->wav, pos);
         if (ok != DRWAV_TRUE) {
@@ -93,7 +105,9 @@ namespace Source {
     }
 
     WAV::~WAV() {
-        drwav_uninit(this->wav);
-        delete this->wav;
+        if (this->wav != nullptr) {
+            drwav_uninit(this->wav);
+            Source::release(this->wav);
+        }
     }
 };
\ No newline at end of file
@@ -0,0 +1,120 @@
+#include <cstring>
+#include <new>
+#include "utils/BlockPool.hpp"
+
+// Placed in front of every block, recording it's (rounded) size
+struct alignas(16) Header {
+    size_t size;
+};
+
+namespace Utils {
+    BlockPool::BlockPool(const size_t granularity, const size_t maxKept) {
+        this->granularity = (granularity > 0 ? granularity : 1);
+        this->maxKept = maxKept;
+        this->blocks.reserve(8);
+        this->hits = 0;
+        this->misses = 0;
+        this->kept = 0;
+    }
+
+    size_t BlockPool::blockSize(void * block) {
+        return (static_cast<Header *>(block) - 1)->size;
+    }
+
+    void BlockPool::release(void * block) {
+        delete[] reinterpret_cast<uint8_t *>(static_cast<Header *>(block) - 1);
+    }
+
+    bool BlockPool::suitable(void * block, const size_t size) {
+        const size_t have = BlockPool::blockSize(block);
+        return (have >= size && have / 2 <= size);
+    }
+
+    void * BlockPool::allocate(const size_t bytes) {
+        const size_t size = ((bytes + this->granularity - 1) / this->granularity) * this->granularity;
+
+        // Reuse the smallest kept block which is suitable
+        std::unique_lock<std::mutex> mtx(this->mutex);
+        std::vector<void *>::iterator best = this->blocks.end();
+        for (std::vector<void *>::iterator it = this->blocks.begin(); it != this->blocks.end(); it++) {
+            if (BlockPool::suitable(*it, size) && (best == this->blocks.end() || BlockPool::blockSize(*it) < BlockPool::blockSize(*best))) {
+                best = it;
+            }
+        }
+        if (best != this->blocks.end()) {
+            void * block = *best;
+            this->blocks.erase(best);
+            this->kept -= BlockPool::blockSize(block);
+            this->hits++;
+            return block;
+        }
+        mtx.unlock();
+
+        Header * header = reinterpret_cast<Header *>(new (std::nothrow) uint8_t[sizeof(Header) + size]);
+        if (header == nullptr) {
+            return nullptr;
+        }
+        header->size = size;
+        this->misses++;
+        return header + 1;
+    }
+
+    void * BlockPool::reallocate(void * block, const size_t bytes) {
+        if (block == nullptr) {
+            return this->allocate(bytes);
+        }
+
+        // Nothing to do if the block is still suitable
+        if (BlockPool::suitable(block, bytes)) {
+            return block;
+        }
+
+        void * moved = this->allocate(bytes);
+        if (moved != nullptr) {
+            const size_t size = BlockPool::blockSize(block);
+            std::memcpy(moved, block, (bytes < size ? bytes : size));
+            this->free(block);
+        }
+        return moved;
+    }
+
+    void BlockPool::free(void * block) {
+        if (block == nullptr) {
+            return;
+        }
+
+        // Blocks too big to ever be kept are freed straight away
+        const size_t size = BlockPool::blockSize(block);
+        if (size > this->maxKept) {
+            BlockPool::release(block);
+            return;
+        }
+
+        // Otherwise make room by dropping the oldest blocks
+        std::scoped_lock<std::mutex> mtx(this->mutex);
+        while (this->kept + size > this->maxKept) {
+            this->kept -= BlockPool::blockSize(this->blocks.front());
+            BlockPool::release(this->blocks.front());
+            this->blocks.erase(this->blocks.begin());
+        }
+        this->blocks.push_back(block);
+        this->kept += size;
+    }
+
+    void BlockPool::trim() {
+        std::scoped_lock<std::mutex> mtx(this->mutex);
+        for (void * block : this->blocks) {
+            BlockPool::release(block);
+        }
+        this->blocks.clear();
+        this->kept = 0;
+    }
+
+    BlockPool::Stats BlockPool::stats() {
+        return Stats{this->hits, this->misses, this->kept};
+    }
+
+    BlockPool::~BlockPool() {
+        this->trim();
+    }
+};
@@ -0,0 +1,90 @@
+#include <cmath>
+#include "utils/LatencyStats.hpp"
+
+constexpr double firstBucket = 0.00001;     // Upper edge of the first bucket (10us)
+constexpr double bucketsPerDoubling = 8.0;
+
+// Returns the index of the bucket the duration falls into
+static size_t bucketFor(const double secs, const size_t count) {
+    if (secs <= firstBucket) {
+        return 0;
+    }
+    size_t idx = static_cast<size_t>(std::ceil(std::log2(secs / firstBucket) * bucketsPerDoubling));
+    return (idx < count ? idx : count - 1);
+}
+
+// Returns the upper edge of the given bucket
+static double bucketEdge(const size_t idx) {
+    return firstBucket * std::exp2(idx / bucketsPerDoubling);
+}
+
+namespace Utils {
+    LatencyStats::LatencyStats() {
+        this->reset();
+    }
+
+    void LatencyStats::add(const double secs) {
+        std::scoped_lock<std::mutex> mtx(this->mutex);
+        this->buckets[bucketFor(secs, this->buckets.size())]++;
+        this->min_ = (this->count_ == 0 || secs < this->min_ ? secs : this->min_);
+        this->max_ = (secs > this->max_ ? secs : this->max_);
+        this->last_ = secs;
+        this->total += secs;
+        this->count_++;
+    }
+
+    void LatencyStats::reset() {
+        std::scoped_lock<std::mutex> mtx(this->mutex);
+        this->buckets.fill(0);
+        this->count_ = 0;
+        this->min_ = 0.0;
+        this->max_ = 0.0;
+        this->last_ = 0.0;
+        this->total = 0.0;
+    }
+
+    size_t LatencyStats::count() {
+        std::scoped_lock<std::mutex> mtx(this->mutex);
+        return this->count_;
+    }
+
+    double LatencyStats::min() {
+        std::scoped_lock<std::mutex> mtx(this->mutex);
+        return this->min_;
+    }
+
+    double LatencyStats::max() {
+        std::scoped_lock<std::mutex> mtx(this->mutex);
+        return this->max_;
+    }
+
+    double LatencyStats::average() {
+        std::scoped_lock<std::mutex> mtx(this->mutex);
+        return (this->count_ > 0 ? this->total / this->count_ : 0.0);
+    }
+
+    double LatencyStats::last() {
+        std::scoped_lock<std::mutex> mtx(this->mutex);
+        return this->last_;
+    }
+
+    double LatencyStats::percentile(const double fraction) {
+        std::scoped_lock<std::mutex> mtx(this->mutex);
+        if (this->count_ == 0) {
+            return 0.0;
+        }
+
+        // Walk up the buckets until enough durations have been passed, never reporting
+        // more than the longest duration actually seen
+        const double target = fraction * this->count_;
+        size_t seen = 0;
+        for (size_t i = 0; i < this->buckets.size(); i++) {
+            seen += this->buckets[i];
+            if (seen > 0 && seen >= target) {
+                const double edge = bucketEdge(i);
+                return (edge < this->max_ ? edge : this->max_);
+            }
+        }
+        return this->max_;
+    }
+};
@@ -0,0 +1,225 @@
+#include <array>
+#include <atomic>
+#include <cstdlib>
+#include "Log.hpp"
+#include <malloc.h>
+#include <new>
+#include <sqlite3.h>
+#include "utils/Memory.hpp"
+
+// Placed in front of every allocation made through operator new, recording who made it.
+// Keeps the allocation aligned as malloc() would
+struct alignas(16) Header {
+    size_t size;
+    Utils::Memory::Tag tag;
+};
+
+constexpr size_t tagCount = static_cast<size_t>(Utils::Memory::Tag::Count);
+
+// Subsystem the calling thread is allocating for
+static thread_local Utils::Memory::Tag current = Utils::Memory::Tag::Other;
+
+// Counters for each subsystem
+static std::array<std::atomic<size_t>, tagCount> used;
+static std::array<std::atomic<size_t>, tagCount> peak;
+static std::array<std::atomic<size_t>, tagCount> budgets;
+static std::array<std::atomic<size_t>, tagCount> overruns;
+static std::atomic<bool> overrunSeen(false);
+
+// Record the given number of bytes against a subsystem
+static void account(const Utils::Memory::Tag tag, const size_t size) {
+    const size_t t = static_cast<size_t>(tag);
+    const size_t now = (used[t] += size);
+    size_t old = peak[t];
+    while (now > old && !peak[t].compare_exchange_weak(old, now));
+
+    // Count only the allocation which crossed the budget
+    const size_t limit = budgets[t];
+    if (limit > 0 && now > limit && now - size <= limit) {
+        overruns[t]++;
+        overrunSeen = true;
+    }
+}
+
+static void * allocate(const size_t size) {
+    Header * header = static_cast<Header *>(std::malloc(sizeof(Header) + size));
+    if (header == nullptr) {
+        return nullptr;
+    }
+
+    header->size = sizeof(Header) + size;
+    header->tag = current;
+    account(header->tag, header->size);
+    return header + 1;
+}
+
+static void deallocate(void * ptr) {
+    if (ptr == nullptr) {
+        return;
+    }
+
+    Header * header = static_cast<Header *>(ptr) - 1;
+    used[static_cast<size_t>(header->tag)] -= header->size;
+    std::free(header);
+}
+
+// Replacements for the global allocation functions. There are no exceptions to throw,
+// so running out of memory is as fatal as it would've been before
+void * operator new(size_t size) {
+    void * ptr = allocate(size);
+    if (ptr == nullptr) {
+        std::abort();
+    }
+    return ptr;
+}
+
+void * operator new[](size_t size) {
+    return operator new(size);
+}
+
+void * operator new(size_t size, const std::nothrow_t &) noexcept {
+    return allocate(size);
+}
+
+void * operator new[](size_t size, const std::nothrow_t &) noexcept {
+    return allocate(size);
+}
+
+void operator delete(void * ptr) noexcept {
+    deallocate(ptr);
+}
+
+void operator delete[](void * ptr) noexcept {
+    deallocate(ptr);
+}
+
+void operator delete(void * ptr, size_t) noexcept {
+    deallocate(ptr);
+}
+
+void operator delete[](void * ptr, size_t) noexcept {
+    deallocate(ptr);
+}
+
+void operator delete(void * ptr, const std::nothrow_t &) noexcept {
+    deallocate(ptr);
+}
+
+void operator delete[](void * ptr, const std::nothrow_t &) noexcept {
+    deallocate(ptr);
+}
+
+namespace Utils::Memory {
+    Scope::Scope(const Tag tag) {
+        this->previous = current;
+        current = tag;
+    }
+
+    Scope::~Scope() {
+        current = this->previous;
+    }
+
+    const char * name(const Tag tag) {
+        switch (tag) {
+            case Tag::Audio:
+                return "Audio";
+
+            case Tag::Queue:
+                return "Queue";
+
+            case Tag::SubQueue:
+                return "SubQueue";
+
+            case Tag::Source:
+                return "Source";
+
+            case Tag::Cache:
+                return "Cache";
+
+            case Tag::Database:
+                return "Database";
+
+            case Tag::Ipc:
+                return "IPC";
+
+            default:
+                break;
+        }
+        return "Other";
+    }
+
+    void setBudget(const Tag tag, const size_t bytes) {
+        budgets[static_cast<size_t>(tag)] = bytes;
+
+        // SQLite can give back memory it's using for caches when it goes over a (soft) limit
+        if (tag == Tag::Database) {
+            sqlite3_soft_heap_limit64(bytes);
+        }
+    }
+
+    size_t budget(const Tag tag) {
+        return budgets[static_cast<size_t>(tag)];
+    }
+
+    bool fits(const Tag tag, const size_t bytes) {
+        const Usage use = usage(tag);
+        return (use.budget == 0 || use.used + bytes <= use.budget);
+    }
+
+    void add(const Tag tag, const size_t bytes) {
+        account(tag, bytes);
+    }
+
+    void remove(const Tag tag, const size_t bytes) {
+        used[static_cast<size_t>(tag)] -= bytes;
+    }
+
+    Usage usage(const Tag tag) {
+        const size_t t = static_cast<size_t>(tag);
+        Usage use = {used[t], peak[t], budgets[t], overruns[t]};
+
+        // SQLite allocates with malloc(), but counts how much it's using itself
+        if (tag == Tag::Database) {
+            use.used += sqlite3_memory_used();
+            use.peak += sqlite3_memory_highwater(0);
+        }
+        return use;
+    }
+
+    size_t heapUsed() {
+    #if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+        struct mallinfo2 info = mallinfo2();
+    #else
+        struct mallinfo info = mallinfo();
+    #endif
+        return info.uordblks;
+    }
+
+    bool overrun() {
+        return overrunSeen.exchange(false);
+    }
+
+    void log() {
+        size_t total = 0;
+        for (size_t i = 0; i < tagCount; i++) {
+            const Tag tag = static_cast<Tag>(i);
+            const Usage use = usage(tag);
+            total += use.used;
+
+            std::string str = "[MEMORY] " + std::string(name(tag)) + ": " + std::to_string(use.used/1024) + "kB";
+            if (use.budget > 0) {
+                str += " of " + std::to_string(use.budget/1024) + "kB";
+            }
+            str += " (peak: " + std::to_string(use.peak/1024) + "kB, overruns: " + std::to_string(use.overruns) + ")";
+            if (use.overruns > 0) {
+                Log::writeWarning(str);
+            } else {
+                Log::writeInfo(str);
+            }
+        }
+
+        // Whatever the heap has handed out beyond the above was allocated by C libraries
+        const size_t heap = heapUsed();
+        Log::writeInfo("[MEMORY] Untracked: " + std::to_string((heap > total ? heap - total : 0)/1024) + "kB, heap in use: " + std::to_string(heap/1024) + "kB");
+    }
+};
@@ -0,0 +1,102 @@
+#include <algorithm>
+#include "dsp/Convert.hpp"
+#include "utils/Memory.hpp"
+#include "utils/PcmCache.hpp"
+
+namespace Utils {
+    size_t PcmCache::Entry::frames() const {
+        return (this->channels > 0 ? this->samples.size()/this->channels : 0);
+    }
+
+    PcmCache::PcmCache(const size_t budget) {
+        this->budget = budget;
+        this->lookups = 0;
+        this->hits = 0;
+        this->memory = 0;
+    }
+
+    std::shared_ptr<PcmCache::Entry> PcmCache::find(const SongID id) {
+        for (const std::shared_ptr<Entry> & entry : this->entries) {
+            if (entry->id == id) {
+                return entry;
+            }
+        }
+        return nullptr;
+    }
+
+    std::shared_ptr<PcmCache::Entry> PcmCache::lookup(const SongID id) {
+        this->lookups++;
+        std::shared_ptr<Entry> entry = this->find(id);
+        if (entry != nullptr && entry->frames() > 0) {
+            this->hits++;
+            return entry;
+        }
+        return nullptr;
+    }
+
+    std::shared_ptr<PcmCache::Entry> PcmCache::create(const SongID id, const long rate, const int channels, const int total, const size_t frames) {
+        // Any existing entry is replaced
+        Utils::Memory::Scope scope(Utils::Memory::Tag::Cache);
+        const size_t size = frames * channels * sizeof(int16_t);
+        for (const std::shared_ptr<Entry> & entry : this->entries) {
+            if (entry->id == id) {
+                this->memory -= entry->samples.capacity() * sizeof(int16_t);
+                this->entries.erase(std::find(this->entries.begin(), this->entries.end(), entry));
+                break;
+            }
+        }
+        if (channels <= 0 || this->memory + size > this->budget) {
+            return nullptr;
+        }
+
+        std::shared_ptr<Entry> entry = std::make_shared<Entry>();
+        entry->id = id;
+        entry->sampleRate = rate;
+        entry->channels = channels;
+        entry->totalSamples = total;
+        entry->maxFrames = frames;
+        entry->complete = (frames == 0);
+        entry->samples.reserve(frames * channels);
+        this->memory += entry->samples.capacity() * sizeof(int16_t);
+        this->entries.push_back(entry);
+        return entry;
+    }
+
+    void PcmCache::append(const std::shared_ptr<Entry> & entry, const float * samples, const size_t frames) {
+        Utils::Memory::Scope scope(Utils::Memory::Tag::Cache);
+        const size_t count = std::min(frames, entry->maxFrames - entry->frames());
+        const size_t start = entry->samples.size();
+        entry->samples.resize(start + count * entry->channels);
+        Dsp::floatToInt16(samples, entry->samples.data() + start, count * entry->channels);
+        if (count == 0 || entry->frames() >= entry->maxFrames) {
+            entry->complete = true;
+        }
+    }
+
+    size_t PcmCache::read(const std::shared_ptr<Entry> & entry, const size_t pos, float * samples, const size_t frames) {
+        const size_t available = entry->frames();
+        const size_t count = (pos < available ? std::min(frames, available - pos) : 0);
+        Dsp::int16ToFloat(entry->samples.data() + pos * entry->channels, samples, count * entry->channels);
+        return count;
+    }
+
+    void PcmCache::retain(const std::vector<SongID> & ids) {
+        std::vector< std::shared_ptr<Entry> >::iterator it = this->entries.begin();
+        while (it != this->entries.end()) {
+            if (std::find(ids.begin(), ids.end(), (*it)->id) == ids.end()) {
+                this->memory -= (*it)->samples.capacity() * sizeof(int16_t);
+                it = this->entries.erase(it);
+            } else {
+                it++;
+            }
+        }
+    }
+
+    void PcmCache::clear() {
+        this->retain(std::vector<SongID>());
+    }
+
+    PcmCache::Stats PcmCache::stats() {
+        return Stats{this->lookups, this->hits, this->memory, this->budget};
+    }
+};
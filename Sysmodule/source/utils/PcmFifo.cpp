@@ -0,0 +1,76 @@
+#include "utils/PcmFifo.hpp"
+
+namespace Utils {
+    PcmFifo::PcmFifo(const std::vector<uint8_t *> & memory, const size_t size) {
+        for (size_t i = 0; i < memory.size(); i++) {
+            this->blocks.push_back(Block{memory[i], 0, i});
+        }
+        this->capacity = size;
+        this->depth_ = this->blocks.size();
+        this->head = 0;
+        this->tail = 0;
+    }
+
+    size_t PcmFifo::blockSize() {
+        return this->capacity;
+    }
+
+    size_t PcmFifo::count() {
+        return this->tail.load(std::memory_order_acquire) - this->head.load(std::memory_order_acquire);
+    }
+
+    bool PcmFifo::empty() {
+        return (this->count() == 0);
+    }
+
+    bool PcmFifo::full() {
+        return (this->count() >= this->depth_.load(std::memory_order_relaxed));
+    }
+
+    size_t PcmFifo::depth() {
+        return this->depth_;
+    }
+
+    void PcmFifo::setDepth(const size_t depth) {
+        this->depth_ = (depth < 1 ? 1 : (depth > this->blocks.size() ? this->blocks.size() : depth));
+    }
+
+    PcmFifo::Block * PcmFifo::acquire() {
+        if (this->blocks.empty() || this->full()) {
+            return nullptr;
+        }
+
+        return &this->blocks[this->tail.load(std::memory_order_relaxed) % this->blocks.size()];
+    }
+
+    void PcmFifo::commit(const size_t size) {
+        // Publish the block only after it's size has been set
+        size_t tail = this->tail.load(std::memory_order_relaxed);
+        this->blocks[tail % this->blocks.size()].size = (size > this->capacity ? this->capacity : size);
+        this->tail.store(tail + 1, std::memory_order_release);
+    }
+
+    PcmFifo::Block * PcmFifo::front() {
+        return this->peek(0);
+    }
+
+    PcmFifo::Block * PcmFifo::peek(const size_t offset) {
+        if (offset >= this->count()) {
+            return nullptr;
+        }
+
+        return &this->blocks[(this->head.load(std::memory_order_relaxed) + offset) % this->blocks.size()];
+    }
+
+    void PcmFifo::pop() {
+        if (this->empty()) {
+            return;
+        }
+
+        this->head.fetch_add(1, std::memory_order_release);
+    }
+
+    void PcmFifo::flush() {
+        this->head.store(this->tail.load(std::memory_order_acquire), std::memory_order_release);
+    }
+};